@@ -93,6 +93,21 @@ static OSSL_PROVIDER *legacy_provider;
 static OSSL_PROVIDER *default_provider;
 #endif
 
+/* Contexts with the Blowfish key schedule already worked out, by a
+ * digest of mode, direction and key, so no copy of the key is kept.
+ * Every line to or from a target uses the same key. */
+#define CIPHER_CACHE_MAX 64
+static GHashTable *cipher_cache;
+
+/**
+ * Drops every cached context. Call when a key is set or deleted, so the
+ * old key schedule doesn't outlive it.
+ */
+void fish_cipher_cache_clear(void) {
+    if (cipher_cache)
+        g_hash_table_remove_all(cipher_cache);
+}
+
 int fish_init(void)
 {
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
@@ -104,6 +119,8 @@ int fish_init(void)
 
 void fish_deinit(void)
 {
+    g_clear_pointer(&cipher_cache, g_hash_table_destroy);
+
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
     if (legacy_provider) {
         OSSL_PROVIDER_unload(legacy_provider);
@@ -207,6 +224,107 @@ char *fish_base64_decode(const char *message, size_t *final_len) {
     return bytes;
 }
 
+/**
+ * Return a cipher context with the key set, from the cache if it was used before
+ *
+ * @param [in] key       Bytes of key
+ * @param [in] keylen    Size of key
+ * @param [in] encode    1 or encrypt 0 for decrypt
+ * @param [in] mode      EVP_CIPH_ECB_MODE or EVP_CIPH_CBC_MODE
+ * @return The context, owned by the cache, or NULL if it can't be set up
+ */
+static EVP_CIPHER_CTX *fish_cipher_ctx(const char *key, size_t keylen, int encode, int mode) {
+    EVP_CIPHER_CTX *ctx;
+    EVP_CIPHER *cipher = NULL;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    gboolean fetched = FALSE;
+#endif
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned char prefix[2];
+    unsigned int digest_len = 0;
+    EVP_MD_CTX *md;
+    GBytes *id;
+
+    prefix[0] = mode;
+    prefix[1] = encode;
+    md = EVP_MD_CTX_new();
+    if (!md ||
+        !EVP_DigestInit_ex(md, EVP_sha256(), NULL) ||
+        !EVP_DigestUpdate(md, prefix, sizeof(prefix)) ||
+        !EVP_DigestUpdate(md, key, keylen) ||
+        !EVP_DigestFinal_ex(md, digest, &digest_len)) {
+        EVP_MD_CTX_free(md);
+        return NULL;
+    }
+    EVP_MD_CTX_free(md);
+    id = g_bytes_new(digest, digest_len);
+
+    if (cipher_cache == NULL)
+        cipher_cache = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                             (GDestroyNotify) g_bytes_unref,
+                                             (GDestroyNotify) EVP_CIPHER_CTX_free);
+
+    ctx = g_hash_table_lookup(cipher_cache, id);
+    if (ctx) {
+        g_bytes_unref(id);
+        return ctx;
+    }
+
+    if (mode == EVP_CIPH_CBC_MODE) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        cipher = EVP_CIPHER_fetch(NULL, "BF-CBC", NULL);
+        fetched = cipher != NULL;
+        if (!cipher)
+            cipher = (EVP_CIPHER *) EVP_bf_cbc();
+#else
+        cipher = (EVP_CIPHER *) EVP_bf_cbc();
+#endif
+
+    } else if (mode == EVP_CIPH_ECB_MODE) {
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        cipher = EVP_CIPHER_fetch(NULL, "BF-ECB", NULL);
+        fetched = cipher != NULL;
+        if (!cipher)
+            cipher = (EVP_CIPHER *) EVP_bf_ecb();
+#else
+        cipher = (EVP_CIPHER *) EVP_bf_ecb();
+#endif
+    }
+
+    /* Initialise the cipher operation only with mode, then the custom
+     * key length and the key itself */
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx || !cipher ||
+        !EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, encode) ||
+        !EVP_CIPHER_CTX_set_key_length(ctx, keylen) ||
+        1 != EVP_CipherInit_ex(ctx, NULL, NULL, (const unsigned char *) key, NULL, encode)) {
+        EVP_CIPHER_CTX_free(ctx);
+        ctx = NULL;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    /* the context keeps its own reference */
+    if (fetched)
+        EVP_CIPHER_free(cipher);
+#endif
+
+    if (!ctx) {
+        g_bytes_unref(id);
+        return NULL;
+    }
+
+    /* We will manage this */
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+    /* Keys come and go with key exchanges, don't keep them all */
+    if (g_hash_table_size(cipher_cache) >= CIPHER_CACHE_MAX)
+        g_hash_table_remove_all(cipher_cache);
+
+    g_hash_table_insert(cipher_cache, id, ctx);
+    return ctx;
+}
+
 /**
  * Encrypt or decrypt data with Blowfish cipher, support binary data.
  *
@@ -231,7 +349,6 @@ char *fish_base64_decode(const char *message, size_t *final_len) {
  */
 char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key, size_t keylen, int encode, int mode, size_t *ciphertext_len) {
     EVP_CIPHER_CTX *ctx;
-    EVP_CIPHER *cipher = NULL;
     int bytes_written = 0;
     unsigned char *ciphertext = NULL;
     unsigned char *iv_ciphertext = NULL;
@@ -259,23 +376,6 @@ char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key,
             plaintext_len -= 8;
         }
 
-#if OPENSSL_VERSION_NUMBER >= 0x30000000L
-        cipher = EVP_CIPHER_fetch(NULL, "BF-CBC", NULL);
-        if (!cipher)
-            cipher = (EVP_CIPHER *) EVP_bf_cbc();
-#else
-        cipher = (EVP_CIPHER *) EVP_bf_cbc();
-#endif
-
-    } else if (mode == EVP_CIPH_ECB_MODE) {
-
-#if OPENSSL_VERSION_NUMBER >= 0x30000000L
-        cipher = EVP_CIPHER_fetch(NULL, "BF-ECB", NULL);
-        if (!cipher)
-            cipher = (EVP_CIPHER *) EVP_bf_ecb();
-#else
-        cipher = (EVP_CIPHER *) EVP_bf_ecb();
-#endif
     }
 
     /* Zero Padding */
@@ -286,25 +386,14 @@ char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key,
     ciphertext = (unsigned char *) g_malloc0(block_size);
     memcpy(ciphertext, plaintext, plaintext_len);
 
-    /* Create and initialise the context */
-    if (!(ctx = EVP_CIPHER_CTX_new()))
+    /* Get a context set up with this key */
+    if (!(ctx = fish_cipher_ctx(key, keylen, encode, mode)))
         return NULL;
 
-    /* Initialise the cipher operation only with mode */
-    if (!EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, encode))
+    /* Start over, keeping the key schedule */
+    if (1 != EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, encode))
         return NULL;
 
-    /* Set custom key length */
-    if (!EVP_CIPHER_CTX_set_key_length(ctx, keylen))
-        return NULL;
-
-    /* Finish the initiation the cipher operation */
-    if (1 != EVP_CipherInit_ex(ctx, NULL, NULL, (const unsigned char *) key, iv, encode))
-        return NULL;
-
-    /* We will manage this */
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-
     /* Do cipher operation */
     if (1 != EVP_CipherUpdate(ctx, ciphertext, &bytes_written, ciphertext, block_size))
         return NULL;
@@ -317,9 +406,6 @@ char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key,
 
     *ciphertext_len += bytes_written;
 
-    /* Clean up */
-    EVP_CIPHER_CTX_free(ctx);
-
 
     if (mode == EVP_CIPH_CBC_MODE && encode == 1) {
         /* Join IV + DATA */
@@ -514,6 +600,7 @@ GSList *fish_encrypt_for_nick(const char *nick, const char *data, enum fish_mode
         data_chunk += chunks_len;
     }
 
+    g_free(key);
     return encrypted_list;
 }
 
@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "irc.h"
@@ -35,6 +36,22 @@
 
 static char *keystore_password = NULL;
 
+/* How often, at most, addon_fishlim.conf is checked for outside changes */
+#define KEY_CACHE_RECHECK G_USEC_PER_SEC
+
+typedef struct {
+    char *group;            /* as written in the file */
+    char *key;              /* decrypted, NULL if the group has none */
+    enum fish_mode mode;
+} cached_key;
+
+/* Keys as last read from the file, so that encrypting or decrypting a line
+ * doesn't parse it again. Folded nick -> GSList of cached_key, in file order. */
+static GHashTable *key_cache = NULL;
+static gint64 key_cache_checked;
+static time_t key_cache_mtime;
+static goffset key_cache_size;
+
 
 /**
  * Opens the key store file: ~/.config/zoitechat/addon_fishlim.conf
@@ -80,79 +97,191 @@ static char *escape_nickname(const char *nick) {
 }
 
 /**
- * Gets a value for a nick/channel from addon_fishlim.conf. Unlike
- * g_key_file_get_string, this function is case insensitive.
+ * Folds a nick so that all casemappings IRC servers use agree on the result.
+ * Nicks that fold the same are told apart with irc_nick_cmp().
  */
-static gchar *get_nick_value(GKeyFile *keyfile, const char *nick, const char *item) {
-    gchar **group;
-    gchar **groups = g_key_file_get_groups(keyfile, NULL);
-    gchar *result = NULL;
-    
-    for (group = groups; *group != NULL; group++) {
-        if (!irc_nick_cmp(*group, nick)) {
-            result = g_key_file_get_string(keyfile, *group, item, NULL);
-            break;
-        }
+static char *fold_nick(const char *nick) {
+    char *folded = g_ascii_strdown(nick, -1);
+    char *p;
+
+    for (p = folded; *p; p++) {
+        if (*p == '[')
+            *p = '{';
+        else if (*p == ']')
+            *p = '}';
+        else if (*p == '\\')
+            *p = '|';
+        else if (*p == '~')
+            *p = '^';
     }
-    
-    g_strfreev(groups);
-    return result;
-}
 
+    return folded;
+}
 
 /**
- * Extracts a key from the key store file.
+ * Decrypts a key as stored in the file, "+OK " prefixed keys are encrypted.
  */
-char *keystore_get_key(const char *nick, enum fish_mode *mode) {
-    GKeyFile *keyfile;
-    char *escaped_nick;
-    gchar *value, *key_mode;
+static char *decrypt_stored_key(gchar *value) {
     int encrypted_mode;
     char *password;
     char *encrypted;
     char *decrypted;
 
-    /* Get the key */
-    keyfile = getConfigFile();
-    escaped_nick = escape_nickname(nick);
-    value = get_nick_value(keyfile, escaped_nick, "key");
-    key_mode = get_nick_value(keyfile, escaped_nick, "mode");
-    g_key_file_free(keyfile);
-    g_free(escaped_nick);
+    if (strncmp(value, "+OK ", 4) != 0) {
+        /* Key is stored in plaintext */
+        return value;
+    }
 
-    /* Determine cipher mode */
-    *mode = FISH_ECB_MODE;
-    if (key_mode) {
-        if (*key_mode == '1')
-            *mode = FISH_ECB_MODE;
-        else if (*key_mode == '2')
-            *mode = FISH_CBC_MODE;
-        g_free(key_mode);
+    /* Key is encrypted */
+    encrypted = (char *) value;
+    encrypted += 4;
+
+    encrypted_mode = FISH_ECB_MODE;
+
+    if (*encrypted == '*') {
+        ++encrypted;
+        encrypted_mode = FISH_CBC_MODE;
     }
 
-    if (!value)
-        return NULL;
+    password = (char *) get_keystore_password();
+    decrypted = fish_decrypt_str((const char *) password, strlen(password), (const char *) encrypted, encrypted_mode);
+    g_free(value);
+    return decrypted;
+}
 
-    if (strncmp(value, "+OK ", 4) == 0) {
-        /* Key is encrypted */
-        encrypted = (char *) value;
-        encrypted += 4;
+static void free_cached_key(gpointer data) {
+    cached_key *entry = data;
 
-        encrypted_mode = FISH_ECB_MODE;
+    if (entry->key) {
+        memset(entry->key, 0, strlen(entry->key));
+        g_free(entry->key);
+    }
+    g_free(entry->group);
+    g_free(entry);
+}
 
-        if (*encrypted == '*') {
-            ++encrypted;
-            encrypted_mode = FISH_CBC_MODE;
+static void free_cached_list(gpointer data) {
+    g_slist_free_full(data, free_cached_key);
+}
+
+/* also whenever a key was set, deleted or changed on disk */
+static void key_cache_clear(void) {
+    g_clear_pointer(&key_cache, g_hash_table_destroy);
+    fish_cipher_cache_clear();
+}
+
+static void key_cache_load(void) {
+    GKeyFile *keyfile = getConfigFile();
+    gchar **groups = g_key_file_get_groups(keyfile, NULL);
+    gchar **group;
+    gchar *value, *key_mode;
+    cached_key *entry;
+    GSList *list;
+    char *folded;
+
+    key_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_cached_list);
+
+    for (group = groups; *group != NULL; group++) {
+        entry = g_new0(cached_key, 1);
+        entry->group = g_strdup(*group);
+
+        /* Determine cipher mode */
+        entry->mode = FISH_ECB_MODE;
+        key_mode = g_key_file_get_string(keyfile, *group, "mode", NULL);
+        if (key_mode) {
+            if (*key_mode == '1')
+                entry->mode = FISH_ECB_MODE;
+            else if (*key_mode == '2')
+                entry->mode = FISH_CBC_MODE;
+            g_free(key_mode);
         }
 
-        password = (char *) get_keystore_password();
-        decrypted = fish_decrypt_str((const char *) password, strlen(password), (const char *) encrypted, encrypted_mode);
-        g_free(value);
-        return decrypted;
-    } else {
-        /* Key is stored in plaintext */
-        return value;
+        value = g_key_file_get_string(keyfile, *group, "key", NULL);
+        if (value)
+            entry->key = decrypt_stored_key(value);
+
+        /* the first group in the file wins, as it did when it was searched */
+        folded = fold_nick(*group);
+        list = g_hash_table_lookup(key_cache, folded);
+        if (list) {
+            list = g_slist_append(list, entry);
+            g_free(folded);
+        } else {
+            g_hash_table_insert(key_cache, folded, g_slist_prepend(NULL, entry));
+        }
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(keyfile);
+}
+
+/**
+ * Makes sure the cache matches the file, re-reading it if it was changed
+ * by anything but us.
+ */
+static void key_cache_check(void) {
+    gint64 now = g_get_monotonic_time();
+    char *filename;
+    GStatBuf st;
+    time_t mtime = 0;
+    goffset size = 0;
+
+    if (key_cache && now - key_cache_checked < KEY_CACHE_RECHECK)
+        return;
+    key_cache_checked = now;
+
+    filename = get_config_filename();
+    if (g_stat(filename, &st) == 0) {
+        mtime = st.st_mtime;
+        size = st.st_size;
+    }
+    g_free(filename);
+
+    if (key_cache && mtime == key_cache_mtime && size == key_cache_size)
+        return;
+
+    key_cache_clear();
+    key_cache_mtime = mtime;
+    key_cache_size = size;
+    key_cache_load();
+}
+
+static cached_key *key_cache_find(const char *nick) {
+    char *escaped_nick;
+    char *folded;
+    GSList *list;
+    cached_key *entry = NULL;
+
+    key_cache_check();
+
+    escaped_nick = escape_nickname(nick);
+    folded = fold_nick(escaped_nick);
+
+    for (list = g_hash_table_lookup(key_cache, folded); list; list = list->next) {
+        if (!irc_nick_cmp(((cached_key *) list->data)->group, escaped_nick)) {
+            entry = list->data;
+            break;
+        }
     }
+
+    g_free(folded);
+    g_free(escaped_nick);
+    return entry;
+}
+
+
+/**
+ * Extracts a key from the key store file.
+ */
+char *keystore_get_key(const char *nick, enum fish_mode *mode) {
+    cached_key *entry = key_cache_find(nick);
+
+    *mode = FISH_ECB_MODE;
+    if (!entry)
+        return NULL;
+
+    *mode = entry->mode;
+    return g_strdup(entry->key);
 }
 
 /**
@@ -265,6 +394,7 @@ gboolean keystore_store_key(const char *nick, const char *key, enum fish_mode mo
     
     /* Save key store file */
     ok = save_keystore(keyfile);
+    key_cache_clear();
     
   end:
     g_key_file_free(keyfile);
@@ -284,8 +414,16 @@ gboolean keystore_delete_nick(const char *nick) {
     
     /* Save */
     if (ok) save_keystore(keyfile);
+    key_cache_clear();
     
     g_key_file_free(keyfile);
     g_free(escaped_nick);
     return ok;
 }
+
+/**
+ * Forgets the keys read from the key store.
+ */
+void keystore_deinit(void) {
+    key_cache_clear();
+}
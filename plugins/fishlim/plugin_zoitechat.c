@@ -1163,6 +1163,7 @@ int zoitechat_plugin_deinit(void) {
         gtk_widget_destroy(fishlim_dialog);
     g_clear_pointer(&pending_exchanges, g_hash_table_destroy);
     dh1080_deinit();
+    keystore_deinit();
     fish_deinit();
 
     zoitechat_printf(ph, "%s plugin unloaded\n", plugin_name);
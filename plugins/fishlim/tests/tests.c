@@ -264,6 +264,48 @@ test_foreach_utf8_data_chunks(void)
     g_rand_free (rand);
 }
 
+/**
+ * Check that many keys in turn, more than are kept set up, each decrypt their own messages
+ */
+static void
+test_interleaved_keys(void)
+{
+    char keys[100][17];
+    char *encrypted[100];
+    char *de = NULL;
+    char message[] = "the same line sent to many targets";
+    int i, round;
+    enum fish_mode mode;
+
+    for (round = 0; round < 2; ++round) {
+        mode = round ? FISH_CBC_MODE : FISH_ECB_MODE;
+
+        for (i = 0; i < 100; ++i) {
+            random_string(keys[i], 16);
+            encrypted[i] = fish_encrypt(keys[i], 16, message, strlen(message), mode);
+            g_assert_nonnull(encrypted[i]);
+        }
+
+        /* A key set or deleted drops everything set up so far */
+        if (round)
+            fish_cipher_cache_clear();
+
+        /* Backwards, so the oldest keys have been dropped by now */
+        for (i = 99; i >= 0; --i) {
+            de = fish_decrypt_str(keys[i], 16, encrypted[i], mode);
+            g_assert_cmpstr(de, ==, message);
+            g_free(de);
+
+            /* A different key must not get the same result */
+            de = fish_decrypt_str(keys[(i + 1) % 100], 16, encrypted[i], mode);
+            g_assert_cmpstr(de, !=, message);
+            g_free(de);
+
+            g_free(encrypted[i]);
+        }
+    }
+}
+
 int
 main(int argc, char *argv[]) {
 
@@ -277,6 +319,7 @@ main(int argc, char *argv[]) {
     g_test_add_func("/fishlim/base64_cbc_len", test_base64_cbc_len);
     g_test_add_func("/fishlim/max_text_command_len", test_max_text_command_len);
     g_test_add_func("/fishlim/foreach_utf8_data_chunks", test_foreach_utf8_data_chunks);
+    g_test_add_func("/fishlim/interleaved_keys", test_interleaved_keys);
 
     fish_init();
     int ret = g_test_run();
@@ -504,7 +504,7 @@ sub context_info {
 	my $old_ctx = ZoiteChat::get_context;
 	my @fields = (
 		qw(away channel charset host id inputbox libdirfs modes network),
-		qw(nick nickserv server topic version win_ptr win_status),
+		qw(nick nickserv reconnect sendq server topic version win_ptr win_status),
 		qw(configdir xchatdir xchatdirfs state_cursor),
 	);
 
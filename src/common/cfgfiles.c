@@ -25,6 +25,7 @@
 
 #include "zoitechat.h"
 #include "cfgfiles.h"
+#include "cfgindex.h"
 #include "util.h"
 #include "fe.h"
 #include "text.h"
@@ -54,6 +55,9 @@ const char * const languages[LANGUAGES_LENGTH] = {
 	"uk", "vi", "wa"                                                     /* 50 .. */
 };
 
+/* bumped whenever a popup list changes, so indexes built on one know to rebuild */
+guint list_generation = 0;
+
 void
 list_addentry (GSList ** list, char *cmd, char *name)
 {
@@ -76,72 +80,57 @@ list_addentry (GSList ** list, char *cmd, char *name)
 		pop->cmd[0] = 0;
 
 	*list = g_slist_append (*list, pop);
+	list_generation++;
 }
 
 /* read it in from a buffer to our linked list */
 
-static void
-list_load_from_data (GSList ** list, char *ibuf, int size)
+struct list_load_state
 {
-	char cmd[384];
+	GSList **list;
 	char name[128];
-	char *buf;
-	int pnt = 0;
+};
 
-	cmd[0] = 0;
-	name[0] = 0;
+static void
+list_load_line (char *key, char *rest, void *data)
+{
+	struct list_load_state *state = data;
+	char cmd[384];
 
-	while (buf_get_line (ibuf, &buf, &pnt, size))
+	if (!g_ascii_strcasecmp (key, "NAME"))
 	{
-		if (*buf != '#')
-		{
-			if (!g_ascii_strncasecmp (buf, "NAME ", 5))
-			{
-				safe_strcpy (name, buf + 5, sizeof (name));
-			}
-			else if (!g_ascii_strncasecmp (buf, "CMD ", 4))
-			{
-				safe_strcpy (cmd, buf + 4, sizeof (cmd));
-				if (*name)
-				{
-					list_addentry (list, cmd, name);
-					cmd[0] = 0;
-					name[0] = 0;
-				}
-			}
-		}
+		safe_strcpy (state->name, rest, sizeof (state->name));
+	}
+	else if (!g_ascii_strcasecmp (key, "CMD") && state->name[0])
+	{
+		safe_strcpy (cmd, rest, sizeof (cmd));
+		list_addentry (state->list, cmd, state->name);
+		state->name[0] = 0;
 	}
 }
 
 void
 list_loadconf (char *file, GSList ** list, char *defaultconf)
 {
+	struct list_load_state state;
 	char *filebuf;
 	char *ibuf;
-	int fd;
-	struct stat st;
 
 	filebuf = g_build_filename (get_xdir (), file, NULL);
-	fd = g_open (filebuf, O_RDONLY | OFLAGS, 0);
-	g_free (filebuf);
-
-	if (fd == -1)
-	{
-		if (defaultconf)
-			list_load_from_data (list, defaultconf, strlen (defaultconf));
-		return;
-	}
-	if (fstat (fd, &st) != 0)
+	if (!g_file_get_contents (filebuf, &ibuf, NULL, NULL))
 	{
-		perror ("fstat");
-		abort ();
+		if (!defaultconf)
+		{
+			g_free (filebuf);
+			return;
+		}
+		ibuf = g_strdup (defaultconf);
 	}
+	g_free (filebuf);
 
-	ibuf = g_malloc (st.st_size);
-	read (fd, ibuf, st.st_size);
-	close (fd);
-
-	list_load_from_data (list, ibuf, st.st_size);
+	state.list = list;
+	state.name[0] = 0;
+	cfg_parse_lines (ibuf, list_load_line, &state);
 
 	g_free (ibuf);
 }
@@ -156,6 +145,7 @@ list_free (GSList ** list)
 		g_free (data);
 		*list = g_slist_remove (*list, data);
 	}
+	list_generation++;
 }
 
 int
@@ -171,6 +161,7 @@ list_delentry (GSList ** list, char *name)
 		{
 			*list = g_slist_remove (*list, pop);
 			g_free (pop);
+			list_generation++;
 			return 1;
 		}
 		alist = alist->next;
@@ -267,21 +258,6 @@ cfg_get_color (char *cfg, char *var, guint16 *r, guint16 *g, guint16 *b)
 	return matched == 3;
 }
 
-int
-cfg_get_int_with_result (char *cfg, char *var, int *result)
-{
-	char str[128];
-
-	if (!cfg_get_str (cfg, var, str, sizeof (str)))
-	{
-		*result = 0;
-		return 0;
-	}
-
-	*result = 1;
-	return atoi (str);
-}
-
 int
 cfg_get_int (char *cfg, char *var)
 {
@@ -372,6 +348,7 @@ const struct prefs vars[] =
 	{"completion_sort", P_OFFINT (hex_completion_sort), TYPE_INT},
 	{"completion_suffix", P_OFFSET (hex_completion_suffix), TYPE_STR},
 
+	{"dcc_ack_interval", P_OFFINT (hex_dcc_ack_interval), TYPE_INT},
 	{"dcc_auto_chat", P_OFFINT (hex_dcc_auto_chat), TYPE_BOOL},
 	{"dcc_auto_recv", P_OFFINT (hex_dcc_auto_recv), TYPE_INT},
 	{"dcc_auto_resume", P_OFFINT (hex_dcc_auto_resume), TYPE_BOOL},
@@ -390,6 +367,8 @@ const struct prefs vars[] =
 	{"dcc_permissions", P_OFFINT (hex_dcc_permissions), TYPE_INT},
 	{"dcc_port_first", P_OFFINT (hex_dcc_port_first), TYPE_INT},
 	{"dcc_port_last", P_OFFINT (hex_dcc_port_last), TYPE_INT},
+	{"dcc_preallocate", P_OFFINT (hex_dcc_preallocate), TYPE_BOOL},
+	{"dcc_recv_bufsize", P_OFFINT (hex_dcc_recv_bufsize), TYPE_INT},
 	{"dcc_remove", P_OFFINT (hex_dcc_remove), TYPE_BOOL},
 	{"dcc_save_nick", P_OFFINT (hex_dcc_save_nick), TYPE_BOOL},
 	{"dcc_send_fillspaces", P_OFFINT (hex_dcc_send_fillspaces), TYPE_BOOL},
@@ -564,6 +543,7 @@ const struct prefs vars[] =
 	{"net_proxy_use", P_OFFINT (hex_net_proxy_use), TYPE_INT},
 	{"net_proxy_user", P_OFFSET (hex_net_proxy_user), TYPE_STR},
 	{"net_reconnect_delay", P_OFFINT (hex_net_reconnect_delay), TYPE_INT},
+	{"net_reconnect_max", P_OFFINT (hex_net_reconnect_max), TYPE_INT},
 	{"net_throttle", P_OFFINT (hex_net_throttle), TYPE_BOOL},
 
 	{"notify_timeout", P_OFFINT (hex_notify_timeout), TYPE_INT},
@@ -834,9 +814,11 @@ load_default_config(void)
 	prefs.hex_away_timeout = 60;
 	prefs.hex_completion_amount = 5;
 	prefs.hex_completion_sort = 1;
+	prefs.hex_dcc_ack_interval = 65536;
 	prefs.hex_dcc_auto_recv = 1;			/* browse mode */
 	prefs.hex_dcc_blocksize = 1024;
 	prefs.hex_dcc_permissions = 0600;
+	prefs.hex_dcc_recv_bufsize = 65536;
 	prefs.hex_dcc_stall_timeout = 60;
 	prefs.hex_dcc_timeout = 180;
 	prefs.hex_flood_ctcp_num = 5;
@@ -873,6 +855,7 @@ load_default_config(void)
 	prefs.hex_net_keepalive_interval = 20;
 	prefs.hex_net_keepalive_count = 3;
 	prefs.hex_net_reconnect_delay = 10;
+	prefs.hex_net_reconnect_max = 3;
 	prefs.hex_notify_timeout = 15;
 	prefs.hex_text_max_indent = 256;
 	prefs.hex_text_max_lines = 5000;
@@ -994,8 +977,10 @@ make_dcc_dirs (void)
 int
 load_config (void)
 {
+	cfg_index *table;
+	const char *value;
 	char *cfg, *sp;
-	int res, val, i;
+	int i;
 
 	g_assert(check_config_dir () == 0);
 
@@ -1005,27 +990,32 @@ load_config (void)
 	/* If the config is incomplete we have the default values loaded */
 	load_default_config();
 
+	/* one pass over the file, instead of one per variable */
+	table = cfg_index_new (cfg);
+	g_free (cfg);
+
 	i = 0;
 	do
 	{
-		switch (vars[i].type)
+		value = cfg_index_get (table, vars[i].name);
+		if (value)
 		{
-		case TYPE_STR:
-			cfg_get_str (cfg, vars[i].name, (char *) &prefs + vars[i].offset,
-				     vars[i].len);
-			break;
-		case TYPE_BOOL:
-		case TYPE_INT:
-			val = cfg_get_int_with_result (cfg, vars[i].name, &res);
-			if (res)
-				*((int *) &prefs + vars[i].offset) = val;
-			break;
+			switch (vars[i].type)
+			{
+			case TYPE_STR:
+				safe_strcpy ((char *) &prefs + vars[i].offset, value, vars[i].len);
+				break;
+			case TYPE_BOOL:
+			case TYPE_INT:
+				*((int *) &prefs + vars[i].offset) = atoi (value);
+				break;
+			}
 		}
 		i++;
 	}
 	while (vars[i].name);
 
-	g_free (cfg);
+	cfg_index_free (table);
 
 	if (prefs.hex_gui_win_height < 138)
 		prefs.hex_gui_win_height = 138;
@@ -28,10 +28,10 @@
 
 extern char *xdir;
 extern const char * const languages[LANGUAGES_LENGTH];
+extern guint list_generation;
 
 char *cfg_get_str (char *cfg, const char *var, char *dest, int dest_len);
 int cfg_get_bool (char *var);
-int cfg_get_int_with_result (char *cfg, char *var, int *result);
 int cfg_get_int (char *cfg, char *var);
 int cfg_put_int (int fh, int value, char *var);
 int cfg_get_color (char *cfg, char *var, guint16 *r, guint16 *g, guint16 *b);
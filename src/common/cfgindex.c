@@ -0,0 +1,117 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "cfgindex.h"
+
+struct cfg_index
+{
+	char *data;				/* the parsed copy, keys and values point into it */
+	GHashTable *vars;
+};
+
+void
+cfg_parse_lines (char *cfg, cfg_line_func *func, void *data)
+{
+	char *line, *end, *space;
+
+	for (line = cfg; *line; line = end + 1)
+	{
+		end = strchr (line, '\n');
+		if (end)
+			*end = 0;
+
+		space = strchr (line, ' ');
+		if (space)
+		{
+			*space = 0;
+			func (line, space + 1, data);
+		}
+
+		if (!end)
+			break;
+	}
+}
+
+guint
+cfg_key_hash (gconstpointer key)
+{
+	const char *p;
+	guint h = 5381;
+
+	for (p = key; *p; p++)
+		h = (h << 5) + h + g_ascii_tolower (*p);
+
+	return h;
+}
+
+gboolean
+cfg_key_equal (gconstpointer a, gconstpointer b)
+{
+	return g_ascii_strcasecmp (a, b) == 0;
+}
+
+static void
+cfg_index_add (char *key, char *rest, void *data)
+{
+	GHashTable *vars = data;
+
+	/* same trimming as cfg_get_str () */
+	while (*rest == ' ')
+		rest++;
+	if (*rest == '=')
+		rest++;
+	while (*rest == ' ')
+		rest++;
+
+	if (!g_hash_table_contains (vars, key))
+		g_hash_table_insert (vars, key, rest);
+}
+
+cfg_index *
+cfg_index_new (const char *cfg)
+{
+	cfg_index *table;
+
+	table = g_new0 (cfg_index, 1);
+	table->data = g_strdup (cfg);
+	table->vars = g_hash_table_new (cfg_key_hash, cfg_key_equal);
+
+	cfg_parse_lines (table->data, cfg_index_add, table->vars);
+
+	return table;
+}
+
+void
+cfg_index_free (cfg_index *table)
+{
+	if (!table)
+		return;
+
+	g_hash_table_destroy (table->vars);
+	g_free (table->data);
+	g_free (table);
+}
+
+const char *
+cfg_index_get (cfg_index *table, const char *var)
+{
+	return g_hash_table_lookup (table->vars, var);
+}
@@ -0,0 +1,48 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* cfgindex.h */
+
+#ifndef ZOITECHAT_CFGINDEX_H
+#define ZOITECHAT_CFGINDEX_H
+
+#include <glib.h>
+
+/* Config files are lines of "key rest". cfg_parse_lines () walks a buffer
+ * once, cutting it into lines and keys in place; lines without a space
+ * are skipped. */
+
+typedef void (cfg_line_func) (char *key, char *rest, void *data);
+
+void cfg_parse_lines (char *cfg, cfg_line_func *func, void *data);
+
+/* hash and equality for config keys, ASCII case-insensitive */
+guint cfg_key_hash (gconstpointer key);
+gboolean cfg_key_equal (gconstpointer a, gconstpointer b);
+
+/* A zoitechat.conf style "key = value" file by key, ASCII case-insensitive.
+ * Values follow cfg_get_str (): the first line for a key wins. */
+
+typedef struct cfg_index cfg_index;
+
+cfg_index *cfg_index_new (const char *cfg);
+void cfg_index_free (cfg_index *table);
+const char *cfg_index_get (cfg_index *table, const char *var);
+
+#endif
@@ -36,6 +36,7 @@
 #include "zoitechat.h"
 
 #include "cfgfiles.h"
+#include "cfgindex.h"
 #include "server.h"
 #include "text.h"
 #include "util.h"
@@ -245,48 +246,56 @@ chanopt_add_opt (chanopt_in_memory *co, char *var, int new_value)
 	}
 }
 
+struct chanopt_load_state
+{
+	char *network;
+	chanopt_in_memory *current;
+};
+
 static void
-chanopt_load_all (void)
+chanopt_load_line (char *key, char *rest, void *data)
 {
-	int fh;
-	char buf[256];
-	char *eq;
-	char *network = NULL;
-	chanopt_in_memory *current = NULL;
+	struct chanopt_load_state *state = data;
+	char *value;
 
-	fh = zoitechat_open_file ("chanopt.conf", O_RDONLY, 0, 0);
-	if (fh != -1)
-	{
-		while (waitline (fh, buf, sizeof buf, FALSE) != -1)
-		{
-			eq = strchr (buf, '=');
-			if (!eq)
-				continue;
-			eq[0] = 0;
+	/* lines are "key = value" */
+	if (rest[0] != '=')
+		return;
+	value = rest + 1;
+	if (*value == ' ')
+		value++;
 
-			if (eq != buf && eq[-1] == ' ')
-				eq[-1] = 0;
+	if (!strcmp (key, "network"))
+	{
+		g_free (state->network);
+		state->network = g_strdup (value);
+	}
+	else if (!strcmp (key, "channel"))
+	{
+		state->current = chanopt_find (state->network, value, TRUE);
+		chanopt_changed = FALSE;
+	}
+	else
+	{
+		if (state->current)
+			chanopt_add_opt (state->current, key, str_to_chanopt (value));
+	}
+}
 
-			if (!strcmp (buf, "network"))
-			{
-				g_free (network);
-				network = g_strdup (eq + 2);
-			}
-			else if (!strcmp (buf, "channel"))
-			{
-				current = chanopt_find (network, eq + 2, TRUE);
-				chanopt_changed = FALSE;
-			}
-			else
-			{
-				if (current)
-					chanopt_add_opt (current, buf, str_to_chanopt (eq + 2));
-			}
+static void
+chanopt_load_all (void)
+{
+	struct chanopt_load_state state = { NULL, NULL };
+	char *path, *cfg;
 
-		}
-		close (fh);
-		g_free (network);
+	path = g_build_filename (get_xdir (), "chanopt.conf", NULL);
+	if (g_file_get_contents (path, &cfg, NULL, NULL))
+	{
+		cfg_parse_lines (cfg, chanopt_load_line, &state);
+		g_free (cfg);
+		g_free (state.network);
 	}
+	g_free (path);
 }
 
 void
@@ -0,0 +1,92 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "zoitechat.h"
+#include "cmdindex.h"
+
+struct command_index
+{
+	GHashTable *names;	/* name -> GSList of struct popup */
+};
+
+static guint
+command_name_hash (gconstpointer key)
+{
+	const char *p;
+	guint h = 5381;
+
+	for (p = key; *p; p++)
+		h = (h << 5) + h + g_ascii_tolower (*p);
+
+	return h;
+}
+
+static gboolean
+command_name_equal (gconstpointer a, gconstpointer b)
+{
+	return g_ascii_strcasecmp (a, b) == 0;
+}
+
+command_index *
+command_index_new (GSList *list)
+{
+	command_index *table;
+	GHashTableIter iter;
+	struct popup *pop;
+	gpointer bucket;
+
+	table = g_new0 (command_index, 1);
+	table->names = g_hash_table_new (command_name_hash, command_name_equal);
+
+	/* keys are the popups' own names, which outlive the table */
+	for (; list; list = list->next)
+	{
+		pop = list->data;
+		bucket = g_hash_table_lookup (table->names, pop->name);
+		g_hash_table_insert (table->names, pop->name, g_slist_prepend (bucket, pop));
+	}
+
+	g_hash_table_iter_init (&iter, table->names);
+	while (g_hash_table_iter_next (&iter, NULL, &bucket))
+		g_hash_table_iter_replace (&iter, g_slist_reverse (bucket));
+
+	return table;
+}
+
+void
+command_index_free (command_index *table)
+{
+	GHashTableIter iter;
+	gpointer bucket;
+
+	if (!table)
+		return;
+
+	g_hash_table_iter_init (&iter, table->names);
+	while (g_hash_table_iter_next (&iter, NULL, &bucket))
+		g_slist_free (bucket);
+	g_hash_table_destroy (table->names);
+	g_free (table);
+}
+
+GSList *
+command_index_lookup (command_index *table, const char *name)
+{
+	return g_hash_table_lookup (table->names, name);
+}
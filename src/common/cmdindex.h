@@ -0,0 +1,37 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* cmdindex.h */
+
+#ifndef ZOITECHAT_CMDINDEX_H
+#define ZOITECHAT_CMDINDEX_H
+
+#include <glib.h>
+
+/* User commands (struct popup) by their ASCII case-insensitive name. A
+ * name can be defined more than once; its commands are kept in the order
+ * of the list they came from. */
+
+typedef struct command_index command_index;
+
+command_index *command_index_new (GSList *list);
+void command_index_free (command_index *table);
+GSList *command_index_lookup (command_index *table, const char *name);
+
+#endif
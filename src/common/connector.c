@@ -0,0 +1,1016 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <gio/gio.h>
+
+#define WANTSOCKET
+#define WANTARPA
+#include "inet.h"
+
+#include "fe.h"
+#include "network.h"
+#include "connector.h"
+
+#ifdef WIN32
+#define connect_in_progress() (WSAGetLastError () == WSAEWOULDBLOCK)
+#else
+#define connect_in_progress() (errno == EINPROGRESS)
+#endif
+
+#define CONNECTOR_ATTEMPT_DELAY 250	/* ms before the next address joins the race */
+#define CONNECTOR_BUFSIZE 512
+
+/* where a proxy handshake is, see connector_proxy_step () */
+enum
+{
+	STEP_START,
+	STEP_REPLY,				/* SOCKS4 reply, or the end of the SOCKS5 one */
+	STEP_SOCKS5_METHOD,
+	STEP_SOCKS5_AUTH,
+	STEP_SOCKS5_CONNECT,
+	STEP_SOCKS5_NAME,
+	STEP_HTTP_STATUS,
+	STEP_HTTP_HEADER,
+	STEP_DONE
+};
+
+typedef struct
+{
+	struct connector *conn;
+	int sok;
+	int tag;
+} connector_attempt;
+
+struct connector
+{
+	connector_options opts;		/* strings are our own copies */
+	connector_callbacks cb;
+	void *data;
+
+	int refs;						/* the owner's, and one per pending call */
+	gboolean cancelled;
+	GCancellable *cancellable;
+
+	GSocketAddress *local;		/* bind address, or NULL */
+	GList *addrs;					/* GInetAddress, in the order they are tried */
+	GList *next_addr;
+	int connect_port;
+	guint8 socks4_addr[4];
+
+	GSList *attempts;				/* connector_attempt still connecting */
+	int attempt_tag;				/* starts the next attempt */
+	int last_error;
+
+	int sok;							/* the attempt that won */
+	int iotag;
+
+	/* proxy handshake */
+	int step;
+	unsigned char out[CONNECTOR_BUFSIZE];
+	int outlen, outused;
+	unsigned char in[CONNECTOR_BUFSIZE];
+	int inlen;
+	int want;						/* bytes to read in all, -1 for a line */
+
+	gint64 mark;					/* when the current phase began */
+	gint64 times[CONNECTOR_PHASES];
+};
+
+static void connector_find_proxy (connector *conn);
+static void connector_resolve (connector *conn);
+static void connector_connect_next (connector *conn);
+static void connector_proxy_step (connector *conn);
+
+static void
+connector_destroy (connector *conn)
+{
+	g_free ((char *) conn->opts.host);
+	g_free ((char *) conn->opts.bind_host);
+	g_free ((char *) conn->opts.proxy_host);
+	g_free ((char *) conn->opts.proxy_user);
+	g_free ((char *) conn->opts.proxy_pass);
+	g_free ((char *) conn->opts.username);
+	if (conn->local)
+		g_object_unref (conn->local);
+	g_resolver_free_addresses (conn->addrs);
+	g_object_unref (conn->cancellable);
+	g_free (conn);
+}
+
+/* drop a reference; FALSE if the connector is gone or was cancelled */
+static gboolean
+connector_release (connector *conn)
+{
+	gboolean alive = !conn->cancelled;
+
+	if (--conn->refs == 0)
+		connector_destroy (conn);
+
+	return alive;
+}
+
+static void
+connector_attempt_free (connector_attempt *attempt, gboolean close_it)
+{
+	if (attempt->tag)
+		fe_input_remove (attempt->tag);
+	if (close_it)
+		closesocket (attempt->sok);
+	g_free (attempt);
+}
+
+/* stop all I/O; the sockets are closed unless handed over already */
+static void
+connector_stop (connector *conn)
+{
+	GSList *list;
+
+	if (conn->attempt_tag)
+	{
+		fe_timeout_remove (conn->attempt_tag);
+		conn->attempt_tag = 0;
+	}
+
+	for (list = conn->attempts; list; list = list->next)
+		connector_attempt_free (list->data, TRUE);
+	g_slist_free (conn->attempts);
+	conn->attempts = NULL;
+
+	if (conn->iotag)
+	{
+		fe_input_remove (conn->iotag);
+		conn->iotag = 0;
+	}
+
+	if (conn->sok != -1)
+	{
+		closesocket (conn->sok);
+		conn->sok = -1;
+	}
+}
+
+static void
+connector_fail (connector *conn, connector_error error, int sock_err)
+{
+	connector_stop (conn);
+
+	conn->refs++;
+	conn->cb.failed (conn->data, error, sock_err);
+	connector_release (conn);
+}
+
+static void
+connector_finish (connector *conn)
+{
+	gint64 now = g_get_monotonic_time ();
+	int sok;
+
+	if (conn->opts.proxy_type != CONNECTOR_PROXY_NONE)
+		conn->times[CONNECTOR_PHASE_PROXY] = now - conn->mark;
+
+	sok = conn->sok;
+	conn->sok = -1;
+	connector_stop (conn);
+
+	conn->refs++;
+	conn->cb.connected (conn->data, sok, conn->times);
+	connector_release (conn);
+}
+
+/* ============================ DNS ============================ */
+
+static void
+connector_bind_resolved (GObject *source, GAsyncResult *res, gpointer data)
+{
+	connector *conn = data;
+	GList *addrs;
+	char *ip = NULL;
+
+	addrs = g_resolver_lookup_by_name_finish (G_RESOLVER (source), res, NULL);
+	if (!connector_release (conn))
+	{
+		g_resolver_free_addresses (addrs);
+		return;
+	}
+
+	if (addrs)
+	{
+		conn->local = g_inet_socket_address_new (addrs->data, 0);
+		ip = g_inet_address_to_string (addrs->data);
+		g_resolver_free_addresses (addrs);
+	}
+
+	conn->refs++;
+	conn->cb.bound (conn->data, ip);
+	g_free (ip);
+	if (!connector_release (conn))
+		return;
+
+	connector_find_proxy (conn);
+}
+
+/* "socks5://host:port" and the like, as GProxyResolver gives them */
+static void
+connector_use_proxy_uri (connector *conn, const char *uri)
+{
+	const char *host, *end;
+	connector_proxy type;
+
+	if (!strncmp (uri, "http", 4))
+		type = CONNECTOR_PROXY_HTTP;
+	else if (!strncmp (uri, "socks5", 6))
+		type = CONNECTOR_PROXY_SOCKS5;
+	else if (!strncmp (uri, "socks", 5))
+		type = CONNECTOR_PROXY_SOCKS4;
+	else
+		return;	/* "direct://" */
+
+	host = strstr (uri, "://");
+	if (!host)
+		return;
+	host += 3;
+	end = strrchr (host, ':');
+	if (!end)
+		return;
+
+	conn->opts.proxy_type = type;
+	g_free ((char *) conn->opts.proxy_host);
+	conn->opts.proxy_host = g_strndup (host, end - host);
+	conn->opts.proxy_port = atoi (end + 1);
+}
+
+static void
+connector_proxy_found (GObject *source, GAsyncResult *res, gpointer data)
+{
+	connector *conn = data;
+	GError *error = NULL;
+	char **proxies;
+
+	proxies = g_proxy_resolver_lookup_finish (G_PROXY_RESOLVER (source), res, &error);
+	if (!connector_release (conn))
+	{
+		g_strfreev (proxies);
+		g_clear_error (&error);
+		return;
+	}
+
+	conn->opts.proxy_type = CONNECTOR_PROXY_NONE;
+	if (proxies && proxies[0])
+		connector_use_proxy_uri (conn, proxies[0]);	/* can use only one */
+	else if (error)
+		g_printerr ("Failed to lookup proxy: %s\n", error->message);
+
+	g_strfreev (proxies);
+	g_clear_error (&error);
+	connector_resolve (conn);
+}
+
+static void
+connector_find_proxy (connector *conn)
+{
+	char *url;
+
+	if (conn->opts.proxy_type != CONNECTOR_PROXY_AUTO)
+	{
+		connector_resolve (conn);
+		return;
+	}
+
+	/*
+	 * In Flatpak, auto proxy resolution may block indefinitely when
+	 * proxy backends are unavailable in the sandbox. Prefer direct
+	 * connections there unless the user configured a specific proxy.
+	 */
+	if (g_file_test ("/.flatpak-info", G_FILE_TEST_EXISTS))
+	{
+		conn->opts.proxy_type = CONNECTOR_PROXY_NONE;
+		connector_resolve (conn);
+		return;
+	}
+
+	url = g_strdup_printf ("irc://%s:%d", conn->opts.host, conn->opts.port);
+	conn->refs++;
+	g_proxy_resolver_lookup_async (g_proxy_resolver_get_default (), url, conn->cancellable,
+											 connector_proxy_found, conn);
+	g_free (url);
+}
+
+/* RFC 8305 section 4: alternate the families, starting with the one
+ * the resolver put first */
+GList *
+connector_order_addresses (GList *addrs)
+{
+	GQueue first = G_QUEUE_INIT, other = G_QUEUE_INIT;
+	GSocketFamily family;
+	GList *list, *ordered = NULL;
+
+	if (!addrs)
+		return NULL;
+
+	family = g_inet_address_get_family (addrs->data);
+	for (list = addrs; list; list = list->next)
+	{
+		if (g_inet_address_get_family (list->data) == family)
+			g_queue_push_tail (&first, list->data);
+		else
+			g_queue_push_tail (&other, list->data);
+	}
+	g_list_free (addrs);
+
+	while (first.length || other.length)
+	{
+		if (first.length)
+			ordered = g_list_prepend (ordered, g_queue_pop_head (&first));
+		if (other.length)
+			ordered = g_list_prepend (ordered, g_queue_pop_head (&other));
+	}
+
+	return g_list_reverse (ordered);
+}
+
+static void
+connector_resolve_done (connector *conn)
+{
+	char *ip;
+	gboolean alive;
+
+	conn->times[CONNECTOR_PHASE_DNS] = g_get_monotonic_time () - conn->mark;
+
+	ip = g_inet_address_to_string (conn->addrs->data);
+	conn->refs++;
+	conn->cb.resolved (conn->data,
+							 conn->opts.proxy_type != CONNECTOR_PROXY_NONE ?
+							 conn->opts.proxy_host : conn->opts.host,
+							 ip, conn->connect_port);
+	g_free (ip);
+	alive = connector_release (conn);
+
+	if (alive)
+	{
+		conn->mark = g_get_monotonic_time ();
+		conn->next_addr = conn->addrs;
+		connector_connect_next (conn);
+	}
+}
+
+/* SOCKS4 can only be given an IPv4 address of the server */
+static void
+connector_socks4_resolved (GObject *source, GAsyncResult *res, gpointer data)
+{
+	connector *conn = data;
+	GList *addrs, *list;
+	gboolean found = FALSE;
+
+	addrs = g_resolver_lookup_by_name_finish (G_RESOLVER (source), res, NULL);
+	if (!connector_release (conn))
+	{
+		g_resolver_free_addresses (addrs);
+		return;
+	}
+
+	for (list = addrs; list && !found; list = list->next)
+	{
+		if (g_inet_address_get_family (list->data) == G_SOCKET_FAMILY_IPV4)
+		{
+			memcpy (conn->socks4_addr, g_inet_address_to_bytes (list->data), 4);
+			found = TRUE;
+		}
+	}
+	g_resolver_free_addresses (addrs);
+
+	if (!found)
+		connector_fail (conn, CONNECTOR_ERR_RESOLVE, 0);
+	else
+		connector_resolve_done (conn);
+}
+
+static void
+connector_resolved (GObject *source, GAsyncResult *res, gpointer data)
+{
+	connector *conn = data;
+	GList *addrs;
+
+	addrs = g_resolver_lookup_by_name_finish (G_RESOLVER (source), res, NULL);
+	if (!connector_release (conn))
+	{
+		g_resolver_free_addresses (addrs);
+		return;
+	}
+
+	if (!addrs)
+	{
+		connector_fail (conn, CONNECTOR_ERR_RESOLVE, 0);
+		return;
+	}
+	conn->addrs = connector_order_addresses (addrs);
+
+	if (conn->opts.proxy_type == CONNECTOR_PROXY_SOCKS4)
+	{
+		conn->refs++;
+		g_resolver_lookup_by_name_async (G_RESOLVER (source), conn->opts.host,
+													conn->cancellable, connector_socks4_resolved, conn);
+		return;
+	}
+
+	connector_resolve_done (conn);
+}
+
+static void
+connector_resolve (connector *conn)
+{
+	GResolver *resolver = g_resolver_get_default ();
+	const char *host = conn->opts.host;
+
+	conn->connect_port = conn->opts.port;
+	if (conn->opts.proxy_type != CONNECTOR_PROXY_NONE)
+	{
+		host = conn->opts.proxy_host;
+		conn->connect_port = conn->opts.proxy_port;
+
+		conn->refs++;
+		conn->cb.lookup (conn->data, host);
+		if (!connector_release (conn))
+		{
+			g_object_unref (resolver);
+			return;
+		}
+	}
+
+	conn->refs++;
+	g_resolver_lookup_by_name_async (resolver, host, conn->cancellable, connector_resolved, conn);
+	g_object_unref (resolver);
+}
+
+/* ============================ TCP ============================ */
+
+static void
+connector_tcp_done (connector *conn)
+{
+	gint64 now = g_get_monotonic_time ();
+	int sok = conn->sok;
+
+	/* close the attempts that lost */
+	conn->sok = -1;
+	connector_stop (conn);
+	conn->sok = sok;
+
+	conn->times[CONNECTOR_PHASE_TCP] = now - conn->mark;
+	conn->mark = now;
+
+	if (conn->opts.proxy_type == CONNECTOR_PROXY_NONE)
+	{
+		connector_finish (conn);
+		return;
+	}
+
+	conn->step = STEP_START;
+	connector_proxy_step (conn);
+}
+
+static gboolean
+connector_attempt_ready (GIOChannel *source, GIOCondition condition, connector_attempt *attempt)
+{
+	connector *conn = attempt->conn;
+	socklen_t len = sizeof (int);
+	int err = 0;
+
+	if (getsockopt (attempt->sok, SOL_SOCKET, SO_ERROR, (char *) &err, &len) != 0)
+		err = sock_error ();
+
+	conn->attempts = g_slist_remove (conn->attempts, attempt);
+
+	if (err == 0)
+	{
+		conn->sok = attempt->sok;
+		connector_attempt_free (attempt, FALSE);
+		connector_tcp_done (conn);
+		return TRUE;
+	}
+
+	conn->last_error = err;
+	connector_attempt_free (attempt, TRUE);
+
+	/* don't wait for the timer, the next address can go right away */
+	if (conn->attempt_tag)
+	{
+		fe_timeout_remove (conn->attempt_tag);
+		conn->attempt_tag = 0;
+	}
+	connector_connect_next (conn);
+	return TRUE;
+}
+
+static int
+connector_attempt_timeout (connector *conn)
+{
+	conn->attempt_tag = 0;
+	connector_connect_next (conn);
+	return 0;
+}
+
+/* 1: connected at once (conn->sok is set), 0: in progress, -1: failed */
+static int
+connector_attempt_start (connector *conn, GInetAddress *addr)
+{
+	struct sockaddr_storage native, local;
+	GSocketAddress *sockaddr;
+	connector_attempt *attempt;
+	int sok, family;
+	socklen_t len;
+
+	sockaddr = g_inet_socket_address_new (addr, conn->connect_port);
+	len = g_socket_address_get_native_size (sockaddr);
+	g_socket_address_to_native (sockaddr, &native, sizeof (native), NULL);
+	g_object_unref (sockaddr);
+
+	family = native.ss_family;
+	sok = net_socket (family);
+	if (sok == -1)
+	{
+		conn->last_error = sock_error ();
+		return -1;
+	}
+	set_nonblocking (sok);
+
+	if (conn->local && g_socket_address_get_family (conn->local) == (GSocketFamily) family)
+	{
+		g_socket_address_to_native (conn->local, &local, sizeof (local), NULL);
+		bind (sok, (struct sockaddr *) &local, g_socket_address_get_native_size (conn->local));
+	}
+
+	if (connect (sok, (struct sockaddr *) &native, len) == 0)
+	{
+		conn->sok = sok;
+		return 1;
+	}
+
+	if (!connect_in_progress ())
+	{
+		conn->last_error = sock_error ();
+		closesocket (sok);
+		return -1;
+	}
+
+	attempt = g_new0 (connector_attempt, 1);
+	attempt->conn = conn;
+	attempt->sok = sok;
+	attempt->tag = fe_input_add (sok, FIA_WRITE|FIA_EX, connector_attempt_ready, attempt);
+	conn->attempts = g_slist_prepend (conn->attempts, attempt);
+	return 0;
+}
+
+static void
+connector_connect_next (connector *conn)
+{
+	GInetAddress *addr;
+
+	while (conn->next_addr)
+	{
+		addr = conn->next_addr->data;
+		conn->next_addr = conn->next_addr->next;
+
+		switch (connector_attempt_start (conn, addr))
+		{
+		case 1:
+			connector_tcp_done (conn);
+			return;
+		case 0:
+			/* give it a head start before the next one joins the race */
+			if (conn->next_addr)
+				conn->attempt_tag = fe_timeout_add (CONNECTOR_ATTEMPT_DELAY,
+																connector_attempt_timeout, conn);
+			return;
+		}
+	}
+
+	if (!conn->attempts)
+		connector_fail (conn, CONNECTOR_ERR_CONNECT, conn->last_error);
+}
+
+/* =========================== proxy =========================== */
+
+static void
+connector_proxy_fail (connector *conn, const char *message)
+{
+	if (message)
+	{
+		conn->refs++;
+		conn->cb.message (conn->data, message);
+		if (!connector_release (conn))
+			return;
+	}
+
+	connector_fail (conn, CONNECTOR_ERR_PROXY, 0);
+}
+
+static gboolean
+connector_proxy_io (GIOChannel *source, GIOCondition condition, connector *conn)
+{
+	gboolean socks = conn->opts.proxy_type == CONNECTOR_PROXY_SOCKS4 ||
+						  conn->opts.proxy_type == CONNECTOR_PROXY_SOCKS5;
+	int n, want;
+
+	if (conn->outused < conn->outlen)
+	{
+		n = send (conn->sok, (char *) conn->out + conn->outused, conn->outlen - conn->outused, 0);
+		if (n < 0)
+		{
+			if (!would_block ())
+				connector_proxy_fail (conn, NULL);
+			return TRUE;
+		}
+
+		conn->outused += n;
+		if (conn->outused < conn->outlen)
+			return TRUE;
+
+		fe_input_remove (conn->iotag);
+		conn->iotag = 0;
+		if (conn->want == 0)
+			connector_proxy_step (conn);
+		else
+			conn->iotag = fe_input_add (conn->sok, FIA_READ|FIA_EX, connector_proxy_io, conn);
+		return TRUE;
+	}
+
+	/* a line is read a byte at a time, so nothing after it is taken */
+	want = conn->want < 0 ? conn->inlen + 1 : conn->want;
+	n = recv (conn->sok, (char *) conn->in + conn->inlen, want - conn->inlen, 0);
+	if (n < 0 && would_block ())
+		return TRUE;
+	if (n <= 0)
+	{
+		connector_proxy_fail (conn, socks ? "SOCKS\tRead error from server.\n" : NULL);
+		return TRUE;
+	}
+
+	conn->inlen += n;
+	if (conn->want < 0)
+	{
+		if (conn->in[conn->inlen - 1] != '\n' && conn->inlen < sizeof (conn->in) - 1)
+			return TRUE;
+		conn->in[conn->inlen] = 0;
+	}
+	else if (conn->inlen < conn->want)
+	{
+		return TRUE;
+	}
+
+	connector_proxy_step (conn);
+	return TRUE;
+}
+
+/* send the first len bytes of conn->out, then read 'want' bytes of reply
+ * (-1: a line, 0: nothing) and carry on at 'step' */
+static void
+connector_proxy_send (connector *conn, int len, int want, int step)
+{
+	conn->outlen = len;
+	conn->outused = 0;
+	conn->inlen = 0;
+	conn->want = want;
+	conn->step = step;
+
+	if (conn->iotag)
+		fe_input_remove (conn->iotag);
+	conn->iotag = fe_input_add (conn->sok, FIA_WRITE|FIA_EX, connector_proxy_io, conn);
+}
+
+/* read on until 'want' bytes of this reply are in (-1: the next line) */
+static void
+connector_proxy_read (connector *conn, int want, int step)
+{
+	if (want < 0)
+		conn->inlen = 0;
+	conn->want = want;
+	conn->step = step;
+}
+
+static gboolean
+connector_proxy_auth (connector *conn)
+{
+	return conn->opts.proxy_user && conn->opts.proxy_user[0] &&
+			 conn->opts.proxy_pass && conn->opts.proxy_pass[0];
+}
+
+static void
+connector_wingate_step (connector *conn)
+{
+	int len;
+
+	if (conn->step == STEP_START)
+	{
+		len = g_snprintf ((char *) conn->out, sizeof (conn->out), "%s %d\r\n",
+								conn->opts.host, conn->opts.port);
+		connector_proxy_send (conn, MIN (len, sizeof (conn->out) - 1), 0, STEP_DONE);
+		return;
+	}
+
+	connector_finish (conn);
+}
+
+static void
+connector_socks4_step (connector *conn)
+{
+	char buf[128];
+	int len;
+
+	if (conn->step == STEP_START)
+	{
+		conn->out[0] = 4;	/* version */
+		conn->out[1] = 1;	/* connect */
+		conn->out[2] = conn->opts.port >> 8;
+		conn->out[3] = conn->opts.port & 0xff;
+		memcpy (conn->out + 4, conn->socks4_addr, 4);
+		len = g_strlcpy ((char *) conn->out + 8, conn->opts.username ? conn->opts.username : "", 10);
+		connector_proxy_send (conn, 8 + MIN (len, 9) + 1, 8, STEP_REPLY);
+		return;
+	}
+
+	if (conn->in[1] != 90)
+	{
+		g_snprintf (buf, sizeof (buf), "SOCKS\tServer reported error %d,%d.\n", conn->in[0], conn->in[1]);
+		connector_proxy_fail (conn, buf);
+		return;
+	}
+
+	connector_finish (conn);
+}
+
+static void
+connector_socks5_connect (connector *conn)
+{
+	int len = MIN (strlen (conn->opts.host), 255);
+
+	conn->out[0] = 5;	/* version */
+	conn->out[1] = 1;	/* connect */
+	conn->out[2] = 0;	/* reserved */
+	conn->out[3] = 3;	/* address type: host name */
+	conn->out[4] = len;
+	memcpy (conn->out + 5, conn->opts.host, len);
+	conn->out[5 + len] = conn->opts.port >> 8;
+	conn->out[6 + len] = conn->opts.port & 0xff;
+	connector_proxy_send (conn, 7 + len, 4, STEP_SOCKS5_CONNECT);
+}
+
+static void
+connector_socks5_step (connector *conn)
+{
+	char buf[128];
+	int len_u, len_p;
+
+	switch (conn->step)
+	{
+	case STEP_START:
+		conn->out[0] = 5;	/* version */
+		conn->out[1] = 1;	/* one method: */
+		conn->out[2] = connector_proxy_auth (conn) ? 2 : 0;	/* username/password (RFC1929) or none */
+		connector_proxy_send (conn, 3, 2, STEP_SOCKS5_METHOD);
+		break;
+
+	case STEP_SOCKS5_METHOD:
+		if (conn->in[0] != 5)
+		{
+			connector_proxy_fail (conn, "SOCKS\tServer is not socks version 5.\n");
+			break;
+		}
+		if (conn->in[1] == 0)	/* no auth required */
+		{
+			connector_socks5_connect (conn);
+			break;
+		}
+		if (!connector_proxy_auth (conn))
+		{
+			connector_proxy_fail (conn, "SOCKS\tAuthentication required but disabled in settings.\n");
+			break;
+		}
+		if (conn->in[1] != 2)
+		{
+			connector_proxy_fail (conn, "SOCKS\tServer doesn't support UPA authentication.\n");
+			break;
+		}
+
+		len_u = MIN (strlen (conn->opts.proxy_user), 255);
+		len_p = MIN (strlen (conn->opts.proxy_pass), 255);
+		conn->out[0] = 1;
+		conn->out[1] = len_u;
+		memcpy (conn->out + 2, conn->opts.proxy_user, len_u);
+		conn->out[2 + len_u] = len_p;
+		memcpy (conn->out + 3 + len_u, conn->opts.proxy_pass, len_p);
+		connector_proxy_send (conn, 3 + len_u + len_p, 2, STEP_SOCKS5_AUTH);
+		break;
+
+	case STEP_SOCKS5_AUTH:
+		if (conn->in[1] != 0)
+		{
+			connector_proxy_fail (conn, "SOCKS\tAuthentication failed. "
+										 "Is username and password correct?\n");
+			break;
+		}
+		connector_socks5_connect (conn);
+		break;
+
+	case STEP_SOCKS5_CONNECT:
+		if (conn->in[0] != 5 || conn->in[1] != 0)
+		{
+			if (conn->in[1] == 2)
+				g_snprintf (buf, sizeof (buf), "SOCKS\tProxy refused to connect to host (not allowed).\n");
+			else
+				g_snprintf (buf, sizeof (buf), "SOCKS\tProxy failed to connect to host (error %d).\n", conn->in[1]);
+			connector_proxy_fail (conn, buf);
+			break;
+		}
+
+		/* consume all of the reply, the bound address and port end it */
+		switch (conn->in[3])
+		{
+		case 1:	/* IPv4 */
+			connector_proxy_read (conn, 4 + 4 + 2, STEP_REPLY);
+			break;
+		case 4:	/* IPv6 */
+			connector_proxy_read (conn, 4 + 16 + 2, STEP_REPLY);
+			break;
+		case 3:	/* host name, the first byte is its length */
+			connector_proxy_read (conn, 4 + 1, STEP_SOCKS5_NAME);
+			break;
+		default:
+			connector_proxy_fail (conn, "SOCKS\tRead error from server.\n");
+		}
+		break;
+
+	case STEP_SOCKS5_NAME:
+		connector_proxy_read (conn, 4 + 1 + conn->in[4] + 2, STEP_REPLY);
+		break;
+
+	case STEP_REPLY:
+		connector_finish (conn);
+		break;
+	}
+}
+
+static void
+connector_http_step (connector *conn)
+{
+	char auth[256], *encoded;
+	int n, len;
+
+	if (conn->step == STEP_START)
+	{
+		n = g_snprintf ((char *) conn->out, sizeof (conn->out), "CONNECT %s:%d HTTP/1.0\r\n",
+							 conn->opts.host, conn->opts.port);
+		if (conn->opts.proxy_user)
+		{
+			len = g_snprintf (auth, sizeof (auth), "%s:%s", conn->opts.proxy_user,
+									conn->opts.proxy_pass ? conn->opts.proxy_pass : "");
+			encoded = g_base64_encode ((guchar *) auth, MIN (len, sizeof (auth) - 1));
+			n += g_snprintf ((char *) conn->out + n, sizeof (conn->out) - n,
+								  "Proxy-Authorization: Basic %s\r\n", encoded);
+			g_free (encoded);
+		}
+		n += g_snprintf ((char *) conn->out + n, sizeof (conn->out) - n, "\r\n");
+		connector_proxy_send (conn, MIN (n, sizeof (conn->out) - 1), -1, STEP_HTTP_STATUS);
+		return;
+	}
+
+	/* show what the proxy says, like any other server message */
+	g_strchomp ((char *) conn->in);
+	g_strlcat ((char *) conn->in, "\n", sizeof (conn->in));
+	conn->refs++;
+	conn->cb.message (conn->data, (char *) conn->in);
+	if (!connector_release (conn))
+		return;
+
+	if (conn->step == STEP_HTTP_STATUS)
+	{
+		/* "HTTP/1.0 200 OK" */
+		if (strlen ((char *) conn->in) < 13 || memcmp (conn->in, "HTTP/", 5) ||
+			 memcmp (conn->in + 9, "200", 3))
+		{
+			connector_proxy_fail (conn, NULL);
+			return;
+		}
+	}
+	else if (conn->in[0] == '\n')
+	{
+		/* a blank line ends the headers */
+		connector_finish (conn);
+		return;
+	}
+
+	connector_proxy_read (conn, -1, STEP_HTTP_HEADER);
+}
+
+static void
+connector_proxy_step (connector *conn)
+{
+	switch (conn->opts.proxy_type)
+	{
+	case CONNECTOR_PROXY_WINGATE:
+		connector_wingate_step (conn);
+		break;
+	case CONNECTOR_PROXY_SOCKS4:
+		connector_socks4_step (conn);
+		break;
+	case CONNECTOR_PROXY_SOCKS5:
+		connector_socks5_step (conn);
+		break;
+	case CONNECTOR_PROXY_HTTP:
+		connector_http_step (conn);
+		break;
+	default:
+		connector_proxy_fail (conn, NULL);
+	}
+}
+
+/* ============================================================= */
+
+/* the lookups run one after the other: bind address, proxy, server */
+static gboolean
+connector_start (connector *conn)
+{
+	GResolver *resolver;
+
+	if (!connector_release (conn))
+		return FALSE;
+
+	if (conn->opts.bind_host && conn->opts.bind_host[0])
+	{
+		resolver = g_resolver_get_default ();
+		conn->refs++;
+		g_resolver_lookup_by_name_async (resolver, conn->opts.bind_host, conn->cancellable,
+													connector_bind_resolved, conn);
+		g_object_unref (resolver);
+		return FALSE;
+	}
+
+	connector_find_proxy (conn);
+	return FALSE;
+}
+
+connector *
+connector_new (const connector_options *opts, const connector_callbacks *cb, void *data)
+{
+	connector *conn;
+
+	conn = g_new0 (connector, 1);
+	conn->opts.host = g_strdup (opts->host);
+	conn->opts.port = opts->port;
+	conn->opts.bind_host = g_strdup (opts->bind_host);
+	conn->opts.proxy_type = opts->proxy_type;
+	conn->opts.proxy_host = g_strdup (opts->proxy_host);
+	conn->opts.proxy_port = opts->proxy_port;
+	conn->opts.proxy_user = g_strdup (opts->proxy_user);
+	conn->opts.proxy_pass = g_strdup (opts->proxy_pass);
+	conn->opts.username = g_strdup (opts->username);
+	conn->cb = *cb;
+	conn->data = data;
+	conn->refs = 1;
+	conn->cancellable = g_cancellable_new ();
+	conn->sok = -1;
+	conn->mark = g_get_monotonic_time ();
+
+	/* start from the main loop, so no callback comes before the caller
+	 * has the connector */
+	conn->refs++;
+	fe_idle_add (connector_start, conn);
+
+	return conn;
+}
+
+/* stop the attempt; safe to call from any of the callbacks */
+void
+connector_free (connector *conn)
+{
+	if (!conn)
+		return;
+
+	conn->cancelled = TRUE;
+	g_cancellable_cancel (conn->cancellable);
+	connector_stop (conn);
+	connector_release (conn);
+}
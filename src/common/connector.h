@@ -0,0 +1,90 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef ZOITECHAT_CONNECTOR_H
+#define ZOITECHAT_CONNECTOR_H
+
+#include <glib.h>
+
+/* Sets up the TCP connection to a server without leaving the main loop.
+ * Names are looked up with GResolver, the addresses of both families are
+ * raced as RFC 8305 (Happy Eyeballs) describes and a proxy, if any, is
+ * traversed with non-blocking reads and writes. */
+
+typedef enum
+{
+	CONNECTOR_PHASE_DNS,
+	CONNECTOR_PHASE_TCP,
+	CONNECTOR_PHASE_PROXY,
+	CONNECTOR_PHASE_TLS,		/* not done here, left for the caller */
+	CONNECTOR_PHASES
+} connector_phase;
+
+/* same numbering as prefs.hex_net_proxy_type */
+typedef enum
+{
+	CONNECTOR_PROXY_NONE,
+	CONNECTOR_PROXY_WINGATE,
+	CONNECTOR_PROXY_SOCKS4,
+	CONNECTOR_PROXY_SOCKS5,
+	CONNECTOR_PROXY_HTTP,
+	CONNECTOR_PROXY_AUTO		/* ask the system's GProxyResolver */
+} connector_proxy;
+
+typedef enum
+{
+	CONNECTOR_ERR_RESOLVE,	/* unknown host */
+	CONNECTOR_ERR_CONNECT,	/* no address could be connected to */
+	CONNECTOR_ERR_PROXY		/* proxy traversal failed */
+} connector_error;
+
+typedef struct
+{
+	const char *host;
+	int port;
+	const char *bind_host;	/* NULL: don't bind */
+	connector_proxy proxy_type;
+	const char *proxy_host;
+	int proxy_port;
+	const char *proxy_user;	/* NULL: no proxy authentication */
+	const char *proxy_pass;
+	const char *username;	/* for SOCKS4 */
+} connector_options;
+
+/* Every callback may free the connector. After connected () or failed ()
+ * nothing else is called and the connector only waits to be freed.
+ * connected () hands over the socket along with the microseconds spent
+ * in each connector_phase. */
+typedef struct
+{
+	void (*lookup) (void *data, const char *host);	/* looking up the proxy */
+	void (*bound) (void *data, const char *ip);		/* NULL if bind_host is unknown */
+	void (*resolved) (void *data, const char *host, const char *ip, int port);
+	void (*message) (void *data, const char *text);	/* what the proxy said */
+	void (*connected) (void *data, int sok, const gint64 *times);
+	void (*failed) (void *data, connector_error error, int sock_err);
+} connector_callbacks;
+
+typedef struct connector connector;
+
+connector *connector_new (const connector_options *opts, const connector_callbacks *cb, void *data);
+void connector_free (connector *conn);
+GList *connector_order_addresses (GList *addrs);
+
+#endif
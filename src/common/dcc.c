@@ -25,6 +25,7 @@
 
 /* Required to make lseek use off64_t, but doesn't work on Windows */
 #define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE	/* for fallocate */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -63,6 +64,9 @@
 	#define lseek _lseeki64
 #endif
 
+/* how long a receive holds back an ack, waiting for more data */
+#define DCC_ACK_DELAY 20
+
 /* interval timer to detect timeouts */
 static int timeout_timer = 0;
 
@@ -412,6 +416,16 @@ dcc_close (struct DCC *dcc, enum dcc_state dccstat, int destroy)
 		dcc->dccchat = NULL;
 	}
 
+	if (dcc->acktag)
+	{
+		fe_timeout_remove (dcc->acktag);
+		dcc->acktag = 0;
+	}
+
+	g_free (dcc->iobuf);
+	dcc->iobuf = NULL;
+	dcc->iobuf_size = 0;
+
 	if (destroy)
 	{
 		dcc_list = g_slist_remove (dcc_list, dcc);
@@ -642,12 +656,96 @@ dcc_calc_average_cps (struct DCC *dcc)
 		dcc->cps = (dcc->pos - dcc->resumable) / sec;
 }
 
+static void
+dcc_iobuf_reserve (struct DCC *dcc, int size)
+{
+	if (dcc->iobuf_size < size)
+	{
+		g_free (dcc->iobuf);
+		dcc->iobuf = g_malloc (size);
+		dcc->iobuf_size = size;
+	}
+}
+
 static void
 dcc_send_ack (struct DCC *dcc)
 {
 	/* send in 32-bit big endian */
 	guint32 pos = htonl (dcc->pos & 0xffffffff);
 	send (dcc->sok, (char *) &pos, 4, 0);
+	dcc->ack = dcc->pos;
+
+	if (dcc->acktag)
+	{
+		fe_timeout_remove (dcc->acktag);
+		dcc->acktag = 0;
+	}
+}
+
+/* Nothing arrived since the last read and the ack was held back: the
+ * sender waits for acks before sending more (no "fast send"), so from
+ * now on ack after every read as the protocol expects. */
+
+static int
+dcc_ack_timeout (struct DCC *dcc)
+{
+	dcc->acktag = 0;
+	dcc->ack_waited = TRUE;
+	if (dcc->ack < dcc->pos)
+		dcc_send_ack (dcc);
+	return 0;
+}
+
+/* The socket is drained: ack now, or once dcc_ack_interval bytes have
+ * come in for senders that don't wait on us. */
+
+static void
+dcc_read_ack (struct DCC *dcc)
+{
+	if (dcc->ack >= dcc->pos)
+		return;
+
+	if (dcc->ack_waited || prefs.hex_dcc_ack_interval <= 0 ||
+		 dcc->pos - dcc->ack >= (guint64) prefs.hex_dcc_ack_interval)
+	{
+		dcc_send_ack (dcc);
+	}
+	else if (!dcc->acktag)
+	{
+		dcc->acktag = fe_timeout_add (DCC_ACK_DELAY, dcc_ack_timeout, dcc);
+	}
+}
+
+/* write out what's been received so far, in one go */
+
+static gboolean
+dcc_read_flush (struct DCC *dcc, int *fill)
+{
+	int done = 0, n;
+
+	while (done < *fill)
+	{
+		n = write (dcc->fp, dcc->iobuf + done, *fill - done);
+		if (n == -1) /* could be out of hdd space */
+			return FALSE;
+		done += n;
+		dcc->pos += n;
+	}
+
+	*fill = 0;
+	return TRUE;
+}
+
+/* reserve the disk space of a new download up front, to keep it in one
+ * piece. The file size is left alone since resuming goes by it. */
+
+static void
+dcc_preallocate (struct DCC *dcc)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	if (prefs.hex_dcc_preallocate && dcc->size > dcc->pos)
+		fallocate (dcc->fp, FALLOC_FL_KEEP_SIZE, dcc->pos, dcc->size - dcc->pos);
+#endif
 }
 
 static gboolean
@@ -655,8 +753,7 @@ dcc_read (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 {
 	char *old;
 	char buf[4096];
-	int n;
-	gboolean need_ack = FALSE;
+	int n, fill = 0, bufsize;
 
 	if (dcc->fp == -1)
 	{
@@ -699,6 +796,9 @@ dcc_read (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 			dcc->fp = g_open (filename_fs, OFLAGS | O_TRUNC | O_WRONLY | O_CREAT, prefs.hex_dcc_permissions);
 			g_free (filename_fs);
 		}
+
+		if (dcc->fp != -1)
+			dcc_preallocate (dcc);
 	}
 	if (dcc->fp == -1)
 	{
@@ -708,11 +808,17 @@ dcc_read (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 		dcc_close (dcc, STAT_FAILED, FALSE);
 		return TRUE;
 	}
+
+	bufsize = CLAMP (prefs.hex_dcc_recv_bufsize, 4096, 4 * 1024 * 1024);
+	dcc_iobuf_reserve (dcc, bufsize);
+
 	while (1)
 	{
 		if (dcc->throttled)
 		{
-			if (need_ack)
+			if (!dcc_read_flush (dcc, &fill))
+				goto writeerr;
+			if (dcc->ack < dcc->pos)
 				dcc_send_ack (dcc);
 
 			fe_input_remove (dcc->iotag);
@@ -723,18 +829,21 @@ dcc_read (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 		if (!dcc->iotag)
 			dcc->iotag = fe_input_add (dcc->sok, FIA_READ|FIA_EX, dcc_read, dcc);
 
-		n = recv (dcc->sok, buf, sizeof (buf), 0);
+		n = recv (dcc->sok, dcc->iobuf + fill, bufsize - fill, 0);
 		if (n < 1)
 		{
 			if (n < 0)
 			{
 				if (would_block ())
 				{
-					if (need_ack)
-						dcc_send_ack (dcc);
+					if (!dcc_read_flush (dcc, &fill))
+						goto writeerr;
+					dcc_read_ack (dcc);
 					return TRUE;
 				}
 			}
+			/* keep what did arrive, it can be resumed */
+			dcc_read_flush (dcc, &fill);
 			EMIT_SIGNAL (XP_TE_DCCRECVERR, dcc->serv->front_session, dcc->file,
 							 dcc->destfile, dcc->nick,
 							 errorstring ((n < 0) ? sock_error () : 0), 0);
@@ -742,20 +851,23 @@ dcc_read (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 			return TRUE;
 		}
 
-		if (write (dcc->fp, buf, n) == -1) /* could be out of hdd space */
+		dcc->lasttime = time (0);
+		fill += n;
+
+		if (fill == bufsize || dcc->pos + fill >= dcc->size)
 		{
-			EMIT_SIGNAL (XP_TE_DCCRECVERR, dcc->serv->front_session, dcc->file,
-							 dcc->destfile, dcc->nick, errorstring (errno), 0);
-			if (need_ack)
-				dcc_send_ack (dcc);
-			dcc_close (dcc, STAT_FAILED, FALSE);
-			return TRUE;
+			if (!dcc_read_flush (dcc, &fill))
+			{
+writeerr:
+				EMIT_SIGNAL (XP_TE_DCCRECVERR, dcc->serv->front_session, dcc->file,
+								 dcc->destfile, dcc->nick, errorstring (errno), 0);
+				if (dcc->ack < dcc->pos)
+					dcc_send_ack (dcc);
+				dcc_close (dcc, STAT_FAILED, FALSE);
+				return TRUE;
+			}
 		}
 
-		dcc->lasttime = time (0);
-		dcc->pos += n;
-		need_ack = TRUE;	/* send ack when we're done recv()ing */
-
 		if (dcc->pos >= dcc->size)
 		{
 			dcc_send_ack (dcc);
@@ -1406,8 +1518,7 @@ dcc_connect (struct DCC *dcc)
 static gboolean
 dcc_send_data (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 {
-	char *buf;
-	int len, sent, sok = dcc->sok;
+	int sent, sok = dcc->sok;
 
 	if (prefs.hex_dcc_blocksize < 1) /* this is too little! */
 		prefs.hex_dcc_blocksize = 1024;
@@ -1430,18 +1541,14 @@ dcc_send_data (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 	else if (!dcc->wiotag)
 		dcc->wiotag = fe_input_add (sok, FIA_WRITE, dcc_send_data, dcc);
 
-	buf = g_malloc (prefs.hex_dcc_blocksize);
+	/* only used where the file can't go to the socket directly */
+	dcc_iobuf_reserve (dcc, prefs.hex_dcc_blocksize);
 
-	lseek (dcc->fp, dcc->pos, SEEK_SET);
-	len = read (dcc->fp, buf, prefs.hex_dcc_blocksize);
-	if (len < 1)
-		goto abortit;
-	sent = send (sok, buf, len, 0);
+	sent = net_send_file (sok, dcc->fp, dcc->pos, prefs.hex_dcc_blocksize,
+								 dcc->iobuf, TRUE);
 
-	if (sent < 0 && !(would_block ()))
+	if (sent == 0 || (sent < 0 && !(would_block ())))
 	{
-abortit:
-		g_free (buf);
 		EMIT_SIGNAL (XP_TE_DCCSENDFAIL, dcc->serv->front_session,
 						 file_part (dcc->file), dcc->nick,
 						 errorstring (sock_error ()), NULL, 0);
@@ -1465,8 +1572,6 @@ abortit:
 		}
 	}
 
-	g_free (buf);
-
 	return TRUE;
 }
 
@@ -68,6 +68,10 @@ struct DCC
 	unsigned char ack_buf[4];	/* buffer for reading 4-byte ack */
 	int ack_pos;
 
+	char *iobuf;					/* file data between the socket and disk */
+	int iobuf_size;
+	int acktag;						/* deferred ack of a receive */
+
 	guint64 size;
 	guint64 resumable;
 	guint64 ack;
@@ -84,6 +88,7 @@ struct DCC
 	unsigned int fastsend:1;
 	unsigned int ackoffset:1;	/* is receiver sending acks as an offset from */
 										/* the resume point? */
+	unsigned int ack_waited:1;	/* sender stalled until acked, ack every read */
 	unsigned int throttled:2;	/* 0x1 = per send/get throttle
 											0x2 = global throttle */
 };
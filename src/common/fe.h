@@ -102,12 +102,19 @@ gboolean fe_ban_list_end (struct session *sess, int rplcode);
 void fe_notify_update (char *name);
 void fe_notify_ask (char *name, char *networks);
 void fe_text_clear (struct session *sess, int lines);
+/* describes the memory held by the session's scrollback, g_free() it */
+char *fe_text_memory (struct session *sess);
+/* describes the render work of the session's window, g_free() it */
+char *fe_text_render_stats (struct session *sess);
 void fe_close_window (struct session *sess);
 void fe_progressbar_start (struct session *sess);
 void fe_progressbar_end (struct server *serv);
 void fe_print_text (struct session *sess, char *text, time_t stamp,
 					gboolean no_activity);
+void fe_print_text_batch_start (struct session *sess, gboolean older);
+int fe_print_text_batch_end (struct session *sess);
 void fe_userlist_insert (struct session *sess, struct User *newuser, gboolean sel);
+void fe_userlist_insert_batch (struct session *sess, struct User **users, int count);
 int fe_userlist_remove (struct session *sess, struct User *user);
 void fe_userlist_rehash (struct session *sess, struct User *user);
 void fe_userlist_update (struct session *sess, struct User *user);
@@ -0,0 +1,125 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "framer.h"
+
+/* '\r' never makes it into a line, wherever the server put it */
+static int
+framer_strip_cr (char *line, int len)
+{
+	char *src, *dst, *end = line + len;
+
+	dst = memchr (line, '\r', len);
+	if (!dst)
+		return len;
+
+	for (src = dst; src < end; src++)
+	{
+		if (*src != '\r')
+			*dst++ = *src;
+	}
+	*dst = 0;
+
+	return dst - line;
+}
+
+/* add to the partial line, keeping room for the NUL */
+static void
+framer_append (char *linebuf, int linebuf_size, int *pos, const char *text, int len)
+{
+	if (*pos + len > linebuf_size - 1)
+	{
+		if (*pos < linebuf_size - 1)
+			fprintf (stderr, "*** ZOITECHAT WARNING: Buffer overflow - non-compliant server!\n");
+		len = MAX (0, linebuf_size - 1 - *pos);
+	}
+
+	memcpy (linebuf + *pos, text, len);
+	*pos += len;
+}
+
+void
+framer_feed (char *linebuf, int linebuf_size, int *pos,
+				 char *buf, int len, framer_line_func func, void *data)
+{
+	char *line = buf, *end = buf + len, *eol;
+	int line_len;
+
+	while ((eol = memchr (line, '\n', end - line)))
+	{
+		if (*pos)
+		{
+			/* finish the line the last read started */
+			framer_append (linebuf, linebuf_size, pos, line, eol - line);
+			linebuf[*pos] = 0;
+			line_len = framer_strip_cr (linebuf, *pos);
+			*pos = 0;
+			func (data, linebuf, line_len);
+		}
+		else
+		{
+			if (eol - line > linebuf_size - 1)
+			{
+				fprintf (stderr, "*** ZOITECHAT WARNING: Buffer overflow - non-compliant server!\n");
+				line_len = linebuf_size - 1;
+			}
+			else
+			{
+				line_len = eol - line;
+			}
+
+			line[line_len] = 0;
+			line_len = framer_strip_cr (line, line_len);
+			func (data, line, line_len);
+		}
+
+		line = eol + 1;
+	}
+
+	if (line < end)
+		framer_append (linebuf, linebuf_size, pos, line, end - line);
+}
+
+/* checks 8 bytes at a time; pure ASCII is valid UTF-8 as it is */
+gboolean
+framer_is_ascii (const char *text, gsize len)
+{
+	const unsigned char *p = (const unsigned char *) text;
+	const unsigned char *end = p + len;
+	guint64 word;
+
+	while (end - p >= 8)
+	{
+		memcpy (&word, p, 8);
+		if (word & G_GUINT64_CONSTANT (0x8080808080808080))
+			return FALSE;
+		p += 8;
+	}
+
+	while (p < end)
+	{
+		if (*p++ & 0x80)
+			return FALSE;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,36 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef ZOITECHAT_FRAMER_H
+#define ZOITECHAT_FRAMER_H
+
+#include <glib.h>
+
+/* Splits what a server sends into lines. Complete lines are handed to the
+ * callback NUL terminated and without "\r\n", straight from the buffer that
+ * was read into where possible; only a line split between two reads is
+ * copied, into linebuf. Lines longer than linebuf are truncated. */
+
+typedef void (*framer_line_func) (void *data, char *line, int len);
+
+void framer_feed (char *linebuf, int linebuf_size, int *pos,
+						char *buf, int len, framer_line_func func, void *data);
+gboolean framer_is_ascii (const char *text, gsize len);
+
+#endif
@@ -0,0 +1,268 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "zoitechat.h"
+#include "util.h"
+#include "hilight.h"
+
+struct hilight_set
+{
+	char *source;				/* the mask string this set was built from */
+	GHashTable *literals;	/* normalized masks without wildcards */
+	GPtrArray *wildcards;	/* normalized masks that need match() */
+};
+
+char *
+hilight_normalize_word (const char *text)
+{
+	GString *normalized;
+	char *composed;
+	const char *p;
+
+	composed = g_utf8_normalize (text, -1, G_NORMALIZE_ALL_COMPOSE);
+	if (!composed)
+		composed = g_strdup (text);
+
+	normalized = g_string_sized_new (strlen (composed));
+	p = composed;
+
+	while (*p)
+	{
+		gunichar ch = g_utf8_get_char ((const guchar *)p);
+
+		/* Ignore selector/joiner codepoints that vary by input method. */
+		if (ch != 0x200D && ch != 0xFE0E && ch != 0xFE0F)
+			g_string_append_unichar (normalized, ch);
+
+		p = g_utf8_next_char (p);
+	}
+
+	g_free (composed);
+	return g_string_free (normalized, FALSE);
+}
+
+/* NFKC leaves plain ASCII untouched, so most words never need a copy. */
+static gboolean
+hilight_is_ascii (const char *text)
+{
+	const unsigned char *p;
+
+	for (p = (const unsigned char *)text; *p; p++)
+	{
+		if (*p & 0x80)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Returns the unescaped mask if it has no wildcards, else NULL.
+ * Follows the escaping rules of match(): only "\*" and "\?" are escapes. */
+static char *
+hilight_mask_literal (const char *mask)
+{
+	GString *literal;
+	const char *p;
+
+	literal = g_string_sized_new (strlen (mask));
+
+	for (p = mask; *p; p++)
+	{
+		if (*p == '*' || *p == '?')
+		{
+			g_string_free (literal, TRUE);
+			return NULL;
+		}
+
+		if (*p == '\\' && (p[1] == '*' || p[1] == '?'))
+			p++;
+
+		g_string_append_c (literal, *p);
+	}
+
+	return g_string_free (literal, FALSE);
+}
+
+static guint
+hilight_hash (gconstpointer key)
+{
+	return str_ihash ((const unsigned char *)key);
+}
+
+static gboolean
+hilight_equal (gconstpointer a, gconstpointer b)
+{
+	return rfc_casecmp (a, b) == 0;
+}
+
+hilight_set *
+hilight_set_new (const char *masks)
+{
+	hilight_set *set;
+	char **tokens;
+	char *normalized;
+	char *literal;
+	int i;
+
+	set = g_new0 (hilight_set, 1);
+	set->source = g_strdup (masks);
+	set->literals = g_hash_table_new_full (hilight_hash, hilight_equal, g_free, NULL);
+	set->wildcards = g_ptr_array_new_with_free_func (g_free);
+
+	tokens = g_strsplit_set (masks, " ,", -1);
+	for (i = 0; tokens[i]; i++)
+	{
+		g_strchug (tokens[i]);
+
+		/* an empty mask could only ever match an empty word */
+		if (!tokens[i][0])
+			continue;
+
+		normalized = hilight_normalize_word (tokens[i]);
+		literal = hilight_mask_literal (normalized);
+		if (literal)
+		{
+			g_hash_table_add (set->literals, literal);
+			g_free (normalized);
+		}
+		else
+		{
+			g_ptr_array_add (set->wildcards, normalized);
+		}
+	}
+	g_strfreev (tokens);
+
+	return set;
+}
+
+void
+hilight_set_free (hilight_set *set)
+{
+	if (!set)
+		return;
+
+	g_hash_table_destroy (set->literals);
+	g_ptr_array_free (set->wildcards, TRUE);
+	g_free (set->source);
+	g_free (set);
+}
+
+const char *
+hilight_set_get_source (const hilight_set *set)
+{
+	return set->source;
+}
+
+static gboolean
+hilight_set_is_empty (const hilight_set *set)
+{
+	return g_hash_table_size (set->literals) == 0 && set->wildcards->len == 0;
+}
+
+gboolean
+hilight_set_match_word (const hilight_set *set, const char *word)
+{
+	char *normalized = NULL;
+	const char *key = word;
+	gboolean res;
+	guint i;
+
+	if (!word[0] || hilight_set_is_empty (set))
+		return FALSE;
+
+	if (!hilight_is_ascii (word))
+	{
+		normalized = hilight_normalize_word (word);
+		key = normalized;
+	}
+
+	res = g_hash_table_contains (set->literals, key);
+
+	for (i = 0; !res && i < set->wildcards->len; i++)
+		res = match (g_ptr_array_index (set->wildcards, i), key);
+
+	g_free (normalized);
+	return res;
+}
+
+gboolean
+hilight_set_match_text (const hilight_set *set, char *text)
+{
+	unsigned char *p = text;
+	unsigned char endchar;
+	gunichar ch;
+	GUnicodeType ch_type;
+	int res;
+
+	if (hilight_set_is_empty (set))
+		return FALSE;
+
+	while (1)
+	{
+		ch = g_utf8_get_char (p);
+		ch_type = g_unichar_type (ch);
+
+		if (g_unichar_isdigit (ch) || g_unichar_isalpha (ch))
+		{
+			p += g_utf8_skip [p[0]];
+			continue;
+		}
+
+		/* if it's RFC1459 <special>, it can be inside a word */
+		switch (ch)
+		{
+		case '-': case '[': case ']': case '\\':
+		case '`': case '^': case '{': case '}':
+		case '_': case '|':
+			p += g_utf8_skip [p[0]];
+			continue;
+		}
+
+		/* Symbols (including emoji) can be part of highlighted words. */
+		if (ch_type == G_UNICODE_MATH_SYMBOL ||
+			 ch_type == G_UNICODE_CURRENCY_SYMBOL ||
+			 ch_type == G_UNICODE_MODIFIER_SYMBOL ||
+			 ch_type == G_UNICODE_OTHER_SYMBOL)
+		{
+			p += g_utf8_skip [p[0]];
+			continue;
+		}
+
+		/* Delimiters end the word. */
+		if (*p == 0 || g_unichar_isspace (ch) || g_unichar_ispunct (ch) ||
+			 g_unichar_iscntrl (ch))
+		{
+			endchar = *p;
+			*p = 0;
+			res = hilight_set_match_word (set, text);
+			*p = endchar;
+
+			if (res)
+				return TRUE;	/* yes, matched! */
+
+			text = p + g_utf8_skip [p[0]];
+			if (*p == 0)
+				return FALSE;
+		}
+
+		p += g_utf8_skip [p[0]];
+	}
+}
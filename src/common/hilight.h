@@ -0,0 +1,39 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef ZOITECHAT_HILIGHT_H
+#define ZOITECHAT_HILIGHT_H
+
+#include <glib.h>
+
+/* A list of alert masks (separated by commas and spaces), normalized once.
+ * Masks without wildcards are kept in a hash table so that matching a word
+ * costs a single lookup no matter how many of them there are; only masks
+ * containing '*' or '?' are tried one by one with match(). */
+typedef struct hilight_set hilight_set;
+
+hilight_set *hilight_set_new (const char *masks);
+void hilight_set_free (hilight_set *set);
+const char *hilight_set_get_source (const hilight_set *set);
+gboolean hilight_set_match_word (const hilight_set *set, const char *word);
+gboolean hilight_set_match_text (const hilight_set *set, char *text);
+
+char *hilight_normalize_word (const char *text);
+
+#endif
@@ -0,0 +1,189 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "hooktable.h"
+
+struct hook_table
+{
+	GHashTable *names;	/* name -> GArray of hook_entry */
+	guint seq;				/* bumped for every hook added */
+};
+
+typedef struct
+{
+	int pri;
+	guint seq;
+	void *hook;
+} hook_entry;
+
+static guint
+hook_name_hash (gconstpointer key)
+{
+	const char *p;
+	guint h = 5381;
+
+	for (p = key; *p; p++)
+		h = (h << 5) + h + g_ascii_tolower (*p);
+
+	return h;
+}
+
+static gboolean
+hook_name_equal (gconstpointer a, gconstpointer b)
+{
+	return g_ascii_strcasecmp (a, b) == 0;
+}
+
+static void
+hook_bucket_free (gpointer bucket)
+{
+	g_array_free (bucket, TRUE);
+}
+
+hook_table *
+hook_table_new (void)
+{
+	hook_table *table;
+
+	table = g_new0 (hook_table, 1);
+	table->names = g_hash_table_new_full (hook_name_hash, hook_name_equal,
+													  g_free, hook_bucket_free);
+
+	return table;
+}
+
+void
+hook_table_free (hook_table *table)
+{
+	if (!table)
+		return;
+
+	g_hash_table_destroy (table->names);
+	g_free (table);
+}
+
+/* does entry a run before entry b? */
+static gboolean
+hook_entry_before (const hook_entry *a, const hook_entry *b)
+{
+	if (a->pri != b->pri)
+		return a->pri > b->pri;
+
+	return a->seq > b->seq;
+}
+
+void
+hook_table_add (hook_table *table, const char *name, int pri, void *hook)
+{
+	GArray *bucket;
+	hook_entry entry;
+	guint i;
+
+	bucket = g_hash_table_lookup (table->names, name);
+	if (!bucket)
+	{
+		bucket = g_array_new (FALSE, FALSE, sizeof (hook_entry));
+		g_hash_table_insert (table->names, g_strdup (name), bucket);
+	}
+
+	entry.pri = pri;
+	entry.seq = ++table->seq;
+	entry.hook = hook;
+
+	/* the newest entry goes before every other one of equal priority */
+	for (i = 0; i < bucket->len; i++)
+	{
+		if (g_array_index (bucket, hook_entry, i).pri <= pri)
+			break;
+	}
+	g_array_insert_val (bucket, i, entry);
+}
+
+void
+hook_table_remove (hook_table *table, const char *name, void *hook)
+{
+	GArray *bucket;
+	guint i;
+
+	bucket = g_hash_table_lookup (table->names, name);
+	if (!bucket)
+		return;
+
+	for (i = 0; i < bucket->len; i++)
+	{
+		if (g_array_index (bucket, hook_entry, i).hook == hook)
+		{
+			g_array_remove_index (bucket, i);
+			break;
+		}
+	}
+
+	if (bucket->len == 0)
+		g_hash_table_remove (table->names, name);
+}
+
+void *
+hook_table_first (hook_table *table, const char *name)
+{
+	GArray *bucket;
+
+	bucket = g_hash_table_lookup (table->names, name);
+	if (!bucket)
+		return NULL;
+
+	return g_array_index (bucket, hook_entry, 0).hook;
+}
+
+/* Stores the hooks registered under name and, if given, under also in the
+ * order they should run, up to max of them. Returns how many there are in
+ * total, so the caller can retry with a bigger array. */
+int
+hook_table_collect (hook_table *table, const char *name, const char *also,
+						  void **out, int max)
+{
+	GArray *a, *b;
+	guint i = 0, j = 0;
+	int n = 0;
+
+	a = g_hash_table_lookup (table->names, name);
+	b = also ? g_hash_table_lookup (table->names, also) : NULL;
+	if (b == a)
+		b = NULL;
+
+	while ((a && i < a->len) || (b && j < b->len))
+	{
+		hook_entry *entry;
+
+		if (!b || j >= b->len)
+			entry = &g_array_index (a, hook_entry, i++);
+		else if (!a || i >= a->len)
+			entry = &g_array_index (b, hook_entry, j++);
+		else if (hook_entry_before (&g_array_index (b, hook_entry, j),
+											 &g_array_index (a, hook_entry, i)))
+			entry = &g_array_index (b, hook_entry, j++);
+		else
+			entry = &g_array_index (a, hook_entry, i++);
+
+		if (n < max)
+			out[n] = entry->hook;
+		n++;
+	}
+
+	return n;
+}
@@ -0,0 +1,39 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef ZOITECHAT_HOOKTABLE_H
+#define ZOITECHAT_HOOKTABLE_H
+
+#include <glib.h>
+
+/* Plugin hooks of one kind, indexed by their (ASCII case-insensitive) name.
+ * Each name keeps its hooks ordered by priority, the most recently added
+ * first among equal priorities. */
+
+typedef struct hook_table hook_table;
+
+hook_table *hook_table_new (void);
+void hook_table_free (hook_table *table);
+void hook_table_add (hook_table *table, const char *name, int pri, void *hook);
+void hook_table_remove (hook_table *table, const char *name, void *hook);
+void *hook_table_first (hook_table *table, const char *name);
+int hook_table_collect (hook_table *table, const char *name, const char *also,
+								void **out, int max);
+
+#endif
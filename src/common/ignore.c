@@ -46,6 +46,264 @@ int ignored_noti = 0;
 int ignored_invi = 0;
 static int ignored_total = 0;
 
+/* Ignore index
+ *
+ * Every message from an unignored nick used to be matched against every
+ * mask, twice. Masks are now filed per IG_* type, and within a type by the
+ * one piece of the hostmask that any matching sender must share with them:
+ *
+ *   exact    "nick!user@host"       whole sender, folded
+ *   host     "*!*@host"             text after the sender's last '@'
+ *   suffix   "*!*@*.isp.com"        ".isp.com", tried for every dot in the host
+ *   nick     "nick!*@*"             text before the sender's first '!'
+ *
+ * Anything else (or anything with '\' escapes) goes to the wild list.
+ * The index only picks candidates, match () still has the final word. */
+
+#define IGNORE_BUCKET_TYPES (IG_PRIV | IG_NOTI | IG_CHAN | IG_CTCP | IG_INVI | IG_DCC)
+
+enum
+{
+	IGNORE_KEY_EXACT,
+	IGNORE_KEY_HOST,
+	IGNORE_KEY_SUFFIX,
+	IGNORE_KEY_NICK,
+	IGNORE_KEY_WILD,
+	IGNORE_KEY_KINDS = IGNORE_KEY_WILD
+};
+
+struct ignore_bucket
+{
+	GHashTable *keys[IGNORE_KEY_KINDS];	/* folded key -> GSList of struct ignore */
+	GSList *wild;
+};
+
+/* [0] ignores, [1] unignores; one bucket per IG_* type bit */
+static struct ignore_bucket *ignore_buckets[2][8];
+
+static char *
+ignore_fold (const char *str)
+{
+	char *folded = g_strdup (str);
+	char *p;
+
+	for (p = folded; *p; p++)
+		*p = rfc_tolower (*p);
+
+	return folded;
+}
+
+static gboolean
+ignore_is_literal (const char *str, const char *end)
+{
+	for (; str < end; str++)
+	{
+		if (*str == '*' || *str == '?' || *str == '\\')
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* returns the index key for a mask, or NULL for the wild list */
+static char *
+ignore_mask_key (const char *mask, int *kind)
+{
+	const char *end = mask + strlen (mask);
+	const char *at, *bang;
+
+	if (ignore_is_literal (mask, end))
+	{
+		*kind = IGNORE_KEY_EXACT;
+		return ignore_fold (mask);
+	}
+
+	at = strrchr (mask, '@');
+	if (at && at[1])
+	{
+		if (ignore_is_literal (at + 1, end))
+		{
+			*kind = IGNORE_KEY_HOST;
+			return ignore_fold (at + 1);
+		}
+		if (at[1] == '*' && at[2] == '.' && at[3] && ignore_is_literal (at + 2, end))
+		{
+			*kind = IGNORE_KEY_SUFFIX;
+			return ignore_fold (at + 2);
+		}
+	}
+
+	bang = strchr (mask, '!');
+	if (bang && bang != mask && ignore_is_literal (mask, bang))
+	{
+		char *nick = g_strndup (mask, bang - mask);
+		char *key = ignore_fold (nick);
+
+		g_free (nick);
+		*kind = IGNORE_KEY_NICK;
+		return key;
+	}
+
+	*kind = IGNORE_KEY_WILD;
+	return NULL;
+}
+
+static struct ignore_bucket *
+ignore_bucket_get (int unignore, int bit, gboolean create)
+{
+	struct ignore_bucket *bucket = ignore_buckets[unignore][bit];
+	int i;
+
+	if (!bucket && create)
+	{
+		bucket = g_new0 (struct ignore_bucket, 1);
+		for (i = 0; i < IGNORE_KEY_KINDS; i++)
+			bucket->keys[i] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		ignore_buckets[unignore][bit] = bucket;
+	}
+
+	return bucket;
+}
+
+static void
+ignore_index_add (struct ignore *ig)
+{
+	struct ignore_bucket *bucket;
+	GSList *list;
+	char *key;
+	int kind, bit;
+
+	key = ignore_mask_key (ig->mask, &kind);
+
+	for (bit = 0; bit < 8; bit++)
+	{
+		if (!(ig->type & (1 << bit) & IGNORE_BUCKET_TYPES))
+			continue;
+
+		bucket = ignore_bucket_get ((ig->type & IG_UNIG) != 0, bit, TRUE);
+		if (kind == IGNORE_KEY_WILD)
+		{
+			bucket->wild = g_slist_prepend (bucket->wild, ig);
+			continue;
+		}
+
+		list = g_hash_table_lookup (bucket->keys[kind], key);
+		g_hash_table_insert (bucket->keys[kind], g_strdup (key), g_slist_prepend (list, ig));
+	}
+
+	g_free (key);
+}
+
+static void
+ignore_index_remove (struct ignore *ig)
+{
+	struct ignore_bucket *bucket;
+	GSList *list;
+	char *key;
+	int kind, bit;
+
+	key = ignore_mask_key (ig->mask, &kind);
+
+	for (bit = 0; bit < 8; bit++)
+	{
+		if (!(ig->type & (1 << bit) & IGNORE_BUCKET_TYPES))
+			continue;
+
+		bucket = ignore_bucket_get ((ig->type & IG_UNIG) != 0, bit, FALSE);
+		if (!bucket)
+			continue;
+
+		if (kind == IGNORE_KEY_WILD)
+		{
+			bucket->wild = g_slist_remove (bucket->wild, ig);
+			continue;
+		}
+
+		list = g_slist_remove (g_hash_table_lookup (bucket->keys[kind], key), ig);
+		if (list)
+			g_hash_table_insert (bucket->keys[kind], g_strdup (key), list);
+		else
+			g_hash_table_remove (bucket->keys[kind], key);
+	}
+
+	g_free (key);
+}
+
+static struct ignore *
+ignore_candidates_match (GSList *list, const char *host)
+{
+	struct ignore *ig;
+
+	for (; list; list = list->next)
+	{
+		ig = list->data;
+		if (match (ig->mask, host))
+			return ig;
+	}
+	return NULL;
+}
+
+static struct ignore *
+ignore_bucket_match (struct ignore_bucket *bucket, const char *host, char *folded)
+{
+	struct ignore *ig;
+	char *hostpart, *p;
+
+	if ((ig = ignore_candidates_match (g_hash_table_lookup (bucket->keys[IGNORE_KEY_EXACT], folded), host)))
+		return ig;
+
+	hostpart = strrchr (folded, '@');
+	if (hostpart)
+	{
+		hostpart++;
+		if ((ig = ignore_candidates_match (g_hash_table_lookup (bucket->keys[IGNORE_KEY_HOST], hostpart), host)))
+			return ig;
+
+		for (p = strchr (hostpart, '.'); p; p = strchr (p + 1, '.'))
+		{
+			if ((ig = ignore_candidates_match (g_hash_table_lookup (bucket->keys[IGNORE_KEY_SUFFIX], p), host)))
+				return ig;
+		}
+	}
+
+	p = strchr (folded, '!');
+	if (p)
+	{
+		*p = 0;
+		ig = ignore_candidates_match (g_hash_table_lookup (bucket->keys[IGNORE_KEY_NICK], folded), host);
+		*p = '!';
+		if (ig)
+			return ig;
+	}
+
+	return ignore_candidates_match (bucket->wild, host);
+}
+
+static struct ignore *
+ignore_index_match (const char *host, int type, int unignore)
+{
+	struct ignore_bucket *bucket;
+	struct ignore *ig = NULL;
+	char *folded = NULL;
+	int bit;
+
+	for (bit = 0; bit < 8 && !ig; bit++)
+	{
+		if (!(type & (1 << bit) & IGNORE_BUCKET_TYPES))
+			continue;
+
+		bucket = ignore_bucket_get (unignore, bit, FALSE);
+		if (!bucket)
+			continue;
+
+		if (!folded)
+			folded = ignore_fold (host);
+		ig = ignore_bucket_match (bucket, host, folded);
+	}
+
+	g_free (folded);
+	return ig;
+}
+
 /* ignore_exists ():
  * returns: struct ig, if this mask is in the ignore list already
  *          NULL, otherwise
@@ -87,7 +345,12 @@ ignore_add (char *mask, int type, gboolean overwrite)
 	if (ig)
 		change_only = TRUE;
 
-	if (!change_only)
+	if (change_only)
+	{
+		ignore_index_remove (ig);
+		g_free (ig->mask);
+	}
+	else
 		ig = g_new (struct ignore, 1);
 
 	ig->mask = g_strdup (mask);
@@ -99,6 +362,7 @@ ignore_add (char *mask, int type, gboolean overwrite)
 
 	if (!change_only)
 		ignore_list = g_slist_prepend (ignore_list, ig);
+	ignore_index_add (ig);
 	fe_ignore_update (1);
 
 	if (change_only)
@@ -187,6 +451,7 @@ ignore_del (char *mask, struct ignore *ig)
 	if (ig)
 	{
 		ignore_list = g_slist_remove (ignore_list, ig);
+		ignore_index_remove (ig);
 		g_free (ig->mask);
 		g_free (ig);
 		fe_ignore_update (1);
@@ -200,49 +465,25 @@ ignore_del (char *mask, struct ignore *ig)
 int
 ignore_check (char *host, int type)
 {
-	struct ignore *ig;
-	GSList *list = ignore_list;
-
 	/* check if there's an UNIGNORE first, they take precendance. */
-	while (list)
-	{
-		ig = (struct ignore *) list->data;
-		if (ig->type & IG_UNIG)
-		{
-			if (ig->type & type)
-			{
-				if (match (ig->mask, host))
-					return FALSE;
-			}
-		}
-		list = list->next;
-	}
+	if (ignore_index_match (host, type, 1))
+		return FALSE;
 
-	list = ignore_list;
-	while (list)
+	if (ignore_index_match (host, type, 0))
 	{
-		ig = (struct ignore *) list->data;
-
-		if (ig->type & type)
-		{
-			if (match (ig->mask, host))
-			{
-				ignored_total++;
-				if (type & IG_PRIV)
-					ignored_priv++;
-				if (type & IG_NOTI)
-					ignored_noti++;
-				if (type & IG_CHAN)
-					ignored_chan++;
-				if (type & IG_CTCP)
-					ignored_ctcp++;
-				if (type & IG_INVI)
-					ignored_invi++;
-				fe_ignore_update (2);
-				return TRUE;
-			}
-		}
-		list = list->next;
+		ignored_total++;
+		if (type & IG_PRIV)
+			ignored_priv++;
+		if (type & IG_NOTI)
+			ignored_noti++;
+		if (type & IG_CHAN)
+			ignored_chan++;
+		if (type & IG_CTCP)
+			ignored_ctcp++;
+		if (type & IG_INVI)
+			ignored_invi++;
+		fe_ignore_update (2);
+		return TRUE;
 	}
 
 	return FALSE;
@@ -291,7 +532,10 @@ ignore_load ()
 			{
 				ignore = g_new0 (struct ignore, 1);
 				if ((my_cfg = ignore_read_next_entry (my_cfg, ignore)))
+				{
 					ignore_list = g_slist_prepend (ignore_list, ignore);
+					ignore_index_add (ignore);
+				}
 				else
 					g_free (ignore);
 			}
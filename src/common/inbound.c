@@ -37,11 +37,13 @@
 #include "util.h"
 #include "ignore.h"
 #include "fe.h"
+#include "hilight.h"
 #include "modes.h"
 #include "network.h"
 #include "notify.h"
 #include "outbound.h"
 #include "inbound.h"
+#include "reconnect.h"
 #include "server.h"
 #include "servlist.h"
 #include "sts.h"
@@ -205,7 +207,7 @@ clear_channel (session *sess)
 {
 	if (sess->channel[0])
 		strcpy (sess->waitchannel, sess->channel);
-	sess->channel[0] = 0;
+	session_set_channel (sess, "");
 	sess->doing_who = FALSE;
 	sess->done_away_check = FALSE;
 
@@ -355,7 +357,7 @@ inbound_privmsg (server *serv, char *from, char *ip, char *text, int id,
 	if (user)
 	{
 		user->lasttalk = time (0);
-		if (user->account)
+		if (user->info->account)
 			id = TRUE;
 	}
 	
@@ -371,143 +373,50 @@ inbound_privmsg (server *serv, char *from, char *ip, char *text, int id,
 
 /* used for Alerts section. Masks can be separated by commas and spaces. */
 
-static char *
-alert_normalize_word (const char *text)
-{
-	GString *normalized;
-	char *composed;
-	const char *p;
+/* Compiled mask lists, keyed by the mask string they were built from, so a
+ * changed preference or nick simply compiles into a new entry. */
+static GHashTable *alert_sets = NULL;
 
-	composed = g_utf8_normalize (text, -1, G_NORMALIZE_ALL_COMPOSE);
-	if (!composed)
-		composed = g_strdup (text);
+#define ALERT_SETS_MAX 64
 
-	normalized = g_string_sized_new (strlen (composed));
-	p = composed;
+static hilight_set *
+alert_set_lookup (const char *masks)
+{
+	hilight_set *set;
 
-	while (*p)
-	{
-		gunichar ch = g_utf8_get_char ((const guchar *)p);
+	if (!alert_sets)
+		alert_sets = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+														(GDestroyNotify) hilight_set_free);
 
-		/* Ignore selector/joiner codepoints that vary by input method. */
-		if (ch != 0x200D && ch != 0xFE0E && ch != 0xFE0F)
-			g_string_append_unichar (normalized, ch);
+	set = g_hash_table_lookup (alert_sets, masks);
+	if (set)
+		return set;
 
-		p = g_utf8_next_char (p);
-	}
+	/* stale entries (old nicks, edited prefs) are never looked up again */
+	if (g_hash_table_size (alert_sets) >= ALERT_SETS_MAX)
+		g_hash_table_remove_all (alert_sets);
 
-	g_free (composed);
-	return g_string_free (normalized, FALSE);
+	set = hilight_set_new (masks);
+	g_hash_table_insert (alert_sets, (char *) hilight_set_get_source (set), set);
+	return set;
 }
 
 gboolean
 alert_match_word (char *word, char *masks)
 {
-	char *p = masks;
-	char endchar;
-	char *word_normalized;
-	char *mask_normalized;
-	int res;
-
-	word_normalized = alert_normalize_word (word);
-
 	if (masks[0] == 0)
-	{
-		g_free (word_normalized);
 		return FALSE;
-	}
 
-	while (1)
-	{
-		/* if it's a 0, space or comma, the word has ended. */
-		if (*p == 0 || *p == ' ' || *p == ',')
-		{
-			endchar = *p;
-			*p = 0;
-			mask_normalized = alert_normalize_word (g_strchug (masks));
-			res = match (mask_normalized, word_normalized);
-			g_free (mask_normalized);
-			*p = endchar;
-
-			if (res)
-			{
-				g_free (word_normalized);
-				return TRUE;	/* yes, matched! */
-			}
-
-			masks = p + 1;
-			if (*p == 0)
-			{
-				g_free (word_normalized);
-				return FALSE;
-			}
-		}
-		p++;
-	}
+	return hilight_set_match_word (alert_set_lookup (masks), word);
 }
 
 gboolean
 alert_match_text (char *text, char *masks)
 {
-	unsigned char *p = text;
-	unsigned char endchar;
-	gunichar ch;
-	GUnicodeType ch_type;
-	int res;
-
 	if (masks[0] == 0)
 		return FALSE;
 
-	while (1)
-	{
-		ch = g_utf8_get_char (p);
-		ch_type = g_unichar_type (ch);
-
-		if (g_unichar_isdigit (ch) || g_unichar_isalpha (ch))
-		{
-			p += g_utf8_skip [p[0]];
-			continue;
-		}
-
-		/* if it's RFC1459 <special>, it can be inside a word */
-		switch (ch)
-		{
-		case '-': case '[': case ']': case '\\':
-		case '`': case '^': case '{': case '}':
-		case '_': case '|':
-			p += g_utf8_skip [p[0]];
-			continue;
-		}
-
-		/* Symbols (including emoji) can be part of highlighted words. */
-		if (ch_type == G_UNICODE_MATH_SYMBOL ||
-			 ch_type == G_UNICODE_CURRENCY_SYMBOL ||
-			 ch_type == G_UNICODE_MODIFIER_SYMBOL ||
-			 ch_type == G_UNICODE_OTHER_SYMBOL)
-		{
-			p += g_utf8_skip [p[0]];
-			continue;
-		}
-
-		/* Delimiters end the word. */
-		if (*p == 0 || g_unichar_isspace (ch) || g_unichar_ispunct (ch) ||
-			 g_unichar_iscntrl (ch))
-		{
-			endchar = *p;
-			*p = 0;
-			res = alert_match_word (text, masks);
-			*p = endchar;
-
-			if (res)
-				return TRUE;	/* yes, matched! */
-
-			text = p + g_utf8_skip [p[0]];
-			if (*p == 0)
-				return FALSE;
-		}
-
-		p += g_utf8_skip [p[0]];
-	}
+	return hilight_set_match_text (alert_set_lookup (masks), text);
 }
 
 static int
@@ -593,7 +502,7 @@ inbound_action (session *sess, char *chan, char *from, char *ip, char *text,
 	{
 		nickchar[0] = user->prefix[0];
 		user->lasttalk = time (0);
-		if (user->account)
+		if (user->info->account)
 			id = TRUE;
 		if (user->me)
 			fromme = TRUE;
@@ -662,7 +571,7 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 	user = userlist_find (sess, from);
 	if (user)
 	{
-		if (user->account)
+		if (user->info->account)
 			id = TRUE;
 		nickchar[0] = user->prefix[0];
 		user->lasttalk = time (0);
@@ -712,6 +621,7 @@ inbound_newnick (server *serv, char *nick, char *newnick, int quiet,
 	int me = FALSE;
 	session *sess;
 	GSList *list = sess_list;
+	GSList *changed;
 
 	if (!serv->p_cmp (nick, serv->nick))
 	{
@@ -719,12 +629,14 @@ inbound_newnick (server *serv, char *nick, char *newnick, int quiet,
 		safe_strcpy (serv->nick, newnick, NICKLEN);
 	}
 
+	changed = userlist_change (serv, nick, newnick);
+
 	while (list)
 	{
 		sess = list->data;
 		if (sess->server == serv)
 		{
-			if (userlist_change (sess, nick, newnick) || (me && sess->type == SESS_SERVER))
+			if (g_slist_find (changed, sess) || (me && sess->type == SESS_SERVER))
 			{
 				if (!quiet)
 				{
@@ -739,13 +651,14 @@ inbound_newnick (server *serv, char *nick, char *newnick, int quiet,
 			}
 			if (sess->type == SESS_DIALOG && !serv->p_cmp (sess->channel, nick))
 			{
-				safe_strcpy (sess->channel, newnick, CHANLEN);
+				session_set_channel (sess, newnick);
 				fe_set_channel (sess);
 			}
 			fe_set_title (sess);
 		}
 		list = list->next;
 	}
+	g_slist_free (changed);
 
 	dcc_change_nick (serv, nick, newnick);
 
@@ -815,7 +728,7 @@ inbound_ujoin (server *serv, char *chan, char *nick, char *ip,
 		}
 	}
 
-	safe_strcpy (sess->channel, chan, CHANLEN);
+	session_set_channel (sess, chan);
 	if (found_unused)
 	{
 		chanopt_load (sess);
@@ -891,10 +804,8 @@ inbound_nameslist (server *serv, char *chan, char *names,
 						 const message_tags_data *tags_data)
 {
 	session *sess;
-	char **name_list;
-	char *host, *nopre_name;
+	char *host, *nopre_name, *end;
 	char name[NICKLEN];
-	int i;
 	size_t offset;
 
 	sess = find_channel (serv, chan);
@@ -914,37 +825,47 @@ inbound_nameslist (server *serv, char *chan, char *names,
 		userlist_clear (sess);
 	}
 
-	name_list = g_strsplit (names, " ", -1);
-	for (i = 0; name_list[i]; i++)
+	/* split the line in place, putting each space back once done with it */
+	while (*names)
 	{
-		host = NULL;
-		offset = sizeof(name);
+		end = strchr (names, ' ');
+		if (end)
+			*end = 0;
 
-		if (name_list[i][0] == 0)
-			continue;
-
-		if (serv->have_uhnames)
+		if (names[0] != 0)
 		{
-			offset = 0;
-			nopre_name = name_list[i];
+			host = NULL;
+			offset = sizeof(name);
 
-			/* Ignore prefixes so '!' won't cause issues */
-			while (strchr (serv->nick_prefixes, *nopre_name) != NULL)
+			if (serv->have_uhnames)
 			{
-				nopre_name++;
+				offset = 0;
+				nopre_name = names;
+
+				/* Ignore prefixes so '!' won't cause issues */
+				while (*nopre_name && strchr (serv->nick_prefixes, *nopre_name) != NULL)
+				{
+					nopre_name++;
+					offset++;
+				}
+
+				offset += strcspn (nopre_name, "!");
+				if (names[offset] == '!')
+					host = names + offset + 1;
 				offset++;
 			}
 
-			offset += strcspn (nopre_name, "!");
-			if (offset++ < strlen (name_list[i]))
-				host = name_list[i] + offset;
-		}
+			g_strlcpy (name, names, MIN(offset, sizeof(name)));
 
-		g_strlcpy (name, name_list[i], MIN(offset, sizeof(name)));
+			/* sorted into the userlist as one batch at the 366 */
+			userlist_queue_name (sess, name, host, tags_data);
+		}
 
-		userlist_add (sess, name, host, NULL, NULL, tags_data);
+		if (!end)
+			break;
+		*end = ' ';
+		names = end + 1;
 	}
-	g_strfreev (name_list);
 }
 
 void
@@ -1048,31 +969,32 @@ void
 inbound_quit (server *serv, char *nick, char *ip, char *reason,
 				  const message_tags_data *tags_data)
 {
-	GSList *list = sess_list;
+	GSList *list, *channels;
 	session *sess;
 	struct User *user;
 	int was_on_front_session = FALSE;
 
-	while (list)
+	/* only the channels the nick is in, instead of every tab */
+	channels = userlist_find_sessions (serv, nick);
+	for (list = channels; list; list = list->next)
 	{
-		sess = (session *) list->data;
-		if (sess->server == serv)
+		sess = list->data;
+		if ((user = userlist_find (sess, nick)))
 		{
- 			if (sess == current_sess)
- 				was_on_front_session = TRUE;
-			if ((user = userlist_find (sess, nick)))
-			{
-				EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
-											  tags_data->timestamp);
-				userlist_remove_user (sess, user);
-			} else if (sess->type == SESS_DIALOG && !serv->p_cmp (sess->channel, nick))
-			{
-				EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
-											  tags_data->timestamp);
-			}
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
+										  tags_data->timestamp);
+			userlist_remove_user (sess, user);
 		}
-		list = list->next;
 	}
+	g_slist_free (channels);
+
+	if (current_sess && current_sess->server == serv)
+		was_on_front_session = TRUE;
+
+	sess = find_dialog (serv, nick);
+	if (sess)
+		EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
+									  tags_data->timestamp);
 
 	notify_set_offline (serv, nick, was_on_front_session, tags_data);
 }
@@ -1081,17 +1003,7 @@ void
 inbound_account (server *serv, char *nick, char *account,
 					  const message_tags_data *tags_data)
 {
-	session *sess = NULL;
-	GSList *list;
-
-	list = sess_list;
-	while (list)
-	{
-		sess = list->data;
-		if (sess->server == serv)
-			userlist_set_account (sess, nick, account);
-		list = list->next;
-	}
+	userlist_set_account (serv, nick, account);
 }
 
 void
@@ -1262,7 +1174,6 @@ inbound_away (server *serv, char *nick, char *msg,
 {
 	struct away_msg *away = server_away_find_message (serv, nick);
 	session *sess = NULL;
-	GSList *list;
 
 	if (away && !strcmp (msg, away->message))	/* Seen the msg before? */
 	{
@@ -1288,41 +1199,25 @@ inbound_away (server *serv, char *nick, char *msg,
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_WHOIS5, sess, nick, msg, NULL, NULL, 0,
 									  tags_data->timestamp);
 
-	list = sess_list;
-	while (list)
-	{
-		sess = list->data;
-		if (sess->server == serv)
-			userlist_set_away (sess, nick, TRUE);
-		list = list->next;
-	}
+	userlist_set_away (serv, nick, TRUE);
 }
 
 void
 inbound_away_notify (server *serv, char *nick, char *reason,
 							const message_tags_data *tags_data)
 {
-	session *sess = NULL;
-	GSList *list;
+	session *sess = serv->front_session;
 
-	list = sess_list;
-	while (list)
+	userlist_set_away (serv, nick, reason ? TRUE : FALSE);
+
+	if (sess && notify_is_in_list (serv, nick))
 	{
-		sess = list->data;
-		if (sess->server == serv)
-		{
-			userlist_set_away (sess, nick, reason ? TRUE : FALSE);
-			if (sess == serv->front_session && notify_is_in_list (serv, nick))
-			{
-				if (reason)
-					EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYAWAY, sess, nick, reason, NULL,
-												  NULL, 0, tags_data->timestamp);
-				else
-					EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYBACK, sess, nick, NULL, NULL, 
-												  NULL, 0, tags_data->timestamp);
-			}
-		}
-		list = list->next;
+		if (reason)
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYAWAY, sess, nick, reason, NULL,
+										  NULL, 0, tags_data->timestamp);
+		else
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYBACK, sess, nick, NULL, NULL, 
+										  NULL, 0, tags_data->timestamp);
 	}
 }
 
@@ -1341,6 +1236,7 @@ inbound_nameslist_end (server *serv, char *chan,
 			sess = list->data;
 			if (sess->server == serv)
 			{
+				userlist_flush_names (sess);
 				sess->end_of_names = TRUE;
 				sess->ignore_names = FALSE;
 				fe_userlist_numbers (sess);
@@ -1352,6 +1248,7 @@ inbound_nameslist_end (server *serv, char *chan,
 	sess = find_channel (serv, chan);
 	if (sess)
 	{
+		userlist_flush_names (sess);
 		sess->end_of_names = TRUE;
 		sess->ignore_names = FALSE;
 		fe_userlist_numbers (sess);
@@ -1438,6 +1335,50 @@ check_autojoin_channels (server *serv)
 	return FALSE;
 }
 
+/* how many channels check_autojoin_channels () is going to join */
+static int
+autojoin_count (server *serv)
+{
+	GSList *list;
+	session *sess;
+	int count = 0;
+
+	for (list = sess_list; list; list = list->next)
+	{
+		sess = list->data;
+		if (sess->server == serv && sess->willjoinchannel[0])
+			count++;
+	}
+
+	if (!count)
+		count = g_slist_length (serv->favlist);
+
+	return count;
+}
+
+/* join now, or once the servers that logged in just before are done */
+static void
+autojoin_spread (server *serv)
+{
+	int wait = reconnect_autojoin_delay (autojoin_count (serv));
+
+	if (wait > 0)
+		serv->joindelay_tag = fe_timeout_add (wait, check_autojoin_channels, serv);
+	else
+		check_autojoin_channels (serv);
+}
+
+static gboolean
+autojoin_delay_cb (server *serv)
+{
+	if (!is_server (serv))
+		return FALSE;
+
+	serv->joindelay_tag = 0;
+	autojoin_spread (serv);
+	return FALSE;
+}
+
 void
 inbound_next_nick (session *sess, char *nick, int error,
 						 const message_tags_data *tags_data)
@@ -1603,17 +1544,7 @@ inbound_login_start (session *sess, char *nick, char *servname,
 static void
 inbound_set_all_away_status (server *serv, char *nick, unsigned int status)
 {
-	GSList *list;
-	session *sess;
-
-	list = sess_list;
-	while (list)
-	{
-		sess = list->data;
-		if (sess->server == serv)
-			userlist_set_away (sess, nick, status);
-		list = list->next;
-	}
+	userlist_set_away (serv, nick, status);
 }
 
 void
@@ -1669,7 +1600,6 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 {
 	server *serv = sess->server;
 	session *who_sess;
-	GSList *list;
 	char *uhost = NULL;
 
 	if (user && host)
@@ -1681,7 +1611,7 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 	{
 		who_sess = find_channel (serv, chan);
 		if (who_sess)
-			userlist_add_hostname (who_sess, nick, uhost, realname, servname, account, away);
+			userlist_add_hostname (serv, nick, uhost, realname, servname, account, away);
 		else
 		{
 			if (serv->doing_dns && nick && host)
@@ -1691,21 +1621,11 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 	else
 	{
 		/* came from WHOIS, not channel specific */
-		for (list = sess_list; list; list = list->next)
-		{
-			sess = list->data;
-			if (sess->server != serv)
-				continue;
+		userlist_add_hostname (serv, nick, uhost, realname, servname, account, away);
 
-			if (sess->type == SESS_CHANNEL)
-			{
-				userlist_add_hostname (sess, nick, uhost, realname, servname, account, away);
-			}
-			else if (sess->type == SESS_DIALOG && uhost && !serv->p_cmp (sess->channel, nick))
-			{
-				set_topic (sess, uhost, uhost);
-			}
-		}
+		sess = find_dialog (serv, nick);
+		if (sess && uhost)
+			set_topic (sess, uhost, uhost);
 	}
 
 	g_free (uhost);
@@ -1792,6 +1712,9 @@ inbound_login_end (session *sess, char *text, const message_tags_data *tags_data
 
 	if (!serv->end_of_motd)
 	{
+		/* logged in, so the next disconnect starts a fresh backoff */
+		reconnect_forget (serv);
+
 		if (prefs.hex_dcc_ip_from_server && serv->use_who)
 		{
 			serv->skip_next_userhost = TRUE;
@@ -1826,11 +1749,11 @@ inbound_login_end (session *sess, char *text, const message_tags_data *tags_data
 			&& ((serv->password[0] && inbound_nickserv_login (serv))
 				|| net->commandlist))
 		{
-			serv->joindelay_tag = fe_timeout_add_seconds (prefs.hex_irc_join_delay, check_autojoin_channels, serv);
+			serv->joindelay_tag = fe_timeout_add_seconds (prefs.hex_irc_join_delay, autojoin_delay_cb, serv);
 		}
 		else
 		{
-			check_autojoin_channels (serv);
+			autojoin_spread (serv);
 		}
 
 		if (serv->supports_watch || serv->supports_monitor)
@@ -1861,7 +1784,7 @@ inbound_identified (server *serv)	/* 'MODE +e MYSELF' on freenode */
 		/* stop waiting, just auto JOIN now */
 		fe_timeout_remove (serv->joindelay_tag);
 		serv->joindelay_tag = 0;
-		check_autojoin_channels (serv);
+		autojoin_spread (serv);
 	}
 }
 
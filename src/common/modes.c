@@ -28,6 +28,7 @@
 #include "fe.h"
 #include "util.h"
 #include "inbound.h"
+#include "notify.h"
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
@@ -892,21 +893,31 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 		} else if (g_strcmp0 (tokname, "WATCH") == 0)
 		{
 			serv->supports_watch = tokadding;
+			if (!serv->supports_monitor)	/* MONITOR is used when there's both */
+				serv->watch_limit = tokadding ? atoi (tokvalue) : 0;
 		} else if (g_strcmp0 (tokname, "MONITOR") == 0)
 		{
 			serv->supports_monitor = tokadding;
+			serv->watch_limit = tokadding ? atoi (tokvalue) : 0;
 		} else if (g_strcmp0 (tokname, "NETWORK") == 0)
 		{
 			if (serv->server_session->type == SESS_SERVER && strlen (tokvalue))
 			{
-				safe_strcpy (serv->server_session->channel, tokvalue, CHANLEN);
+				session_set_channel (serv->server_session, tokvalue);
 				fe_set_channel (serv->server_session);
+				/* may change which notify entries apply here */
+				notify_index_reset (serv);
 			}
 
 		} else if (g_strcmp0 (tokname, "CASEMAPPING") == 0)
 		{
 			if (g_strcmp0 (tokvalue, "ascii") == 0)
+			{
 				serv->p_cmp = (void *)g_ascii_strcasecmp;
+				session_index_rebuild (serv);
+				userlist_index_rebuild (serv);
+				notify_index_reset (serv);
+			}
 		} else if (g_strcmp0 (tokname, "CLIENTTAGDENY") == 0)
 		{
 			g_free (serv->clienttagdeny);
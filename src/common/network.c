@@ -17,7 +17,8 @@
  */
 
 /* ipv4 and ipv6 networking functions with a common interface */
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L	/* for pread */
+#define _FILE_OFFSET_BITS 64
 #ifdef _WIN32
 #  include <ws2tcpip.h>
 #else
@@ -37,6 +38,12 @@
 #ifdef HAVE_NETINET_TCP_H
 #include <netinet/tcp.h>
 #endif
+#ifdef HAVE_SENDFILE
+#include <errno.h>
+#include <sys/sendfile.h>
+#endif
+#else
+#include <io.h>
 #endif
 
 #define WANTSOCKET
@@ -44,14 +51,11 @@
 #define WANTDNS
 #include "inet.h"
 
-#define NETWORK_PRIVATE
 #include "network.h"
 #include "zoitechat.h"
 
 extern struct zoitechatprefs prefs;
 
-#define RAND_INT(n) ((int)(rand() / (RAND_MAX + 1.0) * (n)))
-
 
 /* ================== COMMON ================= */
 
@@ -136,129 +140,63 @@ net_lookup_ipv4 (const char *hostname, uint32_t *addr)
 	return TRUE;
 }
 
-void
-net_store_destroy (netstore * ns)
-{
-	if (ns->ip6_hostent)
-		freeaddrinfo (ns->ip6_hostent);
-	free (ns);
-}
-
-netstore *
-net_store_new (void)
-{
-	return calloc (1, sizeof (netstore));
-}
-
-/* =================== IPV6 ================== */
+/* a TCP socket for the given address family, set up for IRC */
 
-char *
-net_resolve (netstore * ns, char *hostname, int port, char **real_host)
+int
+net_socket (int family)
 {
-	struct addrinfo hints;
-	char ipstring[MAX_HOSTNAME];
-	char portstring[MAX_HOSTNAME];
-	int ret;
-
-/*	if (ns->ip6_hostent)
-		freeaddrinfo (ns->ip6_hostent);*/
-
-	sprintf (portstring, "%d", port);
-
-	memset (&hints, 0, sizeof (struct addrinfo));
-	hints.ai_family = PF_UNSPEC; /* support ipv6 and ipv4 */
-	hints.ai_flags = AI_CANONNAME | AI_ADDRCONFIG;
-	hints.ai_socktype = SOCK_STREAM;
-
-	if (port == 0)
-		ret = getaddrinfo (hostname, NULL, &hints, &ns->ip6_hostent);
-	else
-		ret = getaddrinfo (hostname, portstring, &hints, &ns->ip6_hostent);
-	if (ret != 0)
-		return NULL;
-
-#ifdef LOOKUPD	/* See note about lookupd above the IPv4 version of net_resolve. */
-	struct addrinfo *tmp;
-	int count = 0;
-
-	for (tmp = ns->ip6_hostent; tmp; tmp = tmp->ai_next)
-		count ++;
-
-	count = RAND_INT(count);
-	
-	while (count--) ns->ip6_hostent = ns->ip6_hostent->ai_next;
-#endif
+	int sok;
 
-	/* find the numeric IP number */
-	ipstring[0] = 0;
-	getnameinfo (ns->ip6_hostent->ai_addr, ns->ip6_hostent->ai_addrlen,
-					 ipstring, sizeof (ipstring), NULL, 0, NI_NUMERICHOST);
+	sok = socket (family, SOCK_STREAM, IPPROTO_TCP);
+	if (sok != -1)
+		net_set_socket_options (sok);
 
-	if (ns->ip6_hostent->ai_canonname)
-		*real_host = g_strdup(ns->ip6_hostent->ai_canonname);
-	else
-		*real_host = g_strdup(hostname);
+	return sok;
+}
 
-	return g_strdup(ipstring);
+void
+udp_sockets (int *sok4, int *sok6)
+{
+	*sok4 = socket (AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	*sok6 = socket (AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
 }
 
-/* the only thing making this interface unclean, this shitty sok4, sok6 business */
+/* Sends up to len bytes of the file fd, starting at offset, to sok.
+ * With zerocopy the kernel copies straight from the file where it can;
+ * otherwise the data is read into buf, which must hold len bytes.
+ * Returns the number of bytes sent, 0 at end of file or -1 on error
+ * (would_block () tells whether the socket was only full). */
 
 int
-net_connect (netstore * ns, int sok4, int sok6, int *sok_return)
+net_send_file (int sok, int fd, guint64 offset, int len, char *buf, int zerocopy)
 {
-	struct addrinfo *res, *res0;
-	int error = -1;
+	int n;
 
-	res0 = ns->ip6_hostent;
+#ifdef HAVE_SENDFILE
+	static int no_sendfile = FALSE;
+	off_t off = offset;
 
-	for (res = res0; res; res = res->ai_next)
+	if (zerocopy && !no_sendfile)
 	{
-/*		sok = socket (res->ai_family, res->ai_socktype, res->ai_protocol);
-		if (sok < 0)
-			continue;*/
-		switch (res->ai_family)
-		{
-		case AF_INET:
-			error = connect (sok4, res->ai_addr, res->ai_addrlen);
-			*sok_return = sok4;
-			break;
-		case AF_INET6:
-			error = connect (sok6, res->ai_addr, res->ai_addrlen);
-			*sok_return = sok6;
-			break;
-		default:
-			error = 1;
-		}
-
-		if (error == 0)
-			break;
-	}
-
-	return error;
-}
+		n = sendfile (sok, fd, &off, len);
+		if (n >= 0 || (errno != EINVAL && errno != ENOSYS))
+			return n;
 
-void
-net_bind (netstore * tobindto, int sok4, int sok6)
-{
-	bind (sok4, tobindto->ip6_hostent->ai_addr,
-			tobindto->ip6_hostent->ai_addrlen);
-	bind (sok6, tobindto->ip6_hostent->ai_addr,
-			tobindto->ip6_hostent->ai_addrlen);
-}
+		/* ENOSYS won't change, EINVAL may be just this file */
+		if (errno == ENOSYS)
+			no_sendfile = TRUE;
+	}
+#endif
 
-void
-net_sockets (int *sok4, int *sok6)
-{
-	*sok4 = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	*sok6 = socket (AF_INET6, SOCK_STREAM, IPPROTO_TCP);
-	net_set_socket_options (*sok4);
-	net_set_socket_options (*sok6);
-}
+#ifdef WIN32
+	if (_lseeki64 (fd, offset, SEEK_SET) == -1)
+		return -1;
+	n = read (fd, buf, len);
+#else
+	n = pread (fd, buf, len, offset);
+#endif
+	if (n < 1)
+		return n;
 
-void
-udp_sockets (int *sok4, int *sok6)
-{
-	*sok4 = socket (AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-	*sok6 = socket (AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	return send (sok, buf, n, 0);
 }
@@ -21,26 +21,12 @@
 #define ZOITECHAT_NETWORK_H
 
 #include <stdint.h>
+#include <glib.h>
 
-typedef struct netstore_
-{
-#ifdef NETWORK_PRIVATE
-	struct addrinfo *ip6_hostent;
-#else
-	int _dummy;	/* some compilers don't like empty structs */
-#endif
-} netstore;
-
-#define MAX_HOSTNAME 128
-
-netstore *net_store_new (void);
-void net_store_destroy (netstore *ns);
-int net_connect (netstore *ns, int sok4, int sok6, int *sok_return);
-char *net_resolve (netstore *ns, char *hostname, int port, char **real_host);
-void net_bind (netstore *tobindto, int sok4, int sok6);
 char *net_ip (uint32_t addr);
 int net_parse_ipv4 (const char *hostname, uint32_t *addr);
 int net_lookup_ipv4 (const char *hostname, uint32_t *addr);
-void net_sockets (int *sok4, int *sok6);
+int net_socket (int family);
+int net_send_file (int sok, int fd, guint64 offset, int len, char *buf, int zerocopy);
 
 #endif
@@ -43,6 +43,16 @@
 GSList *notify_list = 0;
 int notify_tag = 0;
 
+#define NOTIFY_ISON_LEN 500		/* longest ISON line we send */
+#define NOTIFY_ISON_STALE 120		/* seconds to wait for a 303 before asking again */
+
+/* one ISON line sent, waiting for its 303 in serv->notify_ison */
+typedef struct
+{
+	time_t sent;
+	GPtrArray *nicks;		/* NULL if the user sent it */
+} notify_ison_batch;
+
 
 static char *
 despacify_dup (char *str)
@@ -171,31 +181,101 @@ notify_load (void)
 	}
 }
 
-static struct notify_per_server *
-notify_find (server *serv, char *nick)
+/* The entries that apply to a server are found through serv->notify_index.
+ * Keys are folded like session_index_key () does, so they agree with
+ * serv->p_cmp. */
+static void
+notify_index_key (server *serv, const char *nick, char *key)
+{
+	gboolean rfc = (serv->p_cmp == rfc_casecmp);
+	int i;
+
+	for (i = 0; nick[i] && i < NICKLEN - 1; i++)
+		key[i] = rfc ? rfc_tolower (nick[i]) : g_ascii_tolower (nick[i]);
+	key[i] = 0;
+}
+
+static GHashTable *
+notify_index (server *serv)
 {
-	GSList *list = notify_list;
 	struct notify_per_server *servnot;
 	struct notify *notify;
+	char key[NICKLEN];
+	GSList *list;
 
-	while (list)
-	{
-		notify = (struct notify *) list->data;
+	if (serv->notify_index)
+		return serv->notify_index;
 
+	serv->notify_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (list = notify_list; list; list = list->next)
+	{
+		notify = list->data;
 		servnot = notify_find_server_entry (notify, serv);
 		if (!servnot)
-		{
-			list = list->next;
 			continue;
-		}
-
-		if (!serv->p_cmp (notify->name, nick))
-			return servnot;
 
-		list = list->next;
+		/* the newest entry for a nick wins, as it did when the list was searched */
+		notify_index_key (serv, notify->name, key);
+		if (!g_hash_table_contains (serv->notify_index, key))
+			g_hash_table_insert (serv->notify_index, g_strdup (key), servnot);
 	}
 
-	return NULL;
+	return serv->notify_index;
+}
+
+/* call when the notify list, serv->p_cmp or the network changes;
+   the index is built again when next used */
+void
+notify_index_reset (server *serv)
+{
+	g_clear_pointer (&serv->notify_index, g_hash_table_destroy);
+}
+
+static void
+notify_index_reset_all (void)
+{
+	GSList *list;
+
+	for (list = serv_list; list; list = list->next)
+		notify_index_reset (list->data);
+}
+
+static struct notify_per_server *
+notify_find (server *serv, const char *nick)
+{
+	char key[NICKLEN];
+
+	if (!notify_list)
+		return NULL;
+
+	notify_index_key (serv, nick, key);
+	return g_hash_table_lookup (notify_index (serv), key);
+}
+
+static void
+notify_ison_batch_free (notify_ison_batch *batch)
+{
+	if (batch->nicks)
+		g_ptr_array_free (batch->nicks, TRUE);
+	g_free (batch);
+}
+
+static void
+notify_ison_clear (server *serv)
+{
+	if (!serv->notify_ison)
+		return;
+
+	g_queue_free_full (serv->notify_ison, (GDestroyNotify) notify_ison_batch_free);
+	serv->notify_ison = NULL;
+}
+
+/* the server went away or was disconnected */
+void
+notify_forget_server (server *serv)
+{
+	notify_index_reset (serv);
+	notify_ison_clear (serv);
 }
 
 static void
@@ -330,6 +410,46 @@ notify_set_online_list (server * serv, char *users,
 	}
 }
 
+/* MONITOR list full (734): ISON has to ask about these */
+
+void
+notify_set_unwatched_list (server * serv, char *users)
+{
+	struct notify_per_server *servnot;
+	char *token;
+
+	token = strtok (users, ",");
+	while (token != NULL)
+	{
+		servnot = notify_find (serv, token);
+		if (servnot)
+			servnot->watched = FALSE;
+
+		token = strtok (NULL, ",");
+	}
+}
+
+/* how many MONITOR or WATCH entries this server may take yet, -1 for any */
+static int
+notify_watch_room (server *serv)
+{
+	GHashTableIter iter;
+	struct notify_per_server *servnot;
+	int used = 0;
+
+	if (!serv->watch_limit)
+		return -1;
+
+	g_hash_table_iter_init (&iter, notify_index (serv));
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &servnot))
+	{
+		if (servnot->watched)
+			used++;
+	}
+
+	return MAX (0, serv->watch_limit - used);
+}
+
 static void
 notify_watch (server * serv, char *nick, int add)
 {
@@ -352,13 +472,27 @@ notify_watch (server * serv, char *nick, int add)
 static void
 notify_watch_all (struct notify *notify, int add)
 {
+	struct notify_per_server *servnot;
 	server *serv;
 	GSList *list = serv_list;
 	while (list)
 	{
 		serv = list->data;
 		if (serv->connected && serv->end_of_motd && notify_do_network (notify, serv))
-			notify_watch (serv, notify->name, add);
+		{
+			if (!add)
+				notify_watch (serv, notify->name, FALSE);
+			else if (serv->supports_monitor || serv->supports_watch)
+			{
+				/* a full list leaves the nick to ISON */
+				servnot = notify_find_server_entry (notify, serv);
+				if (servnot && notify_watch_room (serv) != 0)
+				{
+					servnot->watched = TRUE;
+					notify_watch (serv, notify->name, TRUE);
+				}
+			}
+		}
 		list = list->next;
 	}
 }
@@ -392,25 +526,33 @@ void
 notify_send_watches (server * serv)
 {
 	struct notify *notify;
+	struct notify_per_server *servnot;
 	const int format_len = serv->supports_monitor ? 1 : 2; /* just , for monitor or + and space for watch */
 	GSList *list;
 	GSList *point;
 	GSList *send_list = NULL;
 	int len = 0;
+	int room = serv->watch_limit ? serv->watch_limit : -1;
 
-	/* Only get the list for this network */
+	/* Only get the list for this network, as much of it as the
+	   server takes; ISON asks about the rest */
 	list = notify_list;
-	while (list)
+	while (list && room != 0)
 	{
 		notify = list->data;
+		servnot = notify_find_server_entry (notify, serv);
 
-		if (notify_do_network (notify, serv))
+		if (servnot && notify_find (serv, notify->name) == servnot)
 		{
-			send_list = g_slist_append (send_list, notify);
+			servnot->watched = TRUE;
+			send_list = g_slist_prepend (send_list, notify);
+			if (room > 0)
+				room--;
 		}
 
 		list = list->next;
 	}
+	send_list = g_slist_reverse (send_list);
 
 	/* Now send that list in batches */
 	point = list = send_list;
@@ -438,86 +580,175 @@ notify_send_watches (server * serv)
 	g_slist_free (send_list);
 }
 
-/* called when receiving a ISON 303 - should this func go? */
+/* is this 303 the answer to batch? User ISONs are queued too, so this
+   only guards against one sent some other way, e.g. by a plugin's raw
+   socket: if it names someone we didn't ask about it isn't ours */
+static gboolean
+notify_ison_answers (server *serv, notify_ison_batch *batch, GHashTable *online)
+{
+	GHashTable *asked = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	GHashTableIter iter;
+	gboolean res = TRUE;
+	char key[NICKLEN];
+	char *nick;
+	guint i;
+
+	for (i = 0; i < batch->nicks->len; i++)
+	{
+		notify_index_key (serv, g_ptr_array_index (batch->nicks, i), key);
+		g_hash_table_add (asked, g_strdup (key));
+	}
+
+	g_hash_table_iter_init (&iter, online);
+	while (res && g_hash_table_iter_next (&iter, (gpointer *) &nick, NULL))
+		res = g_hash_table_contains (asked, nick);
+
+	g_hash_table_destroy (asked);
+	return res;
+}
+
+/* The user sent a raw line, by /QUOTE or as an unknown command. If it's
+ * an ISON, its 303 comes in turn with ours and must not be taken for
+ * the answer to one of our batches. A bare ISON only gets an error. */
+void
+notify_note_user_ison (server *serv, const char *raw)
+{
+	notify_ison_batch *batch;
+
+	if (g_ascii_strncasecmp (raw, "ISON ", 5) != 0)
+		return;
+	raw += 5;
+	while (*raw == ' ')
+		raw++;
+	if (!*raw || (raw[0] == ':' && !raw[1]))
+		return;
+
+	batch = g_new0 (notify_ison_batch, 1);
+	batch->sent = time (NULL);
+
+	if (!serv->notify_ison)
+		serv->notify_ison = g_queue_new ();
+	g_queue_push_tail (serv->notify_ison, batch);
+}
+
+/* called when receiving a ISON 303, nicks is the list of who is on */
 
 void
-notify_markonline (server *serv, char *word[], const message_tags_data *tags_data)
+notify_markonline (server *serv, char *nicks, const message_tags_data *tags_data)
 {
-	struct notify *notify;
+	notify_ison_batch *batch = NULL;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
-	int i, seen;
-
-	while (list)
+	GHashTable *online;
+	char key[NICKLEN];
+	char **names;
+	guint i;
+
+	online = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	names = g_strsplit (nicks, " ", -1);
+	for (i = 0; names[i]; i++)
 	{
-		notify = (struct notify *) list->data;
-		servnot = notify_find_server_entry (notify, serv);
-		if (!servnot)
-		{
-			list = list->next;
+		if (!names[i][0])
 			continue;
-		}
-		i = 4;
-		seen = FALSE;
-		while (*word[i])
-		{
-			if (!serv->p_cmp (notify->name, word[i]))
-			{
-				seen = TRUE;
-				notify_announce_online (serv, servnot, notify->name, tags_data);
-				break;
-			}
-			i++;
-			/* FIXME: word[] is only a 32 element array, limits notify list to
-			   about 27 people */
-			if (i > PDIWORDS - 5)
-			{
-				/*fprintf (stderr, _("*** ZOITECHAT WARNING: notify list too large.\n"));*/
-				break;
-			}
-		}
-		if (!seen && servnot->ison)
+		notify_index_key (serv, names[i], key);
+		g_hash_table_add (online, g_strdup (key));
+
+		servnot = notify_find (serv, names[i]);
+		if (servnot)
+			notify_announce_online (serv, servnot, servnot->notify->name, tags_data);
+	}
+
+	if (serv->notify_ison)
+		batch = g_queue_peek_head (serv->notify_ison);
+
+	/* the answer to the user's own ISON: just take who's on */
+	if (batch && !batch->nicks)
+	{
+		g_queue_pop_head (serv->notify_ison);
+		notify_ison_batch_free (batch);
+	}
+	/* whoever we asked about and isn't named is offline */
+	else if (batch && notify_ison_answers (serv, batch, online))
+	{
+		g_queue_pop_head (serv->notify_ison);
+		for (i = 0; i < batch->nicks->len; i++)
 		{
-			notify_announce_offline (serv, servnot, notify->name, FALSE, tags_data);
+			servnot = notify_find (serv, g_ptr_array_index (batch->nicks, i));
+			if (!servnot || !servnot->ison)
+				continue;
+
+			notify_index_key (serv, servnot->notify->name, key);
+			if (!g_hash_table_contains (online, key))
+				notify_announce_offline (serv, servnot, servnot->notify->name, FALSE, tags_data);
 		}
-		list = list->next;
+		notify_ison_batch_free (batch);
 	}
+
+	g_strfreev (names);
+	g_hash_table_destroy (online);
 	fe_notify_update (0);
 }
 
-/* yuck! Old routine for ISON notify */
+static void
+notify_ison_send (server *serv, notify_ison_batch *batch, GString *line)
+{
+	serv->p_raw (serv, line->str);
+
+	if (!serv->notify_ison)
+		serv->notify_ison = g_queue_new ();
+	g_queue_push_tail (serv->notify_ison, batch);
+}
+
+/* ask about everyone MONITOR or WATCH doesn't cover, in as many ISON
+   lines as it takes. Servers answer in order, one 303 per line. */
 
 static void
 notify_checklist_for_server (server *serv)
 {
-	char outbuf[512];
+	notify_ison_batch *batch = NULL, *oldest;
+	struct notify_per_server *servnot;
 	struct notify *notify;
-	GSList *list = notify_list;
-	int i = 0;
+	GString *line;
+	GSList *list;
 
-	strcpy (outbuf, "ISON ");
-	while (list)
+	/* don't pile up rounds on a lagging server */
+	if (serv->notify_ison)
+	{
+		oldest = g_queue_peek_head (serv->notify_ison);
+		if (oldest && oldest->sent + NOTIFY_ISON_STALE > time (NULL))
+			return;
+		notify_ison_clear (serv);
+	}
+
+	line = g_string_sized_new (512);
+	for (list = notify_list; list; list = list->next)
 	{
 		notify = list->data;
-		if (notify_do_network (notify, serv))
+		servnot = notify_find (serv, notify->name);
+		if (!servnot || servnot->notify != notify || servnot->watched)
+			continue;
+
+		if (batch && line->len + 1 + strlen (notify->name) > NOTIFY_ISON_LEN)
 		{
-			i++;
-			strcat (outbuf, notify->name);
-			strcat (outbuf, " ");
-			if (strlen (outbuf) > 460)
-			{
-				/* LAME: we can't send more than 512 bytes to the server, but     *
-				 * if we split it in two packets, our offline detection wouldn't  *
-				 work                                                           */
-				/*fprintf (stderr, _("*** ZOITECHAT WARNING: notify list too large.\n"));*/
-				break;
-			}
+			notify_ison_send (serv, batch, line);
+			batch = NULL;
 		}
-		list = list->next;
+
+		if (!batch)
+		{
+			batch = g_new (notify_ison_batch, 1);
+			batch->sent = time (NULL);
+			batch->nicks = g_ptr_array_new_with_free_func (g_free);
+			g_string_assign (line, "ISON");
+		}
+
+		g_string_append_c (line, ' ');
+		g_string_append (line, notify->name);
+		g_ptr_array_add (batch->nicks, g_strdup (notify->name));
 	}
 
-	if (i)
-		serv->p_raw (serv, outbuf);
+	if (batch)
+		notify_ison_send (serv, batch, line);
+	g_string_free (line, TRUE);
 }
 
 int
@@ -529,7 +760,7 @@ notify_checklist (void)	/* check ISON list */
 	while (list)
 	{
 		serv = list->data;
-		if (serv->connected && serv->end_of_motd && !serv->supports_watch && !serv->supports_monitor)
+		if (serv->connected && serv->end_of_motd)
 		{
 			notify_checklist_for_server (serv);
 		}
@@ -593,6 +824,7 @@ notify_deluser (char *name)
 				g_free (servnot);
 			}
 			notify_list = g_slist_remove (notify_list, notify);
+			notify_index_reset_all ();
 			notify_watch_all (notify, FALSE);
 			g_free (notify->networks);
 			g_free (notify->name);
@@ -616,49 +848,27 @@ notify_adduser (char *name, char *networks)
 		notify->networks = despacify_dup (networks);
 	notify->server_list = 0;
 	notify_list = g_slist_prepend (notify_list, notify);
+	notify_index_reset_all ();
+	/* watch first, so ISON only asks where MONITOR or WATCH can't */
+	notify_watch_all (notify, TRUE);
 	notify_checklist ();
 	fe_notify_update (notify->name);
 	fe_notify_update (0);
-	notify_watch_all (notify, TRUE);
 }
 
 gboolean
 notify_is_in_list (server *serv, char *name)
 {
-	struct notify *notify;
-	GSList *list = notify_list;
-
-	while (list)
-	{
-		notify = (struct notify *) list->data;
-		if (!serv->p_cmp (notify->name, name))
-			return TRUE;
-		list = list->next;
-	}
-
-	return FALSE;
+	return notify_find (serv, name) != NULL;
 }
 
 int
 notify_isnotify (struct session *sess, char *name)
 {
-	struct notify *notify;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
 
-	while (list)
-	{
-		notify = (struct notify *) list->data;
-		if (!sess->server->p_cmp (notify->name, name))
-		{
-			servnot = notify_find_server_entry (notify, sess->server);
-			if (servnot && servnot->ison)
-				return TRUE;
-		}
-		list = list->next;
-	}
-
-	return FALSE;
+	servnot = notify_find (sess->server, name);
+	return servnot && servnot->ison;
 }
 
 void
@@ -671,6 +881,16 @@ notify_cleanup ()
 	struct server *serv;
 	int valid;
 
+	/* the per-server entries below may go away, and with them
+	   anything a disconnected server was still waiting on */
+	notify_index_reset_all ();
+	for (srvlist = serv_list; srvlist; srvlist = srvlist->next)
+	{
+		serv = srvlist->data;
+		if (!serv->connected)
+			notify_ison_clear (serv);
+	}
+
 	while (list)
 	{
 		/* Traverse the list of notify structures */
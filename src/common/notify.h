@@ -37,6 +37,7 @@ struct notify_per_server
 	time_t lastseen;
 	time_t lastoff;
 	unsigned int ison:1;
+	unsigned int watched:1;	/* on the server's MONITOR or WATCH list */
 };
 
 extern GSList *notify_list;
@@ -50,7 +51,11 @@ void notify_set_online_list (server * serv, char *users,
 								const message_tags_data *tags_data);
 void notify_set_offline_list (server * serv, char *users, int quiet,
 									 const message_tags_data *tags_data);
+void notify_set_unwatched_list (server * serv, char *users);
+void notify_note_user_ison (server *serv, const char *raw);
 void notify_send_watches (server * serv);
+void notify_index_reset (server *serv);
+void notify_forget_server (server *serv);
 
 void notify_adduser (char *name, char *networks);
 int notify_deluser (char *name);
@@ -62,7 +67,7 @@ gboolean notify_is_in_list (server *serv, char *name);
 int notify_isnotify (session *sess, char *name);
 struct notify_per_server *notify_find_server_entry (struct notify *notify, struct server *serv);
 
-void notify_markonline (server *serv, char *word[], 
+void notify_markonline (server *serv, char *nicks,
 								const message_tags_data *tags_data);
 int notify_checklist (void);
 
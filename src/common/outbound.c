@@ -52,9 +52,11 @@
 #include "zoitechatc.h"
 #include "servlist.h"
 #include "server.h"
+#include "reconnect.h"
 #include "tree.h"
 #include "outbound.h"
 #include "chanopt.h"
+#include "cmdindex.h"
 
 #define TBUFSIZE 4096
 
@@ -420,14 +422,14 @@ create_mask (session * sess, char *mask, char *mode, char *typestr, int deop)
 	char username[64], fullhost[128], domain[128], buf[512], *p2;
 
 	user = userlist_find (sess, mask);
-	if (user && user->hostname)  /* it's a nickname, let's find a proper ban mask */
+	if (user && user->info->hostname)  /* it's a nickname, let's find a proper ban mask */
 	{
 		if (deop)
 			p2 = user->nick;
 		else
 			p2 = "";
 
-		mask = user->hostname;
+		mask = user->info->hostname;
 
 		at = strchr (mask, '@');	/* FIXME: utf8 */
 		if (!at)
@@ -886,6 +888,7 @@ cmd_debug (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	struct session *s;
 	struct server *v;
 	GSList *list = sess_list;
+	GSList *seen = NULL;
 
 	PrintText (sess, "Session   T Channel    WaitChan  WillChan  Server\n");
 	while (list)
@@ -898,13 +901,62 @@ cmd_debug (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		list = list->next;
 	}
 
+	list = sess_list;
+	PrintText (sess, "Session   Lines  Text      Arena     Wraps     Index     Search\n");
+	while (list)
+	{
+		char *mem;
+
+		s = (struct session *) list->data;
+		mem = fe_text_memory (s);
+		if (mem)
+		{
+			sprintf (tbuf, "%p %s\n", s, mem);
+			PrintText (sess, tbuf);
+			g_free (mem);
+		}
+		list = list->next;
+	}
+
+	/* one line per window, the text widget is shared by its tabs */
+	list = sess_list;
+	PrintText (sess, "Window    Frames    Coalesced Dropped   Draw ms\n");
+	while (list)
+	{
+		char *stats;
+
+		s = (struct session *) list->data;
+		list = list->next;
+		if (g_slist_find (seen, s->gui))
+			continue;
+		seen = g_slist_prepend (seen, s->gui);
+
+		stats = fe_text_render_stats (s);
+		if (stats)
+		{
+			sprintf (tbuf, "%p %s\n", s->gui, stats);
+			PrintText (sess, tbuf);
+			g_free (stats);
+		}
+	}
+	g_slist_free (seen);
+
+	/* how long the last connect took per phase, in ms */
 	list = serv_list;
-	PrintText (sess, "Server    Sock  Name\n");
+	PrintText (sess, "Server    Sock  DNS   TCP   Proxy TLS   Name\n");
 	while (list)
 	{
 		v = (struct server *) list->data;
-		sprintf (tbuf, "%p %-5d %s\n",
-					v, v->sok, v->servername);
+		if (v->connected)
+			sprintf (tbuf, "%p %-5d %-5d %-5d %-5d %-5d %s\n",
+						v, v->sok, (int) (v->connect_times[CONNECTOR_PHASE_DNS] / 1000),
+						(int) (v->connect_times[CONNECTOR_PHASE_TCP] / 1000),
+						(int) (v->connect_times[CONNECTOR_PHASE_PROXY] / 1000),
+						(int) (v->connect_times[CONNECTOR_PHASE_TLS] / 1000), v->servername);
+		else
+			/* the TLS slot holds the handshake's start until it's done */
+			sprintf (tbuf, "%p %-5d -     -     -     -     %s\n",
+						v, v->sok, v->servername);
 		PrintText (sess, tbuf);
 		list = list->next;
 	}
@@ -997,9 +1049,12 @@ mdehop_cb (struct User *user, multidata *data)
 static int
 cmd_mdehop (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
-	char **nicks = g_new0 (char *, sess->hops);
+	char **nicks;
 	multidata data;
 
+	/* the counts must include a NAMES burst still queued */
+	userlist_flush_names (sess);
+	nicks = g_new0 (char *, sess->hops);
 	data.nicks = nicks;
 	data.i = 0;
 	tree_foreach (sess->usertree, (tree_traverse_func *)mdehop_cb, &data);
@@ -1023,9 +1078,12 @@ mdeop_cb (struct User *user, multidata *data)
 static int
 cmd_mdeop (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
-	char **nicks = g_new0(char *, sess->ops);
+	char **nicks;
 	multidata data;
 
+	/* the counts must include a NAMES burst still queued */
+	userlist_flush_names (sess);
+	nicks = g_new0 (char *, sess->ops);
 	data.nicks = nicks;
 	data.i = 0;
 	tree_foreach (sess->usertree, (tree_traverse_func *)mdeop_cb, &data);
@@ -1351,9 +1409,12 @@ mhop_cb (struct User *user, multidata *data)
 static int
 cmd_mhop (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
-	char **nicks = g_new0 (char *, sess->total - sess->hops);
+	char **nicks;
 	multidata data;
 
+	/* the counts must include a NAMES burst still queued */
+	userlist_flush_names (sess);
+	nicks = g_new0 (char *, sess->total - sess->hops);
 	data.nicks = nicks;
 	data.i = 0;
 	tree_foreach (sess->usertree, (tree_traverse_func *)mhop_cb, &data);
@@ -1387,6 +1448,7 @@ cmd_mkick (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 
 	data.sess = sess;
 	data.reason = word_eol[2];
+	userlist_flush_names (sess);
 	tree_foreach (sess->usertree, (tree_traverse_func *)mkickops_cb, &data);
 	tree_foreach (sess->usertree, (tree_traverse_func *)mkick_cb, &data);
 
@@ -1430,9 +1492,9 @@ cmd_dns (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		user = userlist_find (sess, nick);
 		if (user)
 		{
-			if (user->hostname)
+			if (user->info->hostname)
 			{
-				do_dns (sess, user->nick, user->hostname, &no_tags);
+				do_dns (sess, user->nick, user->info->hostname, &no_tags);
 			} else
 			{
 				sess->server->p_get_ip (sess->server, nick);
@@ -2808,9 +2870,12 @@ mop_cb (struct User *user, multidata *data)
 static int
 cmd_mop (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
-	char **nicks = g_new0 (char *, sess->total - sess->ops);
+	char **nicks;
 	multidata data;
 
+	/* the counts must include a NAMES burst still queued */
+	userlist_flush_names (sess);
+	nicks = g_new0 (char *, sess->total - sess->ops);
 	data.nicks = nicks;
 	data.i = 0;
 	tree_foreach (sess->usertree, (tree_traverse_func *)mop_cb, &data);
@@ -3350,17 +3415,63 @@ cmd_quote (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
 	char *raw = word_eol[2];
 
+	notify_note_user_ison (sess->server, raw);
 	return sess->server->p_raw (sess->server, raw);
 }
 
+static void
+reconnect_print_status (session *sess)
+{
+	GSList *list, *item;
+	reconnect_info *info;
+	char *name;
+
+	if (prefs.hex_net_reconnect_max > 0)
+		PrintTextf (sess, _("Reconnecting: %d of %d slots in use\n"),
+						reconnect_active_count (), prefs.hex_net_reconnect_max);
+	else
+		PrintTextf (sess, _("Reconnecting: %d servers, no limit\n"), reconnect_active_count ());
+
+	list = reconnect_get_list ();
+	if (!list)
+	{
+		PrintText (sess, _("No servers are waiting to reconnect.\n"));
+		return;
+	}
+
+	for (item = list; item; item = item->next)
+	{
+		info = item->data;
+		name = server_get_network (info->owner, TRUE);
+
+		switch (info->state)
+		{
+		case RECONNECT_ACTIVE:
+			PrintTextf (sess, _("  %-20s connecting, attempt %d\n"), name, info->attempts);
+			break;
+		case RECONNECT_QUEUED:
+			PrintTextf (sess, _("  %-20s waiting for a slot, attempt %d\n"), name, info->attempts);
+			break;
+		default:
+			PrintTextf (sess, _("  %-20s retrying in %ds, attempt %d\n"), name,
+							(info->remaining + 999) / 1000, info->attempts);
+		}
+	}
+
+	g_slist_free_full (list, g_free);
+}
+
 static int
 cmd_reconnect (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
-	int tmp = prefs.hex_net_reconnect_delay;
 	GSList *list;
 	server *serv = sess->server;
 
-	prefs.hex_net_reconnect_delay = 0;
+	if (!g_ascii_strcasecmp (word[2], "STATUS"))
+	{
+		reconnect_print_status (sess);
+		return TRUE;
+	}
 
 	if (!g_ascii_strcasecmp (word[2], "ALL"))
 	{
@@ -3369,7 +3480,9 @@ cmd_reconnect (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		{
 			serv = list->data;
 			if (serv->connected)
-				serv->auto_reconnect (serv, TRUE, -1);
+			{
+				server_reconnect_now (serv);
+			}
 			list = list->next;
 		}
 	}
@@ -3407,13 +3520,12 @@ cmd_reconnect (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		if (*word[3+offset])
 			serv->port = atoi (word[3+offset]);
 		safe_strcpy (serv->hostname, word[2+offset], sizeof (serv->hostname));
-		serv->auto_reconnect (serv, TRUE, -1);
+		server_reconnect_now (serv);
 	}
 	else
 	{
-		serv->auto_reconnect (serv, TRUE, -1);
+		server_reconnect_now (serv);
 	}
-	prefs.hex_net_reconnect_delay = tmp;
 
 	return TRUE;
 }
@@ -3991,7 +4103,7 @@ userlist_cb (struct User *user, session *sess)
 		lt = time (0) - user->lasttalk;
 	PrintTextf (sess,
 				"\00306%s\t\00314[\00310%-38s\00314] \017ov\0033=\017%d%d away=%u lt\0033=\017%ld\n",
-				user->nick, user->hostname, user->op, user->voice, user->away, (long)lt);
+				user->nick, user->info->hostname, user->op, user->voice, user->info->away, (long)lt);
 
 	return TRUE;
 }
@@ -4022,6 +4134,7 @@ static int
 cmd_userlist (struct session *sess, char *tbuf, char *word[],
 				  char *word_eol[])
 {
+	userlist_flush_names (sess);
 	tree_foreach (sess->usertree, (tree_traverse_func *)userlist_cb, sess);
 	return TRUE;
 }
@@ -4063,6 +4176,7 @@ cmd_wallchop (struct session *sess, char *tbuf, char *word[],
 	data.tbuf = tbuf;
 	data.i = 0;
 	data.sess = sess;
+	userlist_flush_names (sess);
 	tree_foreach (sess->usertree, (tree_traverse_func*)wallchop_cb, &data);
 
 	if (data.i)
@@ -4263,10 +4377,10 @@ const struct commands xc_cmds[] = {
 	 N_("QUOTE <text>, sends the text in raw form to the server")},
 #ifdef USE_OPENSSL
 	{"RECONNECT", cmd_reconnect, 0, 0, 1,
-	 N_("RECONNECT [-ssl|-ssl-noverify] [<host>] [<port>] [<password>], Can be called just as /RECONNECT to reconnect to the current server or with /RECONNECT ALL to reconnect to all the open servers")},
+	 N_("RECONNECT [-ssl|-ssl-noverify] [<host>] [<port>] [<password>], Can be called just as /RECONNECT to reconnect to the current server, with /RECONNECT ALL to reconnect to all the open servers or with /RECONNECT STATUS to list the servers waiting to reconnect")},
 #else
 	{"RECONNECT", cmd_reconnect, 0, 0, 1,
-	 N_("RECONNECT [<host>] [<port>] [<password>], Can be called just as /RECONNECT to reconnect to the current server or with /RECONNECT ALL to reconnect to all the open servers")},
+	 N_("RECONNECT [<host>] [<port>] [<password>], Can be called just as /RECONNECT to reconnect to the current server, with /RECONNECT ALL to reconnect to all the open servers or with /RECONNECT STATUS to list the servers waiting to reconnect")},
 #endif
 	{"RECV", cmd_recv, 1, 0, 1, N_("RECV <text>, send raw data to ZoiteChat, as if it was received from the IRC server")},
 	{"RELOAD", cmd_reload, 0, 0, 1, N_("RELOAD <name>, reloads a plugin or script")},
@@ -4335,6 +4449,23 @@ find_internal_command (char *name)
 				sizeof (xc_cmds[0])) - 1, sizeof (xc_cmds[0]), command_compare);
 }
 
+static command_index *usercommands = NULL;
+static guint usercommands_generation = 0;
+
+/* all user commands called 'name', rebuilding the index if any list changed */
+static GSList *
+usercommand_find (const char *name)
+{
+	if (!usercommands || usercommands_generation != list_generation)
+	{
+		command_index_free (usercommands);
+		usercommands = command_index_new (command_list);
+		usercommands_generation = list_generation;
+	}
+
+	return command_index_lookup (usercommands, name);
+}
+
 static gboolean
 usercommand_show_help (session *sess, char *name)
 {
@@ -4343,17 +4474,14 @@ usercommand_show_help (session *sess, char *name)
 	char buf[1024];
 	GSList *list;
 
-	list = command_list;
+	list = usercommand_find (name);
 	while (list)
 	{
 		pop = (struct popup *) list->data;
-		if (!g_ascii_strcasecmp (pop->name, name))
-		{
-			g_snprintf (buf, sizeof(buf), _("User Command for: %s\n"), pop->cmd);
-			PrintText (sess, buf);
+		g_snprintf (buf, sizeof(buf), _("User Command for: %s\n"), pop->cmd);
+		PrintText (sess, buf);
 
-			found = TRUE;
-		}
+		found = TRUE;
 		list = list->next;
 	}
 
@@ -4698,6 +4826,7 @@ perform_nick_completion (struct session *sess, char *cmd, char *tbuf)
 				data.best = NULL;
 				data.tbuf = tbuf;
 				data.space = space - 1;
+				userlist_flush_names (sess);
 				tree_foreach (sess->usertree, (tree_traverse_func *)nick_comp_cb, &data);
 
 				if (data.len == -1)
@@ -4919,7 +5048,7 @@ handle_command (session *sess, char *cmd, int check_spch)
 {
 	struct popup *pop;
 	int user_cmd = FALSE;
-	GSList *list;
+	GSList *list, *matches;
 	char *word[PDIWORDS+1];
 	char *word_eol[PDIWORDS+1];
 	static int command_level = 0;
@@ -4927,6 +5056,8 @@ handle_command (session *sess, char *cmd, int check_spch)
 	char *pdibuf;
 	char *tbuf;
 	int len;
+	int n;
+	gboolean quotes;
 	int ret = TRUE;
 
 	if (command_level > 99)
@@ -4941,21 +5072,31 @@ handle_command (session *sess, char *cmd, int check_spch)
 	pdibuf = g_malloc (len + 1);
 	tbuf = g_malloc (MAX(TBUFSIZE, (len * 2) + 1));
 
-	/* split the text into words and word_eol */
-	process_data_init (pdibuf, cmd, word, word_eol, TRUE, TRUE);
+	/* split the text into words and word_eol. Commands like /JOIN want no
+	 * quotes processing, so when the command name itself is unquoted look
+	 * it up first and split only once. */
+	n = strcspn (cmd, " \"");
+	if (cmd[n] != '"')
+	{
+		memcpy (pdibuf, cmd, n);
+		pdibuf[n] = 0;
+		int_cmd = find_internal_command (pdibuf);
+		quotes = !int_cmd || int_cmd->handle_quotes;
+		process_data_init (pdibuf, cmd, word, word_eol, quotes, quotes);
+	}
+	else
+	{
+		process_data_init (pdibuf, cmd, word, word_eol, TRUE, TRUE);
+		int_cmd = find_internal_command (word[1]);
+		if (int_cmd && !int_cmd->handle_quotes)
+			process_data_init (pdibuf, cmd, word, word_eol, FALSE, FALSE);
+	}
 
 	/* ensure an empty string at index 32 for cmd_deop etc */
 	/* (internal use only, plugins can still only read 1-31). */
 	word[PDIWORDS] = "\000\000";
 	word_eol[PDIWORDS] = "\000\000";
 
-	int_cmd = find_internal_command (word[1]);
-	/* redo it without quotes processing, for some commands like /JOIN */
-	if (int_cmd && !int_cmd->handle_quotes)
-	{
-		process_data_init (pdibuf, cmd, word, word_eol, FALSE, FALSE);
-	}
-
 	if (check_spch && prefs.hex_input_perc_color)
 	{
 		check_special_chars (cmd, prefs.hex_input_perc_ascii);
@@ -4972,18 +5113,16 @@ handle_command (session *sess, char *cmd, int check_spch)
 		goto xit;
 	}
 
-	/* first see if it's a userCommand */
-	list = command_list;
-	while (list)
+	/* first see if it's a userCommand. The matches are copied because a
+	 * nested command may change a list and rebuild the index under us. */
+	matches = g_slist_copy (usercommand_find (word[1]));
+	for (list = matches; list; list = list->next)
 	{
 		pop = (struct popup *) list->data;
-		if (!g_ascii_strcasecmp (pop->name, word[1]))
-		{
-			user_command (sess, tbuf, pop->cmd, word, word_eol);
-			user_cmd = TRUE;
-		}
-		list = list->next;
+		user_command (sess, tbuf, pop->cmd, word, word_eol);
+		user_cmd = TRUE;
 	}
+	g_slist_free (matches);
 
 	if (user_cmd)
 	{
@@ -4991,8 +5130,6 @@ handle_command (session *sess, char *cmd, int check_spch)
 	}
 
 	/* now check internal commands */
-	int_cmd = find_internal_command (word[1]);
-
 	if (int_cmd)
 	{
 		if (int_cmd->needserver && !sess->server->connected)
@@ -5025,6 +5162,7 @@ handle_command (session *sess, char *cmd, int check_spch)
 		else
 		{
 			/* unknown command, just send it to the server and hope */
+			notify_note_user_ison (sess->server, cmd);
 			sess->server->p_raw (sess->server, cmd);
 		}
 	}
@@ -40,12 +40,15 @@
 #include "servlist.h"
 #include "modes.h"
 #include "notify.h"
+#include "reconnect.h"
 #include "text.h"
 #define PLUGIN_C
 typedef struct session zoitechat_context;
 #include "zoitechat-plugin.h"
 #include "plugin.h"
 #include "typedef.h"
+#include "hooktable.h"
+#include "pluginpref.h"
 
 
 #include "zoitechatc.h"
@@ -129,10 +132,9 @@ enum
 	LIST_USERS
 };
 
-/* We use binary flags here because it makes it possible for plugin_hook_find()
- * to match several types of hooks.  This is used so that plugin_hook_run()
- * match both HOOK_SERVER and HOOK_SERVER_ATTRS hooks when plugin_emit_server()
- * is called.
+/* We use binary flags here because it makes it possible for plugin_hook_run()
+ * to match several types of hooks.  This is used so that it matches both
+ * HOOK_SERVER and HOOK_SERVER_ATTRS hooks when plugin_emit_server() is called.
  */
 enum
 {
@@ -176,9 +178,18 @@ enum
 
 GSList *plugin_list = NULL;	/* export for plugingui.c */
 static GSList *hook_list = NULL;
+/* command, server and print hooks are also indexed by name for dispatch */
+static hook_table *command_hooks = NULL;
+static hook_table *server_hooks = NULL;
+static hook_table *print_hooks = NULL;
+static GSList *hook_dead = NULL;	/* unhooked, freed when no hook is running */
+static int hook_run_depth = 0;
 
 extern const struct prefs vars[];	/* cfgfiles.c */
 
+static void pluginpref_release (zoitechat_plugin *pl);
+static void pluginpref_flush_all (void);
+
 
 /* unload a plugin and remove it from our linked list */
 
@@ -218,6 +229,8 @@ plugin_free (zoitechat_plugin *pl, int do_deinit, int allow_refuse)
 #endif
 
 xit:
+	pluginpref_release (pl);
+
 	if (pl->free_strings)
 	{
 		g_free (pl->name);
@@ -412,6 +425,9 @@ plugin_kill_all (void)
 			plugin_free (list->data, TRUE, FALSE);
 		list = next;
 	}
+
+	/* settings of scripts that are still loaded */
+	pluginpref_flush_all ();
 }
 
 #if defined(USE_PLUGIN) || defined(WIN32)
@@ -577,48 +593,78 @@ plugin_reload (session *sess, char *name, int by_filename)
 
 #endif
 
-static GSList *
-plugin_hook_find (GSList *list, int type, char *name)
+static hook_table *
+plugin_hook_table (int type)
 {
-	zoitechat_hook *hook;
+	hook_table **table;
 
-	while (list)
-	{
-		hook = list->data;
-		if (hook && (hook->type & type))
-		{
-			if (g_ascii_strcasecmp (hook->name, name) == 0)
-				return list;
+	if (type & HOOK_COMMAND)
+		table = &command_hooks;
+	else if (type & (HOOK_SERVER | HOOK_SERVER_ATTRS))
+		table = &server_hooks;
+	else if (type & (HOOK_PRINT | HOOK_PRINT_ATTRS))
+		table = &print_hooks;
+	else
+		return NULL;
 
-			if ((type & HOOK_SERVER)
-				&& g_ascii_strcasecmp (hook->name, "RAW LINE") == 0)
-					return list;
-		}
-		list = list->next;
-	}
+	if (!*table)
+		*table = hook_table_new ();
+	return *table;
+}
 
-	return NULL;
+/* really remove deleted hooks now */
+
+static void
+plugin_reap_hooks (void)
+{
+	GSList *list;
+
+	for (list = hook_dead; list; list = list->next)
+	{
+		hook_list = g_slist_remove (hook_list, list->data);
+		g_free (list->data);
+	}
+	g_slist_free (hook_dead);
+	hook_dead = NULL;
 }
 
+#define HOOK_RUN_STACK 32
+
 /* check for plugin hooks and run them */
 
 static int
 plugin_hook_run (session *sess, char *name, char *word[], char *word_eol[],
 				 zoitechat_event_attrs *attrs, int type)
 {
-	GSList *list, *next;
+	void *stack[HOOK_RUN_STACK];
+	void **hooks = stack;
+	hook_table *table;
 	zoitechat_hook *hook;
-	int ret, eat = 0;
+	char *raw;
+	int i, n, ret, eat = 0;
 
-	list = hook_list;
-	while (1)
+	/* "RAW LINE" hooks see every server line, in priority order with the
+	 * hooks for this one */
+	table = plugin_hook_table (type);
+	raw = (type & HOOK_SERVER) ? "RAW LINE" : NULL;
+
+	/* run from a copy, the callbacks may add or remove hooks */
+	n = hook_table_collect (table, name, raw, stack, HOOK_RUN_STACK);
+	if (n > HOOK_RUN_STACK)
 	{
-		list = plugin_hook_find (list, type, name);
-		if (!list)
-			goto xit;
+		hooks = g_new (void *, n);
+		hook_table_collect (table, name, raw, hooks, n);
+	}
+
+	hook_run_depth++;
+	for (i = 0; i < n; i++)
+	{
+		hook = hooks[i];
+
+		/* unhooked by a callback that ran before it */
+		if (!(hook->type & type))
+			continue;
 
-		hook = list->data;
-		next = list->next;
 		hook->pl->context = sess;
 
 		/* run the plugin's callback function */
@@ -644,30 +690,20 @@ plugin_hook_run (session *sess, char *name, char *word[], char *word_eol[],
 		if ((ret & ZOITECHAT_EAT_ZOITECHAT) && (ret & ZOITECHAT_EAT_PLUGIN))
 		{
 			eat = 1;
-			goto xit;
+			break;
 		}
 		if (ret & ZOITECHAT_EAT_PLUGIN)
-			goto xit;	/* stop running plugins */
+			break;	/* stop running plugins */
 		if (ret & ZOITECHAT_EAT_ZOITECHAT)
 			eat = 1;	/* eventually we'll return 1, but continue running plugins */
-
-		list = next;
 	}
+	hook_run_depth--;
 
-xit:
-	/* really remove deleted hooks now */
-	list = hook_list;
-	while (list)
-	{
-		hook = list->data;
-		next = list->next;
-		if (!hook || hook->type == HOOK_DELETED)
-		{
-			hook_list = g_slist_remove (hook_list, hook);
-			g_free (hook);
-		}
-		list = next;
-	}
+	if (hooks != stack)
+		g_free (hooks);
+
+	if (hook_run_depth == 0 && hook_dead)
+		plugin_reap_hooks ();
 
 	return eat;
 }
@@ -862,6 +898,7 @@ plugin_add_hook (zoitechat_plugin *pl, int type, int pri, const char *name,
 					  const  char *help_text, void *callb, int timeout, void *userdata)
 {
 	zoitechat_hook *hook;
+	hook_table *table;
 
 	hook = g_new0 (zoitechat_hook, 1);
 	hook->type = type;
@@ -875,6 +912,10 @@ plugin_add_hook (zoitechat_plugin *pl, int type, int pri, const char *name,
 	/* insert it into the linked list */
 	plugin_insert_hook (hook);
 
+	table = plugin_hook_table (type);
+	if (table)
+		hook_table_add (table, hook->name ? hook->name : "", pri, hook);
+
 	if (type == HOOK_TIMER)
 		hook->tag = fe_timeout_add (timeout, plugin_timeout_cb, hook);
 
@@ -919,18 +960,13 @@ plugin_command_foreach (session *sess, void *userdata,
 int
 plugin_show_help (session *sess, char *cmd)
 {
-	GSList *list;
 	zoitechat_hook *hook;
 
-	list = plugin_hook_find (hook_list, HOOK_COMMAND, cmd);
-	if (list)
+	hook = hook_table_first (plugin_hook_table (HOOK_COMMAND), cmd);
+	if (hook && hook->help_text)
 	{
-		hook = list->data;
-		if (hook->help_text)
-		{
-			PrintText (sess, hook->help_text);
-			return 1;
-		}
+		PrintText (sess, hook->help_text);
+		return 1;
 	}
 
 	return 0;
@@ -1004,6 +1040,8 @@ plugin_find_context (const char *servname, const char *channel, server *current_
 void *
 zoitechat_unhook (zoitechat_plugin *ph, zoitechat_hook *hook)
 {
+	hook_table *table;
+
 	/* perl.c trips this */
 	if (!g_slist_find (hook_list, hook) || hook->type == HOOK_DELETED)
 		return NULL;
@@ -1014,7 +1052,12 @@ zoitechat_unhook (zoitechat_plugin *ph, zoitechat_hook *hook)
 	if (hook->type == HOOK_FD && hook->tag != 0)
 		fe_input_remove (hook->tag);
 
+	table = plugin_hook_table (hook->type);
+	if (table)
+		hook_table_remove (table, hook->name ? hook->name : "", hook);
+
 	hook->type = HOOK_DELETED;	/* expunge later */
+	hook_dead = g_slist_prepend (hook_dead, hook);
 
 	g_free (hook->name);	/* NULL for timers & fds */
 	g_free (hook->help_text);	/* NULL for non-commands */
@@ -1249,11 +1292,37 @@ zoitechat_get_info (zoitechat_plugin *ph, const char *id)
 	case 0x438fdf9: /* nickserv */
 		return NULL;
 
+	case 0x3b049b57: /* reconnect */
+		{
+			static char reconnect[64];
+			static const char * const states[] = { "idle", "waiting", "queued", "active" };
+			reconnect_info info;
+
+			/* state, failed attempts since the last login, seconds left to wait */
+			reconnect_get_info (sess->server, &info);
+			g_snprintf (reconnect, sizeof (reconnect), "%s %d %d", states[info.state],
+						  info.attempts, (info.remaining + 999) / 1000);
+			return reconnect;
+		}
+
 	case 0xca022f43: /* server */
 		if (!sess->server->connected)
 			return NULL;
 		return sess->server->servername;
 
+	case 0x68421e9: /* sendq */
+		{
+			static char sendq[64];
+			server *serv = sess->server;
+
+			/* lines, then bytes in total and for priority 2 (first), 1 and 0 */
+			g_snprintf (sendq, sizeof (sendq), "%u %d %d %d %d",
+						  serv->outbound_queue[0].length + serv->outbound_queue[1].length +
+						  serv->outbound_queue[2].length, serv->sendq_len,
+						  serv->sendq_bytes[2], serv->sendq_bytes[1], serv->sendq_bytes[0]);
+			return sendq;
+		}
+
 	case 0x696cd2f: /* topic */
 		return sess->topic;
 
@@ -1558,15 +1627,15 @@ zoitechat_list_str (zoitechat_plugin *ph, zoitechat_list *xlist, const char *nam
 		switch (hash)
 		{
 		case 0xb9d38a2d: /* account */
-			return ((struct User *)data)->account;
+			return ((struct User *)data)->info->account;
 		case 0x339763: /* nick */
 			return ((struct User *)data)->nick;
 		case 0x30f5a8: /* host */
-			return ((struct User *)data)->hostname;
+			return ((struct User *)data)->info->hostname;
 		case 0xc594b292: /* prefix */
 			return ((struct User *)data)->prefix;
 		case 0xccc6d529: /* realname */
-			return ((struct User *)data)->realname;
+			return ((struct User *)data)->info->realname;
 		}
 		break;
 	}
@@ -1702,7 +1771,7 @@ zoitechat_list_int (zoitechat_plugin *ph, zoitechat_list *xlist, const char *nam
 		switch (hash)
 		{
 		case 0x2de2ee:	/* away */
-			return ((struct User *)data)->away;
+			return ((struct User *)data)->info->away;
 		case 0x4705f29b: /* selected */
 			return ((struct User *)data)->selected;
 		}
@@ -1818,149 +1887,123 @@ zoitechat_free (zoitechat_plugin *ph, void *ptr)
 	g_free (ptr);
 }
 
-static int
-zoitechat_pluginpref_set_str_real (zoitechat_plugin *pl, const char *var, const char *value, int mode) /* mode: 0 = delete, 1 = save */
+/* each addon_<name>.conf is read once and kept in memory; changes are
+ * written back in one go a few seconds later, or when the plugin unloads */
+
+#define PLUGINPREF_FLUSH_DELAY 5
+
+static GHashTable *pluginpref_stores = NULL;	/* canonical name -> pluginpref_store */
+static int pluginpref_flush_tag = 0;
+
+static char *
+pluginpref_name (zoitechat_plugin *pl)
 {
-	FILE *fpIn;
-	int fhOut;
-	int prevSetting;
-	char *confname;
-	char *confname_tmp;
-	char *escaped_value;
-	char *buffer;
-	char *buffer_tmp;
-	char line_buffer[512];		/* the same as in cfg_put_str */
-	char *line_bufp = line_buffer;
 	char *canon;
 
 	canon = g_strdup (pl->name);
 	canonalize_key (canon);
-	confname = g_strdup_printf ("addon_%s.conf", canon);
-	g_free (canon);
-	confname_tmp = g_strdup_printf ("%s.new", confname);
+	return canon;
+}
+
+static pluginpref_store *
+pluginpref_get_store (zoitechat_plugin *pl)
+{
+	pluginpref_store *store;
+	char *canon, *confname, *filename;
 
-	fhOut = zoitechat_open_file (confname_tmp, O_TRUNC | O_WRONLY | O_CREAT, 0600, XOF_DOMODE);
-	fpIn = zoitechat_fopen_file (confname, "r", 0);
+	if (!pluginpref_stores)
+		pluginpref_stores = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+																 (GDestroyNotify) pluginpref_store_free);
 
-	if (fhOut == -1)		/* unable to save, abort */
+	canon = pluginpref_name (pl);
+	store = g_hash_table_lookup (pluginpref_stores, canon);
+	if (store)
 	{
-		g_free (confname);
-		g_free (confname_tmp);
-		if (fpIn)
-			fclose (fpIn);
-		return 0;
+		g_free (canon);
+		return store;
 	}
-	else if (fpIn == NULL)	/* no previous config file, no parsing */
-	{
-		if (mode)
-		{
-			escaped_value = g_strescape (value, NULL);
-			buffer = g_strdup_printf ("%s = %s\n", var, escaped_value);
-			g_free (escaped_value);
-			write (fhOut, buffer, strlen (buffer));
-			g_free (buffer);
-			close (fhOut);
-
-			buffer = g_build_filename (get_xdir (), confname, NULL);
-			g_free (confname);
-			buffer_tmp = g_build_filename (get_xdir (), confname_tmp, NULL);
-			g_free (confname_tmp);
 
-#ifdef WIN32
-			g_unlink (buffer);
-#endif
+	confname = g_strdup_printf ("addon_%s.conf", canon);
+	filename = g_build_filename (get_xdir (), confname, NULL);
+	store = pluginpref_store_load (filename);
+	g_hash_table_insert (pluginpref_stores, canon, store);
 
-			if (g_rename (buffer_tmp, buffer) == 0)
-			{
-				g_free (buffer);
-				g_free (buffer_tmp);
-				return 1;
-			}
-			else
-			{
-				g_free (buffer);
-				g_free (buffer_tmp);
-				return 0;
-			}
-		}
-		else
-		{
-			/* mode = 0, we want to delete but the config file and thus the given setting does not exist, we're ready */
-			close (fhOut);
-			g_free (confname);
-			g_free (confname_tmp);
-			return 1;
-		}
-	}
-	else	/* existing config file, preserve settings and find & replace current var value if any */
+	g_free (filename);
+	g_free (confname);
+	return store;
+}
+
+static void
+pluginpref_flush_all (void)
+{
+	GHashTableIter iter;
+	gpointer store;
+
+	if (pluginpref_flush_tag)
 	{
-		prevSetting = 0;
+		fe_timeout_remove (pluginpref_flush_tag);
+		pluginpref_flush_tag = 0;
+	}
 
-		while (fscanf (fpIn, " %511[^\n]", line_bufp) != EOF)	/* read whole lines including whitespaces */
-		{
-			buffer_tmp = g_strdup_printf ("%s ", var);	/* add one space, this way it works against var - var2 checks too */
+	if (!pluginpref_stores)
+		return;
 
-			if (strncmp (buffer_tmp, line_buffer, strlen (var) + 1) == 0)	/* given setting already exists */
-			{
-				if (mode)									/* overwrite the existing matching setting if we are in save mode */
-				{
-					escaped_value = g_strescape (value, NULL);
-					buffer = g_strdup_printf ("%s = %s\n", var, escaped_value);
-					g_free (escaped_value);
-				}
-				else										/* erase the setting in delete mode */
-				{
-					buffer = g_strdup ("");
-				}
+	g_hash_table_iter_init (&iter, pluginpref_stores);
+	while (g_hash_table_iter_next (&iter, NULL, &store))
+		pluginpref_store_flush (store);
+}
 
-				prevSetting = 1;
-			}
-			else
-			{
-				buffer = g_strdup_printf ("%s\n", line_buffer);	/* preserve the existing different settings */
-			}
+static int
+pluginpref_flush_timeout (void *unused)
+{
+	pluginpref_flush_tag = 0;
+	pluginpref_flush_all ();
+	return 0;
+}
 
-			write (fhOut, buffer, strlen (buffer));
+static void
+pluginpref_changed (void)
+{
+	if (!pluginpref_flush_tag)
+		pluginpref_flush_tag = fe_timeout_add_seconds (PLUGINPREF_FLUSH_DELAY,
+																	  pluginpref_flush_timeout, NULL);
+}
 
-			g_free (buffer);
-			g_free (buffer_tmp);
-		}
+/* write out and forget a plugin's settings, so the next load of it
+ * sees the file as it is on disk */
+static void
+pluginpref_release (zoitechat_plugin *pl)
+{
+	pluginpref_store *store;
+	char *canon;
 
-		fclose (fpIn);
+	if (!pluginpref_stores || !pl->name)
+		return;
 
-		if (!prevSetting && mode)	/* var doesn't exist currently, append if we're in save mode */
-		{
-			escaped_value = g_strescape (value, NULL);
-			buffer = g_strdup_printf ("%s = %s\n", var, escaped_value);
-			g_free (escaped_value);
-			write (fhOut, buffer, strlen (buffer));
-			g_free (buffer);
-		}
+	canon = pluginpref_name (pl);
+	store = g_hash_table_lookup (pluginpref_stores, canon);
+	if (store)
+	{
+		pluginpref_store_flush (store);
+		g_hash_table_remove (pluginpref_stores, canon);
+	}
+	g_free (canon);
+}
 
-		close (fhOut);
+static int
+zoitechat_pluginpref_set_str_real (zoitechat_plugin *pl, const char *var, const char *value, int mode) /* mode: 0 = delete, 1 = save */
+{
+	pluginpref_store *store = pluginpref_get_store (pl);
 
-		buffer = g_build_filename (get_xdir (), confname, NULL);
-		g_free (confname);
-		buffer_tmp = g_build_filename (get_xdir (), confname_tmp, NULL);
-		g_free (confname_tmp);
+	if (mode)
+		pluginpref_store_set (store, var, value);
+	else
+		pluginpref_store_delete (store, var);
 
-#ifdef WIN32
-		g_unlink (buffer);
-#endif
+	if (pluginpref_store_dirty (store))
+		pluginpref_changed ();
 
-		if (g_rename (buffer_tmp, buffer) == 0)
-		{
-			g_free (buffer);
-			g_free (buffer_tmp);
-			return 1;
-		}
-		else
-		{
-			g_free (buffer);
-			g_free (buffer_tmp);
-			return 0;
-		}
-	}
+	return 1;
 }
 
 int
@@ -1972,32 +2015,13 @@ zoitechat_pluginpref_set_str (zoitechat_plugin *pl, const char *var, const char
 static int
 zoitechat_pluginpref_get_str_real (zoitechat_plugin *pl, const char *var, char *dest, int dest_len)
 {
-	char *confname, *canon, *cfg, *unescaped_value;
-	char buf[512];
-
-	canon = g_strdup (pl->name);
-	canonalize_key (canon);
-	confname = g_strdup_printf ("%s%caddon_%s.conf", get_xdir(), G_DIR_SEPARATOR, canon);
-	g_free (canon);
-
-	if (!g_file_get_contents (confname, &cfg, NULL, NULL))
-	{
-		g_free (confname);
-		return 0;
-	}
-	g_free (confname);
+	const char *value;
 
-	if (!cfg_get_str (cfg, var, buf, sizeof(buf)))
-	{
-		g_free (cfg);
+	value = pluginpref_store_get (pluginpref_get_store (pl), var);
+	if (!value)
 		return 0;
-	}
 
-	unescaped_value = g_strcompress (buf);
-	g_strlcpy (dest, unescaped_value, dest_len);
-
-	g_free (unescaped_value);
-	g_free (cfg);
+	g_strlcpy (dest, value, dest_len);
 	return 1;
 }
 
@@ -2047,35 +2071,11 @@ zoitechat_pluginpref_delete (zoitechat_plugin *pl, const char *var)
 int
 zoitechat_pluginpref_list (zoitechat_plugin *pl, char* dest)
 {
-	FILE *fpIn;
-	char confname[64];
-	char buffer[512];										/* the same as in cfg_put_str */
-	char *bufp = buffer;
-	char *token;
-
-	token = g_strdup (pl->name);
-	canonalize_key (token);
-	sprintf (confname, "addon_%s.conf", token);
-	g_free (token);
+	pluginpref_store *store = pluginpref_get_store (pl);
 
-	fpIn = zoitechat_fopen_file (confname, "r", 0);
+	/* Dest must not be smaller than 4096 */
+	pluginpref_store_list (store, dest, 4096);
 
-	if (fpIn == NULL)										/* no existing config file, no parsing */
-	{
-		return 0;
-	}
-	else													/* existing config file, get list of settings */
-	{
-		strcpy (dest, "");									/* clean up garbage */
-		while (fscanf (fpIn, " %511[^\n]", bufp) != EOF)	/* read whole lines including whitespaces */
-		{
-			token = strtok (buffer, "=");
-			g_strlcat (dest, g_strchomp (token), 4096); /* Dest must not be smaller than this */
-			g_strlcat (dest, ",", 4096);
-		}
-
-		fclose (fpIn);
-	}
-
-	return 1;
+	/* an empty config is still a config, only a missing one fails */
+	return pluginpref_store_exists (store);
 }
@@ -0,0 +1,251 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#include <fcntl.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include "cfgindex.h"
+#include "pluginpref.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+typedef struct
+{
+	char *var;
+	char *value;
+} pluginpref_entry;
+
+struct pluginpref_store
+{
+	char *filename;
+	GPtrArray *entries;		/* in file order */
+	GHashTable *vars;			/* var -> entry */
+	gboolean on_disk;			/* the file was read or written */
+	gboolean dirty;
+};
+
+static void
+pluginpref_entry_free (pluginpref_entry *entry)
+{
+	g_free (entry->var);
+	g_free (entry->value);
+	g_free (entry);
+}
+
+static void
+pluginpref_store_add (pluginpref_store *store, const char *var, char *value)
+{
+	pluginpref_entry *entry;
+
+	entry = g_new (pluginpref_entry, 1);
+	entry->var = g_strdup (var);
+	entry->value = value;
+	g_ptr_array_add (store->entries, entry);
+	g_hash_table_insert (store->vars, entry->var, entry);
+}
+
+static void
+pluginpref_load_line (char *key, char *rest, void *data)
+{
+	pluginpref_store *store = data;
+
+	/* same trimming as cfg_get_str () */
+	while (*rest == ' ')
+		rest++;
+	if (*rest == '=')
+		rest++;
+	while (*rest == ' ')
+		rest++;
+
+	/* the first line for a key wins, as it did when reading the file */
+	if (*key && !g_hash_table_contains (store->vars, key))
+		pluginpref_store_add (store, key, g_strcompress (rest));
+}
+
+pluginpref_store *
+pluginpref_store_load (const char *filename)
+{
+	pluginpref_store *store;
+	char *cfg;
+
+	store = g_new0 (pluginpref_store, 1);
+	store->filename = g_strdup (filename);
+	store->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) pluginpref_entry_free);
+	store->vars = g_hash_table_new (cfg_key_hash, cfg_key_equal);
+
+	if (g_file_get_contents (filename, &cfg, NULL, NULL))
+	{
+		store->on_disk = TRUE;
+		cfg_parse_lines (cfg, pluginpref_load_line, store);
+		g_free (cfg);
+	}
+
+	return store;
+}
+
+void
+pluginpref_store_free (pluginpref_store *store)
+{
+	if (!store)
+		return;
+
+	g_hash_table_destroy (store->vars);
+	g_ptr_array_free (store->entries, TRUE);
+	g_free (store->filename);
+	g_free (store);
+}
+
+const char *
+pluginpref_store_get (pluginpref_store *store, const char *var)
+{
+	pluginpref_entry *entry = g_hash_table_lookup (store->vars, var);
+
+	return entry ? entry->value : NULL;
+}
+
+void
+pluginpref_store_set (pluginpref_store *store, const char *var, const char *value)
+{
+	pluginpref_entry *entry = g_hash_table_lookup (store->vars, var);
+
+	if (entry)
+	{
+		if (!strcmp (entry->value, value))
+			return;
+		g_free (entry->value);
+		entry->value = g_strdup (value);
+	}
+	else
+	{
+		pluginpref_store_add (store, var, g_strdup (value));
+	}
+
+	store->dirty = TRUE;
+}
+
+gboolean
+pluginpref_store_delete (pluginpref_store *store, const char *var)
+{
+	pluginpref_entry *entry = g_hash_table_lookup (store->vars, var);
+
+	if (!entry)
+		return FALSE;
+
+	g_hash_table_remove (store->vars, var);
+	g_ptr_array_remove (store->entries, entry);
+	store->dirty = TRUE;
+	return TRUE;
+}
+
+/* "var1,var2,..." like zoitechat_pluginpref_list () always gave */
+int
+pluginpref_store_list (pluginpref_store *store, char *dest, int dest_len)
+{
+	pluginpref_entry *entry;
+	guint i;
+
+	dest[0] = 0;
+	for (i = 0; i < store->entries->len; i++)
+	{
+		entry = g_ptr_array_index (store->entries, i);
+		g_strlcat (dest, entry->var, dest_len);
+		g_strlcat (dest, ",", dest_len);
+	}
+
+	return store->entries->len;
+}
+
+gboolean
+pluginpref_store_dirty (pluginpref_store *store)
+{
+	return store->dirty;
+}
+
+/* is there a file, or will the next flush make one, even an empty one */
+gboolean
+pluginpref_store_exists (pluginpref_store *store)
+{
+	return store->on_disk || store->dirty;
+}
+
+/* write the whole file to "<file>.new" and rename it over the old one,
+ * so a crash never leaves half a file behind */
+gboolean
+pluginpref_store_flush (pluginpref_store *store)
+{
+	pluginpref_entry *entry;
+	GString *out;
+	char *escaped, *tmpname;
+	gboolean ok;
+	guint i;
+	int fd;
+
+	if (!store->dirty)
+		return TRUE;
+
+	out = g_string_new (NULL);
+	for (i = 0; i < store->entries->len; i++)
+	{
+		entry = g_ptr_array_index (store->entries, i);
+		escaped = g_strescape (entry->value, NULL);
+		g_string_append_printf (out, "%s = %s\n", entry->var, escaped);
+		g_free (escaped);
+	}
+
+	tmpname = g_strdup_printf ("%s.new", store->filename);
+	fd = g_open (tmpname, O_TRUNC | O_WRONLY | O_CREAT | O_BINARY, 0600);
+	ok = fd != -1;
+	if (ok)
+	{
+		ok = write (fd, out->str, out->len) == (int) out->len;
+		ok = close (fd) == 0 && ok;
+	}
+
+	if (ok)
+	{
+#ifdef WIN32
+		g_unlink (store->filename);
+#endif
+		ok = g_rename (tmpname, store->filename) == 0;
+	}
+	else if (fd != -1)
+	{
+		g_unlink (tmpname);
+	}
+
+	if (ok)
+	{
+		store->on_disk = TRUE;
+		store->dirty = FALSE;
+	}
+
+	g_free (tmpname);
+	g_string_free (out, TRUE);
+	return ok;
+}
@@ -0,0 +1,42 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef ZOITECHAT_PLUGINPREF_H
+#define ZOITECHAT_PLUGINPREF_H
+
+#include <glib.h>
+
+/* The "var = value" settings of one addon_<name>.conf, held in memory.
+ * Keys are ASCII case-insensitive and keep their order in the file;
+ * values are stored unescaped. Changes only reach the disk through
+ * pluginpref_store_flush (). */
+
+typedef struct pluginpref_store pluginpref_store;
+
+pluginpref_store *pluginpref_store_load (const char *filename);
+void pluginpref_store_free (pluginpref_store *store);
+const char *pluginpref_store_get (pluginpref_store *store, const char *var);
+void pluginpref_store_set (pluginpref_store *store, const char *var, const char *value);
+gboolean pluginpref_store_delete (pluginpref_store *store, const char *var);
+int pluginpref_store_list (pluginpref_store *store, char *dest, int dest_len);
+gboolean pluginpref_store_dirty (pluginpref_store *store);
+gboolean pluginpref_store_exists (pluginpref_store *store);
+gboolean pluginpref_store_flush (pluginpref_store *store);
+
+#endif
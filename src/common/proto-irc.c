@@ -554,8 +554,7 @@ process_numeric (session * sess, int n,
 		else goto def;
 
 	case 303:
-		word[4]++;
-		notify_markonline (serv, word, tags_data);
+		notify_markonline (serv, word_eol[4][0] == ':' ? word_eol[4] + 1 : word_eol[4], tags_data);
 		break;
 
 	case 305:
@@ -961,6 +960,10 @@ process_numeric (session * sess, int n,
 		notify_set_offline_list (serv, word[4] + 1, FALSE, tags_data);
 		break;
 
+	case 734: /* ERR_MONLISTFULL */
+		notify_set_unwatched_list (serv, word[5]);
+		goto def;
+
 	case 900:	/* successful SASL 'logged in as ' */
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_SERVTEXT, serv->server_session, 
 									  word_eol[6]+1, word[1], word[2], NULL, 0,
@@ -1758,7 +1761,21 @@ irc_inline (server *serv, char *buf, int len)
 	char *pdibuf;
 	message_tags_data tags_data = MESSAGE_TAGS_DATA_INIT;
 
-	pdibuf = g_malloc (len + 1);
+	/* lines injected while handling one (e.g. /recv from a plugin) get
+	 * their own buffer */
+	if (!serv->pdibuf_busy)
+	{
+		if (serv->pdibuf_size < len + 1)
+		{
+			g_free (serv->pdibuf);
+			serv->pdibuf_size = MAX (len + 1, 1024);
+			serv->pdibuf = g_malloc (serv->pdibuf_size);
+		}
+		pdibuf = serv->pdibuf;
+		serv->pdibuf_busy = TRUE;
+	}
+	else
+		pdibuf = g_malloc (len + 1);
 
 	sess = serv->front_session;
 
@@ -1838,7 +1855,10 @@ irc_inline (server *serv, char *buf, int len)
 
 xit:
 	message_tags_data_free (&tags_data);
-	g_free (pdibuf);
+	if (pdibuf == serv->pdibuf)
+		serv->pdibuf_busy = FALSE;
+	else
+		g_free (pdibuf);
 }
 
 void
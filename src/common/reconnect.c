@@ -0,0 +1,332 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "zoitechat.h"
+#include "fe.h"
+#include "reconnect.h"
+
+typedef struct
+{
+	void *owner;
+	reconnect_func *start;
+	reconnect_state state;
+	int priority;
+	int attempts;
+	guint seq;					/* order of arrival in the queue */
+	gint64 due;					/* when the backoff ends */
+	int tag;						/* the backoff, or the slot timeout once ACTIVE */
+} reconnect_entry;
+
+static GHashTable *reconnect_entries;				/* owner -> reconnect_entry */
+static GQueue reconnect_queue = G_QUEUE_INIT;	/* the QUEUED entries, next one first */
+static int reconnect_active;
+static guint reconnect_seq;
+static gboolean reconnect_kicked;
+static gint64 reconnect_autojoin_free;			/* ms, when the last autojoin is out of the way */
+
+/* higher priority first, then the ones that failed less, then first come */
+static gint
+reconnect_queue_cmp (gconstpointer a, gconstpointer b, gpointer unused)
+{
+	const reconnect_entry *x = a, *y = b;
+
+	if (x->priority != y->priority)
+		return y->priority - x->priority;
+	if (x->attempts != y->attempts)
+		return x->attempts - y->attempts;
+	return x->seq < y->seq ? -1 : 1;
+}
+
+static void reconnect_stop (reconnect_entry *e);
+
+/* A server that connects but never finishes logging in (a stuck SASL
+ * exchange, a nick prompt nobody answers) must not keep others out for
+ * good: after a while its slot is given back. The login goes on. */
+static int
+reconnect_slot_timeout (reconnect_entry *e)
+{
+	e->tag = 0;
+	reconnect_stop (e);
+
+	return 0;
+}
+
+static void
+reconnect_activate (reconnect_entry *e)
+{
+	void *owner = e->owner;
+
+	e->state = RECONNECT_ACTIVE;
+	e->tag = fe_timeout_add (RECONNECT_SLOT_TIMEOUT, reconnect_slot_timeout, e);
+	reconnect_active++;
+
+	/* the start function may reschedule or forget the owner */
+	if (!e->start (owner))
+	{
+		e = g_hash_table_lookup (reconnect_entries, owner);
+		if (e && e->state == RECONNECT_ACTIVE)
+			reconnect_release (owner);
+	}
+}
+
+static int
+reconnect_run_queue (void *unused)
+{
+	reconnect_kicked = FALSE;
+
+	while (reconnect_queue.length &&
+			 (prefs.hex_net_reconnect_max <= 0 || reconnect_active < prefs.hex_net_reconnect_max))
+	{
+		reconnect_activate (g_queue_pop_head (&reconnect_queue));
+	}
+
+	return 0;
+}
+
+/* look at the queue from the main loop, never from inside a caller */
+static void
+reconnect_kick (void)
+{
+	if (reconnect_kicked)
+		return;
+
+	reconnect_kicked = TRUE;
+	fe_idle_add (reconnect_run_queue, NULL);
+}
+
+static void
+reconnect_stop (reconnect_entry *e)
+{
+	switch (e->state)
+	{
+	case RECONNECT_WAITING:
+		fe_timeout_remove (e->tag);
+		e->tag = 0;
+		break;
+	case RECONNECT_QUEUED:
+		g_queue_remove (&reconnect_queue, e);
+		break;
+	case RECONNECT_ACTIVE:
+		if (e->tag)
+			fe_timeout_remove (e->tag);
+		e->tag = 0;
+		reconnect_active--;
+		reconnect_kick ();
+		break;
+	case RECONNECT_IDLE:
+		break;
+	}
+
+	e->state = RECONNECT_IDLE;
+}
+
+static int
+reconnect_timeout (reconnect_entry *e)
+{
+	e->tag = 0;
+	e->state = RECONNECT_QUEUED;
+	e->seq = reconnect_seq++;
+	g_queue_insert_sorted (&reconnect_queue, e, reconnect_queue_cmp, NULL);
+	reconnect_kick ();
+
+	return 0;
+}
+
+static reconnect_entry *
+reconnect_lookup (void *owner)
+{
+	if (!reconnect_entries)
+		return NULL;
+
+	return g_hash_table_lookup (reconnect_entries, owner);
+}
+
+static reconnect_entry *
+reconnect_get_entry (void *owner)
+{
+	reconnect_entry *e;
+
+	if (!reconnect_entries)
+		reconnect_entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	e = g_hash_table_lookup (reconnect_entries, owner);
+	if (!e)
+	{
+		e = g_new0 (reconnect_entry, 1);
+		e->owner = owner;
+		g_hash_table_insert (reconnect_entries, owner, e);
+	}
+
+	return e;
+}
+
+/* Back off from 'delay' ms, doubling it for every attempt that failed
+ * since the last login, then start the owner once a slot is free.
+ * Returns the delay actually used. */
+int
+reconnect_schedule (void *owner, int priority, int delay, reconnect_func *start)
+{
+	reconnect_entry *e;
+	gint64 backoff;
+
+	e = reconnect_get_entry (owner);
+	reconnect_stop (e);
+	e->start = start;
+	e->priority = priority;
+	e->attempts++;
+
+	backoff = (gint64) delay << MIN (e->attempts - 1, 16);
+	backoff = MIN (backoff, MAX (delay, RECONNECT_MAX_DELAY));
+
+	/* jitter keeps servers that dropped together from coming back together */
+	delay = backoff * g_random_double_range (0.75, 1.25);
+
+	e->state = RECONNECT_WAITING;
+	e->due = g_get_monotonic_time () + (gint64) delay * 1000;
+	e->tag = fe_timeout_add (delay, reconnect_timeout, e);
+
+	return delay;
+}
+
+/* the user asked for it: start right away, without waiting for a slot.
+ * It still holds one while logging in, like any other. */
+void
+reconnect_start_now (void *owner, int priority, reconnect_func *start)
+{
+	reconnect_entry *e;
+
+	e = reconnect_get_entry (owner);
+	reconnect_stop (e);
+	e->start = start;
+	e->priority = priority;
+	reconnect_activate (e);
+}
+
+/* the attempt is over or called off: stop waiting, or free the slot.
+ * The backoff is kept. Returns the state it was in. */
+reconnect_state
+reconnect_release (void *owner)
+{
+	reconnect_entry *e = reconnect_lookup (owner);
+	reconnect_state state;
+
+	if (!e)
+		return RECONNECT_IDLE;
+
+	state = e->state;
+	reconnect_stop (e);
+	return state;
+}
+
+/* logged in, or gone for good: start over with the next disconnect */
+void
+reconnect_forget (void *owner)
+{
+	if (!reconnect_lookup (owner))
+		return;
+
+	reconnect_release (owner);
+	g_hash_table_remove (reconnect_entries, owner);
+}
+
+reconnect_state
+reconnect_get_info (void *owner, reconnect_info *info)
+{
+	reconnect_entry *e = reconnect_lookup (owner);
+
+	memset (info, 0, sizeof (*info));
+	info->owner = owner;
+	if (!e)
+		return RECONNECT_IDLE;
+
+	info->state = e->state;
+	info->priority = e->priority;
+	info->attempts = e->attempts;
+	if (e->state == RECONNECT_WAITING)
+		info->remaining = MAX (0, (e->due - g_get_monotonic_time ()) / 1000);
+
+	return e->state;
+}
+
+static gint
+reconnect_remaining_cmp (gconstpointer a, gconstpointer b)
+{
+	return ((const reconnect_info *) a)->remaining - ((const reconnect_info *) b)->remaining;
+}
+
+/* everything that isn't idle: the active ones, the queue in order, then
+ * the ones backing off, soonest first. Free with g_slist_free_full (list, g_free). */
+GSList *
+reconnect_get_list (void)
+{
+	GSList *active = NULL, *waiting = NULL, *queued = NULL;
+	reconnect_info *info;
+	reconnect_entry *e;
+	GHashTableIter iter;
+	GList *list;
+
+	if (!reconnect_entries)
+		return NULL;
+
+	g_hash_table_iter_init (&iter, reconnect_entries);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &e))
+	{
+		if (e->state != RECONNECT_ACTIVE && e->state != RECONNECT_WAITING)
+			continue;
+
+		info = g_new (reconnect_info, 1);
+		reconnect_get_info (e->owner, info);
+		if (e->state == RECONNECT_ACTIVE)
+			active = g_slist_prepend (active, info);
+		else
+			waiting = g_slist_prepend (waiting, info);
+	}
+
+	for (list = reconnect_queue.head; list; list = list->next)
+	{
+		e = list->data;
+		info = g_new (reconnect_info, 1);
+		reconnect_get_info (e->owner, info);
+		queued = g_slist_prepend (queued, info);
+	}
+
+	waiting = g_slist_sort (waiting, reconnect_remaining_cmp);
+	return g_slist_concat (active, g_slist_concat (g_slist_reverse (queued), waiting));
+}
+
+int
+reconnect_active_count (void)
+{
+	return reconnect_active;
+}
+
+/* Autojoins of servers that log in together are spread out: each one
+ * holds up the next by a little per channel. Returns how many ms this
+ * one should wait before joining. */
+int
+reconnect_autojoin_delay (int channels)
+{
+	gint64 now = g_get_monotonic_time () / 1000;
+	gint64 start = MAX (now, reconnect_autojoin_free);
+
+	reconnect_autojoin_free = start + MIN (channels * RECONNECT_AUTOJOIN_GAP, RECONNECT_AUTOJOIN_MAX);
+	return start - now;
+}
@@ -0,0 +1,63 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef ZOITECHAT_RECONNECT_H
+#define ZOITECHAT_RECONNECT_H
+
+#include <glib.h>
+
+/* Paces automatic reconnects. Each server backs off exponentially, with
+ * jitter, and only prefs.hex_net_reconnect_max servers connect at once;
+ * the rest wait their turn, favorite networks first. */
+
+typedef enum
+{
+	RECONNECT_IDLE,
+	RECONNECT_WAITING,		/* backing off */
+	RECONNECT_QUEUED,			/* waiting for a free slot */
+	RECONNECT_ACTIVE			/* connecting or logging in, holds a slot */
+} reconnect_state;
+
+#define RECONNECT_MAX_DELAY 300000		/* ms, the longest backoff */
+#define RECONNECT_AUTOJOIN_GAP 50		/* ms between autojoins, per channel */
+#define RECONNECT_AUTOJOIN_MAX 5000		/* ms, the most one autojoin holds up the next */
+#define RECONNECT_SLOT_TIMEOUT 120000	/* ms a login may hold its slot */
+
+/* start connecting; FALSE if nothing was started */
+typedef gboolean (reconnect_func) (void *owner);
+
+typedef struct
+{
+	void *owner;
+	reconnect_state state;
+	int priority;
+	int attempts;		/* since the last successful login */
+	int remaining;		/* ms left of the backoff */
+} reconnect_info;
+
+int reconnect_schedule (void *owner, int priority, int delay, reconnect_func *start);
+void reconnect_start_now (void *owner, int priority, reconnect_func *start);
+reconnect_state reconnect_release (void *owner);
+void reconnect_forget (void *owner);
+reconnect_state reconnect_get_info (void *owner, reconnect_info *info);
+GSList *reconnect_get_list (void);
+int reconnect_active_count (void);
+int reconnect_autojoin_delay (int channels);
+
+#endif
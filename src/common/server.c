@@ -35,8 +35,6 @@
 #include <winbase.h>
 #include <io.h>
 #else
-#include <signal.h>
-#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
@@ -44,6 +42,7 @@
 #include "fe.h"
 #include "cfgfiles.h"
 #include "network.h"
+#include "connector.h"
 #include "notify.h"
 #include "zoitechatc.h"
 #include "inbound.h"
@@ -51,7 +50,9 @@
 #include "text.h"
 #include "util.h"
 #include "url.h"
+#include "framer.h"
 #include "proto-irc.h"
+#include "reconnect.h"
 #include "servlist.h"
 #include "server.h"
 #include "sts.h"
@@ -161,16 +162,6 @@ server_prompt_reconnect_password (server *serv)
 	return TRUE;
 }
 
-static void
-write_error (char *message, GError **error)
-{
-	if (error == NULL || *error == NULL) {
-		return;
-	}
-	g_printerr ("%s: %s\n", message, (*error)->message);
-	g_clear_error (error);
-}
-
 /* actually send to the socket. This might do a character translation or
    send via SSL. server/dcc both use this function. */
 
@@ -208,12 +199,32 @@ server_send_real (server *serv, char *buf, int len)
    ircu2.10 server; under test, a 200-line paste didn't flood
    off the client */
 
+/* one line waiting in serv->outbound_queue[] */
+typedef struct
+{
+	int len;
+	char buf[1];	/* really len + 1 bytes, NUL terminated */
+} outbound_line;
+
+static outbound_line *
+outbound_line_new (const char *buf, int len)
+{
+	outbound_line *line;
+
+	line = g_malloc (sizeof (outbound_line) + len);
+	line->len = len;
+	memcpy (line->buf, buf, len);
+	line->buf[len] = 0;
+
+	return line;
+}
+
 static int
 tcp_send_queue (server *serv)
 {
-	char *buf, *p;
-	int len, i, pri;
-	GSList *list;
+	outbound_line *line;
+	char *p;
+	int i, pri;
 	time_t now = time (0);
 
 	/* did the server close since the timeout was added? */
@@ -221,83 +232,190 @@ tcp_send_queue (server *serv)
 		return 0;
 
 	/* try priority 2,1,0 */
-	pri = 2;
-	while (pri >= 0)
+	for (pri = 2; pri >= 0; pri--)
 	{
-		list = serv->outbound_queue;
-		while (list)
+		while ((line = g_queue_peek_head (&serv->outbound_queue[pri])))
 		{
-			buf = (char *) list->data;
-			if (buf[0] == pri)
+			if (serv->next_send < now)
+				serv->next_send = now;
+			if (serv->next_send - now >= 10)
 			{
-				buf++;	/* skip the priority byte */
-				len = strlen (buf);
+				/* check for clock skew */
+				if (now >= serv->prev_now)
+					return 1;		  /* don't remove the timeout handler */
+				/* it is skewed, reset to something sane */
+				serv->next_send = now;
+			}
 
-				if (serv->next_send < now)
-					serv->next_send = now;
-				if (serv->next_send - now >= 10)
-				{
-					/* check for clock skew */
-					if (now >= serv->prev_now)
-						return 1;		  /* don't remove the timeout handler */
-					/* it is skewed, reset to something sane */
-					serv->next_send = now;
-				}
+			for (p = line->buf, i = line->len; i && *p != ' '; p++, i--);
+			serv->next_send += (2 + i / 120);
+			serv->sendq_len -= line->len;
+			serv->sendq_bytes[pri] -= line->len;
+			serv->prev_now = now;
+			fe_set_throttle (serv);
+
+			g_queue_pop_head (&serv->outbound_queue[pri]);
+			server_send_real (serv, line->buf, line->len);
+			g_free (line);
+		}
+	}
+	return 0;						  /* remove the timeout handler */
+}
 
-				for (p = buf, i = len; i && *p != ' '; p++, i--);
-				serv->next_send += (2 + i / 120);
-				serv->sendq_len -= len;
-				serv->prev_now = now;
-				fe_set_throttle (serv);
+/* Splits a "MODE <target> <modes> <args>\r\n" change where every mode
+   letter is a nick or list mode taking exactly one of the args, i.e. the
+   kind of line a mass op/voice/ban sends. Anything else returns NULL. */
+static char **
+tcp_mode_line_split (server *serv, const char *buf, int len, int *letters)
+{
+	char *line, *listmodes, *comma;
+	char **words;
+	const char *m;
+	int i, count;
 
-				server_send_real (serv, buf, len);
+	if (len < 9 || len > 510 || g_ascii_strncasecmp (buf, "MODE ", 5) != 0 ||
+		 buf[len - 2] != '\r' || buf[len - 1] != '\n')
+		return NULL;
 
-				buf--;
-				serv->outbound_queue = g_slist_remove (serv->outbound_queue, buf);
-				g_free (buf);
-				list = serv->outbound_queue;
-			} else
-			{
-				list = list->next;
-			}
+	line = g_strndup (buf, len - 2);
+	if (strpbrk (line, "\r\n:"))
+	{
+		g_free (line);
+		return NULL;
+	}
+	words = g_strsplit (line, " ", 0);
+	g_free (line);
+
+	count = g_strv_length (words);
+	for (i = 0; i < count; i++)
+	{
+		if (!words[i][0])
+			goto bad;
+	}
+	if (count < 4 || (words[2][0] != '+' && words[2][0] != '-'))
+		goto bad;
+
+	listmodes = g_strdup (serv->chanmodes);
+	comma = strchr (listmodes, ',');
+	if (comma)
+		*comma = 0;
+
+	*letters = 0;
+	for (m = words[2]; *m; m++)
+	{
+		if (*m == '+' || *m == '-')
+			continue;
+		if (!strchr (serv->nick_modes, *m) && !strchr (listmodes, *m))
+		{
+			g_free (listmodes);
+			goto bad;
 		}
-		/* now try pri 0 */
-		pri--;
+		(*letters)++;
 	}
-	return 0;						  /* remove the timeout handler */
+	g_free (listmodes);
+
+	if (*letters != count - 3)
+		goto bad;
+
+	return words;
+
+bad:
+	g_strfreev (words);
+	return NULL;
+}
+
+/* merge a MODE change into the one at the end of the queue, if both
+   only change nick/list modes on the same target and still fit in
+   one line of the server's MODES= limit */
+static gboolean
+tcp_send_coalesce (server *serv, char *buf, int len)
+{
+	GQueue *queue = &serv->outbound_queue[2];
+	outbound_line *tail;
+	char **old_words, **new_words;
+	char last_sign, *new_modes, *old_args, *new_args;
+	GString *merged;
+	int old_letters, new_letters;
+	gboolean done = FALSE;
+
+	tail = g_queue_peek_tail (queue);
+	if (!tail)
+		return FALSE;
+
+	new_words = tcp_mode_line_split (serv, buf, len, &new_letters);
+	if (!new_words)
+		return FALSE;
+	old_words = tcp_mode_line_split (serv, tail->buf, tail->len, &old_letters);
+	if (!old_words)
+	{
+		g_strfreev (new_words);
+		return FALSE;
+	}
+
+	if (old_letters + new_letters <= serv->modes_per_line &&
+		 !serv->p_cmp (old_words[1], new_words[1]))
+	{
+		/* find the sign in effect at the end of the old mode string */
+		last_sign = old_words[2][0];
+		for (new_modes = old_words[2]; *new_modes; new_modes++)
+		{
+			if (*new_modes == '+' || *new_modes == '-')
+				last_sign = *new_modes;
+		}
+		new_modes = new_words[2];
+		if (*new_modes == last_sign)
+			new_modes++;
+
+		old_args = g_strjoinv (" ", old_words + 3);
+		new_args = g_strjoinv (" ", new_words + 3);
+		merged = g_string_new (NULL);
+		g_string_printf (merged, "MODE %s %s%s %s %s\r\n", old_words[1], old_words[2],
+							  new_modes, old_args, new_args);
+		g_free (old_args);
+		g_free (new_args);
+
+		if (merged->len <= 512)
+		{
+			serv->sendq_len += (int) merged->len - tail->len;
+			serv->sendq_bytes[2] += (int) merged->len - tail->len;
+			g_free (tail);
+			queue->tail->data = outbound_line_new (merged->str, merged->len);
+			done = TRUE;
+		}
+		g_string_free (merged, TRUE);
+	}
+
+	g_strfreev (old_words);
+	g_strfreev (new_words);
+	return done;
 }
 
 int
 tcp_send_len (server *serv, char *buf, int len)
 {
-	char *dbuf;
-	int noqueue = !serv->outbound_queue;
+	int pri = 2;	/* pri 2 for most things */
+	int noqueue = (serv->sendq_len == 0);
 
 	if (!prefs.hex_net_throttle)
 		return server_send_real (serv, buf, len);
 
-	dbuf = g_malloc (len + 2);	/* first byte is the priority */
-	dbuf[0] = 2;	/* pri 2 for most things */
-	memcpy (dbuf + 1, buf, len);
-	dbuf[len + 1] = 0;
-
 	/* privmsg and notice get a lower priority */
-	if (g_ascii_strncasecmp (dbuf + 1, "PRIVMSG", 7) == 0 ||
-		 g_ascii_strncasecmp (dbuf + 1, "NOTICE", 6) == 0)
+	if (g_ascii_strncasecmp (buf, "PRIVMSG", 7) == 0 ||
+		 g_ascii_strncasecmp (buf, "NOTICE", 6) == 0)
 	{
-		dbuf[0] = 1;
+		pri = 1;
 	}
 	else
 	{
 		/* WHO gets the lowest priority */
-		if (g_ascii_strncasecmp (dbuf + 1, "WHO ", 4) == 0)
-			dbuf[0] = 0;
+		if (g_ascii_strncasecmp (buf, "WHO ", 4) == 0)
+			pri = 0;
 		/* as do MODE queries (but not changes) */
-		else if (g_ascii_strncasecmp (dbuf + 1, "MODE ", 5) == 0)
+		else if (g_ascii_strncasecmp (buf, "MODE ", 5) == 0)
 		{
 			char *mode_str, *mode_str_end, *loc;
 			/* skip spaces before channel/nickname */
-			for (mode_str = dbuf + 5; *mode_str == ' '; ++mode_str);
+			for (mode_str = buf + 4; *mode_str == ' '; ++mode_str);
 			/* skip over channel/nickname */
 			mode_str = strchr (mode_str, ' ');
 			if (mode_str)
@@ -314,14 +432,18 @@ tcp_send_len (server *serv, char *buf, int len)
 				if (loc && (!mode_str_end || loc < mode_str_end))
 					goto keep_priority;
 			}
-			dbuf[0] = 0;
+			pri = 0;
 keep_priority:
 			;
 		}
 	}
 
-	serv->outbound_queue = g_slist_append (serv->outbound_queue, dbuf);
-	serv->sendq_len += len; /* tcp_send_queue uses strlen */
+	if (pri == 2 && tcp_send_coalesce (serv, buf, len))
+		return 1;
+
+	g_queue_push_tail (&serv->outbound_queue[pri], outbound_line_new (buf, len));
+	serv->sendq_len += len;
+	serv->sendq_bytes[pri] += len;
 
 	if (tcp_send_queue (serv) && noqueue)
 		fe_timeout_add (500, tcp_send_queue, serv);
@@ -366,20 +488,35 @@ close_socket (int sok)
 /* handle 1 line of text received from the server */
 
 static void
-server_inline (server *serv, char *line, gssize len)
+server_inline (server *serv, char *line, int len)
 {
-	gsize len_utf8;
-	if (!strcmp (serv->encoding, "UTF-8"))
-		line = text_fixup_invalid_utf8 (line, len, &len_utf8);
-	else
-		line = text_convert_invalid (line, len, serv->read_converter, unicode_fallback_string, &len_utf8);
+	char *converted = NULL;
+	gsize len_utf8 = len;
+
+	/* most lines need no conversion and are handled where they are */
+	if (!serv->encoding_ascii || !framer_is_ascii (line, len))
+	{
+		if (!strcmp (serv->encoding, "UTF-8"))
+		{
+			if (!g_utf8_validate (line, len, NULL))
+				line = converted = text_fixup_invalid_utf8 (line, len, &len_utf8);
+		}
+		else
+			line = converted = text_convert_invalid (line, len, serv->read_converter, unicode_fallback_string, &len_utf8);
+	}
 
 	fe_add_rawlog (serv, line, len_utf8, FALSE);
 
 	/* let proto-irc.c handle it */
 	serv->p_inline (serv, line, len_utf8);
 
-	g_free (line);
+	g_free (converted);
+}
+
+static void
+server_inline_cb (void *serv, char *line, int len)
+{
+	server_inline (serv, line, len);
 }
 
 /* read data from socket */
@@ -388,18 +525,18 @@ static gboolean
 server_read (GIOChannel *source, GIOCondition condition, server *serv)
 {
 	int sok = serv->sok;
-	int error, i, len;
-	char lbuf[2050];
+	int error, len;
+	char lbuf[16384];
 
 	while (1)
 	{
 #ifdef USE_OPENSSL
 		if (!serv->ssl)
 #endif
-			len = recv (sok, lbuf, sizeof (lbuf) - 2, 0);
+			len = recv (sok, lbuf, sizeof (lbuf), 0);
 #ifdef USE_OPENSSL
 		else
-			len = _SSL_recv (serv->ssl, lbuf, sizeof (lbuf) - 2);
+			len = _SSL_recv (serv->ssl, lbuf, sizeof (lbuf));
 #endif
 		if (len < 1)
 		{
@@ -428,33 +565,8 @@ server_read (GIOChannel *source, GIOCondition condition, server *serv)
 			return TRUE;
 		}
 
-		i = 0;
-
-		lbuf[len] = 0;
-
-		while (i < len)
-		{
-			switch (lbuf[i])
-			{
-			case '\r':
-				break;
-
-			case '\n':
-				serv->linebuf[serv->pos] = 0;
-				server_inline (serv, serv->linebuf, serv->pos);
-				serv->pos = 0;
-				break;
-
-			default:
-				serv->linebuf[serv->pos] = lbuf[i];
-				if (serv->pos >= (sizeof (serv->linebuf) - 1))
-					fprintf (stderr,
-								"*** ZOITECHAT WARNING: Buffer overflow - non-compliant server!\n");
-				else
-					serv->pos++;
-			}
-			i++;
-		}
+		framer_feed (serv->linebuf, sizeof (serv->linebuf), &serv->pos,
+						 lbuf, len, server_inline_cb, serv);
 	}
 }
 
@@ -496,19 +608,6 @@ server_connected (server * serv)
 	fe_server_event (serv, FE_SE_CONNECT, 0);
 }
 
-#ifdef WIN32
-
-static gboolean
-server_close_pipe (int *pipefd)	/* see comments below */
-{
-	close (pipefd[0]);	/* close WRITE end first to cause an EOF on READ */
-	close (pipefd[1]);	/* in giowin32, and end that thread. */
-	g_free (pipefd);
-	return FALSE;
-}
-
-#endif
-
 static void
 server_stopconnecting (server * serv)
 {
@@ -524,24 +623,8 @@ server_stopconnecting (server * serv)
 		serv->joindelay_tag = 0;
 	}
 
-#ifndef WIN32
-	/* kill the child process trying to connect */
-	kill (serv->childpid, SIGKILL);
-	waitpid (serv->childpid, NULL, 0);
-
-	close (serv->childwrite);
-	close (serv->childread);
-#else
-	PostThreadMessage (serv->childpid, WM_QUIT, 0, 0);
-
-	{
-		/* if we close the pipe now, giowin32 will crash. */
-		int *pipefd = g_new (int, 2);
-		pipefd[0] = serv->childwrite;
-		pipefd[1] = serv->childread;
-		g_idle_add ((GSourceFunc)server_close_pipe, pipefd);
-	}
-#endif
+	connector_free (serv->connector);
+	serv->connector = NULL;
 
 #ifdef USE_OPENSSL
 	if (serv->ssl_do_connect_tag)
@@ -739,6 +822,8 @@ conn_fail:
 			return (0);
 		}
 
+		serv->connect_times[CONNECTOR_PHASE_TLS] =
+			g_get_monotonic_time () - serv->connect_times[CONNECTOR_PHASE_TLS];
 		server_stopconnecting (serv);
 
 		/* activate gtk poll */
@@ -778,29 +863,67 @@ conn_fail:
 }
 #endif
 
+static gboolean
+server_reconnect_start (void *owner)
+{
+	server *serv = owner;
+
+	/* make sure it hasnt been closed during the delay */
+	if (!is_server (serv) || serv->connected || serv->connecting || !serv->server_session)
+		return FALSE;
+
+	if (server_prompt_reconnect_password (serv))
+		return FALSE;
+
+	server_connect (serv, serv->hostname, serv->port, FALSE);
+	return TRUE;
+}
+
+/* favorite networks get their slot first, then the auto-connect ones */
 static int
-timeout_auto_reconnect (server *serv)
+server_reconnect_priority (server *serv)
+{
+	ircnet *net = serv->network;
+
+	if (!net)
+		return 0;
+	if (net->flags & FLAG_FAVORITE)
+		return 2;
+	if (net->flags & FLAG_AUTO_CONNECT)
+		return 1;
+	return 0;
+}
+
+/* wait about 'delay' ms, more after repeated failures, then call start
+   once the reconnect scheduler has a slot free */
+int
+server_schedule_reconnect (server *serv, int delay, gboolean (*start) (void *owner))
+{
+	delay = reconnect_schedule (serv, server_reconnect_priority (serv), delay, start);
+	fe_server_event (serv, FE_SE_RECONDELAY, delay);
+	return delay;
+}
+
+gboolean
+server_reconnect_pending (server *serv)
 {
-	if (is_server (serv))  /* make sure it hasnt been closed during the delay */
+	reconnect_info info;
+
+	switch (reconnect_get_info (serv, &info))
 	{
-		serv->recondelay_tag = 0;
-		if (!serv->connected && !serv->connecting && serv->server_session)
-		{
-			if (!server_prompt_reconnect_password (serv))
-				server_connect (serv, serv->hostname, serv->port, FALSE);
-		}
+	case RECONNECT_WAITING:
+	case RECONNECT_QUEUED:
+		return TRUE;
+	default:
+		return FALSE;
 	}
-	return 0;			  /* returning 0 should remove the timeout handler */
 }
 
+/* rejoin what's open, remember away, and drop the connection */
 static void
-auto_reconnect (server *serv, int send_quit, int err)
+server_reconnect_prepare (server *serv, int send_quit, int err)
 {
 	session *s;
-	int del;
-
-	if (serv->server_session == NULL)
-		return;
 
 	if (prefs.hex_irc_reconnect_rejoin)
 	{
@@ -821,32 +944,54 @@ auto_reconnect (server *serv, int send_quit, int err)
 	if (serv->connected)
 		server_disconnect (serv->server_session, send_quit, err);
 
-	del = prefs.hex_net_reconnect_delay * 1000;
-	if (del < 1000)
-		del = 500;				  /* so it doesn't block the gui */
-
 #ifndef WIN32
 	if (err == -1 || err == 0 || err == ECONNRESET || err == ETIMEDOUT)
 #else
 	if (err == -1 || err == 0 || err == WSAECONNRESET || err == WSAETIMEDOUT)
 #endif
 		serv->reconnect_away = serv->is_away;
+}
 
-	/* is this server in a reconnect delay? remove it! */
-	if (serv->recondelay_tag)
-	{
-		fe_timeout_remove (serv->recondelay_tag);
-		serv->recondelay_tag = 0;
-	}
+static void
+auto_reconnect (server *serv, int send_quit, int err)
+{
+	int del;
+
+	if (serv->server_session == NULL)
+		return;
+
+	server_reconnect_prepare (serv, send_quit, err);
+
+	del = prefs.hex_net_reconnect_delay * 1000;
+	if (del < 1000)
+		del = 500;				  /* so it doesn't block the gui */
+
+	server_schedule_reconnect (serv, del, server_reconnect_start);
+}
+
+/* /RECONNECT: no backoff, and no waiting behind automatic reconnects */
+void
+server_reconnect_now (server *serv)
+{
+	if (serv->server_session == NULL)
+		return;
 
-	serv->recondelay_tag = fe_timeout_add (del, timeout_auto_reconnect, serv);
-	fe_server_event (serv, FE_SE_RECONDELAY, del);
+	reconnect_forget (serv);
+	server_reconnect_prepare (serv, TRUE, -1);
+	reconnect_start_now (serv, server_reconnect_priority (serv), server_reconnect_start);
 }
 
 static void
 server_flush_queue (server *serv)
 {
-	list_free (&serv->outbound_queue);
+	int pri;
+
+	for (pri = 0; pri < 3; pri++)
+	{
+		g_queue_foreach (&serv->outbound_queue[pri], (GFunc) g_free, NULL);
+		g_queue_clear (&serv->outbound_queue[pri]);
+		serv->sendq_bytes[pri] = 0;
+	}
 	serv->sendq_len = 0;
 	fe_set_throttle (serv);
 }
@@ -875,6 +1020,7 @@ server_connect_success (server *serv)
 		/* FIXME: it'll be needed by new servers */
 		/* send(serv->sok, "STLS\r\n", 6, 0); sleep(1); */
 		set_nonblocking (serv->sok);
+		serv->connect_times[CONNECTOR_PHASE_TLS] = g_get_monotonic_time ();	/* until done */
 		serv->ssl_do_connect_tag = fe_timeout_add (SSLDOCONNTMOUT,
 																 ssl_do_connect, serv);
 		return;
@@ -887,125 +1033,122 @@ server_connect_success (server *serv)
 	server_connected (serv);
 }
 
-/* receive info from the child-process about connection progress */
+/* the connector's progress reports */
 
-static gboolean
-server_read_child (GIOChannel *source, GIOCondition condition, server *serv)
+static void
+server_connector_lookup (void *data, const char *host)
 {
-	session *sess = serv->server_session;
-	char tbuf[128];
+	server *serv = data;
+
+	EMIT_SIGNAL (XP_TE_SERVERLOOKUP, serv->server_session, (char *)host, NULL, NULL, NULL, 0);
+}
+
+static void
+server_connector_bound (void *data, const char *ip)
+{
+	server *serv = data;
+
+	if (ip)
+	{
+		net_parse_ipv4 (ip, &prefs.local_ip);
+		return;
+	}
+
+	PrintTextf (serv->server_session,
+					_("Cannot resolve hostname %s\nCheck your IP Settings!\n"),
+					prefs.hex_net_bind_host);
+}
+
+static void
+server_connector_resolved (void *data, const char *host, const char *ip, int port)
+{
+	server *serv = data;
+	char portbuf[16];
+
+	g_snprintf (portbuf, sizeof (portbuf), "%d", port);
+	EMIT_SIGNAL (XP_TE_CONNECT, serv->server_session, (char *)host, (char *)ip, portbuf, NULL, 0);
+}
+
+static void
+server_connector_message (void *data, const char *text)
+{
+	server *serv = data;
+
+	PrintText (serv->server_session, (char *)text);
+}
+
+static void
+server_connector_connected (void *data, int sok, const gint64 *times)
+{
+	server *serv = data;
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof (addr);
+	guint16 port;
+	ircnet *net = serv->network;
 	char outbuf[512];
-	char host[100];
-	char ip[100];
 
-	waitline2 (source, tbuf, sizeof tbuf);
+	serv->sok = sok;
+	memcpy (serv->connect_times, times, sizeof (serv->connect_times));
+	connector_free (serv->connector);
+	serv->connector = NULL;
 
-	switch (tbuf[0])
+	if (!getsockname (serv->sok, (struct sockaddr *)&addr, &addr_len))
 	{
-	case '0':	/* print some text */
-		waitline2 (source, tbuf, sizeof tbuf);
-		PrintText (serv->server_session, tbuf);
-		break;
-	case '1':						  /* unknown host */
-		server_stopconnecting (serv);
-		closesocket (serv->sok4);
-		if (serv->proxy_sok4 != -1)
-			closesocket (serv->proxy_sok4);
-		if (serv->sok6 != -1)
-			closesocket (serv->sok6);
-		if (serv->proxy_sok6 != -1)
-			closesocket (serv->proxy_sok6);
-		EMIT_SIGNAL (XP_TE_UKNHOST, sess, NULL, NULL, NULL, NULL, 0);
-		if (!servlist_cycle (serv))
-			if (prefs.hex_net_auto_reconnectonfail)
-				auto_reconnect (serv, FALSE, -1);
-		break;
-	case '2':						  /* connection failed */
-		waitline2 (source, tbuf, sizeof tbuf);
-		server_stopconnecting (serv);
-		closesocket (serv->sok4);
-		if (serv->proxy_sok4 != -1)
-			closesocket (serv->proxy_sok4);
-		if (serv->sok6 != -1)
-			closesocket (serv->sok6);
-		if (serv->proxy_sok6 != -1)
-			closesocket (serv->proxy_sok6);
-		EMIT_SIGNAL (XP_TE_CONNFAIL, sess, errorstring (atoi (tbuf)), NULL,
-						 NULL, NULL, 0);
-		if (!servlist_cycle (serv))
-			if (prefs.hex_net_auto_reconnectonfail)
-				auto_reconnect (serv, FALSE, -1);
-		break;
-	case '3':						  /* resolver finished */
-		waitline2 (source, host, sizeof host);
-		waitline2 (source, ip, sizeof ip);
-		waitline2 (source, outbuf, sizeof outbuf);
-		EMIT_SIGNAL (XP_TE_CONNECT, sess, host, ip, outbuf, NULL, 0);
-		break;
-	case '4':						  /* success */
-		waitline2 (source, tbuf, sizeof (tbuf));
-		serv->sok = atoi (tbuf);
-		/* close the one we didn't end up using */
-		if (serv->sok == serv->sok4)
-			closesocket (serv->sok6);
+		if (addr.ss_family == AF_INET)
+			port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
 		else
-			closesocket (serv->sok4);
-		if (serv->proxy_sok != -1)
-		{
-			if (serv->proxy_sok == serv->proxy_sok4)
-				closesocket (serv->proxy_sok6);
-			else
-				closesocket (serv->proxy_sok4);
-		}
+			port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
 
-		{
-			struct sockaddr_storage addr;
-			int addr_len = sizeof (addr);
-			guint16 port;
-			ircnet *net = serv->network;
+		g_snprintf (outbuf, sizeof (outbuf), "IDENTD %"G_GUINT16_FORMAT" ", port);
+		if (net && net->user && !(net->flags & FLAG_USE_GLOBAL))
+			g_strlcat (outbuf, net->user, sizeof (outbuf));
+		else
+			g_strlcat (outbuf, prefs.hex_irc_user_name, sizeof (outbuf));
 
-			if (!getsockname (serv->sok, (struct sockaddr *)&addr, &addr_len))
-			{
-				if (addr.ss_family == AF_INET)
-					port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
-				else
-					port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+		handle_command (serv->server_session, outbuf, FALSE);
+	}
 
-				g_snprintf (outbuf, sizeof (outbuf), "IDENTD %"G_GUINT16_FORMAT" ", port);
-				if (net && net->user && !(net->flags & FLAG_USE_GLOBAL))
-					g_strlcat (outbuf, net->user, sizeof (outbuf));
-				else
-					g_strlcat (outbuf, prefs.hex_irc_user_name, sizeof (outbuf));
+	server_connect_success (serv);
+}
 
-				handle_command (serv->server_session, outbuf, FALSE);
-			}
-		}
+static void
+server_connector_failed (void *data, connector_error error, int sock_err)
+{
+	server *serv = data;
+	session *sess = serv->server_session;
 
-		server_connect_success (serv);
-		break;
-	case '5':						  /* prefs ip discovered */
-		waitline2 (source, tbuf, sizeof tbuf);
-		net_parse_ipv4 (tbuf, &prefs.local_ip);
+	switch (error)
+	{
+	case CONNECTOR_ERR_RESOLVE:
+		server_stopconnecting (serv);
+		EMIT_SIGNAL (XP_TE_UKNHOST, sess, NULL, NULL, NULL, NULL, 0);
 		break;
-	case '7':						  /* prefs.hex_net_bind_host resolve failed */
-		sprintf (outbuf,
-					_("Cannot resolve hostname %s\nCheck your IP Settings!\n"),
-					prefs.hex_net_bind_host);
-		PrintText (sess, outbuf);
+	case CONNECTOR_ERR_CONNECT:
+		server_stopconnecting (serv);
+		EMIT_SIGNAL (XP_TE_CONNFAIL, sess, errorstring (sock_err), NULL,
+						 NULL, NULL, 0);
 		break;
-	case '8':
+	case CONNECTOR_ERR_PROXY:
 		PrintText (sess, _("Proxy traversal failed.\n"));
 		server_disconnect (sess, FALSE, -1);
-		break;
-	case '9':
-		waitline2 (source, tbuf, sizeof tbuf);
-		EMIT_SIGNAL (XP_TE_SERVERLOOKUP, sess, tbuf, NULL, NULL, NULL, 0);
-		break;
+		return;
 	}
 
-	return TRUE;
+	if (!servlist_cycle (serv))
+		if (prefs.hex_net_auto_reconnectonfail)
+			auto_reconnect (serv, FALSE, -1);
 }
 
+static const connector_callbacks server_connector_callbacks =
+{
+	server_connector_lookup,
+	server_connector_bound,
+	server_connector_resolved,
+	server_connector_message,
+	server_connector_connected,
+	server_connector_failed
+};
+
 /* kill all sockets & iotags of a server. Stop a connection attempt, or
    disconnect if already connected. */
 
@@ -1037,34 +1180,26 @@ server_cleanup (server * serv)
 
 	if (serv->connecting)
 	{
+		/* past the connector, the TLS handshake has the socket */
+		if (!serv->connector)
+			closesocket (serv->sok);
 		server_stopconnecting (serv);
-		closesocket (serv->sok4);
-		if (serv->proxy_sok4 != -1)
-			closesocket (serv->proxy_sok4);
-		if (serv->sok6 != -1)
-			closesocket (serv->sok6);
-		if (serv->proxy_sok6 != -1)
-			closesocket (serv->proxy_sok6);
+		reconnect_release (serv);
 		return 1;
 	}
 
 	if (serv->connected)
 	{
 		close_socket (serv->sok);
-		if (serv->proxy_sok)
-			close_socket (serv->proxy_sok);
 		serv->connected = FALSE;
 		serv->end_of_motd = FALSE;
+		reconnect_release (serv);
 		return 2;
 	}
 
 	/* is this server in a reconnect delay? remove it! */
-	if (serv->recondelay_tag)
-	{
-		fe_timeout_remove (serv->recondelay_tag);
-		serv->recondelay_tag = 0;
+	if (reconnect_release (serv) != RECONNECT_IDLE)
 		return 3;
-	}
 
 	return 0;
 }
@@ -1074,7 +1209,6 @@ server_disconnect (session * sess, int sendquit, int err)
 {
 	server *serv = sess->server;
 	GSList *list;
-	char tbuf[64];
 	gboolean shutup = FALSE;
 
 	/* send our QUIT reason */
@@ -1094,8 +1228,7 @@ server_disconnect (session * sess, int sendquit, int err)
 		notc_msg (sess);
 		return;
 	case 1:							  /* it was in the process of connecting */
-		sprintf (tbuf, "%d", sess->server->childpid);
-		EMIT_SIGNAL (XP_TE_STOPCONNECT, sess, tbuf, NULL, NULL, NULL, 0);
+		EMIT_SIGNAL (XP_TE_STOPCONNECT, sess, serv->hostname, NULL, NULL, NULL, 0);
 		return;
 	case 3:
 		shutup = TRUE;	/* won't print "disconnected" in channels */
@@ -1128,194 +1261,7 @@ server_disconnect (session * sess, int sendquit, int err)
 	notify_cleanup ();
 }
 
-/* send a "print text" command to the parent process - MUST END IN \n! */
-
-static void
-proxy_error (int fd, char *msg)
-{
-	write (fd, "0\n", 2);
-	write (fd, msg, strlen (msg));
-}
-
-struct sock_connect
-{
-	char version;
-	char type;
-	guint16 port;
-	guint32 address;
-	char username[10];
-};
-
-/* traverse_socks() returns:
- *				0 success                *
- *          1 socks traversal failed */
-
-static int
-traverse_socks (int print_fd, int sok, char *serverAddr, int port)
-{
-	struct sock_connect sc;
-	unsigned char buf[256];
-
-	sc.version = 4;
-	sc.type = 1;
-	sc.port = htons (port);
-	net_parse_ipv4 (serverAddr, &sc.address);
-	g_strlcpy (sc.username, prefs.hex_irc_user_name, sizeof (sc.username));
-
-	send (sok, (char *) &sc, 8 + strlen (sc.username) + 1, 0);
-	buf[1] = 0;
-	recv (sok, buf, 10, 0);
-	if (buf[1] == 90)
-		return 0;
-
-	g_snprintf (buf, sizeof (buf), "SOCKS\tServer reported error %d,%d.\n", buf[0], buf[1]);
-	proxy_error (print_fd, buf);
-	return 1;
-}
-
-struct sock5_connect1
-{
-	char version;
-	char nmethods;
-	char method;
-};
-
-static int
-traverse_socks5 (int print_fd, int sok, char *serverAddr, int port)
-{
-	struct sock5_connect1 sc1;
-	unsigned char *sc2;
-	unsigned int packetlen, addrlen;
-	unsigned char buf[260];
-	int auth = prefs.hex_net_proxy_auth && prefs.hex_net_proxy_user[0] && prefs.hex_net_proxy_pass[0];
-
-	sc1.version = 5;
-	sc1.nmethods = 1;
-	if (auth)
-		sc1.method = 2;  /* Username/Password Authentication (UPA) */
-	else
-		sc1.method = 0;  /* NO Authentication */
-	send (sok, (char *) &sc1, 3, 0);
-	if (recv (sok, buf, 2, 0) != 2)
-		goto read_error;
-
-	if (buf[0] != 5)
-	{
-		proxy_error (print_fd, "SOCKS\tServer is not socks version 5.\n");
-		return 1;
-	}
-
-	/* did the server say no auth required? */
-	if (buf[1] == 0)
-		auth = 0;
-
-	if (auth)
-	{
-		int len_u=0, len_p=0;
-		unsigned char *u_p_buf;
-
-		/* authentication sub-negotiation (RFC1929) */
-		if (buf[1] != 2)  /* UPA not supported by server */
-		{
-			proxy_error (print_fd, "SOCKS\tServer doesn't support UPA authentication.\n");
-			return 1;
-		}
-
-		/* form the UPA request */
-		len_u = strlen (prefs.hex_net_proxy_user);
-		len_p = strlen (prefs.hex_net_proxy_pass);
-
-        packetlen = 2 + len_u + 1 + len_p;
-		u_p_buf = g_malloc0 (packetlen);
-
-		u_p_buf[0] = 1;
-		u_p_buf[1] = len_u;
-		memcpy (u_p_buf + 2, prefs.hex_net_proxy_user, len_u);
-		u_p_buf[2 + len_u] = len_p;
-		memcpy (u_p_buf + 3 + len_u, prefs.hex_net_proxy_pass, len_p);
-
-		send (sok, u_p_buf, packetlen, 0);
-		g_free(u_p_buf);
-
-		if ( recv (sok, buf, 2, 0) != 2 )
-			goto read_error;
-		if ( buf[1] != 0 )
-		{
-			proxy_error (print_fd, "SOCKS\tAuthentication failed. "
-							 "Is username and password correct?\n");
-			return 1; /* UPA failed! */
-		}
-	}
-	else
-	{
-		if (buf[1] != 0)
-		{
-			proxy_error (print_fd, "SOCKS\tAuthentication required but disabled in settings.\n");
-			return 1;
-		}
-	}
-
-	addrlen = strlen (serverAddr);
-	packetlen = 4 + 1 + addrlen + 2;
-	sc2 = g_malloc (packetlen);
-	sc2[0] = 5;						  /* version */
-	sc2[1] = 1;						  /* command */
-	sc2[2] = 0;						  /* reserved */
-	sc2[3] = 3;						  /* address type */
-	sc2[4] = (unsigned char) addrlen;	/* hostname length */
-	memcpy (sc2 + 5, serverAddr, addrlen);
-	*((unsigned short *) (sc2 + 5 + addrlen)) = htons (port);
-	send (sok, sc2, packetlen, 0);
-	g_free (sc2);
-
-	/* consume all of the reply */
-	if (recv (sok, buf, 4, 0) != 4)
-		goto read_error;
-	if (buf[0] != 5 || buf[1] != 0)
-	{
-		if (buf[1] == 2)
-			g_snprintf (buf, sizeof (buf), "SOCKS\tProxy refused to connect to host (not allowed).\n");
-		else
-			g_snprintf (buf, sizeof (buf), "SOCKS\tProxy failed to connect to host (error %d).\n", buf[1]);
-		proxy_error (print_fd, buf);
-		return 1;
-	}
-	if (buf[3] == 1)	/* IPV4 32bit address */
-	{
-		if (recv (sok, buf, 6, 0) != 6)
-			goto read_error;
-	} else if (buf[3] == 4)	/* IPV6 128bit address */
-	{
-		if (recv (sok, buf, 18, 0) != 18)
-			goto read_error;
-	} else if (buf[3] == 3)	/* string, 1st byte is size */
-	{
-		if (recv (sok, buf, 1, 0) != 1)	/* read the string size */
-			goto read_error;
-		packetlen = buf[0] + 2;	/* can't exceed 260 */
-		if (recv (sok, buf, packetlen, 0) != packetlen)
-			goto read_error;
-	}
-
-	return 0;	/* success */
-
-read_error:
-	proxy_error (print_fd, "SOCKS\tRead error from server.\n");
-	return 1;
-}
-
-static int
-traverse_wingate (int print_fd, int sok, char *serverAddr, int port)
-{
-	char buf[128];
-
-	g_snprintf (buf, sizeof (buf), "%s %d\r\n", serverAddr, port);
-	send (sok, buf, strlen (buf), 0);
-
-	return 0;
-}
-
-/* stuff for HTTP auth is here */
+/* base64 for HTTP proxy auth, used by dcc.c */
 
 static void
 three_to_four (char *from, char *to)
@@ -1366,289 +1312,10 @@ base64_encode (char *to, char *from, unsigned int len)
 	to[0] = 0;
 }
 
-static int
-http_read_line (int print_fd, int sok, char *buf, int len)
-{
-	len = waitline (sok, buf, len, TRUE);
-	if (len >= 1)
-	{
-		/* print the message out (send it to the parent process) */
-		write (print_fd, "0\n", 2);
-
-		if (buf[len-1] == '\r')
-		{
-			buf[len-1] = '\n';
-			write (print_fd, buf, len);
-		} else
-		{
-			write (print_fd, buf, len);
-			write (print_fd, "\n", 1);
-		}
-	}
-
-	return len;
-}
-
-static int
-traverse_http (int print_fd, int sok, char *serverAddr, int port)
-{
-	char buf[512];
-	char auth_data[256];
-	char auth_data2[252];
-	int n, n2;
-
-	n = g_snprintf (buf, sizeof (buf), "CONNECT %s:%d HTTP/1.0\r\n",
-					  serverAddr, port);
-	if (prefs.hex_net_proxy_auth)
-	{
-		n2 = g_snprintf (auth_data2, sizeof (auth_data2), "%s:%s",
-							prefs.hex_net_proxy_user, prefs.hex_net_proxy_pass);
-		base64_encode (auth_data, auth_data2, n2);
-		n += g_snprintf (buf+n, sizeof (buf)-n, "Proxy-Authorization: Basic %s\r\n", auth_data);
-	}
-	n += g_snprintf (buf+n, sizeof (buf)-n, "\r\n");
-	send (sok, buf, n, 0);
-
-	n = http_read_line (print_fd, sok, buf, sizeof (buf));
-	/* "HTTP/1.0 200 OK" */
-	if (n < 12)
-		return 1;
-	if (memcmp (buf, "HTTP/", 5) || memcmp (buf + 9, "200", 3))
-		return 1;
-	while (1)
-	{
-		/* read until blank line */
-		n = http_read_line (print_fd, sok, buf, sizeof (buf));
-		if (n < 1 || (n == 1 && buf[0] == '\n'))
-			break;
-	}
-	return 0;
-}
-
-static int
-traverse_proxy (int proxy_type, int print_fd, int sok, char *ip, int port, netstore *ns_proxy, int csok4, int csok6, int *csok, char bound)
-{
-	switch (proxy_type)
-	{
-	case 1:
-		return traverse_wingate (print_fd, sok, ip, port);
-	case 2:
-		return traverse_socks (print_fd, sok, ip, port);
-	case 3:
-		return traverse_socks5 (print_fd, sok, ip, port);
-	case 4:
-		return traverse_http (print_fd, sok, ip, port);
-	}
-
-	return 1;
-}
-
-/* this is the child process making the connection attempt */
-
-static int
-server_child (server * serv)
-{
-	netstore *ns_server;
-	netstore *ns_proxy = NULL;
-	netstore *ns_local;
-	int port = serv->port;
-	int error;
-	int sok, psok;
-	char *hostname = serv->hostname;
-	char *real_hostname = NULL;
-	char *ip;
-	char *proxy_ip = NULL;
-	char *local_ip;
-	int connect_port;
-	char buf[512];
-	char bound = 0;
-	int proxy_type = 0;
-	char *proxy_host = NULL;
-	int proxy_port;
-
-	ns_server = net_store_new ();
-
-	/* is a hostname set? - bind to it */
-	if (prefs.hex_net_bind_host[0])
-	{
-		ns_local = net_store_new ();
-		local_ip = net_resolve (ns_local, prefs.hex_net_bind_host, 0, &real_hostname);
-		if (local_ip != NULL)
-		{
-			g_snprintf (buf, sizeof (buf), "5\n%s\n", local_ip);
-			write (serv->childwrite, buf, strlen (buf));
-			net_bind (ns_local, serv->sok4, serv->sok6);
-			bound = 1;
-		} else
-		{
-			write (serv->childwrite, "7\n", 2);
-		}
-		net_store_destroy (ns_local);
-	}
-
-	if (!serv->dont_use_proxy) /* blocked in serverlist? */
-	{
-		if (prefs.hex_net_proxy_type == 5)
-		{
-			char **proxy_list;
-			char *url, *proxy;
-			GProxyResolver *resolver;
-			GError *error = NULL;
-
-			/*
-			 * In Flatpak, auto proxy resolution may block indefinitely when
-			 * proxy backends are unavailable in the sandbox. If this happens,
-			 * the connection attempt appears to hang after pressing Connect.
-			 * Prefer direct connections there unless the user configured a
-			 * specific proxy manually.
-			 */
-			if (g_file_test ("/.flatpak-info", G_FILE_TEST_EXISTS))
-				goto proxy_lookup_done;
-
-			resolver = g_proxy_resolver_get_default ();
-			url = g_strdup_printf ("irc://%s:%d", hostname, port);
-			proxy_list = g_proxy_resolver_lookup (resolver, url, NULL, &error);
-
-			if (proxy_list) {
-				/* can use only one */
-				proxy = proxy_list[0];
-				if (!strncmp (proxy, "direct", 6))
-					proxy_type = 0;
-				else if (!strncmp (proxy, "http", 4))
-					proxy_type = 4;
-				else if (!strncmp (proxy, "socks5", 6))
-					proxy_type = 3;
-				else if (!strncmp (proxy, "socks", 5))
-					proxy_type = 2;
-			} else {
-				write_error ("Failed to lookup proxy", &error);
-			}
-
-			if (proxy_type) {
-				char *c;
-				c = strchr (proxy, ':') + 3;
-				proxy_host = g_strdup (c);
-				c = strchr (proxy_host, ':');
-				*c = '\0';
-				proxy_port = atoi (c + 1);
-			}
-
-			g_strfreev (proxy_list);
-			g_free (url);
-
-		proxy_lookup_done:;
-		}
-
-		if (prefs.hex_net_proxy_host[0] &&
-			   prefs.hex_net_proxy_type > 0 &&
-			   prefs.hex_net_proxy_use != 2) /* proxy is NOT dcc-only */
-		{
-			proxy_type = prefs.hex_net_proxy_type;
-			proxy_host = g_strdup (prefs.hex_net_proxy_host);
-			proxy_port = prefs.hex_net_proxy_port;
-		}
-	}
-
-	serv->proxy_type = proxy_type;
-
-	/* first resolve where we want to connect to */
-	if (proxy_type > 0)
-	{
-		g_snprintf (buf, sizeof (buf), "9\n%s\n", proxy_host);
-		write (serv->childwrite, buf, strlen (buf));
-		ip = net_resolve (ns_server, proxy_host, proxy_port, &real_hostname);
-		g_free (proxy_host);
-		if (!ip)
-		{
-			write (serv->childwrite, "1\n", 2);
-			goto xit;
-		}
-		connect_port = proxy_port;
-
-		/* if using socks4 or MS Proxy, attempt to resolve ip for irc server */
-		if ((proxy_type == 2) || (proxy_type == 5))
-		{
-			ns_proxy = net_store_new ();
-			proxy_ip = net_resolve (ns_proxy, hostname, port, &real_hostname);
-			if (!proxy_ip)
-			{
-				write (serv->childwrite, "1\n", 2);
-				goto xit;
-			}
-		} else						  /* otherwise we can just use the hostname */
-			proxy_ip = g_strdup (hostname);
-	} else
-	{
-		ip = net_resolve (ns_server, hostname, port, &real_hostname);
-		if (!ip)
-		{
-			write (serv->childwrite, "1\n", 2);
-			goto xit;
-		}
-		connect_port = port;
-	}
-
-	g_snprintf (buf, sizeof (buf), "3\n%s\n%s\n%d\n",
-				 real_hostname, ip, connect_port);
-	write (serv->childwrite, buf, strlen (buf));
-
-	if (!serv->dont_use_proxy && (proxy_type == 5))
-		error = net_connect (ns_server, serv->proxy_sok4, serv->proxy_sok6, &psok);
-	else
-	{
-		error = net_connect (ns_server, serv->sok4, serv->sok6, &sok);
-		psok = sok;
-	}
-
-	if (error != 0)
-	{
-		g_snprintf (buf, sizeof (buf), "2\n%d\n", sock_error ());
-		write (serv->childwrite, buf, strlen (buf));
-	} else
-	{
-		/* connect succeeded */
-		if (proxy_ip)
-		{
-			switch (traverse_proxy (proxy_type, serv->childwrite, psok, proxy_ip, port, ns_proxy, serv->sok4, serv->sok6, &sok, bound))
-			{
-			case 0:	/* success */
-				g_snprintf (buf, sizeof (buf), "4\n%d\n", sok);	/* success */
-				write (serv->childwrite, buf, strlen (buf));
-				break;
-			case 1:	/* socks traversal failed */
-				write (serv->childwrite, "8\n", 2);
-				break;
-			}
-		} else
-		{
-			g_snprintf (buf, sizeof (buf), "4\n%d\n", sok);	/* success */
-			write (serv->childwrite, buf, strlen (buf));
-		}
-	}
-
-xit:
-
-	/* this is probably not needed */
-	net_store_destroy (ns_server);
-	if (ns_proxy)
-		net_store_destroy (ns_proxy);
-
-	/* no need to free ip/real_hostname, this process is exiting */
-#ifdef WIN32
-	/* under win32 we use a thread -> shared memory, must free! */
-	g_free (proxy_ip);
-	g_free (ip);
-	g_free (real_hostname);
-#endif
-
-	return 0;
-	/* cppcheck-suppress memleak */
-}
-
 static void
 server_connect (server *serv, char *hostname, int port, int no_login)
 {
-	int pid, read_des[2];
+	connector_options opts;
 	session *sess = serv->server_session;
 
 	if (!hostname[0])
@@ -1682,7 +1349,7 @@ server_connect (server *serv, char *hostname, int port, int no_login)
 		g_debug ("Attempted to connect to invalid port, assuming default port %d", port);
 	}
 
-	if (serv->connected || serv->connecting || serv->recondelay_tag)
+	if (serv->connected || serv->connecting || server_reconnect_pending (serv))
 		server_disconnect (sess, TRUE, -1);
 
 	fe_progressbar_start (sess);
@@ -1731,55 +1398,36 @@ server_connect (server *serv, char *hostname, int port, int no_login)
 	fe_set_away (serv);
 	server_flush_queue (serv);
 
-#ifdef WIN32
-	if (_pipe (read_des, 4096, _O_BINARY) < 0)
-#else
-	if (pipe (read_des) < 0)
-#endif
-		return;
-#ifdef __EMX__ /* os/2 */
-	setmode (read_des[0], O_BINARY);
-	setmode (read_des[1], O_BINARY);
-#endif
-	serv->childread = read_des[0];
-	serv->childwrite = read_des[1];
-
-	/* create both sockets now, drop one later */
-	net_sockets (&serv->sok4, &serv->sok6);
-	serv->proxy_sok4 = -1;
-	serv->proxy_sok6 = -1;
+	memset (&opts, 0, sizeof (opts));
+	opts.host = serv->hostname;
+	opts.port = port;
+	opts.bind_host = prefs.hex_net_bind_host;
+	opts.username = prefs.hex_irc_user_name;
 
-#ifdef WIN32
-	CloseHandle (CreateThread (NULL, 0,
-										(LPTHREAD_START_ROUTINE)server_child,
-										serv, 0, (DWORD *)&pid));
-#else
-#ifdef LOOKUPD
-	/* CL: net_resolve calls rand() when LOOKUPD is set, so prepare a different
-	 * seed for each child. This method gives a bigger variation in seed values
-	 * than calling srand(time(0)) in the child itself.
-	 */
-	rand();
-#endif
-	switch (pid = fork ())
+	if (!serv->dont_use_proxy) /* blocked in serverlist? */
 	{
-	case -1:
-		return;
+		if (prefs.hex_net_proxy_type == CONNECTOR_PROXY_AUTO)
+		{
+			opts.proxy_type = CONNECTOR_PROXY_AUTO;
+		}
+		else if (prefs.hex_net_proxy_host[0] &&
+					prefs.hex_net_proxy_type > 0 &&
+					prefs.hex_net_proxy_use != 2) /* proxy is NOT dcc-only */
+		{
+			opts.proxy_type = prefs.hex_net_proxy_type;
+			opts.proxy_host = prefs.hex_net_proxy_host;
+			opts.proxy_port = prefs.hex_net_proxy_port;
+		}
 
-	case 0:
-		/* this is the child */
-		setuid (getuid ());
-		server_child (serv);
-		_exit (0);
+		if (prefs.hex_net_proxy_auth)
+		{
+			opts.proxy_user = prefs.hex_net_proxy_user;
+			opts.proxy_pass = prefs.hex_net_proxy_pass;
+		}
 	}
-#endif
-	serv->childpid = pid;
-#ifdef WIN32
-	serv->iotag = fe_input_add (serv->childread, FIA_READ|FIA_FD, server_read_child,
-#else
-	serv->iotag = fe_input_add (serv->childread, FIA_READ, server_read_child,
-#endif
-										 serv);
+
+	memset (serv->connect_times, 0, sizeof (serv->connect_times));
+	serv->connector = connector_new (&opts, &server_connector_callbacks, serv);
 }
 
 void
@@ -1794,6 +1442,31 @@ server_fill_her_up (server *serv)
 	proto_fill_her_up (serv);
 }
 
+/* does ASCII come through the read converter unchanged? Not so for the
+ * likes of ISO-2022-JP and UTF-7, which give some of it a meaning. */
+
+static gboolean
+server_encoding_is_ascii (server *serv)
+{
+	char ascii[127], *converted;
+	gsize len;
+	gboolean same;
+	int i;
+
+	if (!strcmp (serv->encoding, "UTF-8"))
+		return TRUE;
+
+	for (i = 0; i < sizeof (ascii); i++)
+		ascii[i] = i + 1;
+
+	converted = g_convert_with_iconv (ascii, sizeof (ascii), serv->read_converter, NULL, &len, NULL);
+	g_iconv (serv->read_converter, NULL, NULL, NULL, NULL);
+	same = converted && len == sizeof (ascii) && !memcmp (converted, ascii, len);
+	g_free (converted);
+
+	return same;
+}
+
 void
 server_set_encoding (server *serv, char *new_encoding)
 {
@@ -1839,6 +1512,8 @@ server_set_encoding (server *serv, char *new_encoding)
 		g_iconv_close (serv->write_converter);
 	}
 	serv->write_converter = g_iconv_open (serv->encoding, "UTF-8");
+
+	serv->encoding_ascii = server_encoding_is_ascii (serv);
 }
 
 server *
@@ -1898,6 +1573,7 @@ server_set_defaults (server *serv)
 	serv->is_away = FALSE;
 	serv->supports_watch = FALSE;
 	serv->supports_monitor = FALSE;
+	serv->watch_limit = 0;
 	serv->bad_prefix = FALSE;
 	serv->use_who = TRUE;
 	serv->have_namesx = FALSE;
@@ -1959,10 +1635,10 @@ server_set_name (server *serv, char *name)
 	{
 		if (serv->network)
 		{
-			safe_strcpy (serv->server_session->channel, ((ircnet *)serv->network)->name, CHANLEN);
+			session_set_channel (serv->server_session, ((ircnet *)serv->network)->name);
 		} else
 		{
-			safe_strcpy (serv->server_session->channel, name, CHANLEN);
+			session_set_channel (serv->server_session, name);
 		}
 		fe_set_channel (serv->server_session);
 	}
@@ -2030,6 +1706,7 @@ void
 server_free (server *serv)
 {
 	serv->cleanup (serv);
+	reconnect_forget (serv);
 
 	serv_list = g_slist_remove (serv_list, serv);
 
@@ -2045,12 +1722,17 @@ server_free (server *serv)
 	g_free (serv->bad_nick_prefixes);
 	g_free (serv->last_away_reason);
 	g_free (serv->encoding);
+	g_free (serv->pdibuf);
 
 	g_iconv_close (serv->read_converter);
 	g_iconv_close (serv->write_converter);
 
 	if (serv->favlist)
 		g_slist_free_full (serv->favlist, (GDestroyNotify) servlist_favchan_free);
+	g_clear_pointer (&serv->channel_index, g_hash_table_destroy);
+	g_clear_pointer (&serv->dialog_index, g_hash_table_destroy);
+	g_clear_pointer (&serv->user_index, g_hash_table_destroy);
+	notify_forget_server (serv);
 #ifdef USE_OPENSSL
 	if (serv->ctx)
 		_SSL_context_free (serv->ctx);
@@ -35,6 +35,9 @@ void server_set_defaults (server *serv);
 char *server_get_network (server *serv, gboolean fallback);
 void server_set_name (server *serv, char *name);
 void server_free (server *serv);
+int server_schedule_reconnect (server *serv, int delay, gboolean (*start) (void *owner));
+gboolean server_reconnect_pending (server *serv);
+void server_reconnect_now (server *serv);
 
 void server_away_save_message (server *serv, char *nick, char *msg);
 struct away_msg *server_away_find_message (server *serv, char *nick);
@@ -715,17 +715,18 @@ servlist_auto_connect (session *sess)
 	return ret;
 }
 
-static gint
-servlist_cycle_cb (server *serv)
+static gboolean
+servlist_cycle_cb (void *owner)
 {
-	if (serv->network)
-	{
-		PrintTextf (serv->server_session,
-			_("Cycling to next server in %s...\n"), ((ircnet *)serv->network)->name);
-		servlist_connect (serv->server_session, serv->network, TRUE);
-	}
+	server *serv = owner;
 
-	return 0;
+	if (!is_server (serv) || !serv->network)
+		return FALSE;
+
+	PrintTextf (serv->server_session,
+		_("Cycling to next server in %s...\n"), ((ircnet *)serv->network)->name);
+	servlist_connect (serv->server_session, serv->network, TRUE);
+	return TRUE;
 }
 
 int
@@ -752,10 +753,7 @@ servlist_cycle (server *serv)
 			if (del < 1000)
 				del = 500;				  /* so it doesn't block the gui */
 
-			if (del)
-				serv->recondelay_tag = fe_timeout_add (del, servlist_cycle_cb, serv);
-			else
-				servlist_connect (serv->server_session, net, TRUE);
+			server_schedule_reconnect (serv, del, servlist_cycle_cb);
 
 			return TRUE;
 		}
@@ -0,0 +1,158 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "../cfgindex.h"
+
+static void
+test_lookup (void)
+{
+	cfg_index *table = cfg_index_new ("irc_nick1 = me\n"
+												 "irc_nick10 = other\n"
+												 "Gui_Win_Height=400\n"
+												 "text_font   =   Monospace 9\n"
+												 "irc_nick1 = ignored\n"
+												 "novalue\n"
+												 "empty = \n"
+												 "last = no newline");
+
+	g_assert_cmpstr (cfg_index_get (table, "irc_nick1"), ==, "me");
+	g_assert_cmpstr (cfg_index_get (table, "IRC_NICK10"), ==, "other");
+	g_assert_cmpstr (cfg_index_get (table, "text_font"), ==, "Monospace 9");
+	g_assert_cmpstr (cfg_index_get (table, "empty"), ==, "");
+	g_assert_cmpstr (cfg_index_get (table, "last"), ==, "no newline");
+
+	/* the key ends at the first space, like cfg_get_str () */
+	g_assert_null (cfg_index_get (table, "gui_win_height"));
+	g_assert_null (cfg_index_get (table, "novalue"));
+	g_assert_null (cfg_index_get (table, "irc_nick"));
+
+	cfg_index_free (table);
+	cfg_index_free (NULL);
+}
+
+static void
+collect_line (char *key, char *rest, void *data)
+{
+	g_ptr_array_add (data, g_strdup_printf ("%s|%s", key, rest));
+}
+
+static void
+test_parse_lines (void)
+{
+	GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+	char *cfg = g_strdup ("NAME Op\nCMD op %a\n\n# comment line\nnospace\nCMD two words");
+
+	cfg_parse_lines (cfg, collect_line, lines);
+
+	g_assert_cmpuint (lines->len, ==, 4);
+	g_assert_cmpstr (g_ptr_array_index (lines, 0), ==, "NAME|Op");
+	g_assert_cmpstr (g_ptr_array_index (lines, 1), ==, "CMD|op %a");
+	g_assert_cmpstr (g_ptr_array_index (lines, 2), ==, "#|comment line");
+	g_assert_cmpstr (g_ptr_array_index (lines, 3), ==, "CMD|two words");
+
+	g_ptr_array_free (lines, TRUE);
+	g_free (cfg);
+}
+
+/* the per-variable scan load_config () used to do through cfg_get_str () */
+static gboolean
+reference_get (const char *cfg, const char *var, char *dest, int dest_len)
+{
+	gsize varlen = strlen (var);
+	const char *end;
+
+	while (1)
+	{
+		if (!g_ascii_strncasecmp (cfg, var, varlen) && cfg[varlen] == ' ')
+		{
+			cfg += varlen;
+			while (*cfg == ' ')
+				cfg++;
+			if (*cfg == '=')
+				cfg++;
+			while (*cfg == ' ')
+				cfg++;
+			end = strchr (cfg, '\n');
+			if (!end)
+				end = cfg + strlen (cfg);
+			g_strlcpy (dest, cfg, MIN (dest_len, end - cfg + 1));
+			return TRUE;
+		}
+		cfg = strchr (cfg, '\n');
+		if (!cfg || !*++cfg)
+			return FALSE;
+	}
+}
+
+static void
+test_perf_cold_start (void)
+{
+	GString *cfg = g_string_new ("version = 2.18\n");
+	char value[256], **names;
+	GTimer *timer;
+	double indexed, scanned;
+	cfg_index *table;
+	int i, round, nvars = 500;
+
+	names = g_new0 (char *, nvars + 1);
+	for (i = 0; i < nvars; i++)
+	{
+		names[i] = g_strdup_printf ("section%d_option_%d", i % 12, i);
+		g_string_append_printf (cfg, "%s = value of option %d\n", names[i], i);
+	}
+
+	timer = g_timer_new ();
+	for (round = 0; round < 100; round++)
+	{
+		table = cfg_index_new (cfg->str);
+		for (i = 0; i < nvars; i++)
+			g_assert_nonnull (cfg_index_get (table, names[i]));
+		cfg_index_free (table);
+	}
+	indexed = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (round = 0; round < 100; round++)
+	{
+		for (i = 0; i < nvars; i++)
+			g_assert_true (reference_get (cfg->str, names[i], value, sizeof (value)));
+	}
+	scanned = g_timer_elapsed (timer, NULL);
+
+	g_test_message ("%d variables, 100 loads: indexed %.3fs, one scan per variable %.3fs",
+						 nvars, indexed, scanned);
+	g_test_minimized_result (indexed / 100, "seconds per load_config () parse");
+
+	g_timer_destroy (timer);
+	g_strfreev (names);
+	g_string_free (cfg, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/cfgindex/lookup", test_lookup);
+	g_test_add_func ("/cfgindex/parse-lines", test_parse_lines);
+	if (g_test_perf ())
+		g_test_add_func ("/cfgindex/perf/cold-start", test_perf_cold_start);
+	return g_test_run ();
+}
@@ -0,0 +1,157 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "../zoitechat.h"
+#include "../cmdindex.h"
+
+static struct popup *
+popup_new (const char *name, const char *cmd)
+{
+	struct popup *pop = g_new0 (struct popup, 1);
+
+	pop->name = g_strdup (name);
+	pop->cmd = g_strdup (cmd);
+	return pop;
+}
+
+static void
+popup_free (gpointer data)
+{
+	struct popup *pop = data;
+
+	g_free (pop->name);
+	g_free (pop->cmd);
+	g_free (pop);
+}
+
+/* the list walk handle_command () used to do */
+static int
+reference_count (GSList *list, const char *name)
+{
+	int count = 0;
+
+	for (; list; list = list->next)
+	{
+		if (!g_ascii_strcasecmp (((struct popup *)list->data)->name, name))
+			count++;
+	}
+
+	return count;
+}
+
+static void
+test_case_and_order (void)
+{
+	GSList *list = NULL, *found;
+	command_index *table;
+
+	list = g_slist_append (list, popup_new ("ACTION", "me %2&"));
+	list = g_slist_append (list, popup_new ("J", "join &2"));
+	list = g_slist_append (list, popup_new ("Action", "say second"));
+	list = g_slist_append (list, popup_new ("action", "say third"));
+	table = command_index_new (list);
+
+	found = command_index_lookup (table, "aCtIoN");
+	g_assert_cmpuint (g_slist_length (found), ==, 3);
+	g_assert_cmpstr (((struct popup *)found->data)->cmd, ==, "me %2&");
+	g_assert_cmpstr (((struct popup *)found->next->data)->cmd, ==, "say second");
+	g_assert_cmpstr (((struct popup *)found->next->next->data)->cmd, ==, "say third");
+
+	g_assert_cmpuint (g_slist_length (command_index_lookup (table, "j")), ==, 1);
+	g_assert_null (command_index_lookup (table, "JOIN"));
+	g_assert_null (command_index_lookup (table, ""));
+
+	command_index_free (table);
+	g_slist_free_full (list, popup_free);
+}
+
+static void
+test_empty_list (void)
+{
+	command_index *table = command_index_new (NULL);
+
+	g_assert_null (command_index_lookup (table, "anything"));
+	command_index_free (table);
+	command_index_free (NULL);
+}
+
+static void
+test_perf_many_commands (void)
+{
+	GSList *list = NULL;
+	GPtrArray *names = g_ptr_array_new_with_free_func (g_free);
+	command_index *table;
+	GTimer *timer;
+	double indexed, linear;
+	guint i, round, hits = 0, hits_old = 0;
+
+	for (i = 0; i < 2000; i++)
+	{
+		char *name = g_strdup_printf ("Alias%u", i);
+		list = g_slist_prepend (list, popup_new (name, "say %2&"));
+		g_free (name);
+	}
+	table = command_index_new (list);
+
+	/* what a busy session sends: mostly built-in commands, some aliases */
+	for (i = 0; i < 1000; i++)
+	{
+		if (i % 4)
+			g_ptr_array_add (names, g_strdup ((i % 3) ? "MSG" : "me"));
+		else
+			g_ptr_array_add (names, g_strdup_printf ("alias%u", i * 7 % 2000));
+	}
+
+	timer = g_timer_new ();
+	for (round = 0; round < 100; round++)
+	{
+		for (i = 0; i < names->len; i++)
+			hits += g_slist_length (command_index_lookup (table, g_ptr_array_index (names, i)));
+	}
+	indexed = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (round = 0; round < 100; round++)
+	{
+		for (i = 0; i < names->len; i++)
+			hits_old += reference_count (list, g_ptr_array_index (names, i));
+	}
+	linear = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (hits, ==, hits_old);
+	g_test_message ("%u commands against 2000 user commands: indexed %.3fs, linear %.3fs",
+						 names->len * 100, indexed, linear);
+	g_test_minimized_result (indexed / (names->len * 100), "seconds per user command lookup");
+
+	g_timer_destroy (timer);
+	g_ptr_array_free (names, TRUE);
+	command_index_free (table);
+	g_slist_free_full (list, popup_free);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/cmdindex/case-and-order", test_case_and_order);
+	g_test_add_func ("/cmdindex/empty-list", test_empty_list);
+	if (g_test_perf ())
+		g_test_add_func ("/cmdindex/perf/many-commands", test_perf_many_commands);
+	return g_test_run ();
+}
@@ -0,0 +1,405 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <gio/gio.h>
+
+#include "../zoitechat.h"
+#include "../fe.h"
+#include "../connector.h"
+
+/* stubs for what connector.c and network.c pull in from the rest of the program */
+struct zoitechatprefs prefs;
+
+int
+fe_input_add (int sok, int flags, void *func, void *data)
+{
+	GIOChannel *channel = g_io_channel_unix_new (sok);
+	GIOCondition cond = 0;
+	int tag;
+
+	if (flags & FIA_READ)
+		cond |= G_IO_IN | G_IO_HUP | G_IO_ERR;
+	if (flags & FIA_WRITE)
+		cond |= G_IO_OUT | G_IO_ERR;
+	if (flags & FIA_EX)
+		cond |= G_IO_PRI;
+
+	tag = g_io_add_watch (channel, cond, func, data);
+	g_io_channel_unref (channel);
+	return tag;
+}
+
+void fe_input_remove (int tag) { g_source_remove (tag); }
+int fe_timeout_add (int interval, void *callback, void *userdata) { return g_timeout_add (interval, callback, userdata); }
+void fe_timeout_remove (int tag) { g_source_remove (tag); }
+void fe_idle_add (void *func, void *data) { g_idle_add (func, data); }
+
+typedef struct
+{
+	GMainLoop *loop;
+	int sok;
+	int error;
+	GPtrArray *messages;
+	char *resolved;
+} outcome;
+
+static void on_lookup (void *data, const char *host) { }
+static void on_bound (void *data, const char *ip) { }
+
+static void
+on_resolved (void *data, const char *host, const char *ip, int port)
+{
+	outcome *out = data;
+
+	out->resolved = g_strdup (host);
+}
+
+static void
+on_message (void *data, const char *text)
+{
+	outcome *out = data;
+
+	g_ptr_array_add (out->messages, g_strdup (text));
+}
+
+static void
+on_connected (void *data, int sok, const gint64 *times)
+{
+	outcome *out = data;
+
+	g_assert_cmpint (times[CONNECTOR_PHASE_DNS], >=, 0);
+	g_assert_cmpint (times[CONNECTOR_PHASE_TCP], >=, 0);
+	out->sok = sok;
+	g_main_loop_quit (out->loop);
+}
+
+static void
+on_failed (void *data, connector_error error, int sock_err)
+{
+	outcome *out = data;
+
+	out->error = error;
+	g_main_loop_quit (out->loop);
+}
+
+static const connector_callbacks callbacks =
+{
+	on_lookup, on_bound, on_resolved, on_message, on_connected, on_failed
+};
+
+/* run a connector to its end; the socket, or -1 and out->error */
+static void
+run_connector (const connector_options *opts, outcome *out)
+{
+	connector *conn;
+
+	out->loop = g_main_loop_new (NULL, FALSE);
+	out->sok = -1;
+	out->error = -1;
+	out->messages = g_ptr_array_new_with_free_func (g_free);
+	out->resolved = NULL;
+
+	conn = connector_new (opts, &callbacks, out);
+	g_main_loop_run (out->loop);
+	connector_free (conn);
+	g_main_loop_unref (out->loop);
+}
+
+static void
+outcome_clear (outcome *out)
+{
+	if (out->sok != -1)
+		close (out->sok);
+	g_ptr_array_free (out->messages, TRUE);
+	g_free (out->resolved);
+}
+
+static int
+listen_loopback (int *port)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof (addr);
+	int listener;
+
+	listener = socket (AF_INET, SOCK_STREAM, 0);
+	g_assert_cmpint (listener, >=, 0);
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	g_assert_cmpint (bind (listener, (struct sockaddr *)&addr, sizeof (addr)), ==, 0);
+	g_assert_cmpint (listen (listener, 4), ==, 0);
+	g_assert_cmpint (getsockname (listener, (struct sockaddr *)&addr, &addrlen), ==, 0);
+
+	*port = ntohs (addr.sin_port);
+	return listener;
+}
+
+/* what comes next on a non-blocking socket, waiting for it */
+static char *
+read_some (int sok)
+{
+	struct pollfd pfd;
+	char buf[256];
+	int len;
+
+	pfd.fd = sok;
+	pfd.events = POLLIN;
+	g_assert_cmpint (poll (&pfd, 1, 5000), ==, 1);
+	len = recv (sok, buf, sizeof (buf) - 1, 0);
+	g_assert_cmpint (len, >, 0);
+	buf[len] = 0;
+	return g_strdup (buf);
+}
+
+static GList *
+make_addresses (const char **ips)
+{
+	GList *addrs = NULL;
+	int i;
+
+	for (i = 0; ips[i]; i++)
+		addrs = g_list_append (addrs, g_inet_address_new_from_string (ips[i]));
+	return addrs;
+}
+
+static void
+test_order_addresses (void)
+{
+	const char *ips[] = { "2001:db8::1", "2001:db8::2", "192.0.2.1", "192.0.2.2", "2001:db8::3", NULL };
+	const char *expected[] = { "2001:db8::1", "192.0.2.1", "2001:db8::2", "192.0.2.2", "2001:db8::3", NULL };
+	GList *addrs, *list;
+	char *ip;
+	int i;
+
+	addrs = connector_order_addresses (make_addresses (ips));
+	for (list = addrs, i = 0; expected[i]; list = list->next, i++)
+	{
+		g_assert_nonnull (list);
+		ip = g_inet_address_to_string (list->data);
+		g_assert_cmpstr (ip, ==, expected[i]);
+		g_free (ip);
+	}
+	g_assert_null (list);
+	g_resolver_free_addresses (addrs);
+
+	g_assert_null (connector_order_addresses (NULL));
+}
+
+static void
+test_direct (void)
+{
+	connector_options opts = { 0 };
+	outcome out;
+	int listener, port, peer;
+
+	listener = listen_loopback (&port);
+	opts.host = "127.0.0.1";
+	opts.port = port;
+
+	run_connector (&opts, &out);
+	g_assert_cmpint (out.sok, >=, 0);
+	g_assert_cmpstr (out.resolved, ==, "127.0.0.1");
+
+	peer = accept (listener, NULL, NULL);
+	g_assert_cmpint (peer, >=, 0);
+	g_assert_cmpint (send (peer, "PING :x\r\n", 9, 0), ==, 9);
+
+	close (peer);
+	close (listener);
+	outcome_clear (&out);
+}
+
+static void
+test_refused (void)
+{
+	connector_options opts = { 0 };
+	outcome out;
+	int listener, port;
+
+	/* nothing listens there any more */
+	listener = listen_loopback (&port);
+	close (listener);
+	opts.host = "127.0.0.1";
+	opts.port = port;
+
+	run_connector (&opts, &out);
+	g_assert_cmpint (out.sok, ==, -1);
+	g_assert_cmpint (out.error, ==, CONNECTOR_ERR_CONNECT);
+
+	outcome_clear (&out);
+}
+
+typedef struct
+{
+	int listener;
+	connector_proxy type;
+	char *request;		/* all that the client sent before our reply */
+} fake_proxy;
+
+static void
+recv_all (int sok, unsigned char *buf, int len)
+{
+	g_assert_cmpint (recv (sok, buf, len, MSG_WAITALL), ==, len);
+}
+
+/* answers one client the way a proxy would, then talks as the server */
+static gpointer
+fake_proxy_serve (gpointer data)
+{
+	fake_proxy *fp = data;
+	GString *request = g_string_new (NULL);
+	unsigned char buf[512];
+	const char *reply;
+	int sok, n;
+
+	sok = accept (fp->listener, NULL, NULL);
+	g_assert_cmpint (sok, >=, 0);
+
+	if (fp->type == CONNECTOR_PROXY_SOCKS5)
+	{
+		recv_all (sok, buf, 3);
+		g_string_append_len (request, (char *)buf, 3);
+		g_assert_cmpint (send (sok, "\x05\x00", 2, 0), ==, 2);
+
+		recv_all (sok, buf, 5);
+		recv_all (sok, buf + 5, buf[4] + 2);
+		g_string_append_len (request, (char *)buf, 7 + buf[4]);
+
+		/* the reply and the server's first line in one go */
+		reply = "\x05\x00\x00\x01\x7f\x00\x00\x01\x1a\x0b" "PING :x\r\n";
+		g_assert_cmpint (send (sok, reply, 19, 0), ==, 19);
+	}
+	else
+	{
+		while (!strstr (request->str, "\r\n\r\n"))
+		{
+			n = recv (sok, buf, sizeof (buf), 0);
+			g_assert_cmpint (n, >, 0);
+			g_string_append_len (request, (char *)buf, n);
+		}
+
+		reply = "HTTP/1.0 200 Connection established\r\nProxy-Agent: test\r\n\r\nPING :x\r\n";
+		g_assert_cmpint (send (sok, reply, strlen (reply), 0), ==, strlen (reply));
+	}
+
+	fp->request = g_string_free (request, FALSE);
+	g_usleep (G_USEC_PER_SEC / 10);
+	close (sok);
+	return NULL;
+}
+
+static void
+test_socks5 (void)
+{
+	connector_options opts = { 0 };
+	fake_proxy fp = { 0 };
+	GThread *thread;
+	outcome out;
+	char *line;
+	int port;
+
+	fp.listener = listen_loopback (&port);
+	fp.type = CONNECTOR_PROXY_SOCKS5;
+	thread = g_thread_new ("proxy", fake_proxy_serve, &fp);
+
+	opts.host = "irc.example.net";
+	opts.port = 6697;
+	opts.proxy_type = CONNECTOR_PROXY_SOCKS5;
+	opts.proxy_host = "127.0.0.1";
+	opts.proxy_port = port;
+
+	run_connector (&opts, &out);
+	g_assert_cmpint (out.sok, >=, 0);
+
+	/* the server's data right after the reply is left for the caller */
+	line = read_some (out.sok);
+	g_assert_cmpstr (line, ==, "PING :x\r\n");
+	g_free (line);
+
+	g_thread_join (thread);
+	g_assert_true (memcmp (fp.request, "\x05\x01\x00" "\x05\x01\x00\x03\x0f" "irc.example.net" "\x1a\x29",
+								  3 + 7 + 15) == 0);
+
+	g_free (fp.request);
+	close (fp.listener);
+	outcome_clear (&out);
+}
+
+static void
+test_http (void)
+{
+	connector_options opts = { 0 };
+	fake_proxy fp = { 0 };
+	GThread *thread;
+	outcome out;
+	char *line;
+	int port;
+
+	fp.listener = listen_loopback (&port);
+	fp.type = CONNECTOR_PROXY_HTTP;
+	thread = g_thread_new ("proxy", fake_proxy_serve, &fp);
+
+	opts.host = "irc.example.net";
+	opts.port = 6697;
+	opts.proxy_type = CONNECTOR_PROXY_HTTP;
+	opts.proxy_host = "127.0.0.1";
+	opts.proxy_port = port;
+	opts.proxy_user = "user";
+	opts.proxy_pass = "pass";
+
+	run_connector (&opts, &out);
+	g_assert_cmpint (out.sok, >=, 0);
+	g_assert_cmpstr (out.resolved, ==, "127.0.0.1");
+
+	g_assert_cmpuint (out.messages->len, ==, 3);
+	g_assert_cmpstr (g_ptr_array_index (out.messages, 0), ==, "HTTP/1.0 200 Connection established\n");
+	g_assert_cmpstr (g_ptr_array_index (out.messages, 1), ==, "Proxy-Agent: test\n");
+
+	line = read_some (out.sok);
+	g_assert_cmpstr (line, ==, "PING :x\r\n");
+	g_free (line);
+
+	g_thread_join (thread);
+	g_assert_cmpstr (fp.request, ==, "CONNECT irc.example.net:6697 HTTP/1.0\r\n"
+						  "Proxy-Authorization: Basic dXNlcjpwYXNz\r\n\r\n");
+
+	g_free (fp.request);
+	close (fp.listener);
+	outcome_clear (&out);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/connector/order-addresses", test_order_addresses);
+	g_test_add_func ("/connector/direct", test_direct);
+	g_test_add_func ("/connector/refused", test_refused);
+	g_test_add_func ("/connector/socks5", test_socks5);
+	g_test_add_func ("/connector/http", test_http);
+	return g_test_run ();
+}
@@ -0,0 +1,236 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "../framer.h"
+
+#define LINEBUF_SIZE 8704
+
+static void
+collect_line (void *data, char *line, int len)
+{
+	GPtrArray *lines = data;
+
+	g_assert_cmpint (strlen (line), ==, len);
+	g_ptr_array_add (lines, g_strdup (line));
+}
+
+/* feed text in pieces of 'chunk' bytes and return the lines seen */
+static GPtrArray *
+frame (const char *text, int chunk, int linebuf_size)
+{
+	GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+	char *linebuf = g_malloc (linebuf_size);
+	char *copy = g_strdup (text);
+	int pos = 0, len = strlen (text), off, n;
+
+	for (off = 0; off < len; off += n)
+	{
+		n = MIN (chunk, len - off);
+		framer_feed (linebuf, linebuf_size, &pos, copy + off, n, collect_line, lines);
+	}
+
+	g_free (copy);
+	g_free (linebuf);
+	return lines;
+}
+
+static void
+assert_lines (GPtrArray *lines, const char **expected)
+{
+	guint i;
+
+	for (i = 0; expected[i]; i++)
+	{
+		g_assert_cmpuint (i, <, lines->len);
+		g_assert_cmpstr (g_ptr_array_index (lines, i), ==, expected[i]);
+	}
+	g_assert_cmpuint (i, ==, lines->len);
+	g_ptr_array_free (lines, TRUE);
+}
+
+static void
+test_split_reads (void)
+{
+	const char *text = ":irc.example.net 001 me :Welcome\r\nPING :123\r\n"
+							 ":a!b@c PRIVMSG #chan :hello\r\n\r\n:x NOTICE me :done\n";
+	const char *expected[] = { ":irc.example.net 001 me :Welcome", "PING :123",
+										":a!b@c PRIVMSG #chan :hello", "", ":x NOTICE me :done", NULL };
+	int chunk;
+
+	/* every way of cutting it up gives the same lines */
+	for (chunk = 1; chunk <= strlen (text); chunk++)
+		assert_lines (frame (text, chunk, LINEBUF_SIZE), expected);
+}
+
+static void
+test_carriage_returns (void)
+{
+	const char *expected[] = { "PRIVMSG #c :ab", "PING :x", NULL };
+
+	assert_lines (frame ("PRIVMSG #c :a\rb\r\nPING :x\r\r\n", 3, LINEBUF_SIZE), expected);
+}
+
+static void
+test_partial_line_kept (void)
+{
+	const char *expected[] = { "PING :1", NULL };
+
+	assert_lines (frame ("PING :1\r\nPING :2", 4, LINEBUF_SIZE), expected);
+}
+
+static void
+test_overlong_lines (void)
+{
+	const char *expected[] = { "0123456789abcde", "0123456789abcde", "ok", NULL };
+
+	/* truncated both when read whole and when split between reads */
+	assert_lines (frame ("0123456789abcdefghij\r\n0123456789abcdefghij\r\nok\r\n", 64, 16), expected);
+	assert_lines (frame ("0123456789abcdefghij\r\n0123456789abcdefghij\r\nok\r\n", 5, 16), expected);
+}
+
+static void
+test_is_ascii (void)
+{
+	char text[64];
+	int i;
+
+	memset (text, 'a', sizeof (text));
+	g_assert_true (framer_is_ascii (text, sizeof (text)));
+	g_assert_true (framer_is_ascii ("", 0));
+
+	/* a high byte is found wherever it is */
+	for (i = 0; i < sizeof (text); i++)
+	{
+		text[i] = (char) 0xc3;
+		g_assert_false (framer_is_ascii (text, sizeof (text)));
+		g_assert_true (framer_is_ascii (text, i));
+		text[i] = 'a';
+	}
+}
+
+/* a NAMES and LIST burst like the one after joining a big network */
+static char *
+make_burst (gsize size)
+{
+	GString *burst = g_string_sized_new (size + 1024);
+	int i, n = 0;
+
+	while (burst->len < size)
+	{
+		if (n % 3)
+		{
+			g_string_append_printf (burst, ":irc.example.net 322 me #channel%d %d :Topic of channel %d, caf\xc3\xa9\r\n",
+											n, n % 500, n);
+		}
+		else
+		{
+			g_string_append (burst, ":irc.example.net 353 me = #big :");
+			for (i = 0; i < 40; i++)
+				g_string_append_printf (burst, "%snick%d ", (i % 7) ? "" : "@", n * 40 + i);
+			g_string_append (burst, "\r\n");
+		}
+		n++;
+	}
+
+	return g_string_free (burst, FALSE);
+}
+
+/* the checks server_inline () makes before using a line as it is */
+static void
+count_line (void *data, char *line, int len)
+{
+	if (!framer_is_ascii (line, len))
+		g_assert_true (g_utf8_validate (line, len, NULL));
+	(*(guint64 *)data) += len;
+}
+
+static void
+test_perf_burst (void)
+{
+	gsize size = 16 * 1024 * 1024;
+	char *burst = make_burst (size);
+	char *copy = g_strdup (burst);
+	char linebuf[LINEBUF_SIZE];
+	guint64 seen = 0, seen_old = 0;
+	gsize len = strlen (burst), off, n, i;
+	GTimer *timer = g_timer_new ();
+	double framed, bytewise;
+	int pos = 0;
+	char *line;
+
+	for (off = 0; off < len; off += n)
+	{
+		n = MIN (16384, len - off);
+		framer_feed (linebuf, sizeof (linebuf), &pos, copy + off, n, count_line, &seen);
+	}
+	framed = g_timer_elapsed (timer, NULL);
+
+	/* what server_read () used to do: copy byte by byte, then make a
+	 * validated copy of every line */
+	g_timer_start (timer);
+	pos = 0;
+	for (off = 0; off < len; off += n)
+	{
+		n = MIN (2048, len - off);
+		for (i = 0; i < n; i++)
+		{
+			switch (burst[off + i])
+			{
+			case '\r':
+				break;
+			case '\n':
+				linebuf[pos] = 0;
+				line = g_strndup (linebuf, pos);
+				g_assert_true (g_utf8_validate (line, pos, NULL));
+				seen_old += strlen (line);
+				g_free (line);
+				pos = 0;
+				break;
+			default:
+				linebuf[pos++] = burst[off + i];
+			}
+		}
+	}
+	bytewise = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (seen, ==, seen_old);
+	g_test_message ("%" G_GSIZE_FORMAT " MB burst: framer %.3fs, byte by byte %.3fs",
+						 len >> 20, framed, bytewise);
+	g_test_minimized_result (framed / (len >> 20), "seconds per MB of server input");
+
+	g_timer_destroy (timer);
+	g_free (copy);
+	g_free (burst);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/framer/split-reads", test_split_reads);
+	g_test_add_func ("/framer/carriage-returns", test_carriage_returns);
+	g_test_add_func ("/framer/partial-line-kept", test_partial_line_kept);
+	g_test_add_func ("/framer/overlong-lines", test_overlong_lines);
+	g_test_add_func ("/framer/is-ascii", test_is_ascii);
+	if (g_test_perf ())
+		g_test_add_func ("/framer/perf/burst", test_perf_burst);
+	return g_test_run ();
+}
@@ -0,0 +1,155 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "../zoitechat.h"
+#include "../hilight.h"
+
+static gboolean
+match_text (const char *masks, const char *text)
+{
+	hilight_set *set = hilight_set_new (masks);
+	char *copy = g_strdup (text);
+	gboolean res = hilight_set_match_text (set, copy);
+
+	g_assert_cmpstr (copy, ==, text);
+	g_free (copy);
+	hilight_set_free (set);
+	return res;
+}
+
+static gboolean
+match_word (const char *masks, const char *word)
+{
+	hilight_set *set = hilight_set_new (masks);
+	gboolean res = hilight_set_match_word (set, word);
+
+	hilight_set_free (set);
+	return res;
+}
+
+static void
+test_literal_masks (void)
+{
+	g_assert_true (match_text ("foo, bar baz", "hello bar!"));
+	g_assert_true (match_text ("foo,bar", "FOO: ping"));
+	g_assert_true (match_text ("nick[away]", "hi NICK{AWAY}"));
+	g_assert_false (match_text ("foo bar", "foobar"));
+	g_assert_false (match_text ("foo bar", "food for thought"));
+	g_assert_false (match_text ("", "foo"));
+}
+
+static void
+test_wildcard_masks (void)
+{
+	g_assert_true (match_text ("zoite*", "zoitechat rocks"));
+	g_assert_true (match_text ("a?c", "xyz abc"));
+	g_assert_false (match_text ("a?c", "abbc"));
+	g_assert_true (match_word ("*!*@*.example.org", "nick!user@host.example.org"));
+}
+
+static void
+test_escaped_masks (void)
+{
+	g_assert_true (match_word ("\\*star", "*star"));
+	g_assert_false (match_word ("\\*star", "bigstar"));
+	g_assert_true (match_word ("q\\?", "q?"));
+	g_assert_false (match_word ("q\\?", "qa"));
+}
+
+static void
+test_empty_masks (void)
+{
+	/* separators next to each other used to produce an empty mask */
+	g_assert_false (match_text ("foo, bar", "hey, you"));
+	g_assert_false (match_word ("foo,,bar", ""));
+}
+
+static void
+test_normalization (void)
+{
+	/* precomposed vs. combining acute accent */
+	g_assert_true (match_text ("caf\xc3\xa9", "at the cafe\xcc\x81 now"));
+	/* emoji variation selectors are ignored */
+	g_assert_true (match_text ("\xe2\x9d\xa4", "I \xe2\x9d\xa4\xef\xb8\x8f it"));
+	g_assert_true (match_word ("\xe2\x9d\xa4*", "\xe2\x9d\xa4\xef\xb8\x8f"));
+}
+
+static double
+time_matches (int nmasks, char **lines)
+{
+	GString *masks = g_string_new ("zoite*,*chat?");
+	hilight_set *set;
+	GTimer *timer;
+	double elapsed;
+	int i, round;
+
+	for (i = 0; i < nmasks; i++)
+		g_string_append_printf (masks, ",keyword%d", i);
+
+	set = hilight_set_new (masks->str);
+	timer = g_timer_new ();
+	for (round = 0; round < 50; round++)
+	{
+		for (i = 0; lines[i]; i++)
+			hilight_set_match_text (set, lines[i]);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_timer_destroy (timer);
+	hilight_set_free (set);
+	g_string_free (masks, TRUE);
+	return elapsed;
+}
+
+static void
+test_perf_mask_count (void)
+{
+	GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+	double few, many;
+	int i;
+
+	for (i = 0; i < 2000; i++)
+		g_ptr_array_add (lines, g_strdup_printf ("<user%d> just another line of channel chatter number %d", i, i));
+	g_ptr_array_add (lines, NULL);
+
+	few = time_matches (2, (char **)lines->pdata);
+	many = time_matches (2000, (char **)lines->pdata);
+
+	g_test_message ("2 masks: %.3fs, 2000 masks: %.3fs", few, many);
+	g_test_minimized_result (many / 100000, "seconds per message with 2000 masks");
+
+	/* literal masks are a hash lookup, so the cost must not scale with them */
+	g_assert_cmpfloat (many, <, few * 3 + 0.05);
+
+	g_ptr_array_free (lines, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/hilight/literal-masks", test_literal_masks);
+	g_test_add_func ("/hilight/wildcard-masks", test_wildcard_masks);
+	g_test_add_func ("/hilight/escaped-masks", test_escaped_masks);
+	g_test_add_func ("/hilight/empty-masks", test_empty_masks);
+	g_test_add_func ("/hilight/normalization", test_normalization);
+	if (g_test_perf ())
+		g_test_add_func ("/hilight/perf/mask-count", test_perf_mask_count);
+	return g_test_run ();
+}
@@ -0,0 +1,204 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "../hooktable.h"
+
+#define RAW "RAW LINE"
+
+static void
+assert_run_order (hook_table *table, const char *name, const char *also, const char *expected)
+{
+	void *out[8];
+	GString *got = g_string_new (NULL);
+	int i, n;
+
+	n = hook_table_collect (table, name, also, out, G_N_ELEMENTS (out));
+	g_assert_cmpint (n, <=, G_N_ELEMENTS (out));
+	for (i = 0; i < n; i++)
+		g_string_append (got, out[i]);
+
+	g_assert_cmpstr (got->str, ==, expected);
+	g_string_free (got, TRUE);
+}
+
+static void
+test_priority_order (void)
+{
+	hook_table *table = hook_table_new ();
+
+	hook_table_add (table, "PRIVMSG", 0, "a");
+	hook_table_add (table, "privmsg", 10, "b");
+	hook_table_add (table, "PrivMsg", 0, "c");
+	hook_table_add (table, "PRIVMSG", -5, "d");
+	hook_table_add (table, "NOTICE", 0, "e");
+
+	/* newest first among equal priorities, names are case-insensitive */
+	assert_run_order (table, "privmsg", NULL, "bcad");
+	assert_run_order (table, "notice", NULL, "e");
+	assert_run_order (table, "JOIN", NULL, "");
+	g_assert_cmpstr (hook_table_first (table, "PRIVMSG"), ==, "b");
+	g_assert_null (hook_table_first (table, "JOIN"));
+
+	hook_table_remove (table, "PRIVMSG", "c");
+	hook_table_remove (table, "NOTICE", "e");
+	hook_table_remove (table, "NOTICE", "e");
+	assert_run_order (table, "PRIVMSG", NULL, "bad");
+	assert_run_order (table, "NOTICE", NULL, "");
+
+	hook_table_free (table);
+}
+
+static void
+test_merged_names (void)
+{
+	hook_table *table = hook_table_new ();
+
+	hook_table_add (table, RAW, 0, "1");
+	hook_table_add (table, "PRIVMSG", 0, "2");
+	hook_table_add (table, RAW, 5, "3");
+	hook_table_add (table, "PRIVMSG", 0, "4");
+	hook_table_add (table, RAW, 0, "5");
+
+	/* as if they were all registered under one name */
+	assert_run_order (table, "PRIVMSG", RAW, "35421");
+	assert_run_order (table, "JOIN", RAW, "351");
+	assert_run_order (table, "raw line", RAW, "351");
+
+	hook_table_free (table);
+}
+
+static void
+test_short_array (void)
+{
+	hook_table *table = hook_table_new ();
+	void *out[2];
+	int i;
+
+	for (i = 0; i < 5; i++)
+		hook_table_add (table, "PING", i, GINT_TO_POINTER (i + 1));
+
+	g_assert_cmpint (hook_table_collect (table, "PING", NULL, out, 2), ==, 5);
+	g_assert_cmpint (GPOINTER_TO_INT (out[0]), ==, 5);
+	g_assert_cmpint (GPOINTER_TO_INT (out[1]), ==, 4);
+
+	hook_table_free (table);
+}
+
+typedef struct
+{
+	char *name;
+} test_hook;
+
+/* the list walk plugin_hook_run () used to do */
+static int
+reference_collect (GPtrArray *list, const char *name, void **out, int max)
+{
+	test_hook *hook;
+	guint i;
+	int n = 0;
+
+	for (i = 0; i < list->len; i++)
+	{
+		hook = g_ptr_array_index (list, i);
+		if (g_ascii_strcasecmp (hook->name, name) == 0
+			 || g_ascii_strcasecmp (hook->name, RAW) == 0)
+		{
+			if (n < max)
+				out[n] = hook;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static const char *inbound[] = {
+	"PRIVMSG", "PRIVMSG", "PRIVMSG", "NOTICE", "JOIN", "PART", "QUIT",
+	"MODE", "353", "366", "PRIVMSG", "NICK", "PING", "372", "PRIVMSG", "001"
+};
+
+static void
+time_dispatch (int count, double *indexed, double *linear)
+{
+	hook_table *table = hook_table_new ();
+	GPtrArray *list = g_ptr_array_new ();
+	test_hook *hooks = g_new (test_hook, count);
+	void *out[32];
+	GTimer *timer;
+	int i, lines = 200000;
+
+	/* a few hooks on common commands, the rest spread over script commands */
+	for (i = 0; i < count; i++)
+	{
+		if (i % 100 == 0)
+			hooks[i].name = g_strdup (RAW);
+		else if (i % 10 == 0)
+			hooks[i].name = g_strdup (inbound[i % G_N_ELEMENTS (inbound)]);
+		else
+			hooks[i].name = g_strdup_printf ("SCRIPTCMD%d", i);
+		hook_table_add (table, hooks[i].name, 0, &hooks[i]);
+		g_ptr_array_add (list, &hooks[i]);
+	}
+
+	timer = g_timer_new ();
+	for (i = 0; i < lines; i++)
+		hook_table_collect (table, inbound[i % G_N_ELEMENTS (inbound)], RAW, out, G_N_ELEMENTS (out));
+	*indexed = lines / g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; i < lines; i++)
+		reference_collect (list, inbound[i % G_N_ELEMENTS (inbound)], out, G_N_ELEMENTS (out));
+	*linear = lines / g_timer_elapsed (timer, NULL);
+
+	g_timer_destroy (timer);
+	for (i = 0; i < count; i++)
+		g_free (hooks[i].name);
+	g_free (hooks);
+	g_ptr_array_free (list, TRUE);
+	hook_table_free (table);
+}
+
+static void
+test_perf_hook_count (void)
+{
+	int counts[] = { 10, 100, 1500, 5000 };
+	double indexed, linear;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (counts); i++)
+	{
+		time_dispatch (counts[i], &indexed, &linear);
+		g_test_message ("%5d hooks: %.0f lines/s indexed, %.0f lines/s list walk",
+							 counts[i], indexed, linear);
+	}
+
+	g_test_maximized_result (indexed, "inbound lines/s dispatched with 5000 hooks");
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/hooktable/priority-order", test_priority_order);
+	g_test_add_func ("/hooktable/merged-names", test_merged_names);
+	g_test_add_func ("/hooktable/short-array", test_short_array);
+	if (g_test_perf ())
+		g_test_add_func ("/hooktable/perf/hook-count", test_perf_hook_count);
+	return g_test_run ();
+}
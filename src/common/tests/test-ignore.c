@@ -0,0 +1,229 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "../zoitechat.h"
+#include "../ignore.h"
+#include "../util.h"
+
+/* stubs for what ignore.c pulls in from the rest of the program */
+GSList *ignore_list = NULL;
+struct zoitechatprefs prefs;
+
+void fe_ignore_update (int level) { }
+int fe_timeout_add_seconds (int interval, void *callback, void *userdata) { return 0; }
+void PrintText (session *sess, char *text) { }
+void text_emit (int index, session *sess, char *a, char *b, char *c, char *d, time_t timestamp) { }
+char *cfg_get_str (char *cfg, const char *var, char *dest, int dest_len) { return NULL; }
+int zoitechat_open_file (const char *file, int flags, int mode, int xof_flags) { return -1; }
+
+static void
+clear_ignores (void)
+{
+	while (ignore_list)
+		ignore_del (NULL, ignore_list->data);
+}
+
+/* the plain list walk ignore_check () used to do */
+static int
+reference_check (const char *host, int type)
+{
+	GSList *list;
+	struct ignore *ig;
+
+	for (list = ignore_list; list; list = list->next)
+	{
+		ig = list->data;
+		if ((ig->type & IG_UNIG) && (ig->type & type) && match (ig->mask, host))
+			return FALSE;
+	}
+
+	for (list = ignore_list; list; list = list->next)
+	{
+		ig = list->data;
+		if ((ig->type & type) && match (ig->mask, host))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+test_mask_kinds (void)
+{
+	ignore_add ("exact!user@host.example.org", IG_PRIV, TRUE);
+	ignore_add ("*!*@spam.example.net", IG_PRIV | IG_CHAN, TRUE);
+	ignore_add ("*!*@*.badisp.com", IG_NOTI, TRUE);
+	ignore_add ("Troll!*@*", IG_CTCP, TRUE);
+	ignore_add ("*bot*!*@*", IG_INVI, TRUE);
+
+	g_assert_true (ignore_check ("EXACT!user@HOST.example.org", IG_PRIV));
+	g_assert_false (ignore_check ("exact!user@host.example.org", IG_CHAN));
+	g_assert_true (ignore_check ("a!b@spam.example.net", IG_CHAN));
+	g_assert_false (ignore_check ("a!b@notspam.example.net", IG_CHAN));
+	g_assert_true (ignore_check ("a!b@dyn-1-2-3.pool.badisp.com", IG_NOTI));
+	g_assert_false (ignore_check ("a!b@badisp.com", IG_NOTI));
+	g_assert_true (ignore_check ("troll!x@y", IG_CTCP));
+	g_assert_true (ignore_check ("TROLL!x@y", IG_CTCP));
+	g_assert_false (ignore_check ("trolly!x@y", IG_CTCP));
+	g_assert_true (ignore_check ("mybot9!x@y", IG_INVI));
+
+	clear_ignores ();
+}
+
+static void
+test_unignore_and_update (void)
+{
+	ignore_add ("*!*@*.example.com", IG_CHAN, TRUE);
+	ignore_add ("friend!*@*", IG_CHAN | IG_UNIG, TRUE);
+
+	g_assert_true (ignore_check ("foe!x@a.example.com", IG_CHAN));
+	g_assert_false (ignore_check ("friend!x@a.example.com", IG_CHAN));
+
+	/* changing the type must move the mask between buckets */
+	g_assert_cmpint (ignore_add ("*!*@*.example.com", IG_PRIV, TRUE), ==, 2);
+	g_assert_false (ignore_check ("foe!x@a.example.com", IG_CHAN));
+	g_assert_true (ignore_check ("foe!x@a.example.com", IG_PRIV));
+
+	g_assert_true (ignore_del ("*!*@*.EXAMPLE.com", NULL));
+	g_assert_false (ignore_check ("foe!x@a.example.com", IG_PRIV));
+
+	clear_ignores ();
+}
+
+static char *
+random_mask (GRand *rand, int i)
+{
+	switch (g_rand_int_range (rand, 0, 6))
+	{
+	case 0:
+		return g_strdup_printf ("n%d!u%d@h%d.example.org", i, i, i);
+	case 1:
+		return g_strdup_printf ("*!*@h%d.example.org", i);
+	case 2:
+		return g_strdup_printf ("*!*@*.isp%d.net", i);
+	case 3:
+		return g_strdup_printf ("n%d!*@*", i);
+	case 4:
+		return g_strdup_printf ("*!u%d@*", i);
+	default:
+		return g_strdup_printf ("*n%d?!*@*", i);
+	}
+}
+
+/* a made-up stream of senders, some of which hit the masks above */
+static GPtrArray *
+make_stream (GRand *rand, int count, int nmasks)
+{
+	GPtrArray *stream = g_ptr_array_new_with_free_func (g_free);
+	int i, n;
+
+	for (i = 0; i < count; i++)
+	{
+		n = g_rand_int_range (rand, 0, nmasks * 2);
+		g_ptr_array_add (stream, g_strdup_printf ("N%d%s!u%d@dyn%d.h%d.ISP%d.net",
+			n, (n & 1) ? "x" : "", n, i, n, n));
+		g_ptr_array_add (stream, g_strdup_printf ("n%d!u%d@h%d.example.org", n, n, n));
+	}
+
+	return stream;
+}
+
+static void
+load_random_masks (GRand *rand, int count)
+{
+	char *mask;
+	int i, types[] = { IG_PRIV, IG_CHAN, IG_NOTI, IG_CTCP, IG_CHAN | IG_UNIG };
+
+	for (i = 0; i < count; i++)
+	{
+		mask = random_mask (rand, i);
+		ignore_add (mask, types[g_rand_int_range (rand, 0, G_N_ELEMENTS (types))], TRUE);
+		g_free (mask);
+	}
+}
+
+static void
+test_matches_reference (void)
+{
+	GRand *rand = g_rand_new_with_seed (1459);
+	GPtrArray *stream;
+	int types[] = { IG_PRIV, IG_CHAN, IG_NOTI, IG_CTCP, IG_INVI };
+	guint i, t;
+
+	load_random_masks (rand, 2000);
+	stream = make_stream (rand, 2000, 2000);
+
+	for (i = 0; i < stream->len; i++)
+	{
+		for (t = 0; t < G_N_ELEMENTS (types); t++)
+		{
+			const char *host = g_ptr_array_index (stream, i);
+			g_assert_cmpint (ignore_check ((char *)host, types[t]), ==,
+								  reference_check (host, types[t]));
+		}
+	}
+
+	g_ptr_array_free (stream, TRUE);
+	clear_ignores ();
+	g_rand_free (rand);
+}
+
+static void
+test_perf_many_masks (void)
+{
+	GRand *rand = g_rand_new_with_seed (1459);
+	GPtrArray *stream;
+	GTimer *timer;
+	double indexed, linear;
+	guint i;
+
+	load_random_masks (rand, 10000);
+	stream = make_stream (rand, 10000, 10000);
+
+	timer = g_timer_new ();
+	for (i = 0; i < stream->len; i++)
+		ignore_check (g_ptr_array_index (stream, i), IG_CHAN);
+	indexed = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; i < stream->len; i++)
+		reference_check (g_ptr_array_index (stream, i), IG_CHAN);
+	linear = g_timer_elapsed (timer, NULL);
+
+	g_test_message ("%u messages against 10000 masks: indexed %.3fs, linear %.3fs",
+						 stream->len, indexed, linear);
+	g_test_minimized_result (indexed / stream->len, "seconds per ignore_check ()");
+
+	g_timer_destroy (timer);
+	g_ptr_array_free (stream, TRUE);
+	clear_ignores ();
+	g_rand_free (rand);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/ignore/mask-kinds", test_mask_kinds);
+	g_test_add_func ("/ignore/unignore-and-update", test_unignore_and_update);
+	g_test_add_func ("/ignore/matches-reference", test_matches_reference);
+	if (g_test_perf ())
+		g_test_add_func ("/ignore/perf/many-masks", test_perf_many_masks);
+	return g_test_run ();
+}
@@ -0,0 +1,210 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../zoitechat.h"
+#include "../network.h"
+
+/* stubs for what network.c pulls in from the rest of the program */
+struct zoitechatprefs prefs;
+
+#define BLOCKSIZE 102400
+
+typedef struct
+{
+	int sok;
+	GChecksum *sum;
+	guint64 received;
+} receiver;
+
+static gpointer
+receive_all (gpointer data)
+{
+	receiver *r = data;
+	char buf[65536];
+	gssize len;
+
+	while ((len = recv (r->sok, buf, sizeof (buf), 0)) > 0)
+	{
+		g_checksum_update (r->sum, (guchar *)buf, len);
+		r->received += len;
+	}
+
+	return NULL;
+}
+
+/* a connected pair of loopback sockets, the sending end non-blocking */
+static void
+loopback_pair (int *send_sok, int *recv_sok)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof (addr);
+	int listener;
+
+	listener = socket (AF_INET, SOCK_STREAM, 0);
+	g_assert_cmpint (listener, >=, 0);
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	g_assert_cmpint (bind (listener, (struct sockaddr *)&addr, sizeof (addr)), ==, 0);
+	g_assert_cmpint (listen (listener, 1), ==, 0);
+	g_assert_cmpint (getsockname (listener, (struct sockaddr *)&addr, &addrlen), ==, 0);
+
+	*send_sok = socket (AF_INET, SOCK_STREAM, 0);
+	g_assert_cmpint (connect (*send_sok, (struct sockaddr *)&addr, sizeof (addr)), ==, 0);
+	*recv_sok = accept (listener, NULL, NULL);
+	g_assert_cmpint (*recv_sok, >=, 0);
+	close (listener);
+
+	fcntl (*send_sok, F_SETFL, fcntl (*send_sok, F_GETFL) | O_NONBLOCK);
+}
+
+static char *
+make_file (gsize size)
+{
+	GError *err = NULL;
+	char *path, *data;
+	gsize i;
+	int fd;
+
+	fd = g_file_open_tmp ("zoitechat-sendfile-XXXXXX", &path, &err);
+	g_assert_no_error (err);
+
+	data = g_malloc (size);
+	for (i = 0; i < size; i++)
+		data[i] = (char)(i * 7 + (i >> 12));
+	g_assert_cmpint (write (fd, data, size), ==, size);
+
+	g_free (data);
+	close (fd);
+	return path;
+}
+
+/* what dcc_send_data () does, one writable event after another */
+static void
+send_file (const char *path, gsize size, gboolean zerocopy, double *elapsed)
+{
+	GChecksum *expected = g_checksum_new (G_CHECKSUM_SHA256);
+	GChecksum *got = g_checksum_new (G_CHECKSUM_SHA256);
+	char *buf = g_malloc (BLOCKSIZE);
+	GTimer *timer;
+	GThread *thread;
+	receiver r;
+	guint64 pos = 0;
+	struct pollfd pfd;
+	int sok, fd, sent;
+	char *data;
+	gsize len;
+
+	g_assert_true (g_file_get_contents (path, &data, &len, NULL));
+	g_checksum_update (expected, (guchar *)data, len);
+	g_free (data);
+
+	loopback_pair (&sok, &r.sok);
+	r.sum = got;
+	r.received = 0;
+	fd = open (path, O_RDONLY);
+	g_assert_cmpint (fd, >=, 0);
+
+	timer = g_timer_new ();
+	thread = g_thread_new ("receiver", receive_all, &r);
+
+	pfd.fd = sok;
+	pfd.events = POLLOUT;
+	while (pos < size)
+	{
+		poll (&pfd, 1, -1);
+		sent = net_send_file (sok, fd, pos, BLOCKSIZE, buf, zerocopy);
+		if (sent < 0)
+			g_assert_true (errno == EAGAIN || errno == EWOULDBLOCK);
+		else
+		{
+			g_assert_cmpint (sent, >, 0);
+			pos += sent;
+		}
+	}
+
+	/* past the end of the file */
+	g_assert_cmpint (net_send_file (sok, fd, pos, BLOCKSIZE, buf, zerocopy), ==, 0);
+
+	close (sok);
+	g_thread_join (thread);
+	if (elapsed)
+		*elapsed = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (r.received, ==, size);
+	g_assert_cmpstr (g_checksum_get_string (got), ==, g_checksum_get_string (expected));
+
+	g_timer_destroy (timer);
+	close (r.sok);
+	close (fd);
+	g_free (buf);
+	g_checksum_free (expected);
+	g_checksum_free (got);
+}
+
+static void
+test_send_file (gconstpointer zerocopy)
+{
+	gsize size = 3 * BLOCKSIZE + 1234;	/* ends on a partial block */
+	char *path = make_file (size);
+
+	send_file (path, size, GPOINTER_TO_INT (zerocopy), NULL);
+
+	g_unlink (path);
+	g_free (path);
+}
+
+static void
+test_perf_throughput (void)
+{
+	gsize size = 256 * 1024 * 1024;
+	char *path = make_file (size);
+	double copied, zerocopy;
+
+	send_file (path, size, FALSE, &copied);
+	send_file (path, size, TRUE, &zerocopy);
+
+	g_test_message ("%" G_GSIZE_FORMAT " MB over loopback: read+send %.1f MB/s, sendfile %.1f MB/s",
+						 size >> 20, (size >> 20) / copied, (size >> 20) / zerocopy);
+	g_test_maximized_result ((size >> 20) / zerocopy, "MB/s sent by net_send_file ()");
+
+	g_unlink (path);
+	g_free (path);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_data_func ("/network/send-file/copy", GINT_TO_POINTER (FALSE), test_send_file);
+	g_test_add_data_func ("/network/send-file/zerocopy", GINT_TO_POINTER (TRUE), test_send_file);
+	if (g_test_perf ())
+		g_test_add_func ("/network/perf/send-file-throughput", test_perf_throughput);
+	return g_test_run ();
+}
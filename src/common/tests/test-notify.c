@@ -0,0 +1,408 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../zoitechat.h"
+#include "../notify.h"
+#include "../util.h"
+
+/* stubs for what notify.c pulls in from the rest of the program */
+GSList *serv_list = NULL;
+struct zoitechatprefs prefs;
+
+void fe_notify_update (char *name) { }
+void PrintTextTimeStamp (session *sess, char *text, time_t timestamp) { }
+void text_emit (int index, session *sess, char *a, char *b, char *c, char *d, time_t timestamp) { }
+char *server_get_network (server *serv, gboolean fallback) { return "TestNet"; }
+int zoitechat_open_file (const char *file, int flags, int mode, int xof_flags) { return -1; }
+
+static GPtrArray *sent;
+
+static int
+capture_raw (server *serv, char *raw)
+{
+	g_ptr_array_add (sent, g_strdup (raw));
+	return 0;
+}
+
+static void
+no_whois (server *serv, char *nicks)
+{
+}
+
+static server *
+make_server (void)
+{
+	server *serv = g_new0 (server, 1);
+
+	serv->p_cmp = rfc_casecmp;
+	serv->p_raw = capture_raw;
+	serv->p_whois = no_whois;
+	serv->connected = TRUE;
+	serv->end_of_motd = TRUE;
+	serv_list = g_slist_prepend (serv_list, serv);
+
+	sent = g_ptr_array_new_with_free_func (g_free);
+	return serv;
+}
+
+static void
+free_server (server *serv)
+{
+	serv_list = g_slist_remove (serv_list, serv);
+	while (notify_list)
+		notify_deluser (((struct notify *) notify_list->data)->name);
+	notify_forget_server (serv);
+	g_free (serv);
+	g_ptr_array_free (sent, TRUE);
+}
+
+static void
+add_nicks (int count)
+{
+	char *nick;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		nick = g_strdup_printf ("friend[%03d]", i);
+		notify_adduser (nick, NULL);
+		g_free (nick);
+	}
+}
+
+static gboolean
+is_online (server *serv, int i)
+{
+	session sess;
+	char *nick = g_strdup_printf ("friend[%03d]", i);
+	int res;
+
+	sess.server = serv;
+	res = notify_isnotify (&sess, nick);
+	g_free (nick);
+	return res;
+}
+
+/* the nicks of every ISON line sent since 'from', batch by batch */
+static GPtrArray *
+take_isons (guint from)
+{
+	GPtrArray *batches = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
+	const char *line;
+	guint i;
+
+	for (i = from; i < sent->len; i++)
+	{
+		line = g_ptr_array_index (sent, i);
+		if (!g_str_has_prefix (line, "ISON "))
+			continue;
+		g_assert_cmpuint (strlen (line) + 2, <=, 512);
+		g_ptr_array_add (batches, g_strsplit (line + 5, " ", -1));
+	}
+
+	return batches;
+}
+
+/* answer one batch the way a server would, with its own casing:
+   every nick for which online () is true */
+static void
+answer (server *serv, char **nicks, gboolean (*online) (int i))
+{
+	message_tags_data tags = MESSAGE_TAGS_DATA_INIT;
+	GString *reply = g_string_new (NULL);
+	char *upper;
+	int i, n;
+
+	for (i = 0; nicks[i]; i++)
+	{
+		sscanf (nicks[i], "friend[%d]", &n);
+		if (!online (n))
+			continue;
+		/* rfc1459 folds [] to {} */
+		upper = g_strdup_printf ("FRIEND{%03d}", n);
+		g_string_append_printf (reply, "%s%s", reply->len ? " " : "", upper);
+		g_free (upper);
+	}
+
+	notify_markonline (serv, reply->str, &tags);
+	g_string_free (reply, TRUE);
+}
+
+static gboolean
+even (int i)
+{
+	return i % 2 == 0;
+}
+
+static gboolean
+nobody (int i)
+{
+	return FALSE;
+}
+
+static void
+test_ison_batches (void)
+{
+	server *serv;
+	GPtrArray *batches;
+	guint i, first, asked = 0;
+	int n;
+
+	/* add them before the server exists, else each one sends an ISON */
+	add_nicks (300);
+	serv = make_server ();
+
+	notify_checklist ();
+	batches = take_isons (0);
+	g_assert_cmpuint (batches->len, >, 1);
+	for (i = 0; i < batches->len; i++)
+		asked += g_strv_length (g_ptr_array_index (batches, i));
+	g_assert_cmpuint (asked, ==, 300);
+
+	/* no second round while the first one is unanswered */
+	first = sent->len;
+	notify_checklist ();
+	g_assert_cmpuint (sent->len, ==, first);
+
+	for (i = 0; i < batches->len; i++)
+		answer (serv, g_ptr_array_index (batches, i), even);
+	for (n = 0; n < 300; n++)
+		g_assert_cmpint (is_online (serv, n), ==, even (n));
+	g_ptr_array_free (batches, TRUE);
+
+	/* answered, so the next round goes out; an empty 303 means all gone */
+	notify_checklist ();
+	batches = take_isons (first);
+	for (i = 0; i < batches->len; i++)
+		answer (serv, g_ptr_array_index (batches, i), nobody);
+	for (n = 0; n < 300; n++)
+		g_assert_false (is_online (serv, n));
+
+	g_ptr_array_free (batches, TRUE);
+	free_server (serv);
+}
+
+static void
+test_user_ison (void)
+{
+	message_tags_data tags = MESSAGE_TAGS_DATA_INIT;
+	char reply[] = "FRIEND{001} stranger";
+	GPtrArray *batches;
+	server *serv;
+	guint i;
+
+	add_nicks (3);
+	serv = make_server ();
+	notify_checklist ();
+	batches = take_isons (0);
+	g_assert_cmpuint (batches->len, ==, 1);
+
+	/* someone's own /ISON names a nick we didn't ask about: it marks
+	   friends online but leaves our batch waiting */
+	notify_markonline (serv, reply, &tags);
+	g_assert_true (is_online (serv, 1));
+
+	answer (serv, g_ptr_array_index (batches, 0), even);
+	g_assert_true (is_online (serv, 0));
+	g_assert_false (is_online (serv, 1));
+	g_assert_true (is_online (serv, 2));
+
+	/* the queue is empty again */
+	notify_checklist ();
+	g_ptr_array_free (batches, TRUE);
+	batches = take_isons (0);
+	g_assert_cmpuint (batches->len, ==, 2);
+	for (i = 0; i < batches->len; i++)
+		g_assert_cmpuint (g_strv_length (g_ptr_array_index (batches, i)), ==, 3);
+
+	g_ptr_array_free (batches, TRUE);
+	free_server (serv);
+}
+
+static void
+test_user_quote_ison (void)
+{
+	message_tags_data tags = MESSAGE_TAGS_DATA_INIT;
+	char nobody_on[] = "";
+	GPtrArray *batches;
+	server *serv;
+	guint first;
+
+	add_nicks (3);
+	serv = make_server ();
+	notify_checklist ();
+	batches = take_isons (0);
+	answer (serv, g_ptr_array_index (batches, 0), even);
+	g_ptr_array_free (batches, TRUE);
+
+	/* /QUOTE ISON friend[000] and the timer fires before its answer:
+	   our next round waits for it instead of going out behind it */
+	notify_note_user_ison (serv, "ISON friend[000]");
+	first = sent->len;
+	notify_checklist ();
+	g_assert_cmpuint (sent->len, ==, first);
+
+	/* its empty 303 is the user's, so friend[002] isn't marked gone */
+	notify_markonline (serv, nobody_on, &tags);
+	g_assert_true (is_online (serv, 0));
+	g_assert_true (is_online (serv, 2));
+
+	notify_checklist ();
+	batches = take_isons (first);
+	g_assert_cmpuint (batches->len, ==, 1);
+	answer (serv, g_ptr_array_index (batches, 0), nobody);
+	g_assert_false (is_online (serv, 0));
+	g_assert_false (is_online (serv, 2));
+	g_ptr_array_free (batches, TRUE);
+
+	/* a bare ISON only gets an error back, nothing to wait for */
+	notify_note_user_ison (serv, "ISON");
+	first = sent->len;
+	notify_checklist ();
+	g_assert_cmpuint (sent->len, >, first);
+
+	free_server (serv);
+}
+
+static guint
+count_monitored (void)
+{
+	const char *line;
+	guint i, j, count = 0;
+	char **nicks;
+
+	for (i = 0; i < sent->len; i++)
+	{
+		line = g_ptr_array_index (sent, i);
+		if (!g_str_has_prefix (line, "MONITOR + "))
+			continue;
+		/* notify_flush_watches () puts a comma before every nick */
+		nicks = g_strsplit (line + 10, ",", -1);
+		for (j = 0; nicks[j]; j++)
+			count += nicks[j][0] != 0;
+		g_strfreev (nicks);
+	}
+
+	return count;
+}
+
+static void
+test_monitor_limit (void)
+{
+	char full[] = "friend[024],friend[023]";
+	GPtrArray *batches;
+	server *serv;
+
+	add_nicks (25);
+	serv = make_server ();
+	serv->supports_monitor = TRUE;
+	serv->watch_limit = 10;
+
+	notify_send_watches (serv);
+	g_assert_cmpuint (count_monitored (), ==, 10);
+
+	/* ISON covers whoever didn't fit */
+	notify_checklist ();
+	batches = take_isons (0);
+	g_assert_cmpuint (batches->len, ==, 1);
+	g_assert_cmpuint (g_strv_length (g_ptr_array_index (batches, 0)), ==, 15);
+	answer (serv, g_ptr_array_index (batches, 0), nobody);
+	g_ptr_array_free (batches, TRUE);
+
+	/* and whoever the server refused (734); the newest were watched */
+	notify_set_unwatched_list (serv, full);
+	g_ptr_array_set_size (sent, 0);
+	notify_checklist ();
+	batches = take_isons (0);
+	g_assert_cmpuint (g_strv_length (g_ptr_array_index (batches, 0)), ==, 17);
+
+	g_ptr_array_free (batches, TRUE);
+	free_server (serv);
+}
+
+/* the list walk notify_is_in_list () used to do */
+static gboolean
+reference_is_in_list (server *serv, const char *name)
+{
+	GSList *list;
+
+	for (list = notify_list; list; list = list->next)
+	{
+		if (!serv->p_cmp (((struct notify *) list->data)->name, name))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+test_perf_lookup (void)
+{
+	char **names = g_new0 (char *, 20001);
+	server *serv;
+	GTimer *timer;
+	double indexed, linear;
+	int i, found = 0, found_old = 0;
+
+	for (i = 0; i < 2000; i++)
+	{
+		names[i] = g_strdup_printf ("Buddy%d", i);
+		notify_adduser (names[i], NULL);
+	}
+	/* joining a big channel: mostly strangers */
+	for (; i < 20000; i++)
+		names[i] = g_strdup_printf ("USER%d", i);
+	serv = make_server ();
+
+	timer = g_timer_new ();
+	for (i = 0; names[i]; i++)
+		found += notify_is_in_list (serv, names[i]);
+	indexed = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; names[i]; i++)
+		found_old += reference_is_in_list (serv, names[i]);
+	linear = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpint (found, ==, 2000);
+	g_assert_cmpint (found, ==, found_old);
+	g_test_message ("20000 joins against 2000 notify entries: indexed %.3fs, linear %.3fs",
+						 indexed, linear);
+	g_test_minimized_result (indexed / 20000, "seconds per notify lookup");
+
+	g_timer_destroy (timer);
+	g_strfreev (names);
+	free_server (serv);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/notify/ison-batches", test_ison_batches);
+	g_test_add_func ("/notify/user-ison", test_user_ison);
+	g_test_add_func ("/notify/user-quote-ison", test_user_quote_ison);
+	g_test_add_func ("/notify/monitor-limit", test_monitor_limit);
+	if (g_test_perf ())
+		g_test_add_func ("/notify/perf/lookup", test_perf_lookup);
+	return g_test_run ();
+}
@@ -0,0 +1,216 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "../pluginpref.h"
+
+static char *
+make_conf (const char *contents)
+{
+	GError *err = NULL;
+	char *dir, *path;
+
+	dir = g_dir_make_tmp ("zoitechat-pluginpref-XXXXXX", &err);
+	g_assert_no_error (err);
+	path = g_build_filename (dir, "addon_test.conf", NULL);
+	g_free (dir);
+
+	if (contents)
+		g_assert_true (g_file_set_contents (path, contents, -1, NULL));
+	return path;
+}
+
+static void
+remove_conf (char *path)
+{
+	char *dir = g_path_get_dirname (path);
+
+	g_unlink (path);
+	g_rmdir (dir);
+	g_free (dir);
+	g_free (path);
+}
+
+static void
+test_load (void)
+{
+	char *path = make_conf ("count = 12\n"
+									"Greeting = hello\\nworld\n"
+									"count = 99\n"
+									"novalue\n"
+									"last=1");
+	pluginpref_store *store = pluginpref_store_load (path);
+	char list[4096];
+
+	g_assert_cmpstr (pluginpref_store_get (store, "count"), ==, "12");
+	g_assert_cmpstr (pluginpref_store_get (store, "greeting"), ==, "hello\nworld");
+	g_assert_null (pluginpref_store_get (store, "novalue"));
+	g_assert_null (pluginpref_store_get (store, "last"));
+	g_assert_false (pluginpref_store_dirty (store));
+	g_assert_true (pluginpref_store_exists (store));
+
+	g_assert_cmpint (pluginpref_store_list (store, list, sizeof (list)), ==, 2);
+	g_assert_cmpstr (list, ==, "count,Greeting,");
+
+	pluginpref_store_free (store);
+	remove_conf (path);
+
+	/* an empty file has no settings, but it's there */
+	path = make_conf ("");
+	store = pluginpref_store_load (path);
+	g_assert_cmpint (pluginpref_store_list (store, list, sizeof (list)), ==, 0);
+	g_assert_true (pluginpref_store_exists (store));
+	pluginpref_store_free (store);
+	remove_conf (path);
+}
+
+static void
+test_write_back (void)
+{
+	char *path = make_conf (NULL);
+	pluginpref_store *store = pluginpref_store_load (path);
+	char *contents, list[4096];
+
+	g_assert_cmpint (pluginpref_store_list (store, list, sizeof (list)), ==, 0);
+	g_assert_false (pluginpref_store_exists (store));
+
+	pluginpref_store_set (store, "a", "1");
+	pluginpref_store_set (store, "b", "tab\there");
+	pluginpref_store_set (store, "c", "3");
+	pluginpref_store_set (store, "A", "one");
+	g_assert_true (pluginpref_store_delete (store, "c"));
+	g_assert_false (pluginpref_store_delete (store, "c"));
+
+	/* nothing reaches the disk before a flush */
+	g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+	g_assert_true (pluginpref_store_dirty (store));
+	g_assert_true (pluginpref_store_exists (store));
+	g_assert_true (pluginpref_store_flush (store));
+	g_assert_false (pluginpref_store_dirty (store));
+
+	g_assert_true (g_file_get_contents (path, &contents, NULL, NULL));
+	g_assert_cmpstr (contents, ==, "a = one\nb = tab\\there\n");
+	g_free (contents);
+
+	/* setting the same value again is not a change */
+	pluginpref_store_set (store, "b", "tab\there");
+	g_assert_false (pluginpref_store_dirty (store));
+	pluginpref_store_free (store);
+
+	store = pluginpref_store_load (path);
+	g_assert_cmpstr (pluginpref_store_get (store, "a"), ==, "one");
+	g_assert_cmpstr (pluginpref_store_get (store, "b"), ==, "tab\there");
+	pluginpref_store_free (store);
+
+	remove_conf (path);
+}
+
+/* what every zoitechat_pluginpref_set_str () used to do: read the
+ * whole file and write it out again with the one line replaced */
+static void
+reference_set (const char *path, const char *var, const char *value)
+{
+	GString *out = g_string_new (NULL);
+	char *cfg = NULL, **lines, *prefix;
+	gboolean found = FALSE;
+	int i;
+
+	g_file_get_contents (path, &cfg, NULL, NULL);
+	lines = g_strsplit (cfg ? cfg : "", "\n", -1);
+	prefix = g_strdup_printf ("%s ", var);
+
+	for (i = 0; lines[i]; i++)
+	{
+		if (!lines[i][0])
+			continue;
+		if (!strncmp (lines[i], prefix, strlen (prefix)))
+		{
+			g_string_append_printf (out, "%s = %s\n", var, value);
+			found = TRUE;
+		}
+		else
+		{
+			g_string_append_printf (out, "%s\n", lines[i]);
+		}
+	}
+	if (!found)
+		g_string_append_printf (out, "%s = %s\n", var, value);
+
+	g_assert_true (g_file_set_contents (path, out->str, out->len, NULL));
+
+	g_free (prefix);
+	g_strfreev (lines);
+	g_free (cfg);
+	g_string_free (out, TRUE);
+}
+
+static void
+test_perf_counters (void)
+{
+	char *path = make_conf (NULL);
+	pluginpref_store *store;
+	char var[32], value[32];
+	GTimer *timer;
+	double stored, rewritten;
+	int i, nops = 5000;
+
+	timer = g_timer_new ();
+	store = pluginpref_store_load (path);
+	for (i = 0; i < nops; i++)
+	{
+		g_snprintf (var, sizeof (var), "seen_nick%d", i % 200);
+		g_snprintf (value, sizeof (value), "%d", i);
+		pluginpref_store_set (store, var, value);
+		g_assert_cmpstr (pluginpref_store_get (store, var), ==, value);
+	}
+	g_assert_true (pluginpref_store_flush (store));
+	pluginpref_store_free (store);
+	stored = g_timer_elapsed (timer, NULL);
+
+	g_unlink (path);
+	g_timer_start (timer);
+	for (i = 0; i < nops; i++)
+	{
+		g_snprintf (var, sizeof (var), "seen_nick%d", i % 200);
+		g_snprintf (value, sizeof (value), "%d", i);
+		reference_set (path, var, value);
+	}
+	rewritten = g_timer_elapsed (timer, NULL);
+
+	g_test_message ("%d sets of 200 keys: in memory %.3fs, file rewrite per set %.3fs",
+						 nops, stored, rewritten);
+	g_test_minimized_result (stored / nops, "seconds per pluginpref set and get");
+
+	g_timer_destroy (timer);
+	remove_conf (path);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/pluginpref/load", test_load);
+	g_test_add_func ("/pluginpref/write-back", test_write_back);
+	if (g_test_perf ())
+		g_test_add_func ("/pluginpref/perf/counters", test_perf_counters);
+	return g_test_run ();
+}
@@ -0,0 +1,247 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "../zoitechat.h"
+#include "../fe.h"
+#include "../reconnect.h"
+
+/* stubs for what reconnect.c pulls in from the rest of the program */
+struct zoitechatprefs prefs;
+
+int fe_timeout_add (int interval, void *callback, void *userdata) { return g_timeout_add (interval, callback, userdata); }
+void fe_timeout_remove (int tag) { g_source_remove (tag); }
+void fe_idle_add (void *func, void *data) { g_idle_add (func, data); }
+
+static GPtrArray *started;
+static gboolean start_result = TRUE;
+
+static gboolean
+record_start (void *owner)
+{
+	g_ptr_array_add (started, owner);
+	return start_result;
+}
+
+/* run the main loop until 'count' owners were started */
+static void
+wait_started (guint count)
+{
+	gint64 end = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+
+	while (started->len < count && g_get_monotonic_time () < end)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpuint (started->len, ==, count);
+}
+
+/* and let whatever else is due happen too */
+static void
+settle (void)
+{
+	gint64 end = g_get_monotonic_time () + 50 * 1000;
+
+	while (g_get_monotonic_time () < end)
+		g_main_context_iteration (NULL, FALSE);
+}
+
+static void
+setup (void)
+{
+	started = g_ptr_array_new ();
+	start_result = TRUE;
+	prefs.hex_net_reconnect_max = 2;
+}
+
+static void
+teardown (int *owners, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		reconnect_forget (&owners[i]);
+	g_assert_cmpint (reconnect_active_count (), ==, 0);
+	g_assert_null (reconnect_get_list ());
+	g_ptr_array_free (started, TRUE);
+}
+
+static void
+test_backoff (void)
+{
+	reconnect_info info;
+	int owner[1], attempt, delay;
+	gint64 expected;
+
+	setup ();
+	for (attempt = 1; attempt <= 12; attempt++)
+	{
+		delay = reconnect_schedule (&owner[0], 0, 1000, record_start);
+		expected = MIN ((gint64) 1000 << (attempt - 1), RECONNECT_MAX_DELAY);
+
+		g_assert_cmpint (delay, >=, expected * 3 / 4);
+		g_assert_cmpint (delay, <=, expected * 5 / 4);
+		g_assert_cmpint (reconnect_get_info (&owner[0], &info), ==, RECONNECT_WAITING);
+		g_assert_cmpint (info.attempts, ==, attempt);
+		g_assert_cmpint (info.remaining, <=, delay);
+	}
+
+	/* a login starts over */
+	reconnect_forget (&owner[0]);
+	g_assert_cmpint (reconnect_get_info (&owner[0], &info), ==, RECONNECT_IDLE);
+	g_assert_cmpint (info.attempts, ==, 0);
+	delay = reconnect_schedule (&owner[0], 0, 1000, record_start);
+	g_assert_cmpint (delay, <=, 1250);
+
+	teardown (owner, 1);
+}
+
+static void
+test_limit_and_priority (void)
+{
+	int owners[5], i;
+	void *third, *fourth;
+	GSList *list;
+
+	setup ();
+
+	/* all due by the time the queue is looked at, the favorite
+	 * (priority 2) first, then the auto-connect one */
+	for (i = 0; i < 5; i++)
+		reconnect_schedule (&owners[i], i == 3 ? 2 : i == 4 ? 1 : 0, 1, record_start);
+	g_usleep (20 * 1000);
+
+	wait_started (2);
+	settle ();
+	g_assert_cmpuint (started->len, ==, 2);
+	g_assert_true (g_ptr_array_index (started, 0) == &owners[3]);
+	g_assert_true (g_ptr_array_index (started, 1) == &owners[4]);
+	g_assert_cmpint (reconnect_active_count (), ==, 2);
+
+	list = reconnect_get_list ();
+	g_assert_cmpuint (g_slist_length (list), ==, 5);
+	g_assert_cmpint (((reconnect_info *) g_slist_nth_data (list, 1))->state, ==, RECONNECT_ACTIVE);
+	g_assert_cmpint (((reconnect_info *) g_slist_nth_data (list, 2))->state, ==, RECONNECT_QUEUED);
+	third = ((reconnect_info *) g_slist_nth_data (list, 2))->owner;
+	fourth = ((reconnect_info *) g_slist_nth_data (list, 3))->owner;
+	g_slist_free_full (list, g_free);
+
+	/* a login frees its slot for the next in line */
+	reconnect_forget (&owners[3]);
+	wait_started (3);
+	g_assert_true (g_ptr_array_index (started, 2) == third);
+
+	/* so does an attempt that failed */
+	reconnect_release (&owners[4]);
+	wait_started (4);
+	g_assert_true (g_ptr_array_index (started, 3) == fourth);
+	g_assert_cmpint (reconnect_active_count (), ==, 2);
+
+	teardown (owners, 5);
+}
+
+static void
+test_start_declined (void)
+{
+	int owners[3], i;
+
+	setup ();
+	start_result = FALSE;
+
+	/* nothing started, so no slot stays taken */
+	for (i = 0; i < 3; i++)
+		reconnect_schedule (&owners[i], 0, 1, record_start);
+	wait_started (3);
+	g_assert_cmpint (reconnect_active_count (), ==, 0);
+
+	teardown (owners, 3);
+}
+
+static void
+test_no_limit (void)
+{
+	int owners[8], i;
+
+	setup ();
+	prefs.hex_net_reconnect_max = 0;
+
+	for (i = 0; i < 8; i++)
+		reconnect_schedule (&owners[i], 0, 1, record_start);
+	wait_started (8);
+	g_assert_cmpint (reconnect_active_count (), ==, 8);
+
+	teardown (owners, 8);
+}
+
+static void
+test_start_now (void)
+{
+	reconnect_info info;
+	int owners[4], i;
+
+	setup ();
+	prefs.hex_net_reconnect_max = 1;
+
+	for (i = 0; i < 3; i++)
+		reconnect_schedule (&owners[i], 0, 1, record_start);
+	g_usleep (20 * 1000);
+	wait_started (1);
+	settle ();
+	g_assert_cmpint (reconnect_active_count (), ==, 1);
+
+	/* an explicit /RECONNECT goes past the queue and any backoff */
+	reconnect_start_now (&owners[3], 0, record_start);
+	g_assert_cmpuint (started->len, ==, 2);
+	g_assert_true (g_ptr_array_index (started, 1) == &owners[3]);
+	g_assert_cmpint (reconnect_get_info (&owners[3], &info), ==, RECONNECT_ACTIVE);
+	g_assert_cmpint (reconnect_active_count (), ==, 2);
+
+	/* and the queue still waits for a free slot */
+	settle ();
+	g_assert_cmpuint (started->len, ==, 2);
+
+	teardown (owners, 4);
+}
+
+static void
+test_autojoin_spread (void)
+{
+	int first, second, third;
+
+	first = reconnect_autojoin_delay (10);
+	second = reconnect_autojoin_delay (1000);
+	third = reconnect_autojoin_delay (1);
+
+	g_assert_cmpint (first, ==, 0);
+	g_assert_cmpint (second, >, 10 * RECONNECT_AUTOJOIN_GAP - 50);
+	g_assert_cmpint (second, <=, 10 * RECONNECT_AUTOJOIN_GAP);
+	/* a big autojoin holds up the next one only so long */
+	g_assert_cmpint (third - second, >, RECONNECT_AUTOJOIN_MAX - 50);
+	g_assert_cmpint (third - second, <=, RECONNECT_AUTOJOIN_MAX);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/reconnect/backoff", test_backoff);
+	g_test_add_func ("/reconnect/limit-and-priority", test_limit_and_priority);
+	g_test_add_func ("/reconnect/start-declined", test_start_declined);
+	g_test_add_func ("/reconnect/no-limit", test_no_limit);
+	g_test_add_func ("/reconnect/start-now", test_start_now);
+	g_test_add_func ("/reconnect/autojoin-spread", test_autojoin_spread);
+	return g_test_run ();
+}
@@ -0,0 +1,130 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "../tree.h"
+
+static int
+str_cmp (const void *a, const void *b, void *data)
+{
+	return g_ascii_strcasecmp (a, b);
+}
+
+static int
+nick_cmp (gconstpointer a, gconstpointer b, gpointer data)
+{
+	return g_ascii_strcasecmp (*(char **)a, *(char **)b);
+}
+
+static int
+collect (const void *key, void *data)
+{
+	g_ptr_array_add (data, (gpointer)key);
+	return TRUE;
+}
+
+static void
+assert_order (tree *t, const char **expected)
+{
+	GPtrArray *seen = g_ptr_array_new ();
+	guint i;
+
+	tree_foreach (t, collect, seen);
+	for (i = 0; expected[i]; i++)
+	{
+		g_assert_cmpuint (i, <, seen->len);
+		g_assert_cmpstr (g_ptr_array_index (seen, i), ==, expected[i]);
+	}
+	g_assert_cmpuint (i, ==, seen->len);
+	g_assert_cmpint (tree_size (t), ==, seen->len);
+	g_ptr_array_free (seen, TRUE);
+}
+
+static void
+test_insert_sorted (void)
+{
+	tree *t = tree_new (str_cmp, NULL);
+	const char *batch[] = { "alice", "Carol", "erin", "zed" };
+	const char *more[] = { "aaron", "Bob", "frank" };
+	const char *expected[] = { "aaron", "alice", "Bob", "Carol", "dave", "erin", "frank", "yves", "zed", NULL };
+	int pos;
+
+	/* into an empty tree, then interleaved with what is there */
+	tree_insert_sorted (t, (void **)batch, G_N_ELEMENTS (batch));
+	tree_insert (t, "dave");
+	tree_insert (t, "yves");
+	tree_insert_sorted (t, (void **)more, G_N_ELEMENTS (more));
+	tree_insert_sorted (t, NULL, 0);
+	assert_order (t, expected);
+
+	/* still searchable */
+	g_assert_cmpstr (tree_find (t, "FRANK", str_cmp, NULL, &pos), ==, "frank");
+	g_assert_cmpint (pos, ==, 6);
+	g_assert_null (tree_find (t, "bobby", str_cmp, NULL, &pos));
+
+	tree_destroy (t);
+}
+
+static void
+test_perf_names_burst (void)
+{
+	GPtrArray *nicks = g_ptr_array_new_with_free_func (g_free);
+	GRand *rand = g_rand_new_with_seed (353);
+	GTimer *timer;
+	double one_by_one, batched;
+	tree *t;
+	int i, n = 20000;
+
+	/* NAMES replies come in server order, not sorted */
+	for (i = 0; i < n; i++)
+		g_ptr_array_add (nicks, g_strdup_printf ("nick%08x%d", g_rand_int (rand), i));
+
+	timer = g_timer_new ();
+	t = tree_new (str_cmp, NULL);
+	for (i = 0; i < n; i++)
+		tree_insert (t, g_ptr_array_index (nicks, i));
+	one_by_one = g_timer_elapsed (timer, NULL);
+	g_assert_cmpint (tree_size (t), ==, n);
+	tree_destroy (t);
+
+	/* what userlist_flush_names () does at the 366 */
+	g_timer_start (timer);
+	t = tree_new (str_cmp, NULL);
+	g_ptr_array_sort_with_data (nicks, nick_cmp, NULL);
+	tree_insert_sorted (t, nicks->pdata, n);
+	batched = g_timer_elapsed (timer, NULL);
+	g_assert_cmpint (tree_size (t), ==, n);
+
+	g_test_message ("%d nicks: one by one %.3fs, sorted batch %.3fs", n, one_by_one, batched);
+	g_test_minimized_result (batched, "seconds to build a %d user tree", n);
+
+	tree_destroy (t);
+	g_rand_free (rand);
+	g_timer_destroy (timer);
+	g_ptr_array_free (nicks, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/tree/insert-sorted", test_insert_sorted);
+	if (g_test_perf ())
+		g_test_add_func ("/tree/perf/names-burst", test_perf_names_burst);
+	return g_test_run ();
+}
@@ -0,0 +1,193 @@
+/* ZoiteChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../zoitechat.h"
+#include "../url.h"
+
+/* stubs for what url.c pulls in from the rest of the program */
+struct zoitechatprefs prefs;
+session *current_sess;
+
+static GPtrArray *grabbed;
+static char *log_path;
+static int log_opens;
+
+struct User *userlist_find (session *sess, const char *name) { return NULL; }
+void fe_url_add (const char *text) { g_ptr_array_add (grabbed, g_strdup (text)); }
+int fe_timeout_add_seconds (int interval, void *callback, void *userdata) { return 1; }
+void fe_timeout_remove (int tag) { }
+
+FILE *
+zoitechat_fopen_file (const char *file, const char *mode, int xof_flags)
+{
+	g_assert_cmpstr (file, ==, "url.log");
+	log_opens++;
+	return fopen (log_path, mode);
+}
+
+static void
+check_line (const char *line)
+{
+	char *copy = g_strdup (line);
+
+	url_check_line (copy);
+	g_free (copy);
+}
+
+static void
+reset (void)
+{
+	url_log_close ();
+	if (url_tree)
+		url_clear ();
+	g_ptr_array_set_size (grabbed, 0);
+	log_opens = 0;
+	prefs.hex_url_grabber = TRUE;
+	prefs.hex_url_logging = FALSE;
+	prefs.hex_url_grabber_limit = 0;
+}
+
+static void
+test_grabs_urls (void)
+{
+	reset ();
+
+	check_line (":a!b@c PRIVMSG #chan :see https://example.org/x and ftp://10.0.0.1:21/pub");
+	check_line (":a!b@c NOTICE me :HTTP://Example.COM.");
+	check_line ("PRIVMSG #chan :irc://irc.example.net/#zoitechat\r\n");
+	g_assert_cmpuint (grabbed->len, ==, 4);
+	g_assert_cmpstr (g_ptr_array_index (grabbed, 0), ==, "https://example.org/x");
+	g_assert_cmpstr (g_ptr_array_index (grabbed, 1), ==, "ftp://10.0.0.1:21/pub");
+	g_assert_cmpstr (g_ptr_array_index (grabbed, 2), ==, "HTTP://Example.COM");
+	g_assert_cmpstr (g_ptr_array_index (grabbed, 3), ==, "irc://irc.example.net/#zoitechat");
+}
+
+static void
+test_skips_plain_lines (void)
+{
+	reset ();
+
+	check_line (":a!b@c PRIVMSG #chan :no links here, only 12:30 and a://");
+	check_line (":a!b@c PRIVMSG #chan ://example.org");
+	check_line (":a!b@c JOIN #chan :http://example.org");
+	g_assert_cmpuint (grabbed->len, ==, 0);
+
+	/* with both features off nothing is looked at */
+	prefs.hex_url_grabber = FALSE;
+	check_line (":a!b@c PRIVMSG #chan :https://example.org");
+	g_assert_cmpuint (grabbed->len, ==, 0);
+	g_assert_cmpint (log_opens, ==, 0);
+}
+
+static void
+test_log_stays_open (void)
+{
+	char *contents;
+	int i;
+
+	reset ();
+	prefs.hex_url_grabber = FALSE;
+	prefs.hex_url_logging = TRUE;
+
+	for (i = 0; i < 100; i++)
+	{
+		char *line = g_strdup_printf ("PRIVMSG #chan :link https://example.org/%d", i);
+		check_line (line);
+		g_free (line);
+	}
+	g_assert_cmpint (log_opens, ==, 1);
+
+	/* turning logging off closes the log, which flushes it */
+	prefs.hex_url_logging = FALSE;
+	prefs.hex_url_grabber = TRUE;
+	check_line ("PRIVMSG #chan :nothing");
+
+	g_assert_true (g_file_get_contents (log_path, &contents, NULL, NULL));
+	g_assert_true (g_str_has_prefix (contents, "https://example.org/0\n"));
+	g_assert_true (g_str_has_suffix (contents, "https://example.org/99\n"));
+	g_free (contents);
+}
+
+static void
+test_perf_chatter (void)
+{
+	GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+	GMatchInfo *gmi;
+	GRegex *re;
+	GTimer *timer;
+	double filtered, scanned;
+	guint i;
+
+	reset ();
+	for (i = 0; i < 200000; i++)
+		g_ptr_array_add (lines, g_strdup_printf (":user%u!u@host PRIVMSG #big :just another line of "
+															  "channel chatter at 12:%02u, number %u", i, i % 60, i));
+
+	timer = g_timer_new ();
+	for (i = 0; i < lines->len; i++)
+		url_check_line (g_ptr_array_index (lines, i));
+	filtered = g_timer_elapsed (timer, NULL);
+
+	/* what url_check_line () used to do with every one of them */
+	re = g_regex_new ("(https?|ftp|gopher|gemini|ircs?)://[^ ]+", G_REGEX_CASELESS | G_REGEX_OPTIMIZE, 0, NULL);
+	g_timer_start (timer);
+	for (i = 0; i < lines->len; i++)
+	{
+		g_regex_match (re, g_ptr_array_index (lines, i), 0, &gmi);
+		g_match_info_free (gmi);
+	}
+	scanned = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (grabbed->len, ==, 0);
+	g_test_message ("%u lines: prefilter %.3fs, regex (simplified) %.3fs", lines->len, filtered, scanned);
+	g_test_minimized_result (filtered / lines->len, "seconds per url_check_line ()");
+
+	g_regex_unref (re);
+	g_timer_destroy (timer);
+	g_ptr_array_free (lines, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+	GError *err = NULL;
+	int fd, ret;
+
+	fd = g_file_open_tmp ("zoitechat-url-XXXXXX", &log_path, &err);
+	g_assert_no_error (err);
+	g_close (fd, NULL);
+	grabbed = g_ptr_array_new_with_free_func (g_free);
+
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/url/grabs-urls", test_grabs_urls);
+	g_test_add_func ("/url/skips-plain-lines", test_skips_plain_lines);
+	g_test_add_func ("/url/log-stays-open", test_log_stays_open);
+	if (g_test_perf ())
+		g_test_add_func ("/url/perf/chatter", test_perf_chatter);
+	ret = g_test_run ();
+
+	reset ();
+	g_unlink (log_path);
+	g_free (log_path);
+	g_ptr_array_free (grabbed, TRUE);
+	return ret;
+}
@@ -101,65 +101,201 @@ scrollback_get_filename (session *sess)
 	return ret;
 }
 
-void
-scrollback_close (session *sess)
+/* Scrollback is kept in SCROLLBACK_SEGMENTS files per channel. Lines are
+ * appended to <chan>.txt through a stream that stays open; once that holds a
+ * segment's worth of lines it becomes <chan>.txt.1, the older segments move
+ * up by one and the oldest is deleted, so nothing is ever rewritten.
+ * <chan>.txt.idx records lines and bytes per segment so that opening a
+ * channel doesn't need to count them. A <chan>.txt from older versions is
+ * simply an oversized active segment and rotates out on the first write.
+ *
+ * Opening a tab only replays the last SCROLLBACK_REPLAY lines, read
+ * backwards from the end of the mapped segments; scrolling to the top of
+ * the tab then brings in the next SCROLLBACK_REPLAY older ones. */
+
+#define SCROLLBACK_SEGMENTS 4
+#define SCROLLBACK_REPLAY 500
+
+struct scrollback
+{
+	char *filename;				/* active segment, in the filesystem encoding */
+	GOutputStream *out;
+	int lines[SCROLLBACK_SEGMENTS];	/* [0] is the active segment */
+	goffset bytes[SCROLLBACK_SEGMENTS];
+	int replay_seg;				/* lines not replayed yet end at this */
+	goffset replay_off;			/* segment and offset */
+};
+
+/* where a line read back ends, for putting it back */
+struct scrollback_pos
+{
+	int seg;
+	goffset off;
+};
+
+static char *
+scrollback_segment_name (struct scrollback *sb, int seg)
 {
-	g_clear_object (&sess->scrollfile);
+	if (seg == 0)
+		return g_strdup (sb->filename);
+	return g_strdup_printf ("%s.%d", sb->filename, seg);
 }
 
-/* shrink the file to roughly prefs.hex_text_max_lines */
+/* lines per segment, chosen so at least hex_text_max_lines are kept */
+static int
+scrollback_segment_lines (void)
+{
+	int max_lines = SCROLLBACK_MAX;
+
+	if (prefs.hex_text_max_lines > 0)
+		max_lines = MIN (prefs.hex_text_max_lines, SCROLLBACK_MAX);
+
+	return MAX (1, (max_lines + SCROLLBACK_SEGMENTS - 2) / (SCROLLBACK_SEGMENTS - 1));
+}
 
 static void
-scrollback_shrink (session *sess)
+scrollback_count_segment (struct scrollback *sb, int seg)
 {
-	char *buf, *p;
+	char *path, *buf, *p;
 	gsize len;
-	gint offset, lines = 0;
-	const gint max_lines = MIN(prefs.hex_text_max_lines, SCROLLBACK_MAX);
 
-	if (!g_file_load_contents (sess->scrollfile, NULL, &buf, &len, NULL, NULL))
-		return;
+	sb->lines[seg] = 0;
+	sb->bytes[seg] = 0;
 
-	/* count all lines */
-	p = buf;
-	while (p != buf + len)
+	path = scrollback_segment_name (sb, seg);
+	if (g_file_get_contents (path, &buf, &len, NULL))
 	{
-		if (*p == '\n')
-			lines++;
-		p++;
+		for (p = buf; (p = memchr (p, '\n', buf + len - p)); p++)
+			sb->lines[seg]++;
+		sb->bytes[seg] = len;
+		g_free (buf);
 	}
+	g_free (path);
+}
 
-	offset = lines - max_lines;
+static void
+scrollback_index_save (struct scrollback *sb)
+{
+	GString *idx;
+	char *idxname;
+	int seg;
+
+	idx = g_string_new (NULL);
+	for (seg = 0; seg < SCROLLBACK_SEGMENTS; seg++)
+		g_string_append_printf (idx, "%d %" G_GINT64_FORMAT "\n", sb->lines[seg], (gint64) sb->bytes[seg]);
+
+	idxname = g_strconcat (sb->filename, ".idx", NULL);
+	g_file_set_contents (idxname, idx->str, idx->len, NULL);
+	g_free (idxname);
+	g_string_free (idx, TRUE);
+}
 
-	/* now just go back to where we want to start the file */
-	p = buf;
-	lines = 0;
-	while (p != buf + len)
-	{
-		if (*p == '\n')
+/* trust the index only for segments whose size still matches it */
+static void
+scrollback_index_load (struct scrollback *sb)
+{
+	GStatBuf st;
+	char *idxname, *contents = NULL, *path;
+	char **rows = NULL;
+	gint64 bytes;
+	goffset size;
+	int seg, lines;
+
+	idxname = g_strconcat (sb->filename, ".idx", NULL);
+	if (g_file_get_contents (idxname, &contents, NULL, NULL))
+		rows = g_strsplit (contents, "\n", SCROLLBACK_SEGMENTS + 1);
+	g_free (contents);
+	g_free (idxname);
+
+	for (seg = 0; seg < SCROLLBACK_SEGMENTS; seg++)
+	{
+		path = scrollback_segment_name (sb, seg);
+		size = (g_stat (path, &st) == 0) ? st.st_size : 0;
+		g_free (path);
+
+		if (rows && g_strv_length (rows) > seg &&
+			 sscanf (rows[seg], "%d %" G_GINT64_FORMAT, &lines, &bytes) == 2 && bytes == size)
 		{
-			lines++;
-			if (lines == offset)
-			{
-				p++;
-				break;
-			}
+			sb->lines[seg] = lines;
+			sb->bytes[seg] = bytes;
 		}
-		p++;
+		else if (size)
+			scrollback_count_segment (sb, seg);
 	}
 
-	if (g_file_replace_contents (sess->scrollfile, p, strlen(p), NULL, FALSE,
-							G_FILE_CREATE_PRIVATE, NULL, NULL, NULL))
-		sess->scrollwritten = lines;
+	g_strfreev (rows);
+}
 
-	g_free (buf);
+static struct scrollback *
+scrollback_open (session *sess)
+{
+	struct scrollback *sb;
+	char *filename;
+
+	if ((filename = scrollback_get_filename (sess)) == NULL)
+		return NULL;
+
+	sb = g_new0 (struct scrollback, 1);
+	sb->filename = filename;
+	sb->replay_seg = SCROLLBACK_SEGMENTS;	/* nothing to replay */
+	scrollback_index_load (sb);
+
+	return sb;
+}
+
+void
+scrollback_close (session *sess)
+{
+	struct scrollback *sb = sess->scrollback;
+
+	if (!sb)
+		return;
+
+	g_clear_object (&sb->out);
+	scrollback_index_save (sb);
+	g_free (sb->filename);
+	g_free (sb);
+	sess->scrollback = NULL;
+}
+
+/* the active segment is full: drop the oldest and start a new one */
+
+static void
+scrollback_rotate (struct scrollback *sb)
+{
+	char *from, *to;
+	int seg;
+
+	g_clear_object (&sb->out);
+
+	for (seg = SCROLLBACK_SEGMENTS - 1; seg > 0; seg--)
+	{
+		from = scrollback_segment_name (sb, seg - 1);
+		to = scrollback_segment_name (sb, seg);
+		if (seg == SCROLLBACK_SEGMENTS - 1)
+			g_unlink (to);
+		g_rename (from, to);
+		g_free (from);
+		g_free (to);
+
+		sb->lines[seg] = sb->lines[seg - 1];
+		sb->bytes[seg] = sb->bytes[seg - 1];
+	}
+	sb->lines[0] = 0;
+	sb->bytes[0] = 0;
+
+	/* the unreplayed part moved along (or was deleted) */
+	if (sb->replay_seg < SCROLLBACK_SEGMENTS)
+		sb->replay_seg++;
+
+	scrollback_index_save (sb);
 }
 
 static void
 scrollback_save (session *sess, char *text, time_t stamp)
 {
-	GOutputStream *ostream;
-	char *buf;
+	struct scrollback *sb;
+	GString *line;
 
 	if (sess->type == SESS_SERVER && prefs.hex_gui_tab_server == 1)
 		return;
@@ -175,170 +311,263 @@ scrollback_save (session *sess, char *text, time_t stamp)
 			return;
 	}
 
-	if (!sess->scrollfile)
-	{
-		if ((buf = scrollback_get_filename (sess)) == NULL)
-			return;
+	if (!sess->scrollback && !(sess->scrollback = scrollback_open (sess)))
+		return;
+	sb = sess->scrollback;
 
-		sess->scrollfile = g_file_new_for_path (buf);
-		g_free (buf);
-	}
-	else
+	if (sb->lines[0] >= scrollback_segment_lines ())
+		scrollback_rotate (sb);
+
+	if (!sb->out)
 	{
+		GFile *file = g_file_new_for_path (sb->filename);
+		GFile *parent = g_file_get_parent (file);
+
 		/* Users can delete the folder after it's created... */
-		GFile *parent = g_file_get_parent (sess->scrollfile);
 		g_file_make_directory_with_parents (parent, NULL, NULL);
+		sb->out = G_OUTPUT_STREAM (g_file_append_to (file, G_FILE_CREATE_PRIVATE, NULL, NULL));
 		g_object_unref (parent);
-	}
+		g_object_unref (file);
 
-	ostream = G_OUTPUT_STREAM(g_file_append_to (sess->scrollfile, G_FILE_CREATE_PRIVATE, NULL, NULL));
-	if (!ostream)
-		return;
+		if (!sb->out)
+			return;
+	}
 
 	if (!stamp)
 		stamp = time(0);
+
+	line = g_string_sized_new (strlen (text) + 24);
 	if (sizeof (stamp) == 4)	/* gcc will optimize one of these out */
-		buf = g_strdup_printf ("T %d ", (int) stamp);
+		g_string_printf (line, "T %d ", (int) stamp);
 	else
-		buf = g_strdup_printf ("T %" G_GINT64_FORMAT " ", (gint64)stamp);
-
-	g_output_stream_write (ostream, buf, strlen (buf), NULL, NULL);
-	g_output_stream_write (ostream, text, strlen (text), NULL, NULL);
+		g_string_printf (line, "T %" G_GINT64_FORMAT " ", (gint64)stamp);
+	g_string_append (line, text);
 	if (!g_str_has_suffix (text, "\n"))
-		g_output_stream_write (ostream, "\n", 1, NULL, NULL);
-
-	g_free (buf);
-	g_object_unref (ostream);
+		g_string_append_c (line, '\n');
 
-	sess->scrollwritten++;
+	/* one write per line, the stream stays open for the next one */
+	if (g_output_stream_write_all (sb->out, line->str, line->len, NULL, NULL, NULL))
+	{
+		sb->lines[0]++;
+		sb->bytes[0] += line->len;
+		sess->scrollwritten++;
+	}
+	else
+	{
+		/* reopen (and recreate the folder) on the next line */
+		g_clear_object (&sb->out);
+	}
 
-	if ((sess->scrollwritten > prefs.hex_text_max_lines && prefs.hex_text_max_lines > 0) ||
-       sess->scrollwritten > SCROLLBACK_MAX)
-		scrollback_shrink (sess);
+	g_string_free (line, TRUE);
 }
 
-void
-scrollback_load (session *sess)
+/* returns FALSE if the line was dropped */
+static gboolean
+scrollback_print_line (session *sess, char *buf, time_t *stamp)
 {
-	GInputStream *stream;
-	GDataInputStream *istream;
-	gchar *buf, *text;
-	gint lines = 0;
-	time_t stamp = 0;
+	char *text;
 
-	if (sess->text_scrollback == SET_DEFAULT)
+	/*
+	 * Some scrollback lines have three blanks after the timestamp and a newline
+	 * Some have only one blank and a newline
+	 * Some don't even have a timestamp
+	 * Some don't have any text at all
+	 */
+	if (buf[0] == 'T' && buf[1] == ' ')
 	{
-		if (!prefs.hex_text_replay)
-			return;
+		if (sizeof (time_t) == 4)
+			*stamp = strtoul (buf + 2, NULL, 10);
+		else
+			*stamp = g_ascii_strtoull (buf + 2, NULL, 10); /* in case time_t is 64 bits */
+
+		if (G_UNLIKELY(*stamp == 0))
+		{
+			g_warning ("Invalid timestamp in scrollback file");
+			return FALSE;
+		}
+
+		text = strchr (buf + 3, ' ');
+		if (text && text[1])
+		{
+			if (prefs.hex_text_stripcolor_replay)
+			{
+				text = strip_color (text + 1, -1, STRIP_COLOR);
+			}
+
+			fe_print_text (sess, text, *stamp, TRUE);
+
+			if (prefs.hex_text_stripcolor_replay)
+			{
+				g_free (text);
+			}
+		}
+		else
+		{
+			fe_print_text (sess, "  ", *stamp, TRUE);
+		}
 	}
 	else
 	{
-		if (sess->text_scrollback != SET_ON)
-			return;
+		if (strlen (buf))
+			fe_print_text (sess, buf, 0, TRUE);
+		else
+			fe_print_text (sess, "  ", 0, TRUE);
 	}
 
-	if (!sess->scrollfile)
-	{
-		if ((buf = scrollback_get_filename (sess)) == NULL)
-			return;
-
-		sess->scrollfile = g_file_new_for_path (buf);
-		g_free (buf);
-	}
+	return TRUE;
+}
 
-	stream = G_INPUT_STREAM(g_file_read (sess->scrollfile, NULL, NULL));
-	if (!stream)
-		return;
+/* Collects up to 'want' lines ending before the replay position, newest
+ * first, and moves the position back past them. 'ends' gets where each
+ * one ended. Only the tail of each segment is touched, so this costs the
+ * same for any size of file. */
 
-	istream = g_data_input_stream_new (stream);
-	/*
-	 * This is to avoid any issues moving between windows/unix
-	 * but the docs mention an invalid \r without a following \n
-	 * can lock up the program... (Our write() always adds \n)
-	 */
-	g_data_input_stream_set_newline_type (istream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
-	g_object_unref (stream);
+static void
+scrollback_read_back (struct scrollback *sb, int want, GPtrArray *lines, GArray *ends)
+{
+	struct scrollback_pos pos;
+	GMappedFile *map;
+	const char *data, *start, *end, *eol;
+	char *path;
 
-	while (1)
+	while (want > 0 && sb->replay_seg < SCROLLBACK_SEGMENTS)
 	{
-		GError *err = NULL;
-		gsize n_bytes;
+		if (sb->replay_off <= 0)
+		{
+			sb->replay_seg++;
+			sb->replay_off = G_MAXINT64;
+			continue;
+		}
+
+		path = scrollback_segment_name (sb, sb->replay_seg);
+		map = g_mapped_file_new (path, FALSE, NULL);
+		g_free (path);
+		if (!map)
+		{
+			sb->replay_off = 0;
+			continue;
+		}
 
-		buf = g_data_input_stream_read_line_utf8 (istream, &n_bytes, NULL, &err);
+		data = g_mapped_file_get_contents (map);
+		end = data + MIN (sb->replay_off, (goffset) g_mapped_file_get_length (map));
 
-		if (!err && buf)
+		while (want > 0 && end > data)
 		{
-			/*
-			 * Some scrollback lines have three blanks after the timestamp and a newline
-			 * Some have only one blank and a newline
-			 * Some don't even have a timestamp
-			 * Some don't have any text at all
-			 */
-			if (buf[0] == 'T' && buf[1] == ' ')
-			{
-				if (sizeof (time_t) == 4)
-					stamp = strtoul (buf + 2, NULL, 10);
-				else
-					stamp = g_ascii_strtoull (buf + 2, NULL, 10); /* in case time_t is 64 bits */
+			pos.seg = sb->replay_seg;
+			pos.off = end - data;
+			g_array_append_val (ends, pos);
+
+			eol = end;
+			if (eol[-1] == '\n')
+				eol--;
+			if (eol > data && eol[-1] == '\r')
+				eol--;
+
+			start = eol;
+			while (start > data && start[-1] != '\n')
+				start--;
+
+			g_ptr_array_add (lines, g_strndup (start, eol - start));
+			end = start;
+			want--;
+		}
 
-				if (G_UNLIKELY(stamp == 0))
-				{
-					g_warning ("Invalid timestamp in scrollback file");
-					continue;
-				}
+		sb->replay_off = end - data;
+		g_mapped_file_unref (map);
+	}
+}
 
-				text = strchr (buf + 3, ' ');
-				if (text && text[1])
-				{
-					if (prefs.hex_text_stripcolor_replay)
-					{
-						text = strip_color (text + 1, -1, STRIP_COLOR);
-					}
+static int
+scrollback_replay (session *sess, gboolean older, time_t *stamp)
+{
+	struct scrollback_pos *pos;
+	GPtrArray *lines;
+	GArray *ends, *shown;
+	int want = SCROLLBACK_REPLAY;
+	int i, line, kept, count = 0;
 
-					fe_print_text (sess, text, stamp, TRUE);
+	if (prefs.hex_text_max_lines > 0)
+		want = MIN (want, prefs.hex_text_max_lines);
 
-					if (prefs.hex_text_stripcolor_replay)
-					{
-						g_free (text);
-					}
-				}
-				else
-				{
-					fe_print_text (sess, "  ", stamp, TRUE);
-				}
-			}
-			else
-			{
-				if (strlen (buf))
-					fe_print_text (sess, buf, 0, TRUE);
-				else
-					fe_print_text (sess, "  ", 0, TRUE);
-			}
-			lines++;
+	lines = g_ptr_array_new_with_free_func (g_free);
+	ends = g_array_new (FALSE, FALSE, sizeof (struct scrollback_pos));
+	shown = g_array_new (FALSE, FALSE, sizeof (int));
+	scrollback_read_back (sess->scrollback, want, lines, ends);
 
-			g_free (buf);
+	/* If its only an encoding error it may be specific to the line */
+	for (i = 0; i < lines->len; )
+	{
+		if (g_utf8_validate (g_ptr_array_index (lines, i), -1, NULL))
+		{
+			i++;
+			continue;
 		}
-		else if (err)
+		g_warning ("Invalid utf8 in scrollback file");
+		g_ptr_array_remove_index (lines, i);
+		g_array_remove_index (ends, i);
+	}
+
+	if (lines->len)
+	{
+		/* Older lines go on top newest first, so when the buffer fills
+		 * up it's the far end that doesn't fit. */
+		fe_print_text_batch_start (sess, older);
+		for (i = 0; i < lines->len; i++)
 		{
-			/* If its only an encoding error it may be specific to the line */
-			if (g_error_matches (err, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE))
+			line = older ? i : lines->len - 1 - i;
+			if (scrollback_print_line (sess, g_ptr_array_index (lines, line), stamp))
 			{
-				g_warning ("Invalid utf8 in scrollback file");
-				g_clear_error (&err);
-				continue;
+				g_array_append_val (shown, line);
+				count++;
 			}
-
-			/* For general errors just give up */
-			g_clear_error (&err);
-			break;
 		}
-		else /* No new line */
+		kept = fe_print_text_batch_end (sess);
+
+		/* what wasn't kept stays unread; the front end only counts
+		   the lines it was given */
+		if (kept >= 0 && kept < count)
 		{
-			break;
+			pos = &g_array_index (ends, struct scrollback_pos,
+										 g_array_index (shown, int, kept));
+			sess->scrollback->replay_seg = pos->seg;
+			sess->scrollback->replay_off = pos->off;
+			count = kept;
 		}
 	}
 
-	g_object_unref (istream);
+	g_array_free (shown, TRUE);
+	g_array_free (ends, TRUE);
+	g_ptr_array_free (lines, TRUE);
+	return count;
+}
+
+void
+scrollback_load (session *sess)
+{
+	gchar *buf, *text;
+	gint lines;
+	time_t stamp = 0;
+
+	/* a reused tab may have been another channel's until now */
+	scrollback_close (sess);
+
+	if (sess->text_scrollback == SET_DEFAULT)
+	{
+		if (!prefs.hex_text_replay)
+			return;
+	}
+	else
+	{
+		if (sess->text_scrollback != SET_ON)
+			return;
+	}
+
+	if (!(sess->scrollback = scrollback_open (sess)))
+		return;
+
+	sess->scrollback->replay_seg = 0;
+	sess->scrollback->replay_off = G_MAXINT64;
+	lines = scrollback_replay (sess, FALSE, &stamp);
 
 	sess->scrollwritten = lines;
 
@@ -352,6 +581,17 @@ scrollback_load (session *sess)
 	}
 }
 
+void
+scrollback_load_older (session *sess)
+{
+	time_t stamp = 0;
+
+	if (!sess->scrollback || sess->scrollback->replay_seg >= SCROLLBACK_SEGMENTS)
+		return;
+
+	scrollback_replay (sess, TRUE, &stamp);
+}
+
 void
 log_close (session *sess)
 {
@@ -1323,7 +1563,7 @@ static char * const pevt_connect_help[] = {
 };
 
 static char * const pevt_sconnect_help[] = {
-	"PID"
+	N_("Server Name")
 };
 
 static char * const pevt_generic_nick_help[] = {
@@ -212,11 +212,11 @@ tree_foreach (tree *t, tree_traverse_func *func, void *data)
 }
 
 static void
-tree_grow (tree *t)
+tree_grow_by (tree *t, int count)
 {
-	if (t->array_size < t->elements + 1)
+	if (t->array_size < t->elements + count)
 	{
-		int new_size = t->array_size + ARRAY_GROW;
+		int new_size = t->array_size + MAX (count, ARRAY_GROW);
 
 		t->array = realloc (t->array, sizeof (void *) * new_size);
 		t->array_size = new_size;
@@ -224,6 +224,12 @@ tree_grow (tree *t)
 
 }
 
+static void
+tree_grow (tree *t)
+{
+	tree_grow_by (t, 1);
+}
+
 int
 tree_insert (tree *t, void *key)
 {
@@ -247,6 +253,33 @@ tree_append (tree *t, void *key)
 	tree_insert_at_pos (t, key, t->elements);
 }
 
+/* add 'count' keys, sorted by the tree's own order and none of them equal
+ * to each other or to a key already in it, merging from the end so every
+ * element moves at most once */
+void
+tree_insert_sorted (tree *t, void **keys, int count)
+{
+	int i, j, k;
+
+	if (count < 1)
+		return;
+
+	tree_grow_by (t, count);
+
+	i = t->elements - 1;
+	j = count - 1;
+	k = t->elements + count - 1;
+	while (j >= 0)
+	{
+		if (i >= 0 && t->cmp (t->array[i], keys[j], t->data) > 0)
+			t->array[k--] = t->array[i--];
+		else
+			t->array[k--] = keys[j--];
+	}
+
+	t->elements += count;
+}
+
 int tree_size (tree *t)
 {
 	return t->elements;
@@ -34,6 +34,12 @@
 
 void *url_tree = NULL;
 GTree *url_btree = NULL;
+static FILE *url_log = NULL;
+static int url_log_tag = 0;
+
+/* seconds url.log lines may sit in the stdio buffer */
+#define URL_LOG_FLUSH 5
+
 static gboolean regex_match (const GRegex *re, const char *word,
 							 int *start, int *end);
 static const GRegex *re_url (void);
@@ -88,19 +94,48 @@ url_save_tree (const char *fname, const char *mode, gboolean fullpath)
 	fclose (fd);
 }
 
+static int
+url_log_flush (void *unused)
+{
+	if (url_log)
+		fflush (url_log);
+	url_log_tag = 0;
+
+	return 0;
+}
+
+void
+url_log_close (void)
+{
+	if (url_log_tag)
+	{
+		fe_timeout_remove (url_log_tag);
+		url_log_tag = 0;
+	}
+	if (url_log)
+	{
+		fclose (url_log);
+		url_log = NULL;
+	}
+}
+
+/* url.log stays open and is flushed a few seconds after the last write */
 static void
 url_save_node (char* url)
 {
-	FILE *fd;
-
-	fd = zoitechat_fopen_file ("url.log", "a", 0);
-	if (fd == NULL)
+	if (!url_log)
 	{
-		return;
+		url_log = zoitechat_fopen_file ("url.log", "a", 0);
+		if (url_log == NULL)
+		{
+			return;
+		}
 	}
 
-	fprintf (fd, "%s\n", url);
-	fclose (fd);	
+	fprintf (url_log, "%s\n", url);
+
+	if (!url_log_tag)
+		url_log_tag = fe_timeout_add_seconds (URL_LOG_FLUSH, url_log_flush, NULL);
 }
 
 static int
@@ -301,14 +336,35 @@ static char *commands[] = {
 
 #define ARRAY_SIZE(a) (sizeof (a) / sizeof ((a)[0]))
 
+/* Every match of re_url () contains a scheme followed by "://", so a
+ * line without one can skip the regex. */
+static gboolean
+url_line_has_candidate (const char *text)
+{
+	const char *p = text;
+
+	while ((p = strchr (p, ':')) != NULL)
+	{
+		if (p[1] == '/' && p[2] == '/' && p > text && g_ascii_isalpha (p[-1]))
+			return TRUE;
+		p++;
+	}
+
+	return FALSE;
+}
+
 void
 url_check_line (char *buf)
 {
-	GRegex *re(void);
 	GMatchInfo *gmi;
 	char *po = buf;
 	size_t i;
 
+	if (!prefs.hex_url_logging && url_log)
+		url_log_close ();
+	if (!prefs.hex_url_grabber && !prefs.hex_url_logging)
+		return;
+
 	/* Skip over message prefix */
 	if (*po == ':')
 	{
@@ -338,6 +394,9 @@ url_check_line (char *buf)
 		return;
 	po++;
 
+	if (!url_line_has_candidate (po))
+		return;
+
 	g_regex_match(re_url(), po, 0, &gmi);
 	while (g_match_info_matches(gmi))
 	{
@@ -74,41 +74,200 @@ userlist_insertname (session *sess, struct User *newuser)
 	return tree_insert (sess->usertree, newuser);
 }
 
+/* Channels share one struct user_info per nick, found through
+ * serv->user_index. Keys are folded like session_index_key () does, so
+ * they agree with serv->p_cmp. */
+static void
+user_info_key (server *serv, const char *nick, char *key)
+{
+	gboolean rfc = (serv->p_cmp == rfc_casecmp);
+	int i;
+
+	for (i = 0; nick[i] && i < NICKLEN - 1; i++)
+		key[i] = rfc ? rfc_tolower (nick[i]) : g_ascii_tolower (nick[i]);
+	key[i] = 0;
+}
+
+static struct user_info *
+user_info_find (server *serv, const char *nick)
+{
+	char key[NICKLEN];
+
+	if (!serv->user_index)
+		return NULL;
+
+	user_info_key (serv, nick, key);
+	return g_hash_table_lookup (serv->user_index, key);
+}
+
+static void
+user_info_index (server *serv, struct user_info *info)
+{
+	if (!serv->user_index)
+		serv->user_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* the key lives in the record, so an old entry's key must go too */
+	g_hash_table_replace (serv->user_index, info->key, info);
+}
+
+static void
+user_info_unindex (server *serv, struct user_info *info)
+{
+	if (serv->user_index && g_hash_table_lookup (serv->user_index, info->key) == info)
+		g_hash_table_remove (serv->user_index, info->key);
+}
+
+static void
+user_info_free (struct user_info *info)
+{
+	g_free (info->realname);
+	g_free (info->hostname);
+	g_free (info->servername);
+	g_free (info->account);
+	g_free (info);
+}
+
+/* a struct User for nick in sess, not yet in its tree */
+static struct User *
+user_new (session *sess, const char *nick)
+{
+	struct user_info *info;
+	struct User *user;
+
+	user = g_new0 (struct User, 1);
+	safe_strcpy (user->nick, nick, NICKLEN);
+	user->sess = sess;
+
+	info = user_info_find (sess->server, user->nick);
+	if (!info)
+	{
+		info = g_new0 (struct user_info, 1);
+		user_info_key (sess->server, user->nick, info->key);
+		user_info_index (sess->server, info);
+	}
+	info->members = g_slist_prepend (info->members, user);
+	user->info = info;
+
+	return user;
+}
+
+static void
+user_info_set (char **field, const char *value)
+{
+	if (g_strcmp0 (*field, value))
+	{
+		g_free (*field);
+		*field = g_strdup (value);
+	}
+}
+
+/* fill in what target doesn't know yet from info */
+static void
+user_info_merge (struct user_info *target, struct user_info *info)
+{
+	if (!target->hostname)
+		target->hostname = g_strdup (info->hostname);
+	if (!target->realname)
+		target->realname = g_strdup (info->realname);
+	if (!target->servername)
+		target->servername = g_strdup (info->servername);
+	if (!target->account)
+		target->account = g_strdup (info->account);
+}
+
+/* Call when serv->p_cmp changes, e.g. on CASEMAPPING. Keys are made
+ * again from the members' nicks: nicks that were one user under the old
+ * mapping may be two under the new one, and the other way round. */
 void
-userlist_set_away (struct session *sess, char *nick, unsigned int away)
+userlist_index_rebuild (server *serv)
 {
+	GHashTable *old = serv->user_index;
+	struct user_info *info, *target;
 	struct User *user;
+	GList *infos, *ilist;
+	GSList *members, *list;
+
+	if (!old)
+		return;
+
+	serv->user_index = NULL;
+	infos = g_hash_table_get_values (old);
+	g_hash_table_destroy (old);
 
-	user = userlist_find (sess, nick);
-	if (user)
+	for (ilist = infos; ilist; ilist = ilist->next)
 	{
-		if (user->away != away)
+		info = ilist->data;
+		members = info->members;
+		info->members = NULL;
+		info->key[0] = 0;		/* not in the new index yet */
+
+		for (list = members; list; list = list->next)
 		{
-			user->away = away;
-			/* rehash GUI */
-			fe_userlist_rehash (sess, user);
-			if (away)
-				fe_userlist_update (sess, user);
+			user = list->data;
+			target = user_info_find (serv, user->nick);
+			if (!target)
+			{
+				if (!info->key[0])
+					target = info;
+				else
+				{
+					target = g_new0 (struct user_info, 1);
+					user_info_merge (target, info);
+					target->away = info->away;
+				}
+				user_info_key (serv, user->nick, target->key);
+				user_info_index (serv, target);
+			}
+			else if (target != info)
+			{
+				user_info_merge (target, info);
+			}
+
+			target->members = g_slist_prepend (target->members, user);
+			user->info = target;
 		}
+		g_slist_free (members);
+
+		if (!info->members)
+			user_info_free (info);
 	}
+	g_list_free (infos);
 }
 
 void
-userlist_set_account (struct session *sess, char *nick, char *account)
+userlist_set_away (server *serv, char *nick, unsigned int away)
 {
+	struct user_info *info;
 	struct User *user;
+	GSList *list;
+
+	info = user_info_find (serv, nick);
+	if (!info || info->away == away)
+		return;
+
+	info->away = away;
+	for (list = info->members; list; list = list->next)
+	{
+		user = list->data;
+		/* rehash GUI */
+		fe_userlist_rehash (user->sess, user);
+		if (away)
+			fe_userlist_update (user->sess, user);
+	}
+}
 
-	user = userlist_find (sess, nick);
-	if (user)
+void
+userlist_set_account (server *serv, char *nick, char *account)
+{
+	struct user_info *info;
+
+	info = user_info_find (serv, nick);
+	if (info)
 	{
 		if (strcmp (account, "*") == 0)
-		{
-			g_clear_pointer (&user->account, g_free);
-		} else if (g_strcmp0 (user->account, account))
-		{
-			g_free (user->account);
-			user->account = g_strdup (account);
-		}
+			g_clear_pointer (&info->account, g_free);
+		else
+			user_info_set (&info->account, account);
 
 		/* gui doesnt currently reflect login status, maybe later
 		fe_userlist_rehash (sess, user); */
@@ -116,54 +275,59 @@ userlist_set_account (struct session *sess, char *nick, char *account)
 }
 
 int
-userlist_add_hostname (struct session *sess, char *nick, char *hostname,
+userlist_add_hostname (server *serv, char *nick, char *hostname,
 							  char *realname, char *servername, char *account, unsigned int away)
 {
+	struct user_info *info;
 	struct User *user;
 	gboolean do_rehash = FALSE;
+	GSList *list;
+
+	info = user_info_find (serv, nick);
+	if (!info)
+		return 0;
 
-	user = userlist_find (sess, nick);
-	if (user)
+	if (hostname && (!info->hostname || strcmp(info->hostname, hostname)))
 	{
-		if (hostname && (!user->hostname || strcmp(user->hostname, hostname)))
-		{
-			if (prefs.hex_gui_ulist_show_hosts)
-				do_rehash = TRUE;
-			g_free (user->hostname);
-			user->hostname = g_strdup (hostname);
-		}
-		if (realname && *realname && g_strcmp0 (user->realname, realname) != 0)
-		{
-			g_free (user->realname);
-			user->realname = g_strdup (realname);
-		}
-		if (!user->servername && servername)
-			user->servername = g_strdup (servername);
-		if (!user->account && account && strcmp (account, "0") != 0)
-			user->account = g_strdup (account);
-		if (away != 0xff)
-		{
-			if (user->away != away)
-				do_rehash = TRUE;
-			user->away = away;
-		}
+		if (prefs.hex_gui_ulist_show_hosts)
+			do_rehash = TRUE;
+		user_info_set (&info->hostname, hostname);
+	}
+	if (realname && *realname)
+		user_info_set (&info->realname, realname);
+	if (!info->servername && servername)
+		info->servername = g_strdup (servername);
+	if (!info->account && account && strcmp (account, "0") != 0)
+		info->account = g_strdup (account);
+	if (away != 0xff)
+	{
+		if (info->away != away)
+			do_rehash = TRUE;
+		info->away = away;
+	}
 
-		fe_userlist_update (sess, user);
+	for (list = info->members; list; list = list->next)
+	{
+		user = list->data;
+		fe_userlist_update (user->sess, user);
 		if (do_rehash)
-			fe_userlist_rehash (sess, user);
-
-		return 1;
+			fe_userlist_rehash (user->sess, user);
 	}
-	return 0;
+
+	return 1;
 }
 
 static int
 free_user (struct User *user, gpointer data)
 {
-	g_free (user->realname);
-	g_free (user->hostname);
-	g_free (user->servername);
-	g_free (user->account);
+	struct user_info *info = user->info;
+
+	info->members = g_slist_remove (info->members, user);
+	if (!info->members)
+	{
+		user_info_unindex (user->sess->server, info);
+		user_info_free (info);
+	}
 	g_free (user);
 
 	return TRUE;
@@ -172,6 +336,13 @@ free_user (struct User *user, gpointer data)
 void
 userlist_free (session *sess)
 {
+	if (sess->names_queue)
+	{
+		g_ptr_array_foreach (sess->names_queue, (GFunc)free_user, NULL);
+		g_ptr_array_free (sess->names_queue, TRUE);
+		sess->names_queue = NULL;
+	}
+
 	tree_foreach (sess->usertree, (tree_traverse_func *)free_user, NULL);
 	tree_destroy (sess->usertree);
 
@@ -203,6 +374,8 @@ userlist_find (struct session *sess, const char *name)
 {
 	int pos;
 
+	userlist_flush_names (sess);
+
 	if (sess->usertree)
 		return tree_find (sess->usertree, name,
 								(tree_cmp_func *)find_cmp, sess->server, &pos);
@@ -213,23 +386,28 @@ userlist_find (struct session *sess, const char *name)
 struct User *
 userlist_find_global (struct server *serv, char *name)
 {
-	struct User *user;
-	session *sess;
-	GSList *list = sess_list;
-	while (list)
-	{
-		sess = (session *) list->data;
-		if (sess->server == serv)
-		{
-			user = userlist_find (sess, name);
-			if (user)
-				return user;
-		}
-		list = list->next;
-	}
+	struct user_info *info = user_info_find (serv, name);
+
+	if (info && info->members)
+		return info->members->data;
 	return NULL;
 }
 
+/* the channels this nick is in, as a new list */
+GSList *
+userlist_find_sessions (server *serv, const char *name)
+{
+	struct user_info *info = user_info_find (serv, name);
+	GSList *list, *sessions = NULL;
+
+	if (!info)
+		return NULL;
+
+	for (list = info->members; list; list = list->next)
+		sessions = g_slist_prepend (sessions, ((struct User *)list->data)->sess);
+	return sessions;
+}
+
 static void
 update_counts (session *sess, struct User *user, char prefix,
 					int level, int offset)
@@ -302,14 +480,47 @@ userlist_update_mode (session *sess, char *name, char mode, char sign)
 	fe_userlist_numbers (sess);
 }
 
-int
-userlist_change (struct session *sess, char *oldname, char *newname)
+/* rename the nick in every channel it is in, returning those channels */
+GSList *
+userlist_change (server *serv, char *oldname, char *newname)
 {
-	struct User *user = userlist_find (sess, oldname);
+	struct user_info *info, *stale;
+	struct User *user;
+	GSList *list, *sessions, *changed = NULL;
+	session *sess;
 	int pos;
 
-	if (user)
+	info = user_info_find (serv, oldname);
+	if (!info)
+		return NULL;
+
+	/* someone we still think is on under the new nick is the same user
+	   now, e.g. a ghost left behind by a missed QUIT */
+	stale = user_info_find (serv, newname);
+	if (stale && stale != info)
 	{
+		user_info_unindex (serv, stale);
+		user_info_merge (info, stale);
+		for (list = stale->members; list; list = list->next)
+			((struct User *) list->data)->info = info;
+		info->members = g_slist_concat (info->members, stale->members);
+		stale->members = NULL;
+		user_info_free (stale);
+	}
+
+	user_info_unindex (serv, info);
+	user_info_key (serv, newname, info->key);
+	user_info_index (serv, info);
+
+	/* look each one up again, userlist_find () may flush queued names */
+	sessions = userlist_find_sessions (serv, newname);
+	for (list = sessions; list; list = list->next)
+	{
+		sess = list->data;
+		user = userlist_find (sess, oldname);
+		if (!user || g_slist_find (changed, sess))
+			continue;
+
 		tree_remove (sess->usertree, user, &pos);
 		fe_userlist_remove (sess, user);
 
@@ -319,10 +530,11 @@ userlist_change (struct session *sess, char *oldname, char *newname)
 		fe_userlist_insert (sess, user, FALSE);
 		fe_userlist_rehash (sess, user);
 
-		return 1;
+		changed = g_slist_prepend (changed, sess);
 	}
+	g_slist_free (sessions);
 
-	return 0;
+	return changed;
 }
 
 int
@@ -367,11 +579,13 @@ userlist_add (struct session *sess, char *name, char *hostname,
 	int row, prefix_chars;
 	unsigned int acc;
 
+	userlist_flush_names (sess);
+
 	acc = nick_access (sess->server, name, &prefix_chars);
 
 	notify_set_online (sess->server, name + prefix_chars, tags_data);
 
-	user = g_new0 (struct User, 1);
+	user = user_new (sess, name + prefix_chars);
 
 	user->access = acc;
 
@@ -379,10 +593,8 @@ userlist_add (struct session *sess, char *name, char *hostname,
 	if (prefix_chars)
 		user->prefix[0] = name[0];
 
-	/* add it to our linked list */
 	if (hostname)
-		user->hostname = g_strdup (hostname);
-	safe_strcpy (user->nick, name + prefix_chars, NICKLEN);
+		user_info_set (&user->info->hostname, hostname);
 	/* is it me? */
 	if (!sess->server->p_cmp (user->nick, sess->server->nick))
 		user->me = TRUE;
@@ -390,9 +602,9 @@ userlist_add (struct session *sess, char *name, char *hostname,
 	if (sess->server->have_extjoin)
 	{
 		if (account && *account)
-			user->account = g_strdup (account);
+			user_info_set (&user->info->account, account);
 		if (realname && *realname)
-			user->realname = g_strdup (realname);
+			user_info_set (&user->info->realname, realname);
 	}
 
 	row = userlist_insertname (sess, user);
@@ -400,10 +612,7 @@ userlist_add (struct session *sess, char *name, char *hostname,
 	/* duplicate? some broken servers trigger this */
 	if (row == -1)
 	{
-		g_free (user->hostname);
-		g_free (user->account);
-		g_free (user->realname);
-		g_free (user);
+		free_user (user, NULL);
 		return;
 	}
 
@@ -426,6 +635,98 @@ userlist_add (struct session *sess, char *name, char *hostname,
 		fe_userlist_numbers (sess);
 }
 
+/* NAMES replies are queued and only sorted into the tree, and handed to
+ * the front end, as one batch. Anything that looks at the userlist
+ * before the 366 arrives flushes the queue first. */
+
+void
+userlist_queue_name (session *sess, char *name, char *hostname,
+							const message_tags_data *tags_data)
+{
+	struct User *user;
+	int prefix_chars;
+	unsigned int acc;
+
+	acc = nick_access (sess->server, name, &prefix_chars);
+
+	notify_set_online (sess->server, name + prefix_chars, tags_data);
+
+	user = user_new (sess, name + prefix_chars);
+	user->access = acc;
+	if (prefix_chars)
+		user->prefix[0] = name[0];
+	if (hostname)
+		user_info_set (&user->info->hostname, hostname);
+	if (!sess->server->p_cmp (user->nick, sess->server->nick))
+		user->me = TRUE;
+
+	/* only set the mode flags here, they are counted once the user is kept */
+	while (prefix_chars)
+	{
+		update_counts (sess, user, name[0], TRUE, 0);
+		name++;
+		prefix_chars--;
+	}
+
+	if (!sess->names_queue)
+		sess->names_queue = g_ptr_array_sized_new (512);
+	g_ptr_array_add (sess->names_queue, user);
+}
+
+static int
+names_cmp (gconstpointer a, gconstpointer b, gpointer serv)
+{
+	return nick_cmp_alpha (*(struct User **)a, *(struct User **)b, serv);
+}
+
+void
+userlist_flush_names (session *sess)
+{
+	GPtrArray *queue = sess->names_queue;
+	struct User *user, *prev = NULL;
+	guint i, kept = 0;
+	int pos;
+
+	if (!queue)
+		return;
+	sess->names_queue = NULL;
+
+	if (!sess->usertree)
+		sess->usertree = tree_new ((tree_cmp_func *)nick_cmp_alpha, sess->server);
+
+	/* a stable sort, so of two entries for one nick the first is kept */
+	g_ptr_array_sort_with_data (queue, names_cmp, sess->server);
+
+	for (i = 0; i < queue->len; i++)
+	{
+		user = g_ptr_array_index (queue, i);
+
+		/* duplicate? some broken servers trigger this */
+		if ((prev && !nick_cmp_alpha (prev, user, sess->server)) ||
+			 tree_find (sess->usertree, user, (tree_cmp_func *)nick_cmp_alpha,
+							sess->server, &pos))
+		{
+			free_user (user, NULL);
+			continue;
+		}
+
+		sess->total++;
+		sess->ops += user->op;
+		sess->hops += user->hop;
+		sess->voices += user->voice;
+		if (user->me)
+			sess->me = user;
+
+		queue->pdata[kept++] = user;
+		prev = user;
+	}
+
+	tree_insert_sorted (sess->usertree, queue->pdata, kept);
+	fe_userlist_insert_batch (sess, (struct User **)queue->pdata, kept);
+
+	g_ptr_array_free (queue, TRUE);
+}
+
 static int
 rehash_cb (struct User *user, session *sess)
 {
@@ -436,6 +737,7 @@ rehash_cb (struct User *user, session *sess)
 void
 userlist_rehash (session *sess)
 {
+	userlist_flush_names (sess);
 	tree_foreach (sess->usertree, (tree_traverse_func *)rehash_cb, sess);
 }
 
@@ -451,6 +753,7 @@ userlist_flat_list (session *sess)
 {
 	GSList *list = NULL;
 
+	userlist_flush_names (sess);
 	tree_foreach (sess->usertree, (tree_traverse_func *)flat_cb, &list);
 	return g_slist_reverse (list);
 }
@@ -467,6 +770,7 @@ userlist_double_list(session *sess)
 {
 	GList *list = NULL;
 
+	userlist_flush_names (sess);
 	tree_foreach (sess->usertree, (tree_traverse_func *)double_cb, &list);
 	return list;
 }
@@ -23,13 +23,25 @@
 #ifndef ZOITECHAT_USERLIST_H
 #define ZOITECHAT_USERLIST_H
 
-struct User
+/* What we know about a nick on one server. Every channel the nick is in
+ * has its own struct User, and they all share this record. */
+struct user_info
 {
-	char nick[NICKLEN];
+	char key[NICKLEN];	/* nick folded with the server's casemapping */
 	char *hostname;
 	char *realname;
 	char *servername;
 	char *account;
+	GSList *members;		/* struct User, freed with the last of them */
+	unsigned int away:1;
+};
+
+/* a nick in one channel */
+struct User
+{
+	char nick[NICKLEN];
+	struct user_info *info;
+	struct session *sess;
 	time_t lasttalk;
 	time_t typing_time;
 	unsigned int access;	/* axs bit field */
@@ -38,27 +50,31 @@ struct User
 	unsigned int hop:1;
 	unsigned int voice:1;
 	unsigned int me:1;
-	unsigned int away:1;
 	unsigned int selected:1;
 	unsigned int typing:2;
 };
 
 #define USERACCESS_SIZE 12
 
-int userlist_add_hostname (session *sess, char *nick,
+int userlist_add_hostname (server *serv, char *nick,
 									char *hostname, char *realname,
 									char *servername, char *account, unsigned int away);
-void userlist_set_away (session *sess, char *nick, unsigned int away);
-void userlist_set_account (session *sess, char *nick, char *account);
+void userlist_set_away (server *serv, char *nick, unsigned int away);
+void userlist_set_account (server *serv, char *nick, char *account);
 struct User *userlist_find (session *sess, const char *name);
 struct User *userlist_find_global (server *serv, char *name);
+GSList *userlist_find_sessions (server *serv, const char *name);
+void userlist_index_rebuild (server *serv);
 void userlist_clear (session *sess);
 void userlist_free (session *sess);
 void userlist_add (session *sess, char *name, char *hostname, char *account,
 						 char *realname, const message_tags_data *tags_data);
+void userlist_queue_name (session *sess, char *name, char *hostname,
+								  const message_tags_data *tags_data);
+void userlist_flush_names (session *sess);
 int userlist_remove (session *sess, char *name);
 void userlist_remove_user (session *sess, struct User *user);
-int userlist_change (session *sess, char *oldname, char *newname);
+GSList *userlist_change (server *serv, char *oldname, char *newname);
 void userlist_update_mode (session *sess, char *name, char mode, char sign);
 GSList *userlist_flat_list (session *sess);
 GList *userlist_double_list (session *sess);
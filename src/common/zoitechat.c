@@ -308,47 +308,172 @@ lastact_getfirst(int (*filter) (session *sess))
 	return sess;
 }
 
+/* every live session, so is_session () doesn't have to walk sess_list */
+static GHashTable *sess_set = NULL;
+
 int
 is_session (session * sess)
 {
-	return g_slist_find (sess_list, sess) ? 1 : 0;
+	return sess_set && g_hash_table_contains (sess_set, sess);
 }
 
-session *
-find_dialog (server *serv, char *nick)
+/* Channels and dialogs are indexed per server by their name folded with the
+ * server's casemapping, so this has to agree with serv->p_cmp. */
+static void
+session_index_key (server *serv, const char *name, char *key, size_t keylen)
 {
-	GSList *list = sess_list;
-	session *sess;
+	gboolean rfc = (serv->p_cmp == rfc_casecmp);
+	size_t i;
 
-	while (list)
+	for (i = 0; name[i] && i < keylen - 1; i++)
+		key[i] = rfc ? rfc_tolower (name[i]) : g_ascii_tolower (name[i]);
+	key[i] = 0;
+}
+
+static GHashTable *
+session_index_table (server *serv, int type, gboolean create)
+{
+	GHashTable **table;
+
+	switch (type)
 	{
-		sess = list->data;
-		if (sess->server == serv && sess->type == SESS_DIALOG)
+	case SESS_CHANNEL:
+		table = &serv->channel_index;
+		break;
+	case SESS_DIALOG:
+		table = &serv->dialog_index;
+		break;
+	default:
+		return NULL;
+	}
+
+	if (!*table && create)
+		*table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return *table;
+}
+
+static void
+session_index_add (session *sess, gboolean replace)
+{
+	GHashTable *table;
+	char key[CHANLEN];
+
+	if (!sess->channel[0])
+		return;
+
+	table = session_index_table (sess->server, sess->type, TRUE);
+	if (!table)
+		return;
+
+	session_index_key (sess->server, sess->channel, key, sizeof (key));
+	if (replace || !g_hash_table_contains (table, key))
+		g_hash_table_insert (table, g_strdup (key), sess);
+}
+
+static void
+session_index_remove (session *sess)
+{
+	server *serv = sess->server;
+	GHashTable *table;
+	GSList *list;
+	session *other;
+	char key[CHANLEN];
+
+	table = session_index_table (serv, sess->type, FALSE);
+	if (!table || !sess->channel[0])
+		return;
+
+	session_index_key (serv, sess->channel, key, sizeof (key));
+	if (g_hash_table_lookup (table, key) != sess)
+		return;
+	g_hash_table_remove (table, key);
+
+	/* another tab with the same name takes its place */
+	for (list = sess_list; list; list = list->next)
+	{
+		other = list->data;
+		if (other != sess && other->server == serv && other->type == sess->type &&
+			 !serv->p_cmp (other->channel, sess->channel))
 		{
-			if (!serv->p_cmp (nick, sess->channel))
-				return (sess);
+			session_index_add (other, TRUE);
+			break;
 		}
-		list = list->next;
 	}
-	return NULL;
 }
 
-session *
-find_channel (server *serv, char *chan)
+/* call when serv->p_cmp changes, e.g. on CASEMAPPING */
+void
+session_index_rebuild (server *serv)
 {
+	GSList *list;
 	session *sess;
-	GSList *list = sess_list;
-	while (list)
+
+	g_clear_pointer (&serv->channel_index, g_hash_table_destroy);
+	g_clear_pointer (&serv->dialog_index, g_hash_table_destroy);
+
+	/* sess_list is newest first, and the newest tab wins, like find_channel () */
+	for (list = sess_list; list; list = list->next)
 	{
 		sess = list->data;
-		if ((serv == sess->server) && sess->type == SESS_CHANNEL)
+		if (sess->server == serv)
+			session_index_add (sess, FALSE);
+	}
+}
+
+/* sess->channel of channel and dialog tabs must only be changed through here */
+void
+session_set_channel (session *sess, const char *name)
+{
+	session_index_remove (sess);
+	safe_strcpy (sess->channel, name, CHANLEN);
+	session_index_add (sess, TRUE);
+}
+
+static session *
+session_index_find (server *serv, int type, const char *name)
+{
+	GHashTable *table;
+	session *sess;
+	GSList *list;
+	char key[CHANLEN];
+
+	/* only "<none>" tabs have no name, they aren't indexed */
+	if (!name[0])
+	{
+		for (list = sess_list; list; list = list->next)
 		{
-			if (!serv->p_cmp (chan, sess->channel))
+			sess = list->data;
+			if (sess->server == serv && sess->type == type && !sess->channel[0])
 				return sess;
 		}
-		list = list->next;
+		return NULL;
 	}
-	return NULL;
+
+	table = session_index_table (serv, type, FALSE);
+	if (!table)
+		return NULL;
+
+	session_index_key (serv, name, key, sizeof (key));
+	sess = g_hash_table_lookup (table, key);
+
+	/* the key is truncated for overlong names, so confirm the hit */
+	if (sess && serv->p_cmp (name, sess->channel))
+		return NULL;
+
+	return sess;
+}
+
+session *
+find_dialog (server *serv, char *nick)
+{
+	return session_index_find (serv, SESS_DIALOG, nick);
+}
+
+session *
+find_channel (server *serv, char *chan)
+{
+	return session_index_find (serv, SESS_CHANNEL, chan);
 }
 
 static void
@@ -626,6 +751,11 @@ session_new (server *serv, char *from, int type, int focus)
 
 	sess_list = g_slist_prepend (sess_list, sess);
 
+	if (!sess_set)
+		sess_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_hash_table_add (sess_set, sess);
+	session_index_add (sess, TRUE);
+
 	fe_new_window (sess, focus);
 
 	return sess;
@@ -670,8 +800,8 @@ new_ircwindow (server *serv, char *name, int type, int focus)
 		log_open_or_close (sess);
 
 		user = userlist_find_global (serv, name);
-		if (user && user->hostname)
-			set_topic (sess, user->hostname, user->hostname);
+		if (user && user->info->hostname)
+			set_topic (sess, user->info->hostname, user->info->hostname);
 	}
 	plugin_emit_dummy_print (sess, "Open Context");
 
@@ -781,6 +911,8 @@ session_free (session *killsess)
 		killserv->server_session = killserv->front_session;
 
 	sess_list = g_slist_remove (sess_list, killsess);
+	g_hash_table_remove (sess_set, killsess);
+	session_index_remove (killsess);
 
 	if (killsess->type == SESS_CHANNEL)
 		userlist_free (killsess);
@@ -1135,6 +1267,7 @@ zoitechat_exit (void)
 	sound_save ();
 	notify_save ();
 	ignore_save ();
+	url_log_close ();
 	sts_cleanup ();
 	free_sessions ();
 	chanopt_save_all (TRUE);
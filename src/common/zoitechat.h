@@ -43,6 +43,7 @@ void zoitechat_run_theme_post_apply_callback (void);
 
 #include "history.h"
 #include "tree.h"
+#include "connector.h"
 
 #ifdef USE_OPENSSL
 #include <openssl/ssl.h>
@@ -71,7 +72,6 @@ void zoitechat_run_theme_post_apply_callback (void);
 #ifndef S_ISDIR
 #define	S_ISDIR(m)	((m) & _S_IFDIR)
 #endif
-#define NETWORK_PRIVATE
 #else
 #define OFLAGS 0
 #endif
@@ -114,6 +114,7 @@ struct zoitechatprefs
 	unsigned int hex_dcc_auto_resume;
 	unsigned int hex_dcc_fast_send;
 	unsigned int hex_dcc_ip_from_server;
+	unsigned int hex_dcc_preallocate;
 	unsigned int hex_dcc_remove;
 	unsigned int hex_dcc_save_nick;
 	unsigned int hex_dcc_send_fillspaces;
@@ -235,6 +236,7 @@ struct zoitechatprefs
 	int hex_away_timeout;
 	int hex_completion_amount;
 	int hex_completion_sort;
+	int hex_dcc_ack_interval;
 	int hex_dcc_auto_recv;
 	int hex_dcc_blocksize;
 	int hex_dcc_global_max_get_cps;
@@ -244,6 +246,7 @@ struct zoitechatprefs
 	int hex_dcc_permissions;
 	int hex_dcc_port_first;
 	int hex_dcc_port_last;
+	int hex_dcc_recv_bufsize;
 	int hex_dcc_stall_timeout;
 	int hex_dcc_timeout;
 	int hex_flood_ctcp_num;				/* flood */
@@ -301,6 +304,7 @@ struct zoitechatprefs
 	int hex_net_proxy_type;				/* 0=disabled, 1=wingate 2=socks4, 3=socks5, 4=http */
 	int hex_net_proxy_use;				/* 0=all 1=IRC_ONLY 2=DCC_ONLY */
 	int hex_net_reconnect_delay;
+	int hex_net_reconnect_max;			/* servers reconnecting at once, 0=no limit */
 	int hex_notify_timeout;
 	int hex_text_max_indent;
 	int hex_text_max_lines;
@@ -413,6 +417,7 @@ typedef struct session
 
 	struct server *server;
 	tree *usertree;					/* alphabetical tree */
+	GPtrArray *names_queue;			/* NAMES replies held until the 366, see userlist.c */
 	struct User *me;					/* points to myself in the usertree */
 	char channel[CHANLEN];
 	char waitchannel[CHANLEN];		  /* waiting to join channel (/join sent) */
@@ -422,7 +427,7 @@ typedef struct session
 	int limit;						  /* channel user limit */
 	int logfd;
 
-	GFile *scrollfile;							/* scrollback file */
+	struct scrollback *scrollback;		/* scrollback files, see text.c */
 	int scrollwritten;					/* number of lines written */
 
 	char lastnick[NICKLEN];			  /* last nick you /msg'ed */
@@ -525,13 +530,7 @@ typedef struct server
 	int (*p_cmp)(const char *s1, const char *s2);
 
 	int port;
-	int sok;					/* is equal to sok4 or sok6 (the one we are using) */
-	int sok4;					/* tcp4 socket */
-	int sok6;					/* tcp6 socket */
-	int proxy_type;
-	int proxy_sok;				/* Additional information for MS Proxy beast */
-	int proxy_sok4;
-	int proxy_sok6;
+	int sok;
 	int id;					/* unique ID number (for plugin API) */
 
 	/* dcc_ip moved from zoitechatprefs to make it per-server */
@@ -544,11 +543,9 @@ typedef struct server
 #else
 	void *ssl;
 #endif
-	int childread;
-	int childwrite;
-	int childpid;
+	struct connector *connector;	/* while connecting, see connector.h */
+	gint64 connect_times[CONNECTOR_PHASES];	/* microseconds per connector_phase */
 	int iotag;
-	int recondelay_tag;				/* reconnect delay timeout */
 	int joindelay_tag;				/* waiting before we send JOIN */
 	char hostname[128];				/* real ip number */
 	char servername[128];			/* what the server says is its name */
@@ -558,6 +555,8 @@ typedef struct server
 	char linebuf[8704];				/* RFC says 512 chars including \r\n, IRCv3 message tags add 8191, plus the NUL byte */
 	char *last_away_reason;
 	int pos;								/* current position in linebuf */
+	char *pdibuf;						/* irc_inline ()'s word buffer, reused */
+	int pdibuf_size;
 	int nickcount;
 	int loginmethod;					/* see login_types[] */
 
@@ -571,10 +570,11 @@ typedef struct server
 
 	void *network;						/* points to entry in servlist.c or NULL! */
 
-	GSList *outbound_queue;
+	GQueue outbound_queue[3];			/* one per priority, 2 is sent first */
 	time_t next_send;						/* cptr->since in ircu */
 	time_t prev_now;					/* previous now-time */
 	int sendq_len;						/* queue size */
+	int sendq_bytes[3];				/* queue size per priority */
 	int lag;								/* milliseconds */
 
 	struct session *front_session;	/* front-most window/tab */
@@ -599,6 +599,13 @@ typedef struct server
 
 	GSList *favlist;			/* list of channels & keys to join */
 
+	GHashTable *channel_index;	/* casemapped name -> channel session, see find_channel () */
+	GHashTable *dialog_index;	/* casemapped nick -> dialog session, see find_dialog () */
+	GHashTable *user_index;		/* casemapped nick -> struct user_info, see userlist.c */
+	GHashTable *notify_index;	/* casemapped nick -> struct notify_per_server, see notify.c */
+	GQueue *notify_ison;			/* ISON lines still waiting for their 303 */
+	int watch_limit;				/* MONITOR= or WATCH= from 005, 0 if not given */
+
 	unsigned int motd_skipped:1;
 	unsigned int connected:1;
 	unsigned int connecting:1;
@@ -633,6 +640,8 @@ typedef struct server
 	unsigned int sts_duration_seen:1;
 	unsigned int sts_upgrade_in_progress:1;
 	unsigned int have_cert:1;	/* have loaded a cert */
+	unsigned int encoding_ascii:1;	/* encoding leaves ASCII as it is */
+	unsigned int pdibuf_busy:1;	/* pdibuf in use by irc_inline () */
 	unsigned int use_who:1;			/* whether to use WHO command to get dcc_ip */
 	unsigned int sasl_mech;			/* mechanism for sasl auth */
 	unsigned int sent_capend:1;	/* have sent CAP END yet */
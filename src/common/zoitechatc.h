@@ -49,6 +49,8 @@ extern GList *sess_list_by_lastact[];
 
 session * find_channel (server *serv, char *chan);
 session * find_dialog (server *serv, char *nick);
+void session_set_channel (session *sess, const char *name);
+void session_index_rebuild (server *serv);
 session * new_ircwindow (server *serv, char *name, int type, int focus);
 void zoitechat_reinit_timers (void);
 void lastact_update (session * sess);
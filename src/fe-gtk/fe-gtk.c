@@ -899,6 +899,33 @@ fe_text_clear (struct session *sess, int lines)
 	gtk_xtext_clear (sess->res->buffer, lines);
 }
 
+char *
+fe_text_memory (struct session *sess)
+{
+	xtext_buffer_memory mem;
+
+	gtk_xtext_buffer_get_memory (sess->res->buffer, &mem);
+	return g_strdup_printf ("%-6u %-9" G_GSIZE_FORMAT " %-9" G_GSIZE_FORMAT " %-9" G_GSIZE_FORMAT
+									" %-9" G_GSIZE_FORMAT " %" G_GSIZE_FORMAT,
+									mem.entries, mem.text_bytes, mem.arena_bytes,
+									mem.line_bytes, mem.index_bytes, mem.search_bytes);
+}
+
+char *
+fe_text_render_stats (struct session *sess)
+{
+	const xtext_render_stats *stats;
+
+	if (!sess->res->buffer->xtext)
+		return NULL;
+
+	stats = gtk_xtext_get_render_stats (sess->res->buffer->xtext);
+	return g_strdup_printf ("%-9" G_GUINT64_FORMAT " %-9" G_GUINT64_FORMAT " %-9" G_GUINT64_FORMAT
+									" %" G_GINT64_FORMAT,
+									stats->frames, stats->coalesced, stats->dropped,
+									stats->draw_usec / 1000);
+}
+
 void
 fe_close_window (struct session *sess)
 {
@@ -958,6 +985,22 @@ fe_print_text (struct session *sess, char *text, time_t stamp,
 		fe_set_tab_color (sess, FE_COLOR_NEW_DATA);
 }
 
+/* scrollback replay: print a run of lines in one go, older ones on top,
+   newest first. Returns how many of those the buffer had room for, or -1
+   when a batch at the bottom kept them all. */
+
+void
+fe_print_text_batch_start (struct session *sess, gboolean older)
+{
+	gtk_xtext_batch_begin (sess->res->buffer, older);
+}
+
+int
+fe_print_text_batch_end (struct session *sess)
+{
+	return gtk_xtext_batch_end (sess->res->buffer);
+}
+
 void
 fe_beep (session *sess)
 {
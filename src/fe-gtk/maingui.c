@@ -974,7 +974,14 @@ mg_inputbox_cb (GtkWidget *igad, session_gui *gui)
         }
 
         if (sess)
+        {
+                GtkWidget *xtext = g_object_ref (gui->xtext);
+
                 mg_send_reply_or_text (sess, cmd);
+                /* show what we just sent without waiting for the next frame */
+                gtk_xtext_render_flush (GTK_XTEXT (xtext));
+                g_object_unref (xtext);
+        }
 
         g_free (cmd);
 }
@@ -1797,7 +1804,7 @@ mg_populate (session *sess)
         gtk_widget_set_sensitive (gui->menu_item[MENU_ID_AWAY], sess->server->connected);
         gtk_widget_set_sensitive (gui->menu_item[MENU_ID_JOIN], sess->server->end_of_motd);
         gtk_widget_set_sensitive (gui->menu_item[MENU_ID_DISCONNECT],
-                                                                          sess->server->connected || sess->server->recondelay_tag);
+                                                                          sess->server->connected || server_reconnect_pending (sess->server));
 
         mg_set_topic_tip (sess);
 
@@ -3668,6 +3675,25 @@ mg_word_check (GtkWidget * xtext, char *word)
         return ret;
 }
 
+/* scrolled to the top of a tab, show older scrollback if there is any */
+
+static void
+mg_xtext_top (GtkXText *xtext, xtext_buffer *buf)
+{
+        GSList *list;
+        session *sess;
+
+        for (list = sess_list; list; list = list->next)
+        {
+                sess = list->data;
+                if (sess->res->buffer == buf)
+                {
+                        scrollback_load_older (sess);
+                        return;
+                }
+        }
+}
+
 /* mouse click inside text area */
 
 static void
@@ -3817,6 +3843,7 @@ mg_create_textarea (session *sess, GtkWidget *box)
         gtk_xtext_set_max_indent (xtext, prefs.hex_text_max_indent);
         gtk_xtext_set_thin_separator (xtext, prefs.hex_text_thin_sep);
         gtk_xtext_set_urlcheck_function (xtext, mg_word_check);
+        gtk_xtext_set_top_function (xtext, mg_xtext_top);
         gtk_xtext_set_max_lines (xtext, prefs.hex_text_max_lines);
         gtk_container_add (GTK_CONTAINER (frame), GTK_WIDGET (xtext));
 
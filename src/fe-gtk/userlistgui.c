@@ -215,11 +215,14 @@ scroll_to_iter (GtkTreeIter *iter, GtkTreeView *treeview, GtkTreeModel *model)
 	}
 }
 
+/* GtkListStore iters stay valid until their row is removed, and every
+ * removal drops the user from this map first, so plain iters are kept
+ * rather than row references, which cost O(rows) on each insert */
 static GHashTable *
 userlist_row_map_ensure (session *sess)
 {
 	if (!sess->res->user_row_refs)
-		sess->res->user_row_refs = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) gtk_tree_row_reference_free);
+		sess->res->user_row_refs = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) gtk_tree_iter_free);
 
 	return sess->res->user_row_refs;
 }
@@ -236,50 +239,23 @@ userlist_row_map_remove (session *sess, struct User *user)
 static void
 userlist_row_map_set (session *sess, GtkTreeModel *model, struct User *user, GtkTreeIter *iter)
 {
-	GtkTreePath *path;
-	GtkTreeRowReference *ref;
-
-	path = gtk_tree_model_get_path (model, iter);
-	if (!path)
-		return;
-
-	ref = gtk_tree_row_reference_new (model, path);
-	gtk_tree_path_free (path);
-	if (!ref)
-		return;
-
-	g_hash_table_replace (userlist_row_map_ensure (sess), user, ref);
+	g_hash_table_replace (userlist_row_map_ensure (sess), user, gtk_tree_iter_copy (iter));
 }
 
 static gboolean
 userlist_row_map_get_iter (session *sess, GtkTreeModel *model, struct User *user, GtkTreeIter *iter)
 {
-	GtkTreeRowReference *ref;
-	GtkTreePath *path;
+	GtkTreeIter *stored;
 	struct User *row_user;
 
 	if (!sess->res->user_row_refs)
 		return FALSE;
 
-	ref = g_hash_table_lookup (sess->res->user_row_refs, user);
-	if (!ref)
+	stored = g_hash_table_lookup (sess->res->user_row_refs, user);
+	if (!stored)
 		return FALSE;
 
-	path = gtk_tree_row_reference_get_path (ref);
-	if (!path)
-	{
-		g_hash_table_remove (sess->res->user_row_refs, user);
-		return FALSE;
-	}
-
-	if (!gtk_tree_model_get_iter (model, iter, path))
-	{
-		gtk_tree_path_free (path);
-		g_hash_table_remove (sess->res->user_row_refs, user);
-		return FALSE;
-	}
-	gtk_tree_path_free (path);
-
+	*iter = *stored;
 	gtk_tree_model_get (model, iter, COL_USER, &row_user, -1);
 	if (row_user != user)
 	{
@@ -589,7 +565,7 @@ fe_userlist_rehash (session *sess, struct User *user)
 		return;
 	userlist_row_map_set (sess, GTK_TREE_MODEL (sess->res->user_model), user, iter);
 
-	if (prefs.hex_away_track && user->away)
+	if (prefs.hex_away_track && user->info->away)
 	{
 		nick_token = THEME_TOKEN_TAB_AWAY;
 		have_nick_token = TRUE;
@@ -609,19 +585,19 @@ fe_userlist_rehash (session *sess, struct User *user)
 		char *nick = userlist_nick_markup (sess, user);
 		gtk_list_store_set (GTK_LIST_STORE (sess->res->user_model), iter,
 							  COL_NICK, nick,
-							  COL_HOST, user->hostname,
+							  COL_HOST, user->info->hostname,
 							  -1);
 		g_free (nick);
 	}
 	userlist_store_color (GTK_LIST_STORE (sess->res->user_model), iter, nick_token, have_nick_token);
 }
 
-void
-fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
+/* add one row at 'position' and remember it; returns the row's icon */
+static GdkPixbuf *
+userlist_insert_row (session *sess, struct User *newuser, int position, GtkTreeIter *iter)
 {
 	GtkTreeModel *model = GTK_TREE_MODEL(sess->res->user_model);
 	GdkPixbuf *pix = get_user_icon (sess->server, newuser);
-	GtkTreeIter iter;
 	char *nick;
 	char *prefix = NULL;
 	char *prefix_escaped;
@@ -630,7 +606,7 @@ fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
 	ThemeSemanticToken nick_token = THEME_TOKEN_TEXT_FOREGROUND;
 	gboolean have_nick_token = FALSE;
 
-	if (prefs.hex_away_track && newuser->away)
+	if (prefs.hex_away_track && newuser->info->away)
 	{
 		nick_token = THEME_TOKEN_TAB_AWAY;
 		have_nick_token = TRUE;
@@ -664,19 +640,31 @@ fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
 		pix = NULL;
 	}
 
-	gtk_list_store_insert_with_values (GTK_LIST_STORE (model), &iter, 0,
+	gtk_list_store_insert_with_values (GTK_LIST_STORE (model), iter, position,
 									COL_PIX, pix,
 									COL_PREFIX, prefix,
 									COL_NICK, nick,
-									COL_HOST, newuser->hostname,
+									COL_HOST, newuser->info->hostname,
 									COL_USER, newuser,
 								  -1);
-	userlist_store_color (GTK_LIST_STORE (model), &iter, nick_token, have_nick_token);
+	userlist_store_color (GTK_LIST_STORE (model), iter, nick_token, have_nick_token);
 
 	g_free (prefix);
 	g_free (nick);
 
-	userlist_row_map_set (sess, model, newuser, &iter);
+	userlist_row_map_set (sess, model, newuser, iter);
+
+	return pix;
+}
+
+void
+fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(sess->res->user_model);
+	GdkPixbuf *pix;
+	GtkTreeIter iter;
+
+	pix = userlist_insert_row (sess, newuser, 0, &iter);
 
 	/* is it me? */
 	if (newuser->me && sess->gui->nick_box)
@@ -695,6 +683,51 @@ fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
 	}
 }
 
+/* a whole NAMES reply at once: fill the model while no view is watching
+ * it and with sorting off, then sort it in one go */
+void
+fe_userlist_insert_batch (session *sess, struct User **users, int count)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(sess->res->user_model);
+	GtkTreeView *treeview = GTK_TREE_VIEW (sess->gui->user_tree);
+	GtkTreeSortable *sortable = GTK_TREE_SORTABLE (model);
+	gboolean shown;
+	GtkSortType order;
+	GdkPixbuf *pix;
+	GtkTreeIter iter;
+	int sort_id;
+	int i;
+
+	if (count < 1)
+		return;
+
+	shown = gtk_tree_view_get_model (treeview) == model;
+	if (shown)
+		gtk_tree_view_set_model (treeview, NULL);
+
+	gtk_tree_sortable_get_sort_column_id (sortable, &sort_id, &order);
+	gtk_tree_sortable_set_sort_column_id (sortable,
+						GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
+
+	for (i = 0; i < count; i++)
+	{
+		pix = userlist_insert_row (sess, users[i], -1, &iter);
+
+		/* is it me? */
+		if (users[i]->me && sess->gui->nick_box)
+		{
+			if (!sess->gui->is_tab || sess == current_tab)
+				mg_set_access_icon (sess->gui, pix, sess->server->is_away);
+		}
+	}
+
+	if (sort_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID)
+		gtk_tree_sortable_set_sort_column_id (sortable, sort_id, order);
+
+	if (shown)
+		gtk_tree_view_set_model (treeview, model);
+}
+
 void
 fe_userlist_clear (session *sess)
 {
@@ -73,6 +73,56 @@
 /* force scrolling off */
 #define dontscroll(buf) (buf)->last_pixel_pos = 0x7fffffff
 
+/* For use by gtk_xtext_strip_color() and its callers -- */
+struct offlen_s {
+	guint16 off;
+	guint16 len;
+	guint16 emph;
+	guint16 width;
+};
+typedef struct offlen_s offlen_t;
+
+/* textentries and their text are cut from big chunks, see
+ * gtk_xtext_entry_new (). Lines leave a buffer from the top, so a chunk
+ * empties out as a whole and goes back in one free. */
+#define XTEXT_CHUNK_SIZE 65536
+
+struct xtext_chunk
+{
+	gsize size;		/* bytes after this header */
+	gsize used;
+	gsize live;		/* entries in it not yet freed */
+};
+
+/* what searches look at: the text without attributes, casefolded for
+ * caseless searches, with the runs it was cut from. Kept with the entry
+ * until the search is reset, see gtk_xtext_search_textentry (). */
+#define SHADOW_FOLD 1
+#define SHADOW_HIDDEN 2
+
+typedef struct xtext_shadow
+{
+	int len;
+	guint16 kind;			/* SHADOW_* it was made for */
+	guint16 run_count;
+} xtext_shadow;
+
+#define SHADOW_RUNS(sh) ((offlen_t *)((sh) + 1))
+#define SHADOW_TEXT(sh) ((gchar *)(SHADOW_RUNS (sh) + (sh)->run_count))
+#define SHADOW_SIZE(sh) (sizeof (xtext_shadow) + (sh)->run_count * sizeof (offlen_t) + (sh)->len + 1)
+
+/* how long a search or lastlog keeps the main loop before yielding */
+#define XTEXT_SEARCH_SLICE 8000	/* usec */
+
+struct xtext_lastlog
+{
+	xtext_buffer *out;
+	xtext_buffer *src;
+	textentry *pos;		/* next entry of src to look at */
+	guint tag;
+	int matches;
+};
+
 struct textentry
 {
 	struct textentry *next;
@@ -85,13 +135,15 @@ struct textentry
 	gint16 mark_end;
 	gint16 indent;
 	gint16 left_len;
-	GSList *slp;
-	GSList *sublines;
+	offlen_t *runs;		/* runs of same emphasis, with their widths */
+	guint16 *sublines;	/* where each wrapped line ends, NULL if it doesn't wrap */
 	int subline_count;
+	guint16 run_count;
 	guchar tag;
 	guchar pad1;
-	guchar pad2;
 	GList *marks;	/* List of found strings */
+	xtext_shadow *shadow;
+	xtext_chunk *chunk;	/* where this entry lives */
 };
 
 enum
@@ -190,25 +242,18 @@ static void gtk_xtext_recalc_widths (xtext_buffer *buf, int);
 static void gtk_xtext_fix_indent (xtext_buffer *buf);
 static int gtk_xtext_find_subline (GtkXText *xtext, textentry *ent, int line);
 /* static char *gtk_xtext_conv_color (unsigned char *text, int len, int *newlen); */
-/* For use by gtk_xtext_strip_color() and its callers -- */
-struct offlen_s {
-	guint16 off;
-	guint16 len;
-	guint16 emph;
-	guint16 width;
-};
-typedef struct offlen_s offlen_t;
 static unsigned char *
 gtk_xtext_strip_color (unsigned char *text, int len, unsigned char *outbuf,
 							  int *newlen, GSList **slp, int strip_hidden);
 static gboolean gtk_xtext_check_ent_visibility (GtkXText * xtext, textentry *find_ent, int add);
 static int gtk_xtext_render_page_timeout (GtkXText * xtext);
 static int gtk_xtext_search_offset (xtext_buffer *buf, textentry *ent, unsigned int off);
-static GList * gtk_xtext_search_textentry (xtext_buffer *, textentry *);
+static GList * gtk_xtext_search_textentry (xtext_buffer *, textentry *, gboolean);
 static void gtk_xtext_search_textentry_add (xtext_buffer *, textentry *, GList *, gboolean);
 static void gtk_xtext_search_textentry_del (xtext_buffer *, textentry *);
 static void gtk_xtext_search_textentry_fini (gpointer, gpointer);
 static void gtk_xtext_search_fini (xtext_buffer *);
+static void gtk_xtext_lastlog_stop (xtext_lastlog *job);
 static gboolean gtk_xtext_search_init (xtext_buffer *buf, const gchar *text, gtk_xtext_search_flags flags, GError **perr);
 static char * gtk_xtext_get_word (GtkXText * xtext, int x, int y, textentry ** ret_ent, int *ret_off, int *ret_len, GSList **slp);
 static gboolean gtk_xtext_word_select_char (const unsigned char *ch);
@@ -782,6 +827,7 @@ gtk_xtext_init (GtkXText * xtext)
 	xtext->render_cycle = 0;
 	xtext->io_tag = 0;
 	xtext->add_io_tag = 0;
+	xtext->render_tick = 0;
 	xtext->scroll_tag = 0;
 	xtext->max_lines = 0;
 	xtext->col_back = XTEXT_BG;
@@ -859,6 +905,24 @@ gtk_xtext_adjustment_set (xtext_buffer *buf, int fire_signal)
 	}
 }
 
+/* the view is at the top, let the owner add older text (once idle) */
+
+static gint
+gtk_xtext_top_timeout (GtkXText * xtext)
+{
+	xtext->top_tag = 0;
+	if (xtext->top_function)
+		xtext->top_function (xtext, xtext->buffer);
+	return 0;
+}
+
+static void
+gtk_xtext_queue_top (GtkXText * xtext)
+{
+	if (xtext->top_function && !xtext->top_tag)
+		xtext->top_tag = g_idle_add ((GSourceFunc) gtk_xtext_top_timeout, xtext);
+}
+
 static gint
 gtk_xtext_adjustment_timeout (GtkXText * xtext)
 {
@@ -884,6 +948,9 @@ gtk_xtext_adjustment_changed (GtkAdjustment * adj, GtkXText * xtext)
 		else
 			xtext->buffer->scrollbar_down = FALSE;
 
+		if (value <= 0)
+			gtk_xtext_queue_top (xtext);
+
 		if (value + 1 == xtext->buffer->old_value ||
 			 value - 1 == xtext->buffer->old_value)	/* clicked an arrow? */
 		{
@@ -1004,6 +1071,18 @@ gtk_xtext_cleanup (GtkXText *xtext)
 		xtext->io_tag = 0;
 	}
 
+	if (xtext->top_tag)
+	{
+		g_source_remove (xtext->top_tag);
+		xtext->top_tag = 0;
+	}
+
+	if (xtext->render_tick)
+	{
+		gtk_widget_remove_tick_callback (GTK_WIDGET (xtext), xtext->render_tick);
+		xtext->render_tick = 0;
+	}
+
 	if (xtext->background_surface)
 	{
 		cairo_surface_destroy (xtext->background_surface);
@@ -1341,23 +1420,34 @@ gtk_xtext_selection_clear (xtext_buffer *buf)
 	return ret;
 }
 
+/* offset where wrapped line 'n' of 'ent' ends */
+
+static int
+gtk_xtext_subline_end (textentry *ent, int n)
+{
+	if (ent->sublines)
+		return n < ent->subline_count ? ent->sublines[n] : 0;
+	/* single liners and entries not laid out yet keep no array */
+	return (n == 0 && ent->str_width >= 0) ? ent->str_len : 0;
+}
+
 static int
 find_x (GtkXText *xtext, textentry *ent, int x, int subline, int indent)
 {
 	int xx = indent;
 	int suboff;
-	GSList *list;
-	GSList *hid = NULL;
+	int run;
+	int hid = -1;
 	offlen_t *meta;
 	int off, len, wid, mbl, mbw;
 
 	/* Skip to the first chunk of stuff for the subline */
 	if (subline > 0)
 	{
-		suboff = GPOINTER_TO_INT (g_slist_nth_data (ent->sublines, subline - 1));
-		for (list = ent->slp; list; list = g_slist_next (list))
+		suboff = gtk_xtext_subline_end (ent, subline - 1);
+		for (run = 0; run < ent->run_count; run++)
 		{
-			meta = list->data;
+			meta = &ent->runs[run];
 			if (meta->off + meta->len > suboff)
 				break;
 		}
@@ -1365,16 +1455,16 @@ find_x (GtkXText *xtext, textentry *ent, int x, int subline, int indent)
 	else
 	{
 		suboff = 0;
-		list = ent->slp;
+		run = 0;
 	} 
 	/* Step to the first character of the subline */
-	if (list == NULL)
+	if (run >= ent->run_count)
 		return 0;
-	meta = list->data;
+	meta = &ent->runs[run];
 	off = meta->off;
 	len = meta->len;
 	if (meta->emph & EMPH_HIDDEN)
-		hid = list;
+		hid = run;
 	while (len > 0)
 	{
 		if (off >= suboff)
@@ -1402,20 +1492,19 @@ find_x (GtkXText *xtext, textentry *ent, int x, int subline, int indent)
 		if (len <= 0)
 		{
 			if (meta->emph & EMPH_HIDDEN)
-				hid = list;
-			list = g_slist_next (list);
-			if (list == NULL)
+				hid = run;
+			if (++run >= ent->run_count)
 				return ent->str_len;
-			meta = list->data;
+			meta = &ent->runs[run];
 			off = meta->off;
 			len = meta->len;
 		}
 	}
 
 	/* If previous chunk exists and is marked hidden, regard it as unhidden */
-	if (hid && list && hid->next == list)
+	if (hid >= 0 && hid + 1 == run)
 	{
-		meta = hid->data;
+		meta = &ent->runs[hid];
 		off = meta->off;
 	}
 
@@ -1676,7 +1765,10 @@ gtk_xtext_paint (GtkWidget *widget, GdkRectangle *area)
 static gboolean
 gtk_xtext_draw (GtkWidget *widget, cairo_t *cr)
 {
+	GtkXText *xtext = GTK_XTEXT (widget);
+	GdkFrameClock *clock;
 	GdkRectangle area;
+	gint64 start, took, interval = 0;
 
 	if (!gdk_cairo_get_clip_rectangle (cr, &area))
 	{
@@ -1689,7 +1781,19 @@ gtk_xtext_draw (GtkWidget *widget, cairo_t *cr)
 		area.height = allocation.height;
 	}
 
+	start = g_get_monotonic_time ();
 	gtk_xtext_render (widget, &area, cr);
+	took = g_get_monotonic_time () - start;
+
+	/* a draw longer than the refresh interval costs frames */
+	xtext->render_stats.draw_usec += took;
+	clock = gtk_widget_get_frame_clock (widget);
+	if (clock)
+		gdk_frame_clock_get_refresh_info (clock, gdk_frame_clock_get_frame_time (clock),
+													 &interval, NULL);
+	if (interval > 0 && took > interval)
+		xtext->render_stats.dropped += took / interval;
+
 	return FALSE;
 }
 
@@ -3011,6 +3115,10 @@ gtk_xtext_scroll (GtkWidget *widget, GdkEventScroll *event)
 
 	if (direction < 0)
 	{
+		/* already at the top, nothing for the adjustment to report */
+		if (xtext_adj_get_value (xtext->adj) <= xtext_adj_get_lower (xtext->adj))
+			gtk_xtext_queue_top (xtext);
+
 		new_value = xtext_adj_get_value (xtext->adj) -
 			step;
 		if (new_value < xtext_adj_get_lower (xtext->adj))
@@ -3252,29 +3360,31 @@ bad_utf8:		/* Normal ending sequence, and give up if bad utf8 */
 static int
 gtk_xtext_text_width_ent (GtkXText *xtext, textentry *ent)
 {
-	unsigned char *new_buf;
 	GSList *slp0, *slp;
+	offlen_t *meta;
 	int width;
 
-	if (ent->slp)
-	{
-		g_slist_free_full (ent->slp, g_free);
-		ent->slp = NULL;
-	}
+	g_free (ent->runs);
+	ent->runs = NULL;
+	ent->run_count = 0;
 
-	new_buf = gtk_xtext_strip_color (ent->str, ent->str_len, xtext->scratch_buffer,
-												NULL, &slp0, 2);
+	gtk_xtext_strip_color (ent->str, ent->str_len, xtext->scratch_buffer,
+								  NULL, &slp0, 2);
 
-	width =  backend_get_text_width_slp (xtext, new_buf, slp0);
-	ent->slp = slp0;
+	/* kept as one array for the life of the entry, not a list of nodes */
+	if (slp0)
+		ent->runs = g_new (offlen_t, g_slist_length (slp0));
 
+	/* the runs are the stripped text, so their widths add up to its width */
+	width = 0;
 	for (slp = slp0; slp; slp = g_slist_next (slp))
 	{
-		offlen_t *meta;
-
-		meta = slp->data;
+		meta = &ent->runs[ent->run_count++];
+		*meta = *(offlen_t *)slp->data;
 		meta->width = backend_get_text_width_emph (xtext, ent->str + meta->off, meta->len, meta->emph);
+		width += meta->width;
 	}
+	g_slist_free_full (slp0, g_free);
 	return width;
 }
 
@@ -3357,37 +3467,27 @@ dounder:
 }
 
 static int
-gtk_xtext_lookup_run_width (textentry *ent, GSList **slp_cache, int off, int len, int emphasis)
+gtk_xtext_lookup_run_width (textentry *ent, int *run_cache, int off, int len, int emphasis)
 {
-	GSList *lp;
+	int run;
 	int emph = emphasis & (EMPH_ITAL | EMPH_BOLD);
 
 	if (len < 1)
 		return 0;
 
-	lp = slp_cache ? *slp_cache : NULL;
-	if (!lp)
-		lp = ent->slp;
-
-	while (lp)
-	{
-		offlen_t *meta = lp->data;
-
-		if (meta->off < off)
-		{
-			lp = g_slist_next (lp);
-			continue;
-		}
+	run = run_cache ? *run_cache : 0;
+	if (run >= ent->run_count)
+		run = 0;
 
-		break;
-	}
+	while (run < ent->run_count && ent->runs[run].off < off)
+		run++;
 
-	if (slp_cache)
-		*slp_cache = lp;
+	if (run_cache)
+		*run_cache = run;
 
-	if (lp)
+	if (run < ent->run_count)
 	{
-		offlen_t *meta = lp->data;
+		offlen_t *meta = &ent->runs[run];
 
 		if (meta->off == off && meta->len == len && (meta->emph & (EMPH_ITAL | EMPH_BOLD)) == emph)
 			return meta->width;
@@ -3479,7 +3579,7 @@ gtk_xtext_search_offset (xtext_buffer *buf, textentry *ent, unsigned int off)
 
 /* render a single line, which WONT wrap, and parse mIRC colors */
 
-#define RENDER_FLUSH x += gtk_xtext_render_flush (xtext, x, y, pstr, j, emphasis, gtk_xtext_lookup_run_width (ent, &slp_cache, pstr - ent->str, j, *emphasis))
+#define RENDER_FLUSH x += gtk_xtext_render_flush (xtext, x, y, pstr, j, emphasis, gtk_xtext_lookup_run_width (ent, &run_cache, pstr - ent->str, j, *emphasis))
 
 static int
 gtk_xtext_render_str (GtkXText * xtext, int y, textentry * ent,
@@ -3495,7 +3595,7 @@ gtk_xtext_render_str (GtkXText * xtext, int y, textentry * ent,
 	int k;
 	int srch_underline = FALSE;
 	int srch_mark = FALSE;
-	GSList *slp_cache = ent->slp;
+	int run_cache = 0;
 
 	xtext->in_hilight = FALSE;
 
@@ -3780,7 +3880,7 @@ gtk_xtext_render_str (GtkXText * xtext, int y, textentry * ent,
 		if (xtext->jump_out_offset > 0 && xtext->jump_out_offset <= (i + offset))
 		{
 			gtk_xtext_render_flush (xtext, x, y, pstr, j, emphasis,
-				gtk_xtext_lookup_run_width (ent, &slp_cache, pstr - ent->str, j, *emphasis));
+				gtk_xtext_lookup_run_width (ent, &run_cache, pstr - ent->str, j, *emphasis));
 			ret = 0;	/* skip the rest of the lines, we're done. */
 			j = 0;
 			break;
@@ -3896,7 +3996,9 @@ find_next_wrap (GtkXText * xtext, textentry * ent, unsigned char *str,
 	int ret;
 	int limit_offset = 0;
 	int emphasis = 0;
-	GSList *lp;
+	int i, run;
+	offlen_t *cached;
+	unsigned char *p;
 
 	/* single liners */
 	if (win_width >= ent->str_width + ent->indent)
@@ -3910,9 +4012,9 @@ find_next_wrap (GtkXText * xtext, textentry * ent, unsigned char *str,
 	}
 
 	/* Find emphasis value for the offset that is the first byte of our string */
-	for (lp = ent->slp; lp; lp = g_slist_next (lp))
+	for (i = 0; i < ent->run_count; i++)
 	{
-		offlen_t *meta = lp->data;
+		offlen_t *meta = &ent->runs[i];
 		unsigned char *start, *end;
 
 		start = ent->str + meta->off;
@@ -3924,6 +4026,13 @@ find_next_wrap (GtkXText * xtext, textentry * ent, unsigned char *str,
 		}
 	}
 
+	/* the next run of text that starts at or after str */
+	for (run = 0; run < ent->run_count; run++)
+	{
+		if (ent->str + ent->runs[run].off >= str)
+			break;
+	}
+
 	while (1)
 	{
 		if (rcol > 0 && (isdigit (*str) || (*str == ',' && isdigit (str[1]) && !bgcol)))
@@ -3968,6 +4077,29 @@ find_next_wrap (GtkXText * xtext, textentry * ent, unsigned char *str,
 				break;
 			default:
 			def:
+				/* a whole run that still fits takes its width from the
+				 * measurement cached with the entry */
+				while (run < ent->run_count && ent->str + ent->runs[run].off < str)
+					run++;
+				if (run < ent->run_count && !hidden && ent->str + ent->runs[run].off == str)
+				{
+					cached = &ent->runs[run++];
+					if (!(cached->emph & EMPH_HIDDEN) && str_width + cached->width <= win_width)
+					{
+						for (p = str; p < str + cached->len; p++)
+						{
+							if (is_del (*p))
+							{
+								last_space = p;
+								limit_offset = 0;
+							}
+						}
+						str_width += cached->width;
+						str += cached->len;
+						break;
+					}
+				}
+
 				mbl = charlen (str);
 				char_width = backend_get_text_width_emph (xtext, str, mbl, emphasis);
 				if (!hidden) str_width += char_width;
@@ -4029,7 +4161,7 @@ gtk_xtext_find_subline (GtkXText *xtext, textentry *ent, int line)
 
 	if (line > 0)
 	{
-		rlen = GPOINTER_TO_UINT (g_slist_nth_data (ent->sublines, line - 1));
+		rlen = gtk_xtext_subline_end (ent, line - 1);
 		if (rlen == 0)
 			rlen = ent->str_len;
 	}
@@ -4115,9 +4247,9 @@ gtk_xtext_render_line (GtkXText * xtext, textentry * ent, int line,
 	do
 	{
 		if (entline > 0)
-			len = GPOINTER_TO_INT (g_slist_nth_data (ent->sublines, entline)) - GPOINTER_TO_INT (g_slist_nth_data (ent->sublines, entline - 1));
+			len = gtk_xtext_subline_end (ent, entline) - gtk_xtext_subline_end (ent, entline - 1);
 		else
-			len = GPOINTER_TO_INT (g_slist_nth_data (ent->sublines, entline));
+			len = gtk_xtext_subline_end (ent, entline);
 
 		entline++;
 
@@ -4333,35 +4465,74 @@ gtk_xtext_lines_taken (xtext_buffer *buf, textentry * ent)
 	unsigned char *str;
 	int indent, len;
 	int win_width;
+	GArray *ends;
+	guint16 end;
 
-	g_slist_free (ent->sublines);
+	g_free (ent->sublines);
 	ent->sublines = NULL;
 	ent->subline_count = 0;
 	win_width = buf->window_width - MARGIN;
 
+	/* not measured yet: guess from an average character width */
+	if (ent->str_width < 0)
+	{
+		len = ent->indent + ent->str_len * buf->xtext->space_width;
+		ent->subline_count = 1;
+		if (win_width > 0 && len > win_width)
+			ent->subline_count = (len + win_width - 1) / win_width;
+		return ent->subline_count;
+	}
+
+	/* most lines don't wrap and need no array at all */
 	if (win_width >= ent->indent + ent->str_width)
 	{
-		ent->sublines = g_slist_append (ent->sublines, GINT_TO_POINTER (ent->str_len));
 		ent->subline_count = 1;
 		return ent->subline_count;
 	}
 
 	indent = ent->indent;
 	str = ent->str;
+	ends = g_array_sized_new (FALSE, FALSE, sizeof (guint16), 4);
 
 	do
 	{
 		len = find_next_wrap (buf->xtext, ent, str, win_width, indent);
-		ent->sublines = g_slist_append (ent->sublines, GINT_TO_POINTER (str + len - ent->str));
-		indent = buf->indent;
 		str += len;
+		end = str - ent->str;
+		g_array_append_val (ends, end);
+		indent = buf->indent;
 	}
 	while (str < ent->str + ent->str_len);
 
-	ent->subline_count = g_slist_length (ent->sublines);
+	ent->subline_count = ends->len;
+	ent->sublines = (guint16 *)g_array_free (ends, FALSE);
 	return ent->subline_count;
 }
 
+/* measure and wrap the text appended while the buffer was hidden */
+
+static void
+gtk_xtext_buffer_measure (xtext_buffer *buf)
+{
+	textentry *ent;
+
+	if (!buf->needs_measure)
+		return;
+	buf->needs_measure = FALSE;
+
+	for (ent = buf->text_first; ent; ent = ent->next)
+	{
+		if (ent->str_width >= 0)
+			continue;
+
+		ent->str_width = gtk_xtext_text_width_ent (buf->xtext, ent);
+		buf->num_lines -= ent->subline_count;
+		buf->num_lines += gtk_xtext_lines_taken (buf, ent);
+	}
+	buf->pagetop_ent = NULL;
+	buf->index_dirty = TRUE;
+}
+
 /* Calculate number of actual lines (with wraps), to set adj->lower. *
  * This should only be called when the window resizes.               */
 
@@ -4394,68 +4565,212 @@ gtk_xtext_calc_lines (xtext_buffer *buf, int fire_signal)
 
 	buf->pagetop_ent = NULL;
 	buf->num_lines = lines;
+	buf->index_dirty = TRUE;
 	gtk_xtext_adjustment_set (buf, fire_signal);
 }
 
-/* find the n-th line in the linked list, this includes wrap calculations */
+/* The line index splits the entry list into blocks of XTEXT_BLOCK entries
+ * and keeps the line each block starts at, so a line number is found with a
+ * binary search and a short walk. Appending and removing the top line keep
+ * it up to date; anything else marks it dirty and it's rebuilt when next
+ * used. Line numbers in it are offset by line_base, which grows as lines are
+ * removed from the top, so the other blocks never need updating. */
+
+#define XTEXT_BLOCK 128
+
+typedef struct
+{
+	textentry *first;
+	int entries;
+	int start;
+	int lines;
+} xtext_block;
+
+static void
+gtk_xtext_index_append (xtext_buffer *buf, textentry *ent)
+{
+	xtext_block *block = NULL, add;
+
+	if (buf->index_dirty || !buf->blocks)
+		return;
+
+	if (buf->blocks->len > buf->block_head)
+		block = &g_array_index (buf->blocks, xtext_block, buf->blocks->len - 1);
+
+	if (block && block->entries < XTEXT_BLOCK)
+	{
+		block->entries++;
+		block->lines += ent->subline_count;
+		return;
+	}
+
+	add.first = ent;
+	add.entries = 1;
+	add.start = block ? block->start + block->lines : buf->line_base;
+	add.lines = ent->subline_count;
+	g_array_append_val (buf->blocks, add);
+	g_hash_table_insert (buf->block_firsts, ent, GUINT_TO_POINTER (buf->blocks->len));
+}
+
+static void
+gtk_xtext_index_rebuild (xtext_buffer *buf)
+{
+	textentry *ent;
+
+	if (!buf->blocks)
+	{
+		buf->blocks = g_array_new (FALSE, FALSE, sizeof (xtext_block));
+		buf->block_firsts = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+	g_array_set_size (buf->blocks, 0);
+	g_hash_table_remove_all (buf->block_firsts);
+	buf->block_head = 0;
+	buf->line_base = 0;
+	buf->index_dirty = FALSE;
+
+	for (ent = buf->text_first; ent; ent = ent->next)
+		gtk_xtext_index_append (buf, ent);
+}
+
+/* ent is text_first and about to be removed */
+static void
+gtk_xtext_index_remove_top (xtext_buffer *buf, textentry *ent)
+{
+	xtext_block *block;
+
+	if (buf->index_dirty || !buf->blocks)
+		return;
+
+	if (buf->block_head >= buf->blocks->len)
+	{
+		buf->index_dirty = TRUE;
+		return;
+	}
+
+	block = &g_array_index (buf->blocks, xtext_block, buf->block_head);
+	g_hash_table_remove (buf->block_firsts, ent);
+	block->first = ent->next;
+	block->entries--;
+	block->start += ent->subline_count;
+	block->lines -= ent->subline_count;
+	buf->line_base += ent->subline_count;
+
+	if (block->entries > 0)
+		g_hash_table_insert (buf->block_firsts, block->first,
+									GUINT_TO_POINTER (buf->block_head + 1));
+	else
+		buf->block_head++;
+
+	/* drop the removed blocks from the array now and then */
+	if (buf->block_head > 1024 && buf->block_head * 2 > buf->blocks->len)
+		buf->index_dirty = TRUE;
+}
+
+static void
+gtk_xtext_index_free (xtext_buffer *buf)
+{
+	if (!buf->blocks)
+		return;
+
+	g_array_free (buf->blocks, TRUE);
+	g_hash_table_destroy (buf->block_firsts);
+	buf->blocks = NULL;
+	buf->block_firsts = NULL;
+}
 
 static textentry *
-gtk_xtext_nth (GtkXText *xtext, int line, int *subline)
+gtk_xtext_index_find (xtext_buffer *buf, int line, int *subline)
 {
-	int lines = 0;
+	xtext_block *block;
 	textentry *ent;
+	guint lo, hi, mid;
+	int i, pos;
 
-	ent = xtext->buffer->text_first;
+	if (buf->index_dirty || !buf->blocks)
+		gtk_xtext_index_rebuild (buf);
 
-	/* -- optimization -- try to make a short-cut using the pagetop ent */
-	if (xtext->buffer->pagetop_ent)
+	if (buf->block_head >= buf->blocks->len)
+		return NULL;
+	line += buf->line_base;
+
+	/* the last block that starts at or before line */
+	lo = buf->block_head;
+	hi = buf->blocks->len - 1;
+	while (lo < hi)
 	{
-		if (line == xtext->buffer->pagetop_line)
-		{
-			*subline = xtext->buffer->pagetop_subline;
-			return xtext->buffer->pagetop_ent;
-		}
-		if (line > xtext->buffer->pagetop_line)
-		{
-			/* lets start from the pagetop instead of the absolute beginning */
-			ent = xtext->buffer->pagetop_ent;
-			lines = xtext->buffer->pagetop_line - xtext->buffer->pagetop_subline;
-		}
-		else if (line > xtext->buffer->pagetop_line - line)
-		{
-			/* move backwards from pagetop */
-			ent = xtext->buffer->pagetop_ent;
-			lines = xtext->buffer->pagetop_line - xtext->buffer->pagetop_subline;
-			while (1)
-			{
-				if (lines <= line)
-				{
-					*subline = line - lines;
-					return ent;
-				}
-				ent = ent->prev;
-				if (!ent)
-					break;
-				lines -= ent->subline_count;
-			}
-			return NULL;
-		}
+		mid = (lo + hi + 1) / 2;
+		if (g_array_index (buf->blocks, xtext_block, mid).start <= line)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
-	/* -- end of optimization -- */
 
-	while (ent)
+	block = &g_array_index (buf->blocks, xtext_block, lo);
+	pos = block->start;
+	ent = block->first;
+	for (i = 0; i < block->entries && ent; i++, ent = ent->next)
 	{
-		lines += ent->subline_count;
-		if (lines > line)
+		if (line < pos + ent->subline_count)
 		{
-			*subline = ent->subline_count - (lines - line);
+			*subline = line - pos;
 			return ent;
 		}
-		ent = ent->next;
+		pos += ent->subline_count;
 	}
+
 	return NULL;
 }
 
+/* the line number find's first line is on */
+static int
+gtk_xtext_index_line (xtext_buffer *buf, textentry *find)
+{
+	xtext_block *block;
+	textentry *ent;
+	gpointer index;
+	int lines = 0;
+
+	if (buf->index_dirty || !buf->blocks)
+		gtk_xtext_index_rebuild (buf);
+
+	for (ent = find; ent; ent = ent->prev)
+	{
+		if (ent != find)
+			lines += ent->subline_count;
+
+		index = g_hash_table_lookup (buf->block_firsts, ent);
+		if (index)
+		{
+			block = &g_array_index (buf->blocks, xtext_block, GPOINTER_TO_UINT (index) - 1);
+			return block->start - buf->line_base + lines;
+		}
+	}
+
+	return 0;
+}
+
+/* find the n-th line in the linked list, this includes wrap calculations */
+
+static textentry *
+gtk_xtext_nth (GtkXText *xtext, int line, int *subline)
+{
+	/* -- optimization -- the page top is asked for on every render */
+	if (xtext->buffer->pagetop_ent && line == xtext->buffer->pagetop_line)
+	{
+		*subline = xtext->buffer->pagetop_subline;
+		return xtext->buffer->pagetop_ent;
+	}
+
+	/* above the top, e.g. while dragging a selection */
+	if (line < 0)
+	{
+		*subline = line;
+		return xtext->buffer->text_first;
+	}
+
+	return gtk_xtext_index_find (xtext->buffer, line, subline);
+}
+
 /* render enta (or an inclusive range enta->entb) */
 
 static int
@@ -4737,6 +5052,66 @@ gtk_xtext_refresh (GtkXText * xtext)
 	}
 }
 
+/* a textentry with room for 'len' bytes of text after it */
+
+static textentry *
+gtk_xtext_entry_new (xtext_buffer *buf, int len)
+{
+	xtext_chunk *chunk = buf->chunk;
+	textentry *ent;
+	gsize need;
+
+	/* keep the next entry aligned */
+	need = (sizeof (textentry) + len + 2 * sizeof (gpointer) - 1) & ~(2 * sizeof (gpointer) - 1);
+
+	if (!chunk || chunk->used + need > chunk->size)
+	{
+		if (chunk && chunk->live == 0 && chunk->size >= need)
+			chunk->used = 0;
+		else
+		{
+			if (chunk && chunk->live == 0)
+			{
+				buf->arena_bytes -= chunk->size;
+				g_free (chunk);
+			}
+			/* a line too long for a chunk gets one of its own */
+			chunk = g_malloc (sizeof (xtext_chunk) + MAX (XTEXT_CHUNK_SIZE, need));
+			chunk->size = MAX (XTEXT_CHUNK_SIZE, need);
+			chunk->used = 0;
+			chunk->live = 0;
+			buf->chunk = chunk;
+			buf->arena_bytes += chunk->size;
+		}
+	}
+
+	ent = (textentry *)((char *)(chunk + 1) + chunk->used);
+	chunk->used += need;
+	chunk->live++;
+
+	memset (ent, 0, sizeof (textentry));
+	ent->chunk = chunk;
+	ent->str = (unsigned char *)ent + sizeof (textentry);
+	return ent;
+}
+
+static void
+gtk_xtext_entry_free (xtext_buffer *buf, textentry *ent)
+{
+	xtext_chunk *chunk = ent->chunk;
+
+	g_free (ent->runs);
+	g_free (ent->sublines);
+	g_free (ent->shadow);
+
+	/* the chunk being filled stays around for the next entries */
+	if (--chunk->live == 0 && chunk != buf->chunk)
+	{
+		buf->arena_bytes -= chunk->size;
+		g_free (chunk);
+	}
+}
+
 static int
 gtk_xtext_kill_ent (xtext_buffer *buffer, textentry *ent)
 {
@@ -4774,12 +5149,17 @@ gtk_xtext_kill_ent (xtext_buffer *buffer, textentry *ent)
 		gtk_xtext_search_textentry_del (buffer, ent);
 	}
 
-	g_slist_free_full (ent->slp, g_free);
-	g_slist_free (ent->sublines);
-	ent->sublines = NULL;
-	ent->subline_count = 0;
+	/* searches running through this buffer step over it */
+	if (buffer->search_scan == ent)
+		buffer->search_scan = ent->prev;
+	if (buffer->search_last == ent)
+		buffer->search_last = ent->prev;
+	if (buffer->hintsearch == ent)
+		buffer->hintsearch = NULL;
+	if (buffer->lastlog_from && buffer->lastlog_from->pos == ent)
+		buffer->lastlog_from->pos = ent->next;
 
-	g_free (ent);
+	gtk_xtext_entry_free (buffer, ent);
 	return visible;
 }
 
@@ -4802,6 +5182,8 @@ gtk_xtext_remove_top (xtext_buffer *buffer)
 	else
 		buffer->text_last = NULL;
 
+	gtk_xtext_index_remove_top (buffer, ent);
+
 	buffer->old_value -= ent->subline_count;
 	if (buffer->xtext->buffer == buffer)	/* is it the current buffer? */
 	{
@@ -4839,6 +5221,7 @@ gtk_xtext_remove_bottom (xtext_buffer *buffer)
 	if (!ent)
 		return;
 	buffer->num_lines -= ent->subline_count;
+	buffer->index_dirty = TRUE;
 	buffer->text_last = ent->prev;
 	if (buffer->text_last)
 		buffer->text_last->next = NULL;
@@ -4901,8 +5284,10 @@ gtk_xtext_clear (xtext_buffer *buf, int lines)
 	else
 	{
 		/* delete all */
-		if (buf->search_found)
+		if (buf->search_found || buf->search_scan)
 			gtk_xtext_search_fini (buf);
+		if (buf->lastlog_from)
+			gtk_xtext_lastlog_stop (buf->lastlog_from);
 		if (buf->xtext->auto_indent)
 			buf->indent = MARGIN;
 		buf->scrollbar_down = TRUE;
@@ -4916,10 +5301,11 @@ gtk_xtext_clear (xtext_buffer *buf, int lines)
 		while (buf->text_first)
 		{
 			next = buf->text_first->next;
-			g_free (buf->text_first);
+			gtk_xtext_entry_free (buf, buf->text_first);
 			buf->text_first = next;
 		}
 		buf->text_last = NULL;
+		buf->index_dirty = TRUE;
 	}
 
 	if (buf->xtext->buffer == buf)
@@ -4987,18 +5373,17 @@ gtk_xtext_check_marker_visibility (GtkXText * xtext)
 }
 
 static void
-gtk_xtext_unstrip_color (gint start, gint end, GSList *slp, GList **gl, gint maxo)
+gtk_xtext_unstrip_color (gint start, gint end, offlen_t *runs, int run_count, GList **gl, gint maxo)
 {
 	gint off1, off2;
-	GSList *cursl;
+	gint i;
 	offsets_t marks;
 	offlen_t *meta;
 
 	off1 = 0;
-	cursl = slp;
-	while (cursl)
+	for (i = 0; i < run_count; i++)
 	{
-		meta = cursl->data;
+		meta = &runs[i];
 		if (start < meta->len)
 		{
 			off1 = meta->off + start;
@@ -5006,22 +5391,20 @@ gtk_xtext_unstrip_color (gint start, gint end, GSList *slp, GList **gl, gint max
 		}
 		start -= meta->len;
 		end -= meta->len;
-		cursl = g_slist_next (cursl);
 	}
 
 	off2 = off1;
-	while (cursl)
+	for (; i < run_count; i++)
 	{
-		meta = cursl->data;
+		meta = &runs[i];
 		if (end < meta->len)
 		{
 			off2 = meta->off + end;
 			break;
 		}
 		end -= meta->len;
-		cursl = g_slist_next (cursl);
 	}
-	if (!cursl)
+	if (i >= run_count)
 	{
 		off2 = maxo;
 	}
@@ -5031,22 +5414,86 @@ gtk_xtext_unstrip_color (gint start, gint end, GSList *slp, GList **gl, gint max
 	*gl = g_list_append (*gl, GUINT_TO_POINTER (marks.u));
 }
 
-/* Search a single textentry for occurrence(s) of search arg string */
+static xtext_shadow *
+gtk_xtext_shadow_new (xtext_buffer *buf, textentry *ent, int kind)
+{
+	xtext_shadow *shadow;
+	GSList *slp, *list;
+	offlen_t *runs;
+	gchar *str, *fold = NULL;
+	gint lstr;
+
+	str = (gchar *)gtk_xtext_strip_color (ent->str, ent->str_len, buf->xtext->scratch_buffer,
+													  &lstr, &slp, kind & SHADOW_HIDDEN);
+	if (kind & SHADOW_FOLD)
+	{
+		fold = g_utf8_casefold (str, lstr);
+		str = fold;
+		lstr = strlen (fold);
+	}
+
+	shadow = g_malloc (sizeof (xtext_shadow) + g_slist_length (slp) * sizeof (offlen_t) + lstr + 1);
+	shadow->len = lstr;
+	shadow->kind = kind;
+	shadow->run_count = 0;
+	runs = SHADOW_RUNS (shadow);
+	for (list = slp; list; list = g_slist_next (list))
+		runs[shadow->run_count++] = *(offlen_t *)list->data;
+	memcpy (SHADOW_TEXT (shadow), str, lstr);
+	SHADOW_TEXT (shadow)[lstr] = 0;
+
+	g_slist_free_full (slp, g_free);
+	g_free (fold);
+	return shadow;
+}
+
+/* drop what searches kept with the entries */
+static void
+gtk_xtext_shadow_free_all (xtext_buffer *buf)
+{
+	textentry *ent;
+
+	for (ent = buf->text_first; ent; ent = ent->next)
+	{
+		g_free (ent->shadow);
+		ent->shadow = NULL;
+	}
+}
+
+/* Search a single textentry for occurrence(s) of search arg string.
+ * With 'keep', the stripped text is left with the entry for the next search. */
 static GList *
-gtk_xtext_search_textentry (xtext_buffer *buf, textentry *ent)
+gtk_xtext_search_textentry (xtext_buffer *buf, textentry *ent, gboolean keep)
 {
-	gchar *str;								/* text string to be searched */
+	xtext_shadow *shadow;
+	gchar *hay;								/* text string to be searched */
 	GList *gl = NULL;
-	GSList *slp;
-	gint lstr;
+	int kind;
 
 	if (buf->search_text == NULL)
 	{
 		return gl;
 	}
+	if ((buf->search_flags & regexp) && buf->search_re == NULL)
+	{
+		return gl;
+	}
 
-	str = gtk_xtext_strip_color (ent->str, ent->str_len, buf->xtext->scratch_buffer,
-										  &lstr, &slp, !buf->xtext->ignore_hidden);
+	kind = (buf->search_flags & (case_match | regexp)) ? 0 : SHADOW_FOLD;
+	if (!buf->xtext->ignore_hidden)
+		kind |= SHADOW_HIDDEN;
+
+	shadow = ent->shadow;
+	if (!shadow || shadow->kind != kind)
+	{
+		shadow = gtk_xtext_shadow_new (buf, ent, kind);
+		if (keep)
+		{
+			g_free (ent->shadow);
+			ent->shadow = shadow;
+		}
+	}
+	hay = SHADOW_TEXT (shadow);
 
 	/* Regular-expression matching --- */
 	if (buf->search_flags & regexp)
@@ -5054,27 +5501,22 @@ gtk_xtext_search_textentry (xtext_buffer *buf, textentry *ent)
 		GMatchInfo *gmi;
 		gint start, end;
 
-		if (buf->search_re == NULL)
-		{
-			return gl;
-		}
-		g_regex_match (buf->search_re, str, 0, &gmi);
+		g_regex_match (buf->search_re, hay, 0, &gmi);
 		while (g_match_info_matches (gmi))
 		{
 			g_match_info_fetch_pos (gmi, 0,  &start, &end);
-			gtk_xtext_unstrip_color (start, end, slp, &gl, ent->str_len);
+			gtk_xtext_unstrip_color (start, end, SHADOW_RUNS (shadow), shadow->run_count,
+											 &gl, ent->str_len);
 			g_match_info_next (gmi, NULL);
 		}
 		g_match_info_free (gmi);
 
 	/* Non-regular-expression matching --- */
 	} else {
-		gchar *hay, *pos;
+		gchar *pos, *str;
 		gint lhay, off, len;
-		gint match = buf->search_flags & case_match;
 
-		hay = match? g_strdup (str): g_utf8_casefold (str, lstr);
-		lhay = strlen (hay);
+		lhay = shadow->len;
 
 		for (pos = hay, len = lhay; len;
 			  off += buf->search_lnee, pos = hay + off, len = lhay - off)
@@ -5086,17 +5528,71 @@ gtk_xtext_search_textentry (xtext_buffer *buf, textentry *ent)
 			}
 			off = str - hay;
 			gtk_xtext_unstrip_color (off, off + buf->search_lnee,
-											 slp, &gl, ent->str_len);
+											 SHADOW_RUNS (shadow), shadow->run_count,
+											 &gl, ent->str_len);
 		}
-
-		g_free (hay);
 	}
 
 	/* Common processing --- */
-	g_slist_free_full (slp, g_free);
+	if (shadow != ent->shadow)
+		g_free (shadow);
 	return gl;
 }
 
+/* search older entries until 'stop' is done or 'budget' usec have passed,
+ * -1 for no limit. Until something is found there is no limit either, so
+ * the caller always has a first match to show if there is one. */
+static void
+gtk_xtext_search_scan (xtext_buffer *buf, textentry *stop, gint64 budget)
+{
+	gint64 end = g_get_monotonic_time () + budget;
+	textentry *ent;
+	GList *gl;
+	int n = 0;
+
+	while ((ent = buf->search_scan))
+	{
+		buf->search_scan = ent->prev;
+		/* walking up, so prepending keeps the results in order */
+		gl = gtk_xtext_search_textentry (buf, ent, TRUE);
+		gtk_xtext_search_textentry_add (buf, ent, gl, TRUE);
+		if (ent == stop)
+			break;
+		if (budget >= 0 && buf->search_found && (++n & 63) == 0 &&
+			 g_get_monotonic_time () >= end)
+			break;
+	}
+}
+
+static gboolean
+gtk_xtext_search_idle (xtext_buffer *buf)
+{
+	GList *found = buf->search_found;
+
+	gtk_xtext_search_scan (buf, NULL, XTEXT_SEARCH_SLICE);
+
+	/* show what turned up so far */
+	if (buf->search_found != found && buf->xtext->buffer == buf)
+		gtk_widget_queue_draw (GTK_WIDGET (buf->xtext));
+
+	if (buf->search_scan)
+		return TRUE;
+	buf->search_tag = 0;
+	return FALSE;
+}
+
+/* search what's left right now, the user wants to go past it */
+static void
+gtk_xtext_search_finish (xtext_buffer *buf)
+{
+	gtk_xtext_search_scan (buf, NULL, -1);
+	if (buf->search_tag)
+	{
+		g_source_remove (buf->search_tag);
+		buf->search_tag = 0;
+	}
+}
+
 /* Add a list of found search results to an entry, maybe NULL */
 static void
 gtk_xtext_search_textentry_add (xtext_buffer *buf, textentry *ent, GList *gl, gboolean pre)
@@ -5149,6 +5645,15 @@ gtk_xtext_search_textentry_fini (gpointer entp, gpointer dummy)
 static void
 gtk_xtext_search_fini (xtext_buffer *buf)
 {
+	if (buf->search_tag)
+	{
+		g_source_remove (buf->search_tag);
+		buf->search_tag = 0;
+	}
+	buf->search_scan = NULL;
+	buf->search_last = NULL;
+	if (buf->lastlog_in)
+		gtk_xtext_lastlog_stop (buf->lastlog_in);
 	g_list_foreach (buf->search_found, gtk_xtext_search_textentry_fini, 0);
 	g_list_free (buf->search_found);
 	buf->search_found = NULL;
@@ -5172,7 +5677,7 @@ static gboolean
 gtk_xtext_search_init (xtext_buffer *buf, const gchar *text, gtk_xtext_search_flags flags, GError **perr)
 {
 	/* Of the five flags, backward and highlight_all do not need a new search */
-	if (buf->search_found &&
+	if ((buf->search_found || buf->search_scan) &&
 		 strcmp (buf->search_text, text) == 0 &&
 		 (buf->search_flags & case_match) == (flags & case_match) &&
 		 (buf->search_flags & follow) == (flags & follow) &&
@@ -5225,6 +5730,8 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 		return NULL;
 	}
 
+	gtk_xtext_buffer_measure (buf);
+
 	/* If the text arg is NULL, one of these has been toggled: highlight follow */
 	if (text == NULL)		/* Here on highlight or follow toggle */
 	{
@@ -5232,17 +5739,16 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 		gint newfollow = flags & follow;
 
 		/* If "Follow" has just been checked, search possible new textentries --- */
-		if (newfollow && (newfollow != oldfollow))
+		if (newfollow && (newfollow != oldfollow) && buf->search_text)
 		{
-			gl = g_list_last (buf->search_found);
-			ent = gl? gl->data: buf->text_first;
+			/* only what came in since the search last looked */
+			ent = buf->search_last? buf->search_last->next: buf->text_first;
 			for (; ent; ent = ent->next)
 			{
-				GList *gl;
-
-				gl = gtk_xtext_search_textentry (buf, ent);
+				gl = gtk_xtext_search_textentry (buf, ent, TRUE);
 				gtk_xtext_search_textentry_add (buf, ent, gl, FALSE);
 			}
+			buf->search_last = buf->text_last;
 		}
 		buf->search_flags = flags;
 		ent = buf->pagetop_ent;
@@ -5252,6 +5758,7 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 	else if (text[0] == 0)		/* Let a null string do a reset. */
 	{
 		gtk_xtext_search_fini (buf);
+		gtk_xtext_shadow_free_all (buf);
 	}
 
 	/* If the text arg is neither NULL nor "", it's the search string */
@@ -5263,14 +5770,19 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 			{
 				return NULL;
 			}
-			for (ent = buf->text_first; ent; ent = ent->next)
+			/* newest lines first, the rest a slice at a time from idle */
+			buf->search_scan = buf->text_last;
+			buf->search_last = buf->text_last;
+			if (!BACKWARD)
+				gtk_xtext_search_finish (buf);
+			else
 			{
-				GList *gl;
-
-				gl = gtk_xtext_search_textentry (buf, ent);
-				gtk_xtext_search_textentry_add (buf, ent, gl, TRUE);
+				if (buf->hintsearch)
+					gtk_xtext_search_scan (buf, buf->hintsearch, -1);
+				gtk_xtext_search_scan (buf, NULL, XTEXT_SEARCH_SLICE);
 			}
-			buf->search_found = g_list_reverse (buf->search_found);
+			if (buf->search_scan && !buf->search_tag)
+				buf->search_tag = g_idle_add ((GSourceFunc) gtk_xtext_search_idle, buf);
 		}
 
 		/* Now base search results are in place. */
@@ -5280,6 +5792,9 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 			/* If we're in the midst of moving among found items */
 			if (buf->cursearch)
 			{
+				/* stepping back past what the scan has reached */
+				if (BACKWARD && buf->search_scan && !buf->cursearch->prev)
+					gtk_xtext_search_finish (buf);
 				ent = buf->cursearch->data;
 				buf->curmark = NEXTPREVIOUS (buf->curmark);
 				if (buf->curmark == NULL)
@@ -5318,6 +5833,8 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 				}
 				if (mark == NULL)
 				{
+					if (BACKWARD)
+						gtk_xtext_search_finish (buf);
 					for (ent = buf->hintsearch; ent; ent = BACKWARD? ent->prev: ent->next)
 						if (ent->marks)
 							break;
@@ -5330,6 +5847,8 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 			/* This is a fresh search */
 			else
 			{
+				if (!BACKWARD)
+					gtk_xtext_search_finish (buf);
 				buf->cursearch = FIRSTLAST (buf->search_found);
 				ent = buf->cursearch->data;
 				buf->curmark = FIRSTLAST (ent->marks);
@@ -5345,11 +5864,8 @@ gtk_xtext_search (GtkXText * xtext, const gchar *text, gtk_xtext_search_flags fl
 		float value;
 
 		buf->pagetop_ent = NULL;
-		for (value = 0, ent = buf->text_first;
-			  ent && ent != buf->hintsearch; ent = ent->next)
-		{
-			value += ent->subline_count;
-		}
+		ent = buf->hintsearch;
+		value = ent ? gtk_xtext_index_line (buf, ent) : buf->num_lines;
 		if (value > xtext_adj_get_upper (adj) - xtext_adj_get_page_size (adj))
 		{
 			value = xtext_adj_get_upper (adj) - xtext_adj_get_page_size (adj);
@@ -5409,12 +5925,77 @@ gtk_xtext_render_page_timeout (GtkXText * xtext)
 	return 0;
 }
 
+/* gtk_xtext_render_page_timeout () forgets add_io_tag, so drop it first */
+static void
+gtk_xtext_render_appended (GtkXText *xtext)
+{
+	if (xtext->add_io_tag)
+	{
+		g_source_remove (xtext->add_io_tag);
+		xtext->add_io_tag = 0;
+	}
+
+	gtk_xtext_render_page_timeout (xtext);
+}
+
+static gboolean
+gtk_xtext_render_tick (GtkWidget *widget, GdkFrameClock *clock, gpointer unused)
+{
+	GtkXText *xtext = GTK_XTEXT (widget);
+
+	xtext->render_tick = 0;
+	xtext->render_stats.frames++;
+	gtk_xtext_render_appended (xtext);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Text appended at the bottom is shown on the next frame, so a flood of
+ * lines costs one render per frame rather than one per line. */
+static void
+gtk_xtext_queue_render (GtkXText *xtext)
+{
+	if (xtext->render_tick)
+	{
+		xtext->render_stats.coalesced++;
+		return;
+	}
+
+	/* no frames are drawn for a hidden widget */
+	if (!gtk_widget_get_mapped (GTK_WIDGET (xtext)))
+	{
+		gtk_xtext_render_page_timeout (xtext);
+		return;
+	}
+
+	xtext->render_tick = gtk_widget_add_tick_callback (GTK_WIDGET (xtext),
+								gtk_xtext_render_tick, NULL, NULL);
+}
+
+/* render a pending append now, e.g. for a line the user just sent */
+void
+gtk_xtext_render_flush (GtkXText *xtext)
+{
+	if (!xtext->render_tick)
+		return;
+
+	gtk_widget_remove_tick_callback (GTK_WIDGET (xtext), xtext->render_tick);
+	xtext->render_tick = 0;
+	gtk_xtext_render_appended (xtext);
+}
+
+const xtext_render_stats *
+gtk_xtext_get_render_stats (GtkXText *xtext)
+{
+	return &xtext->render_stats;
+}
+
 /* append a textentry to our linked list */
 
 static void
 gtk_xtext_append_entry (xtext_buffer *buf, textentry * ent, time_t stamp)
 {
-	int i;
+	int i, lines;
 
 	/* we don't like tabs */
 	i = 0;
@@ -5428,17 +6009,49 @@ gtk_xtext_append_entry (xtext_buffer *buf, textentry * ent, time_t stamp)
 	ent->stamp = stamp;
 	if (stamp == 0)
 		ent->stamp = time (0);
-	ent->slp = NULL;
-	ent->str_width = gtk_xtext_text_width_ent (buf->xtext, ent);
+	/* text for a buffer nobody is looking at is measured once it's shown */
+	if (buf->xtext->buffer != buf && !buf->batch_top)
+	{
+		ent->str_width = -1;
+		buf->needs_measure = TRUE;
+	}
+	else
+		ent->str_width = gtk_xtext_text_width_ent (buf->xtext, ent);
 	ent->mark_start = -1;
 	ent->mark_end = -1;
-	ent->next = NULL;
-	ent->marks = NULL;
-	ent->subline_count = 0;
 
 	if (ent->indent < MARGIN)
 		ent->indent = MARGIN;	  /* 2 pixels is the left margin */
 
+	lines = gtk_xtext_lines_taken (buf, ent);
+
+	if (buf->batch_top)
+	{
+		/* older text comes newest first: never push out what's already
+		   there, and once something doesn't fit, nothing older does */
+		if (buf->batch_full ||
+			 (buf->xtext->max_lines > 2 && buf->xtext->max_lines < buf->num_lines + lines))
+		{
+			buf->batch_full = TRUE;
+			gtk_xtext_entry_free (buf, ent);
+			return;
+		}
+
+		ent->prev = NULL;
+		ent->next = buf->text_first;
+		if (ent->next)
+			ent->next->prev = ent;
+		else
+			buf->text_last = ent;
+		buf->text_first = ent;
+
+		buf->num_lines += lines;
+		buf->batch_kept++;
+		buf->batch_lines += lines;
+		buf->index_dirty = TRUE;
+		return;
+	}
+
 	/* append to our linked list */
 	if (buf->text_last)
 		buf->text_last->next = ent;
@@ -5447,8 +6060,8 @@ gtk_xtext_append_entry (xtext_buffer *buf, textentry * ent, time_t stamp)
 	ent->prev = buf->text_last;
 	buf->text_last = ent;
 
-	ent->sublines = NULL;
-	buf->num_lines += gtk_xtext_lines_taken (buf, ent);
+	buf->num_lines += lines;
+	gtk_xtext_index_append (buf, ent);
 
 	if ((buf->marker_pos == NULL || buf->marker_seen) && (buf->xtext->buffer != buf || 
 		!gtk_window_has_toplevel_focus (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (buf->xtext))))))
@@ -5464,7 +6077,7 @@ gtk_xtext_append_entry (xtext_buffer *buf, textentry * ent, time_t stamp)
 		gtk_xtext_remove_top (buf);
 	}
 
-	if (buf->xtext->buffer == buf)
+	if (buf->xtext->buffer == buf && !buf->batch)
 	{
 		/* this could be improved */
 		if ((buf->num_lines - 1) <= xtext_adj_get_page_size (buf->xtext->adj))
@@ -5478,12 +6091,12 @@ gtk_xtext_append_entry (xtext_buffer *buf, textentry * ent, time_t stamp)
 				g_source_remove (buf->xtext->io_tag);
 				buf->xtext->io_tag = 0;
 			}
-			/* When at the bottom of the buffer, render immediately so long
-			 * scrollback doesn't delay newly-sent messages appearing.
+			/* When at the bottom of the buffer, render on the next frame so
+			 * long scrollback doesn't delay newly-sent messages appearing.
 			 * Otherwise, keep idle batching to avoid extra redraws while
 			 * scrolling around old content. */
 			if (buf->scrollbar_down)
-				gtk_xtext_render_page_timeout (buf->xtext);
+				gtk_xtext_queue_render (buf->xtext);
 			else
 				buf->xtext->add_io_tag = g_idle_add ((GSourceFunc)
 										gtk_xtext_render_page_timeout,
@@ -5501,8 +6114,9 @@ gtk_xtext_append_entry (xtext_buffer *buf, textentry * ent, time_t stamp)
 	{
 		GList *gl;
 
-		gl = gtk_xtext_search_textentry (buf, ent);
+		gl = gtk_xtext_search_textentry (buf, ent, TRUE);
 		gtk_xtext_search_textentry_add (buf, ent, gl, FALSE);
+		buf->search_last = ent;
 	}
 }
 
@@ -5533,8 +6147,8 @@ gtk_xtext_append_indent (xtext_buffer *buf,
 	if (right_text[right_len-1] == '\n')
 		right_len--;
 
-	ent = g_malloc (left_len + right_len + 2 + sizeof (textentry));
-	str = (unsigned char *) ent + sizeof (textentry);
+	ent = gtk_xtext_entry_new (buf, left_len + right_len + 2);
+	str = ent->str;
 
 	if (left_len)
 		memcpy (str, left_text, left_len);
@@ -5607,8 +6221,7 @@ gtk_xtext_append (xtext_buffer *buf, unsigned char *text, int len, time_t stamp)
 		truncate = TRUE;
 	}
 
-	ent = g_malloc (len + 1 + sizeof (textentry));
-	ent->str = (unsigned char *) ent + sizeof (textentry);
+	ent = gtk_xtext_entry_new (buf, len + 1);
 	ent->str_len = len;
 	if (len)
 	{
@@ -5635,25 +6248,109 @@ gtk_xtext_is_empty (xtext_buffer *buf)
 	return buf->text_first == NULL;
 }
 
+/* Lines appended between these two are rendered once, at the end, instead
+ * of one at a time. With at_top they go above the existing text (in the
+ * order given) and the view stays on the lines it was showing. */
 
+void
+gtk_xtext_batch_begin (xtext_buffer *buf, gboolean at_top)
+{
+	buf->batch = TRUE;
+	buf->batch_top = at_top;
+	buf->batch_full = FALSE;
+	buf->batch_kept = 0;
+	buf->batch_lines = 0;
+}
+
+/* returns how many entries a batch at the top kept, -1 for the bottom */
 int
-gtk_xtext_lastlog (xtext_buffer *out, xtext_buffer *search_area)
+gtk_xtext_batch_end (xtext_buffer *buf)
 {
+	GtkXText *xtext = buf->xtext;
+	int lines = buf->batch_lines;
+	int kept = buf->batch_kept;
+	gboolean at_top = buf->batch_top;
+
+	buf->batch = FALSE;
+	buf->batch_top = FALSE;
+	buf->batch_full = FALSE;
+	buf->batch_kept = 0;
+	buf->batch_lines = 0;
+
+	if (at_top)
+	{
+		if (!lines)
+			return kept;
+
+		buf->pagetop_line += lines;
+		buf->old_value += lines;
+		dontscroll (buf);
+
+		if (xtext->buffer != buf)
+			return kept;
+
+		xtext->select_start_adj += lines;
+		g_signal_handler_block (xtext->adj, xtext->vc_signal_tag);
+		gtk_xtext_adjustment_set (buf, FALSE);
+		xtext_adj_set_value (xtext->adj, buf->old_value);
+		g_signal_handler_unblock (xtext->adj, xtext->vc_signal_tag);
+		buf->old_value = xtext_adj_get_value (xtext->adj);
+		gtk_xtext_render_page (xtext);
+		return kept;
+	}
+
+	if (xtext->buffer != buf)
+		return -1;
+
+	if ((buf->num_lines - 1) <= xtext_adj_get_page_size (xtext->adj))
+		dontscroll (buf);
+
+	if (xtext->io_tag)
+	{
+		g_source_remove (xtext->io_tag);
+		xtext->io_tag = 0;
+	}
+	if (xtext->add_io_tag)
+	{
+		g_source_remove (xtext->add_io_tag);
+		xtext->add_io_tag = 0;
+	}
+	gtk_xtext_render_page_timeout (xtext);
+	return -1;
+}
+
+
+static void
+gtk_xtext_lastlog_stop (xtext_lastlog *job)
+{
+	if (job->tag)
+		g_source_remove (job->tag);
+	job->out->lastlog_in = NULL;
+	job->src->lastlog_from = NULL;
+	/* matches were prepended as they came */
+	job->out->search_found = g_list_reverse (job->out->search_found);
+	g_free (job);
+}
+
+/* copy the next slice of matching lines over, FALSE once done */
+static gboolean
+gtk_xtext_lastlog_slice (xtext_lastlog *job)
+{
+	gint64 end = g_get_monotonic_time () + XTEXT_SEARCH_SLICE;
+	xtext_buffer *out = job->out;
 	textentry *ent;
-	int matches;
 	GList *gl;
+	int n = 0;
 
-	ent = search_area->text_first;
-	matches = 0;
-
-	while (ent)
+	while ((ent = job->pos))
 	{
-		gl = gtk_xtext_search_textentry (out, ent);
+		job->pos = ent->next;
+		gl = gtk_xtext_search_textentry (out, ent, FALSE);
 		if (gl)
 		{
-			matches++;
+			job->matches++;
 			/* copy the text over */
-			if (search_area->xtext->auto_indent)
+			if (job->src->xtext->auto_indent)
 			{
 				gtk_xtext_append_indent (out, ent->str, ent->left_len,
 												 ent->str + ent->left_len + 1,
@@ -5669,11 +6366,55 @@ gtk_xtext_lastlog (xtext_buffer *out, xtext_buffer *search_area)
 				out->text_last->stamp = ent->stamp;
 				gtk_xtext_search_textentry_add (out, out->text_last, gl, TRUE);
 			}
+			else
+				g_list_free (gl);
 		}
-		ent = ent->next;
+		if ((++n & 63) == 0 && g_get_monotonic_time () >= end)
+			return TRUE;
 	}
-	out->search_found = g_list_reverse (out->search_found);
 
+	return FALSE;
+}
+
+static gboolean
+gtk_xtext_lastlog_idle (xtext_lastlog *job)
+{
+	if (gtk_xtext_lastlog_slice (job))
+		return TRUE;
+
+	job->tag = 0;
+	gtk_xtext_lastlog_stop (job);
+	return FALSE;
+}
+
+/* Copies the lines of search_area matching out's search into out. A big
+ * buffer is gone through a slice at a time from idle, so this returns the
+ * number of matches in the first slice only. */
+int
+gtk_xtext_lastlog (xtext_buffer *out, xtext_buffer *search_area)
+{
+	xtext_lastlog *job;
+	gboolean more;
+	int matches;
+
+	if (out->lastlog_in)
+		gtk_xtext_lastlog_stop (out->lastlog_in);
+	if (search_area->lastlog_from)
+		gtk_xtext_lastlog_stop (search_area->lastlog_from);
+
+	job = g_new0 (xtext_lastlog, 1);
+	job->out = out;
+	job->src = search_area;
+	job->pos = search_area->text_first;
+	out->lastlog_in = job;
+	search_area->lastlog_from = job;
+
+	more = gtk_xtext_lastlog_slice (job);
+	matches = job->matches;
+	if (more)
+		job->tag = g_idle_add ((GSourceFunc) gtk_xtext_lastlog_idle, job);
+	else
+		gtk_xtext_lastlog_stop (job);
 	return matches;
 }
 
@@ -5737,6 +6478,12 @@ gtk_xtext_set_urlcheck_function (GtkXText *xtext, int (*urlcheck_function) (GtkW
 	xtext->urlcheck_function = urlcheck_function;
 }
 
+void
+gtk_xtext_set_top_function (GtkXText *xtext, void (*top_function) (GtkXText *, xtext_buffer *))
+{
+	xtext->top_function = top_function;
+}
+
 void
 gtk_xtext_set_wordwrap (GtkXText *xtext, gboolean wordwrap)
 {
@@ -5842,8 +6589,10 @@ gtk_xtext_buffer_show (GtkXText *xtext, xtext_buffer *buf, int render)
 	if (buf->needs_recalc)
 	{
 		buf->needs_recalc = FALSE;
+		buf->needs_measure = FALSE;
 		gtk_xtext_recalc_widths (buf, TRUE);
 	}
+	gtk_xtext_buffer_measure (buf);
 
 	/* now change to the new buffer */
 	xtext->buffer = buf;
@@ -5945,23 +6694,58 @@ gtk_xtext_buffer_free (xtext_buffer *buf)
 	textentry *ent, *next;
 
 	if (buf->xtext->buffer == buf)
+	{
 		buf->xtext->buffer = buf->xtext->orig_buffer;
+		gtk_xtext_buffer_measure (buf->xtext->buffer);
+	}
 
 	if (buf->xtext->selection_buffer == buf)
 		buf->xtext->selection_buffer = NULL;
 
-	if (buf->search_found)
+	if (buf->search_found || buf->search_scan)
 	{
 		gtk_xtext_search_fini (buf);
 	}
+	if (buf->lastlog_in)
+		gtk_xtext_lastlog_stop (buf->lastlog_in);
+	if (buf->lastlog_from)
+		gtk_xtext_lastlog_stop (buf->lastlog_from);
 
 	ent = buf->text_first;
 	while (ent)
 	{
 		next = ent->next;
-		g_free (ent);
+		gtk_xtext_entry_free (buf, ent);
 		ent = next;
 	}
 
+	g_free (buf->chunk);
+	gtk_xtext_index_free (buf);
 	g_free (buf);
 }
+
+void
+gtk_xtext_buffer_get_memory (xtext_buffer *buf, xtext_buffer_memory *mem)
+{
+	textentry *ent;
+
+	memset (mem, 0, sizeof (*mem));
+	mem->arena_bytes = buf->arena_bytes;
+
+	for (ent = buf->text_first; ent; ent = ent->next)
+	{
+		mem->entries++;
+		mem->text_bytes += ent->str_len;
+		mem->line_bytes += ent->run_count * sizeof (offlen_t);
+		if (ent->sublines)
+			mem->line_bytes += ent->subline_count * sizeof (guint16);
+		if (ent->shadow)
+			mem->search_bytes += SHADOW_SIZE (ent->shadow);
+	}
+
+	if (buf->blocks)
+	{
+		mem->index_bytes = buf->blocks->len * sizeof (xtext_block) +
+								 g_hash_table_size (buf->block_firsts) * 2 * sizeof (gpointer);
+	}
+}
@@ -58,6 +58,8 @@ GType gtk_xtext_get_type (void);
 #define XTEXT_MARKER 103	/* for marker line */
 #define XTEXT_MAX_COLOR 98
 typedef struct textentry textentry;
+typedef struct xtext_chunk xtext_chunk;
+typedef struct xtext_lastlog xtext_lastlog;
 
 /*
  * offsets_t is used for retaining search information.
@@ -111,7 +113,24 @@ typedef struct {
 	unsigned int time_stamp:1;
 	unsigned int scrollbar_down:1;
 	unsigned int needs_recalc:1;
+	unsigned int needs_measure:1;	/* has text appended while hidden */
+	unsigned int index_dirty:1;		/* blocks must be rebuilt before use */
 	unsigned int marker_seen:1;
+	unsigned int batch:1;			/* between gtk_xtext_batch_begin/end */
+	unsigned int batch_top:1;		/* ... inserting above the existing text */
+	unsigned int batch_full:1;		/* ... and the buffer had no room left */
+
+	int batch_kept;					/* entries inserted at the top so far */
+	int batch_lines;					/* lines inserted at the top so far */
+
+	/* line index: runs of entries with the line number each starts at */
+	GArray *blocks;
+	guint block_head;					/* blocks before this one were removed */
+	int line_base;						/* line number of text_first in blocks */
+	GHashTable *block_firsts;		/* first entry of a block -> its index + 1 */
+
+	xtext_chunk *chunk;				/* where new entries are cut from */
+	gsize arena_bytes;				/* in all chunks still held */
 
 	GList *search_found;		/* list of textentries where search found strings */
 	gchar *search_text;		/* desired text to search for */
@@ -123,8 +142,33 @@ typedef struct {
 	offsets_t curdata;		/* current offset info, from *curmark */
 	GRegex *search_re;		/* Compiled regular expression */
 	textentry *hintsearch;	/* textentry found for last search */
+	textentry *search_scan;	/* next entry a search still has to look at */
+	textentry *search_last;	/* newest entry the search has looked at */
+	guint search_tag;			/* idle going through the rest of the buffer */
+
+	xtext_lastlog *lastlog_in;		/* lastlog being copied into this buffer */
+	xtext_lastlog *lastlog_from;	/* lastlog reading this buffer */
 } xtext_buffer;
 
+/* what a buffer's scrollback costs, see gtk_xtext_buffer_get_memory () */
+typedef struct {
+	guint entries;
+	gsize text_bytes;		/* the lines themselves */
+	gsize arena_bytes;	/* chunks holding the entries and their text */
+	gsize line_bytes;		/* wrap points and emphasis runs */
+	gsize search_bytes;	/* stripped text kept for searching */
+	gsize index_bytes;	/* the line index */
+} xtext_buffer_memory;
+
+/* what the append render scheduler has been doing */
+typedef struct
+{
+	guint64 frames;		/* renders run on a frame clock tick */
+	guint64 coalesced;	/* appended lines folded into a pending render */
+	guint64 dropped;		/* frames lost to draws longer than a refresh */
+	gint64 draw_usec;		/* total time spent drawing */
+} xtext_render_stats;
+
 struct _GtkXText
 {
 	GtkWidget parent_instance;
@@ -169,6 +213,9 @@ struct _GtkXText
 	gint io_tag;					  /* for delayed refresh events */
 	gint add_io_tag;				  /* "" when adding new text */
 	gint scroll_tag;				  /* marking-scroll timeout */
+	gint top_tag;					  /* pending top_function call */
+	guint render_tick;			  /* frame clock tick for appended text */
+	xtext_render_stats render_stats;
 	gulong vc_signal_tag;        /* signal handler for "value_changed" adj */
 
 	int select_start_adj;		  /* the adj->value when the selection started */
@@ -211,6 +258,7 @@ struct _GtkXText
 	unsigned char scratch_buffer[4096];
 
 	int (*urlcheck_function) (GtkWidget * xtext, char *word);
+	void (*top_function) (GtkXText * xtext, xtext_buffer *buf);
 
 	int jump_out_offset;	/* point at which to stop rendering */
 	int jump_in_offset;	/* "" start rendering */
@@ -290,6 +338,10 @@ void gtk_xtext_check_marker_visibility(GtkXText *xtext);
 void gtk_xtext_set_marker_last (session *sess);
 
 gboolean gtk_xtext_is_empty (xtext_buffer *buf);
+void gtk_xtext_batch_begin (xtext_buffer *buf, gboolean at_top);
+int gtk_xtext_batch_end (xtext_buffer *buf);
+void gtk_xtext_render_flush (GtkXText *xtext);
+const xtext_render_stats *gtk_xtext_get_render_stats (GtkXText *xtext);
 typedef void (*GtkXTextForeach) (GtkXText *xtext, unsigned char *text, void *data);
 void gtk_xtext_foreach (xtext_buffer *buf, GtkXTextForeach func, void *data);
 
@@ -302,11 +354,13 @@ void gtk_xtext_set_show_separator (GtkXText *xtext, gboolean show_separator);
 void gtk_xtext_set_thin_separator (GtkXText *xtext, gboolean thin_separator);
 void gtk_xtext_set_time_stamp (xtext_buffer *buf, gboolean timestamp);
 void gtk_xtext_set_urlcheck_function (GtkXText *xtext, int (*urlcheck_function) (GtkWidget *, char *));
+void gtk_xtext_set_top_function (GtkXText *xtext, void (*top_function) (GtkXText *, xtext_buffer *));
 void gtk_xtext_set_wordwrap (GtkXText *xtext, gboolean word_wrap);
 
 xtext_buffer *gtk_xtext_buffer_new (GtkXText *xtext);
 void gtk_xtext_buffer_free (xtext_buffer *buf);
 void gtk_xtext_buffer_show (GtkXText *xtext, xtext_buffer *buf, int render);
+void gtk_xtext_buffer_get_memory (xtext_buffer *buf, xtext_buffer_memory *mem);
 void gtk_xtext_copy_selection (GtkXText *xtext);
 
 #endif
@@ -708,6 +708,25 @@ void
 fe_text_clear (struct session *sess, int lines)
 {
 }
+char *
+fe_text_memory (struct session *sess)
+{
+	return NULL;
+}
+char *
+fe_text_render_stats (struct session *sess)
+{
+	return NULL;
+}
+void
+fe_print_text_batch_start (struct session *sess, gboolean older)
+{
+}
+int
+fe_print_text_batch_end (struct session *sess)
+{
+	return -1;
+}
 void
 fe_progressbar_start (struct session *sess)
 {
@@ -720,6 +739,10 @@ void
 fe_userlist_insert (struct session *sess, struct User *newuser, gboolean sel)
 {
 }
+void
+fe_userlist_insert_batch (struct session *sess, struct User **users, int count)
+{
+}
 int
 fe_userlist_remove (struct session *sess, struct User *user)
 {